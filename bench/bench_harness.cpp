@@ -0,0 +1,266 @@
+// Times every script in the benchmark corpus, and parsing of a large generated script, in
+// this process: a few warmup runs, then repeated timed runs on a fresh interpreter each.
+// Prints a table to stderr and the results as JSON to stdout (or --output). Given a
+// baseline, a file of earlier results, it fails if any median is more than the threshold
+// slower than the baseline's. Where the kernel allows it, hardware counters (cycles,
+// instructions, cache and branch misses) are read around the timed runs and their per-run
+// averages added to the JSON.
+//
+// Usage: simpscript_bench [--corpus DIR] [--warmup N] [--runs N] [--output FILE]
+//                         [--baseline FILE] [--threshold F]
+
+#include "Interpreter.h"
+#include "Json.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "PerfCounters.h"
+#include "Stream.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace SimpScript;
+
+struct Result {
+    std::string name;
+    double medianMs;
+    double p95Ms;
+    double throughput; // Runs per second at the median
+    PerfSample counters; // Totals over the timed runs
+    size_t runs;
+};
+
+// Hardware counters for the timed runs, or nullptr when they are unavailable
+static PerfCounters* counters = nullptr;
+
+// Repeat a block of functions, loops and expressions until the source is about bytes long
+static std::string generateSource(size_t bytes) {
+    std::string source;
+    for (size_t i = 0; source.size() < bytes; i++) {
+        std::string n = std::to_string(i);
+        source += "# Generated block " + n + "\n"
+                  "function work" + n + "(a, b)\n"
+                  "    total = 0\n"
+                  "    for i in range(a)\n"
+                  "        if i % 3 == 0 and b > 1\n"
+                  "            total = total + i * b - (a / 2)\n"
+                  "        else\n"
+                  "            total = total + size(\"text {i}\")\n"
+                  "        endif\n"
+                  "    endfor\n"
+                  "    return total\n"
+                  "endfunction\n"
+                  "values" + n + " = [1, 2.5, \"three\", work" + n + "(4, 5)]\n"
+                  "while values" + n + "[0] < 3\n"
+                  "    values" + n + "[0] = values" + n + "[0] + 1\n"
+                  "endwhile\n";
+    }
+    return source;
+}
+
+static std::unique_ptr<ASTNode> parseSource(const std::string& source, const std::string& name) {
+    std::ostringstream errors;
+    Lexer lexer(source);
+    Parser parser(lexer, errors);
+    auto program = parser.parse();
+    if (!errors.str().empty()) {
+        throw std::runtime_error(name + ": " + errors.str());
+    }
+    return program;
+}
+
+// Run body warmup times untimed and runs times timed
+template <typename Body>
+static Result measure(const std::string& name, size_t warmup, size_t runs, Body body) {
+    for (size_t i = 0; i < warmup; i++) {
+        body();
+    }
+    std::vector<double> samples;
+    PerfSample total;
+    for (size_t i = 0; i < runs; i++) {
+        if (counters != nullptr) {
+            counters->start();
+        }
+        auto begin = std::chrono::steady_clock::now();
+        body();
+        samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+        if (counters != nullptr) {
+            total += counters->stop();
+        }
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t middle = samples.size() / 2;
+    double median = samples.size() % 2 == 1 ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2;
+    size_t p95 = static_cast<size_t>(std::ceil(0.95 * static_cast<double>(samples.size()))) - 1;
+    return Result{name, median, samples[p95], 1000.0 / median, total, runs};
+}
+
+// Run a script on a fresh interpreter each time, checking that it always prints the same
+static Result benchScript(const std::filesystem::path& path, size_t warmup, size_t runs) {
+    std::ifstream file(path);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    auto program = parseSource(buffer.str(), path.string());
+    std::string expected;
+    bool first = true;
+
+    return measure(path.stem().string(), warmup, runs, [&] {
+        std::ostringstream output;
+        {
+            Interpreter interpreter(InputStream::fromString("", "stdin"), output, output);
+            interpreter.execute(program);
+        }
+        if (first) {
+            expected = output.str();
+            first = false;
+        } else if (output.str() != expected) {
+            throw std::runtime_error(path.string() + " printed different output on another run");
+        }
+    });
+}
+
+static void writeJson(std::ostream& out, const std::vector<Result>& results, size_t warmup, size_t runs) {
+    out << std::fixed << std::setprecision(4);
+    out << "{\n  \"warmup\": " << warmup << ",\n  \"runs\": " << runs << ",\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& result = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << result.name << "\", \"median_ms\": " << result.medianMs
+            << ", \"p95_ms\": " << result.p95Ms << ", \"throughput\": " << result.throughput;
+        // Counter averages per run, for the counters that could be read
+        for (size_t event = 0; event < perfEventCount; event++) {
+            if (result.counters.present[event]) {
+                out << ", \"" << perfEventNames[event] << "\": " << result.counters.values[event] / result.runs;
+            }
+        }
+        if (result.counters.ipc() > 0) {
+            out << ", \"ipc\": " << result.counters.ipc();
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+// Compare medians with a baseline file; returns the number of regressions
+static size_t compare(const std::vector<Result>& results, const std::string& baselinePath, double threshold) {
+    std::ifstream file(baselinePath);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file '" + baselinePath + "'");
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    Value baseline = JsonParser(Value(buffer.str()), false).parse();
+    const Value* benchmarks = baseline.isMap() ? baseline.asMap().find("benchmarks") : nullptr;
+    if (benchmarks == nullptr || !benchmarks->isArray()) {
+        throw std::runtime_error(baselinePath + " has no benchmarks array");
+    }
+
+    size_t regressions = 0;
+    for (const Result& result : results) {
+        const Value* before = nullptr;
+        for (const Value& entry : benchmarks->asArray()) {
+            const Value* name = entry.isMap() ? entry.asMap().find("name") : nullptr;
+            if (name != nullptr && name->isString() && name->asString() == result.name) {
+                before = entry.asMap().find("median_ms");
+            }
+        }
+        if (before == nullptr || !before->isNumber()) {
+            std::cerr << result.name << ": not in the baseline" << std::endl;
+            continue;
+        }
+        double change = result.medianMs / before->asFloat() - 1;
+        std::cerr << result.name << ": " << std::showpos << std::setprecision(1) << change * 100 << std::noshowpos << "%";
+        if (change > threshold) {
+            std::cerr << "  slower than the baseline by more than " << threshold * 100 << "%";
+            regressions++;
+        }
+        std::cerr << std::endl;
+    }
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    std::string corpus = "bench/corpus";
+    size_t warmup = 2;
+    size_t runs = 15;
+    std::string outputPath;
+    std::string baselinePath;
+    double threshold = 0.15;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--corpus" && i + 1 < argc) {
+            corpus = argv[++i];
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            warmup = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--runs" && i + 1 < argc) {
+            runs = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            threshold = std::strtod(argv[++i], nullptr);
+        } else {
+            runs = 0;
+            break;
+        }
+    }
+    if (runs == 0) {
+        std::cerr << "Usage: simpscript_bench [--corpus DIR] [--warmup N] [--runs N] [--output FILE]" << std::endl;
+        std::cerr << "                        [--baseline FILE] [--threshold F]" << std::endl;
+        return 1;
+    }
+
+    try {
+        PerfCounters perf;
+        if (perf.available()) {
+            counters = &perf;
+        } else {
+            std::cerr << "Hardware counters are unavailable: " << perf.unavailableReason() << std::endl;
+        }
+        
+        std::vector<std::filesystem::path> scripts;
+        for (const auto& entry : std::filesystem::directory_iterator(corpus)) {
+            if (entry.path().extension() == ".simp") {
+                scripts.push_back(entry.path());
+            }
+        }
+        std::sort(scripts.begin(), scripts.end());
+
+        std::vector<Result> results;
+        for (const auto& script : scripts) {
+            results.push_back(benchScript(script, warmup, runs));
+        }
+        std::string generated = generateSource(1 << 20);
+        results.push_back(measure("parse_large", warmup, runs, [&] { parseSource(generated, "generated source"); }));
+
+        std::cerr << std::fixed << std::setprecision(3) << "benchmark          median ms  p95 ms     runs/s" << std::endl;
+        for (const Result& result : results) {
+            std::cerr << std::left << std::setw(19) << result.name << std::right << std::setw(9) << result.medianMs
+                      << std::setw(9) << result.p95Ms << std::setw(11) << std::setprecision(1) << result.throughput
+                      << std::setprecision(3) << std::endl;
+        }
+
+        if (outputPath.empty()) {
+            writeJson(std::cout, results, warmup, runs);
+        } else {
+            std::ofstream output(outputPath);
+            writeJson(output, results, warmup, runs);
+        }
+        if (!baselinePath.empty() && compare(results, baselinePath, threshold) > 0) {
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
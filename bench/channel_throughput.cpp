@@ -0,0 +1,157 @@
+// Measures how many values a second pass through a shared channel with 1, 2, 4 and 8
+// producer threads, each paired with a consumer thread, next to a channel built on a
+// mutex-guarded deque. Every run checks that each value sent was received exactly once.
+//
+// Usage: simpscript_channel_bench [--messages N] [--capacity N] [--arrays]
+
+#include "Channel.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace SimpScript;
+
+// The straightforward channel: one lock around a deque, taken by every send and receive
+class LockedChannel {
+private:
+    size_t capacity;
+    std::deque<Value> items;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+
+public:
+    explicit LockedChannel(size_t capacity) : capacity(capacity) {}
+
+    void send(Value value) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(std::move(value));
+        notEmpty.notify_one();
+    }
+
+    bool receive(Value& out) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        out = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+    }
+};
+
+static Value message(int number, bool arrays) {
+    if (!arrays) {
+        return Value(number);
+    }
+    return Value(std::vector<Value>{Value(number), Value("payload"), Value(number * 2)});
+}
+
+static int number(const Value& value) {
+    return value.isArray() ? value.asArray()[0].asInteger() : value.asInteger();
+}
+
+// Send messages values from each of threads producers to as many consumers; returns the
+// elapsed seconds, or a negative number if the values received do not add up
+template <typename ChannelType>
+static double run(ChannelType& channel, size_t threads, size_t messages, bool arrays) {
+    std::atomic<long long> received{0};
+    std::atomic<size_t> count{0};
+    std::vector<std::thread> producers;
+    std::vector<std::thread> consumers;
+
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; t++) {
+        consumers.emplace_back([&] {
+            long long sum = 0;
+            size_t seen = 0;
+            Value value;
+            while (channel.receive(value)) {
+                sum += number(value);
+                seen++;
+            }
+            received += sum;
+            count += seen;
+        });
+    }
+    for (size_t t = 0; t < threads; t++) {
+        producers.emplace_back([&, t] {
+            for (size_t i = 0; i < messages; i++) {
+                channel.send(message(static_cast<int>(t * messages + i), arrays));
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    channel.close();
+    for (auto& consumer : consumers) {
+        consumer.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    long long total = static_cast<long long>(threads * messages);
+    if (count != threads * messages || received != total * (total - 1) / 2) {
+        return -1;
+    }
+    return seconds;
+}
+
+int main(int argc, char* argv[]) {
+    size_t messages = 200000;
+    size_t capacity = 1024;
+    bool arrays = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--messages" && i + 1 < argc) {
+            messages = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--capacity" && i + 1 < argc) {
+            capacity = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--arrays") {
+            arrays = true;
+        } else {
+            messages = 0;
+            break;
+        }
+    }
+    if (messages == 0 || capacity == 0) {
+        std::cerr << "Usage: simpscript_channel_bench [--messages N] [--capacity N] [--arrays]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "producers  shared msgs/s  locked msgs/s  speedup" << std::endl;
+    bool failed = false;
+    for (size_t threads : {1, 2, 4, 8}) {
+        SharedChannel shared(capacity);
+        LockedChannel locked(capacity);
+        double sharedSeconds = run(shared, threads, messages, arrays);
+        double lockedSeconds = run(locked, threads, messages, arrays);
+        if (sharedSeconds < 0 || lockedSeconds < 0) {
+            std::cout << threads << "\t   values were lost or duplicated" << std::endl;
+            failed = true;
+            continue;
+        }
+        double total = static_cast<double>(threads * messages);
+        std::cout << threads << "\t   " << static_cast<size_t>(total / sharedSeconds) << "\t  "
+                  << static_cast<size_t>(total / lockedSeconds) << "\t " << lockedSeconds / sharedSeconds << std::endl;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+// Runs one interpreter per thread on 1, 2, 4, ... threads and checks that every run
+// prints the same output as a run on its own, and that throughput grows with the thread
+// count for as long as there are cores to run on.
+//
+// Usage: simpscript_stress [--threads N] [--runs N] [--min-efficiency F] [script.simp]
+
+#include "Lexer.h"
+#include "Parser.h"
+#include "Interpreter.h"
+#include "Stream.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace SimpScript;
+
+// Default workload: function calls, loops, string formatting, regex and JSON
+static const char* defaultScript = R"(
+function score(word, n)
+    total = 0
+    for i = 0; i < n; i = i + 1
+        total = total + size(word) * i % 7
+    endfor
+    return total
+endfunction
+
+words = find_all(re"[a-z]+", "the quick brown fox jumps over the lazy dog")
+weights = json_parse("[3, 1, 4, 1, 5, 9, 2, 6, 5]")
+sum = 0
+k = 0
+for w in words
+    sum = sum + score(w, 300) * weights[k]
+    k = k + 1
+endfor
+shownl "words: {size(words)} sum: {sum}"
+)";
+
+// Lex, parse and run the script on an interpreter of its own, returning what it printed
+static std::string runScript(const std::string& source) {
+    std::ostringstream output;
+    std::ostringstream errors;
+    Lexer lexer(source);
+    Parser parser(lexer, errors);
+    auto program = parser.parse();
+    Interpreter interpreter(InputStream::fromString("", "stdin"), output, errors);
+    interpreter.execute(program);
+    return output.str() + errors.str();
+}
+
+// Run the script runs times on each of threads threads; returns the elapsed seconds
+static double runThreads(const std::string& source, const std::string& expected,
+                         size_t threads, size_t runs, std::atomic<size_t>& mismatches) {
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> start{false};
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            ready++;
+            while (!start.load()) {
+                std::this_thread::yield();
+            }
+            for (size_t i = 0; i < runs; i++) {
+                if (runScript(source) != expected) {
+                    mismatches++;
+                }
+            }
+        });
+    }
+
+    while (ready.load() < threads) {
+        std::this_thread::yield();
+    }
+    auto begin = std::chrono::steady_clock::now();
+    start = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char* argv[]) {
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t maxThreads = cores;
+    size_t runs = 200;
+    double minEfficiency = 0.7;
+    std::string source = defaultScript;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            maxThreads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--runs" && i + 1 < argc) {
+            runs = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--min-efficiency" && i + 1 < argc) {
+            minEfficiency = std::strtod(argv[++i], nullptr);
+        } else {
+            std::ifstream file(arg);
+            if (!file.is_open()) {
+                std::cerr << "Error: Could not open file '" << arg << "'" << std::endl;
+                return 1;
+            }
+            std::stringstream buffer;
+            buffer << file.rdbuf();
+            source = buffer.str();
+        }
+    }
+    if (maxThreads == 0 || runs == 0) {
+        std::cerr << "Usage: simpscript_stress [--threads N] [--runs N] [--min-efficiency F] [script.simp]" << std::endl;
+        return 1;
+    }
+
+    std::string expected = runScript(source);
+    std::cout << "threads  runs/s      efficiency" << std::endl;
+
+    bool failed = false;
+    double baseline = 0;
+    for (size_t threads = 1; threads <= maxThreads; threads = threads < maxThreads ? std::min(threads * 2, maxThreads) : threads + 1) {
+        std::atomic<size_t> mismatches{0};
+        double seconds = runThreads(source, expected, threads, runs, mismatches);
+        double throughput = static_cast<double>(threads * runs) / seconds;
+        if (threads == 1) {
+            baseline = throughput;
+        }
+        double efficiency = throughput / (baseline * static_cast<double>(threads));
+
+        std::cout << threads << "\t " << static_cast<size_t>(throughput) << "\t     " << efficiency;
+        if (mismatches > 0) {
+            std::cout << "  " << mismatches << " runs printed different output";
+            failed = true;
+        } else if (threads <= cores && efficiency < minEfficiency) {
+            std::cout << "  below " << minEfficiency;
+            failed = true;
+        }
+        std::cout << std::endl;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+/* Embedding SimpScript from C: compile a script once, then run it many times with
+   different inputs, calling back into a native function and reading the result. */
+
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+
+#include "simpscript.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* clamp(value, low, high) */
+static simpscript_value* clamp(simpscript_interpreter* interpreter, const simpscript_value* const* args,
+                               size_t count, void* userdata) {
+    (void)count;
+    (void)userdata;
+    if (simpscript_value_type(args[0]) != SIMPSCRIPT_INT && simpscript_value_type(args[0]) != SIMPSCRIPT_NUMBER) {
+        simpscript_raise(interpreter, "clamp() expects a number");
+        return NULL;
+    }
+    double value = simpscript_value_number(args[0]);
+    double low = simpscript_value_number(args[1]);
+    double high = simpscript_value_number(args[2]);
+    return simpscript_number(value < low ? low : value > high ? high : value);
+}
+
+static const char* script =
+    "score = clamp(base * factor, 0, 100)\n"
+    "if score == 100\n"
+    "    shownl \"capped at {score}\"\n"
+    "endif\n"
+    "score\n";
+
+int main(void) {
+    simpscript_interpreter* interpreter = simpscript_interpreter_new_captured(NULL, 0);
+    simpscript_register(interpreter, "clamp", 3, clamp, NULL);
+
+    simpscript_program* program = simpscript_compile(interpreter, script, strlen(script));
+    if (program == NULL) {
+        fprintf(stderr, "compile error: %s\n", simpscript_last_error(interpreter));
+        return 1;
+    }
+
+    const int runs = 100000;
+    double total = 0;
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < runs; i++) {
+        simpscript_set_int(interpreter, "base", i % 50);
+        simpscript_set_number(interpreter, "factor", 2.5);
+        simpscript_value* result = simpscript_execute(interpreter, program);
+        if (result == NULL) {
+            fprintf(stderr, "runtime error: %s\n", simpscript_last_error(interpreter));
+            return 1;
+        }
+        total += simpscript_value_number(result);
+        simpscript_value_free(result);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1e9;
+
+    size_t length;
+    const char* output = simpscript_output(interpreter, &length);
+    size_t lines = 0;
+    for (size_t i = 0; i < length; i++) {
+        lines += output[i] == '\n';
+    }
+    printf("%d runs, total score %.1f, %zu capped\n", runs, total, lines);
+    printf("%.2f us per run\n", seconds * 1e6 / runs);
+
+    /* Errors in scripts and native functions come back as messages */
+    simpscript_set_string(interpreter, "base", "high", 4);
+    simpscript_value* failed = simpscript_execute(interpreter, program);
+    printf("%s\n", failed == NULL ? simpscript_last_error(interpreter) : "no error");
+    simpscript_value_free(failed);
+
+    simpscript_program_free(program);
+    simpscript_interpreter_free(interpreter);
+    return 0;
+}
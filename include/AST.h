@@ -1,30 +1,66 @@
 #ifndef AST_H
 #define AST_H
 
+#include "JitSite.h"
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
 #include <string>
 #include <vector>
 #include <memory>
 #include <variant>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace SimpScript {
 
 // Forward declarations
 class Interpreter;
 class Value;
+class Regex;
+class CppEmitter; // Friend of the node classes, whose trees it lowers to C++
+class JitCompiler; // Friend of the node classes it compiles to machine code
+
+// Names a piece of code reads, assigns and calls, and whether it does anything else
+// observable. Used to decide whether a function can run on several threads at once
+struct Effects {
+    std::unordered_set<std::string> read;
+    std::unordered_set<std::string> assigned;
+    std::unordered_set<std::string> called;
+    bool io = false;     // Reads input or prints
+    bool opaque = false; // Defines functions, so its effects cannot be known up front
+};
 
 // Base class for all AST nodes
 class ASTNode {
+private:
+    int line = 0; // Where the node starts in the source; 0 if the parser did not record it
+    int column = 0;
+
+protected:
+    // Copy of the node and its children, without the source location
+    virtual std::unique_ptr<ASTNode> cloneNode() const = 0;
+
 public:
     virtual ~ASTNode() = default;
     virtual Value evaluate(Interpreter& interpreter) = 0;
-    virtual std::unique_ptr<ASTNode> clone() const = 0;
+    virtual void collectEffects(Effects&) const {}
+
+    // Copy of the node and its children, keeping their source locations
+    std::unique_ptr<ASTNode> clone() const;
+
+    void setLocation(int line, int column);
+    int getLine() const { return line; }
+    int getColumn() const { return column; }
 };
 
 // Expression nodes
 
 // Literal (constant) values
 class LiteralNode : public ASTNode {
+    friend class CppEmitter;
+    friend class JitCompiler;
+
 private:
     std::variant<int, double, std::string, bool> value;
 
@@ -35,11 +71,44 @@ public:
     explicit LiteralNode(bool value);
 
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+};
+
+// Interpolated string literal "Total: {x} items" - literals.size() == expressions.size() + 1
+class InterpolatedStringNode : public ASTNode {
+    friend class CppEmitter;
+
+private:
+    std::vector<std::string> literals;
+    std::vector<std::unique_ptr<ASTNode>> expressions;
+    size_t literalLength; // Total length of the literal parts
+
+public:
+    InterpolatedStringNode(std::vector<std::string> literals,
+                           std::vector<std::unique_ptr<ASTNode>> expressions);
+    Value evaluate(Interpreter& interpreter) override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
+};
+
+// Regex literal re"..." - compiled once, when the script is parsed
+class RegexLiteralNode : public ASTNode {
+    friend class CppEmitter;
+
+private:
+    std::shared_ptr<Regex> regex;
+
+public:
+    explicit RegexLiteralNode(std::shared_ptr<Regex> regex);
+    Value evaluate(Interpreter& interpreter) override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
 };
 
 // Variable reference
 class VariableNode : public ASTNode {
+    friend class CppEmitter;
+    friend class JitCompiler;
+
 private:
     std::string name;
 
@@ -47,11 +116,15 @@ public:
     explicit VariableNode(const std::string& name);
     Value evaluate(Interpreter& interpreter) override;
     std::string getName() const;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Binary operations (arithmetic, logical, comparison)
 class BinaryOpNode : public ASTNode {
+    friend class CppEmitter;
+    friend class JitCompiler;
+
 public:
     enum class OpType {
         // Arithmetic
@@ -70,11 +143,15 @@ private:
 public:
     BinaryOpNode(OpType opType, std::unique_ptr<ASTNode> left, std::unique_ptr<ASTNode> right);
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Unary operations (not, negative)
 class UnaryOpNode : public ASTNode {
+    friend class CppEmitter;
+    friend class JitCompiler;
+
 public:
     enum class OpType {
         NOT, NEGATIVE
@@ -87,22 +164,28 @@ private:
 public:
     UnaryOpNode(OpType opType, std::unique_ptr<ASTNode> operand);
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Array literal [1, 2, 3]
 class ArrayLiteralNode : public ASTNode {
+    friend class CppEmitter;
+
 private:
     std::vector<std::unique_ptr<ASTNode>> elements;
 
 public:
     explicit ArrayLiteralNode(std::vector<std::unique_ptr<ASTNode>> elements);
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Array access a[index]
 class ArrayAccessNode : public ASTNode {
+    friend class CppEmitter;
+
 private:
     std::unique_ptr<ASTNode> array;
     std::unique_ptr<ASTNode> index;
@@ -110,38 +193,73 @@ private:
 public:
     ArrayAccessNode(std::unique_ptr<ASTNode> array, std::unique_ptr<ASTNode> index);
     Value evaluate(Interpreter& interpreter) override;
+    static Value access(const Value& array, const Value& index);
     std::unique_ptr<ASTNode> getArray();
     std::unique_ptr<ASTNode> getIndex();
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
+};
+
+// Slice a[begin:end], sharing the storage of the sliced array or string
+class SliceNode : public ASTNode {
+    friend class CppEmitter;
+
+private:
+    std::unique_ptr<ASTNode> array;
+    std::unique_ptr<ASTNode> begin; // Optional, defaults to the start
+    std::unique_ptr<ASTNode> end;   // Optional, defaults to the end
+
+public:
+    SliceNode(std::unique_ptr<ASTNode> array, std::unique_ptr<ASTNode> begin, std::unique_ptr<ASTNode> end);
+    Value evaluate(Interpreter& interpreter) override;
+    static Value slice(const Value& array, const Value* begin, const Value* end); // Bounds may be nullptr
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Function call node
 class FunctionCallNode : public ASTNode {
+    friend class CppEmitter;
+    friend class JitCompiler;
+
 private:
     std::string name;
     std::vector<std::unique_ptr<ASTNode>> arguments;
+    uint32_t profileId = 0; // The name's id in the profiler, once this call has been profiled
+    const char* traceLabel; // The name for trace events, while tracing
+
+    Value callInstrumented(Interpreter& interpreter, Value& function, std::vector<Value>& args);
+    Value callProfiled(Interpreter& interpreter, Value& function, std::vector<Value>& args);
 
 public:
     FunctionCallNode(const std::string& name, std::vector<std::unique_ptr<ASTNode>> arguments);
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Statement nodes
 
 // Block of statements
 class BlockNode : public ASTNode {
+    friend class CppEmitter;
+    friend class JitCompiler;
+
 private:
     std::vector<std::unique_ptr<ASTNode>> statements;
 
 public:
     explicit BlockNode(std::vector<std::unique_ptr<ASTNode>> statements);
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Variable assignment
 class AssignmentNode : public ASTNode {
+    friend class CppEmitter;
+    friend class JitCompiler;
+
 private:
     std::string name;
     std::unique_ptr<ASTNode> expression;
@@ -149,11 +267,14 @@ private:
 public:
     AssignmentNode(const std::string& name, std::unique_ptr<ASTNode> expression);
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Array element assignment (a[index] = value)
 class ArrayAssignmentNode : public ASTNode {
+    friend class CppEmitter;
+
 private:
     std::unique_ptr<ASTNode> array;
     std::unique_ptr<ASTNode> index;
@@ -162,11 +283,17 @@ private:
 public:
     ArrayAssignmentNode(std::unique_ptr<ASTNode> array, std::unique_ptr<ASTNode> index, std::unique_ptr<ASTNode> value);
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    // Set an element of the array or map held by a variable
+    static void assign(Value& target, const Value& index, const Value& value);
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // If statement
 class IfNode : public ASTNode {
+    friend class CppEmitter;
+    friend class JitCompiler;
+
 private:
     std::unique_ptr<ASTNode> condition;
     std::unique_ptr<ASTNode> thenBranch;
@@ -177,93 +304,174 @@ public:
            std::unique_ptr<ASTNode> thenBranch,
            std::unique_ptr<ASTNode> elseBranch = nullptr);
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // While loop
 class WhileNode : public ASTNode {
+    friend class CppEmitter;
+    friend class JitCompiler;
+
 private:
     std::unique_ptr<ASTNode> condition;
     std::unique_ptr<ASTNode> body;
+    std::shared_ptr<JitSite> jitSite; // Shared with clones, so every copy of a loop is compiled once
 
 public:
-    WhileNode(std::unique_ptr<ASTNode> condition, std::unique_ptr<ASTNode> body);
+    WhileNode(std::unique_ptr<ASTNode> condition, std::unique_ptr<ASTNode> body,
+              std::shared_ptr<JitSite> jitSite = std::make_shared<JitSite>());
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // For loop
 class ForNode : public ASTNode {
+    friend class CppEmitter;
+    friend class JitCompiler;
+
 private:
     std::unique_ptr<ASTNode> initialization;
     std::unique_ptr<ASTNode> condition;
     std::unique_ptr<ASTNode> increment;
     std::unique_ptr<ASTNode> body;
+    std::shared_ptr<JitSite> jitSite; // Shared with clones, so every copy of a loop is compiled once
 
 public:
     ForNode(std::unique_ptr<ASTNode> initialization,
             std::unique_ptr<ASTNode> condition,
             std::unique_ptr<ASTNode> increment,
-            std::unique_ptr<ASTNode> body);
+            std::unique_ptr<ASTNode> body,
+            std::shared_ptr<JitSite> jitSite = std::make_shared<JitSite>());
+    Value evaluate(Interpreter& interpreter) override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
+};
+
+// For-each loop over an array, string or range (for x in sequence)
+class ForEachNode : public ASTNode {
+    friend class CppEmitter;
+
+private:
+    std::string variable;
+    std::unique_ptr<ASTNode> sequence;
+    std::unique_ptr<ASTNode> body;
+
+public:
+    ForEachNode(const std::string& variable,
+                std::unique_ptr<ASTNode> sequence,
+                std::unique_ptr<ASTNode> body);
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Function definition
 class FunctionDefNode : public ASTNode {
+    friend class CppEmitter;
+
 private:
     std::string name;
     std::vector<std::string> parameters;
     std::unique_ptr<ASTNode> body;
+    std::shared_ptr<JitSite> jitSite; // Given to every function made here, and shared with clones
 
 public:
     FunctionDefNode(const std::string& name,
                     const std::vector<std::string>& parameters,
-                    std::unique_ptr<ASTNode> body);
+                    std::unique_ptr<ASTNode> body,
+                    std::shared_ptr<JitSite> jitSite = std::make_shared<JitSite>());
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Return statement
 class ReturnNode : public ASTNode {
+    friend class CppEmitter;
+    friend class JitCompiler;
+
 private:
     std::unique_ptr<ASTNode> expression;
 
 public:
     explicit ReturnNode(std::unique_ptr<ASTNode> expression);
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Print statement (show)
 class PrintNode : public ASTNode {
+    friend class CppEmitter;
+
 private:
     std::unique_ptr<ASTNode> expression;
     bool newline;
 
 public:
     PrintNode(std::unique_ptr<ASTNode> expression, bool newline);
+    static void write(std::ostream& output, const Value& value, bool newline);
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
+};
+
+// spawn f(args): starts the call as a task and evaluates to the task
+class SpawnNode : public ASTNode {
+    friend class CppEmitter;
+
+private:
+    std::string name;
+    std::vector<std::unique_ptr<ASTNode>> arguments;
+
+public:
+    SpawnNode(const std::string& name, std::vector<std::unique_ptr<ASTNode>> arguments);
+    Value evaluate(Interpreter& interpreter) override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Input statement (ask)
 class InputNode : public ASTNode {
+    friend class CppEmitter;
+
 public:
     InputNode() = default;
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
+};
+
+// A statement counted for --coverage. The parser only wraps statements in these while
+// coverage is on, so runs without it pay nothing
+class CoverageNode : public ASTNode {
+    friend class CppEmitter;
+
+private:
+    std::unique_ptr<ASTNode> statement;
+    std::atomic<uint64_t>* executions; // Shared with clones, so every copy of a function body counts together
+
+public:
+    CoverageNode(std::unique_ptr<ASTNode> statement, std::atomic<uint64_t>* executions);
+    Value evaluate(Interpreter& interpreter) override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 // Program node (root of AST)
 class ProgramNode : public ASTNode {
+    friend class CppEmitter;
+
 private:
     std::vector<std::unique_ptr<ASTNode>> statements;
 
 public:
     explicit ProgramNode(std::vector<std::unique_ptr<ASTNode>> statements);
     Value evaluate(Interpreter& interpreter) override;
-    std::unique_ptr<ASTNode> clone() const override;
+    std::unique_ptr<ASTNode> cloneNode() const override;
+    void collectEffects(Effects& effects) const override;
 };
 
 } // namespace SimpScript
@@ -0,0 +1,167 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include "Value.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace SimpScript {
+
+// Queue of values that scripts send and receive with the channel builtins
+class Channel : public Handle {
+public:
+    // Wait while the channel is full; throws once it is closed
+    virtual void send(Value value) = 0;
+
+    // Wait for the next value and store it in out; returns false once the channel is closed and empty
+    virtual bool receive(Value& out) = 0;
+
+    // Send without waiting; returns false, leaving value as it was, if the channel is full
+    virtual bool trySend(Value& value) = 0;
+
+    // Receive without waiting; returns false if nothing is queued
+    virtual bool tryReceive(Value& out) = 0;
+};
+
+// Iterator over the values received from a channel until it is closed
+class ChannelIterator : public Iterator {
+private:
+    std::shared_ptr<Channel> channel;
+
+public:
+    explicit ChannelIterator(std::shared_ptr<Channel> channel);
+    bool next(Value& out) override;
+};
+
+// Bounded lock-free queue for any number of producer and consumer threads (Dmitry Vyukov's
+// design). Each cell carries a sequence number that says whose turn it is, so a push or pop
+// costs one compare-and-swap on a position counter and never blocks the other side
+template <typename T>
+class MpmcQueue {
+private:
+    static constexpr size_t cacheLine = 64;
+
+    struct alignas(cacheLine) Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(cacheLine) std::atomic<size_t> enqueuePosition{0};
+    alignas(cacheLine) std::atomic<size_t> dequeuePosition{0};
+
+    // A single cell cannot tell a full queue from an empty one a lap later, so there are at least two
+    static size_t roundUp(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+public:
+    // Holds at least capacity elements; the size is rounded up to a power of two of at least 2
+    explicit MpmcQueue(size_t capacity) : cells(new Cell[roundUp(capacity)]), mask(roundUp(capacity) - 1) {
+        for (size_t i = 0; i <= mask; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    // Moves from value on success; returns false if the queue is full
+    bool tryPush(T& value) {
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the queue is empty
+    bool tryPop(T& out) {
+        size_t position = dequeuePosition.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (difference == 0) {
+                if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    out = std::move(cell.value);
+                    cell.value = T();
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// Channel that threads share: parallel_map workers, or interpreters that a host runs on
+// threads of their own. Messages go through an MpmcQueue; the mutex is only taken by a side
+// that has to wait, and by the other side to wake it.
+//
+// A task that waits on the channel lets the other tasks of its thread run in the meantime,
+// checking the channel between turns, instead of blocking the thread.
+//
+// Values are copied as they are sent, down to the elements of arrays and maps, so the
+// receiver never shares mutable storage with the sender. Storage the sender holds the only
+// reference to, such as a freshly built array, is moved instead of copied. Functions,
+// iterators and handles other than shared channels and regexes cannot be sent.
+class SharedChannel : public Channel {
+private:
+    static constexpr int spinLimit = 64; // Attempts before a waiting side sleeps
+    static constexpr std::chrono::milliseconds retryInterval{1}; // Sleep of a task whose thread has nothing else to run
+
+    MpmcQueue<Value> queue;
+    std::atomic<bool> closed{false};
+    std::atomic<int> waitingSenders{0};
+    std::atomic<int> waitingReceivers{0};
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+
+    void wakeSenders();
+    void wakeReceivers();
+
+public:
+    explicit SharedChannel(size_t capacity);
+
+    void send(Value value) override;
+    bool receive(Value& out) override;
+    bool trySend(Value& value) override;
+    bool tryReceive(Value& out) override;
+
+    bool threadSafe() const override { return true; }
+    std::string describe() const override;
+    void close() override;
+};
+
+} // namespace SimpScript
+
+#endif // CHANNEL_H
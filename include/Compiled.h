@@ -0,0 +1,86 @@
+#ifndef COMPILED_H
+#define COMPILED_H
+
+#include "Value.h"
+#include "Interpreter.h"
+#include "AST.h"
+#include <functional>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace SimpScript {
+
+// Runtime for the C++ that `simpscript --emit-cpp` writes. The generated code keeps its
+// variables in C++ locals and globals, boxed as Values or, where every value a variable can
+// hold is known to be an integer, float or boolean, unboxed. Operations on Values and the
+// builtins are the interpreter's own, so compiled scripts behave the same.
+
+// Run a compiled program against a fresh interpreter, which supplies the builtins and the
+// standard streams. Errors are reported as the interpreter reports them; returns the exit status
+int runCompiled(const std::function<void(Interpreter&)>& program);
+
+// Call a function value, such as a builtin, with arguments evaluated in order
+Value callFunction(Interpreter& interpreter, Value function, std::vector<Value> arguments);
+
+// A compiled function as a function value, for passing to builtins such as parallel_map
+Value compiledFunction(int arity, std::function<Value(std::vector<Value>&)> function);
+
+// Format literals and values into one string, as an interpolated string does
+Value interpolate(std::initializer_list<Value> parts);
+
+// The next line of input, as ask reads it
+Value readInput(Interpreter& interpreter);
+
+// -value, for values not known to be numbers
+Value negate(const Value& value);
+
+// Reading a variable the script never assigns
+[[noreturn]] void undefinedVariable(const std::string& name);
+
+// Integer and float arithmetic with the interpreter's checks
+inline int divideIntegers(int left, int right) {
+    if (right == 0) {
+        throw std::runtime_error("Division by zero");
+    }
+    if (right == -1) {
+        return wrappingNegate(left);
+    }
+    return left / right;
+}
+
+inline double divideFloats(double left, double right) {
+    if (right == 0.0) {
+        throw std::runtime_error("Division by zero");
+    }
+    return left / right;
+}
+
+inline int moduloIntegers(int left, int right) {
+    if (right == 0) {
+        throw std::runtime_error("Modulo by zero");
+    }
+    if (right == -1) {
+        return 0;
+    }
+    return left % right;
+}
+
+// The elements a for-each loop visits, for sequences not known to be ranges
+class ForEachCursor {
+private:
+    Value items;
+    int position = 0;
+    int count = 0;
+
+public:
+    explicit ForEachCursor(Value items);
+
+    // Store the next element in current, or return false after the last
+    bool next(Value& current);
+};
+
+} // namespace SimpScript
+
+#endif // COMPILED_H
@@ -0,0 +1,53 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace SimpScript {
+
+// Statement coverage for --coverage. While it is on, the parser gives every statement its
+// own counter, so that running a statement costs one increment and no lookup; statements
+// that never run keep a count of 0, which is what finds dead code.
+class Coverage {
+public:
+    struct Counter {
+        int line;
+        std::atomic<uint64_t> executions{0}; // Relaxed; parallel_map workers count too
+
+        explicit Counter(int line) : line(line) {}
+    };
+
+private:
+    std::mutex mutex;
+    std::deque<Counter> counters; // A deque, so counters stay put as more are added
+    std::string script;
+
+public:
+    explicit Coverage(const std::string& script);
+
+    Coverage(const Coverage&) = delete;
+    Coverage& operator=(const Coverage&) = delete;
+
+    // A new counter for a statement starting at line
+    Counter* counter(int line);
+
+    // Execution counts by line in lcov's tracefile format. A line with several statements
+    // gets the count of the one run most
+    void writeLcov(std::ostream& out);
+
+    // "N of M lines executed" for the summary at exit
+    void summary(std::ostream& out);
+};
+
+// The coverage being recorded while --coverage is on, otherwise nullptr. Only the parser
+// reads it; the statements it wraps count through their own pointers
+extern Coverage* coverage;
+
+} // namespace SimpScript
+
+#endif // COVERAGE_H
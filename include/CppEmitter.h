@@ -0,0 +1,117 @@
+#ifndef CPP_EMITTER_H
+#define CPP_EMITTER_H
+
+#include "AST.h"
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SimpScript {
+
+class Environment;
+
+// A construct --emit-cpp cannot lower, with the line it is on
+class EmitError : public std::runtime_error {
+public:
+    explicit EmitError(const std::string& message);
+};
+
+// Lowers a parsed script to C++ for `simpscript --emit-cpp`, to be built against libsimpscript
+// (see Compiled.h). Functions become C++ functions and variables C++ variables; a variable is
+// unboxed when every value assigned to it is an integer, every one a float or every one a
+// boolean. Scripts may define functions only at the top level, and may not use regex literals
+// or spawn. Variables assigned at the top level are globals everywhere, including in functions
+// called before the assignment runs.
+class CppEmitter {
+private:
+    enum class Type { NONE, INT, FLOAT, BOOL, VALUE };
+
+    // A script variable in one scope: the program's globals, a function's locals, or the
+    // variable of a for-each loop
+    struct Variable {
+        std::string name;
+        std::string cppName;
+        Type type = Type::NONE;
+        Type seed = Type::NONE;               // What the variable holds before any assignment
+        bool loop = false;                    // The variable of a for-each loop
+        std::vector<const ASTNode*> assigned; // Expressions assigned to it
+    };
+
+    // What a name refers to at one place in the script
+    struct Binding {
+        enum class Kind { VARIABLE, FUNCTION, BUILTIN, UNDEFINED } kind;
+        Variable* variable = nullptr;
+        const FunctionDefNode* function = nullptr;
+    };
+
+    struct Scope {
+        const FunctionDefNode* function = nullptr; // nullptr for the program
+        std::vector<std::unique_ptr<Variable>> variables;
+        std::unordered_map<std::string, Variable*> names;
+    };
+
+    // C++ for an expression, and the type it evaluates to
+    struct Code {
+        std::string text;
+        Type type;
+    };
+
+    std::string script;
+    std::shared_ptr<Environment> builtinScope; // A fresh interpreter's globals, which hold the builtins
+    std::unordered_map<std::string, const FunctionDefNode*> functions;
+    std::vector<const FunctionDefNode*> functionOrder;
+    std::vector<std::unique_ptr<Scope>> scopes;
+    Scope* globals = nullptr;
+    std::unordered_map<const ASTNode*, Binding> bindings; // Of variable reads, assignments, calls and loops
+    std::vector<std::string> builtins;       // Used, in order of first use
+    std::vector<std::string> functionValues; // Functions used as values
+    std::vector<std::string> literals;       // C++ expressions for the string literals
+    const FunctionDefNode* currentFunction = nullptr; // Being lowered; nullptr for the program
+    size_t loopCount = 0;
+
+    // Analysis
+    static std::vector<const ASTNode*> children(const ASTNode* node);
+    static const ASTNode* unwrap(const ASTNode* node);
+    void collect(const ASTNode* node, Scope& scope, std::vector<Variable*>& loops);
+    void collectAssignments(const ASTNode* node, Scope& scope);
+    Binding resolve(const std::string& name, Scope& scope, const std::vector<Variable*>& loops);
+    Variable* addVariable(Scope& scope, const std::string& name, const std::string& cppName);
+    const Value* builtinValue(const std::string& name) const;
+    void inferTypes();
+    Type typeOf(const ASTNode* node) const;
+    static Type join(Type a, Type b);
+    static bool effectful(const ASTNode* node);
+    [[noreturn]] static void unsupported(const ASTNode* node, const std::string& what);
+
+    // Lowering
+    Code expression(const ASTNode* node);
+    Code binary(const BinaryOpNode* node);
+    Code call(const FunctionCallNode* node);
+    Code assignment(const Variable& variable, const Code& value);
+    std::string sequence(const std::vector<const ASTNode*>& operands, const std::vector<std::string>& texts,
+                         const std::function<std::string(const std::vector<std::string>&)>& build);
+    void statement(std::ostringstream& out, const ASTNode* node, const std::string& indent, const std::string& result);
+    void function(std::ostringstream& out, const FunctionDefNode* node);
+    std::string literal(const std::string& text);
+    std::string builtin(const std::string& name);
+    static std::string box(const Code& code);
+    static std::string truth(const Code& code);
+    static std::string convert(const Code& code, Type type);
+    static std::string cppType(Type type);
+    static std::string initialValue(Type type);
+
+public:
+    explicit CppEmitter(const std::string& script);
+
+    // Write a C++ translation unit with a main() that runs program
+    void emit(const ASTNode& program, std::ostream& out);
+};
+
+} // namespace SimpScript
+
+#endif // CPP_EMITTER_H
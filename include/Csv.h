@@ -0,0 +1,73 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include "Value.h"
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace SimpScript {
+
+class InputStream;
+
+// Reads CSV text into tables of columns. The text is scanned 64 bytes at a time:
+// quotes, delimiters and newlines are turned into bitmasks, a prefix XOR of the quote
+// mask marks the quoted regions, and the remaining delimiter and newline bits give the
+// field boundaries. Fields point into the source text; only fields with escaped quotes are copied.
+class CsvReader {
+private:
+    using Columns = std::vector<std::vector<std::string_view>>;
+
+    std::shared_ptr<const char> data;
+    size_t size = 0;
+    size_t position = 0;
+    char delimiter;
+    std::shared_ptr<InputStream> source; // Where more text comes from, until it runs out
+    std::vector<std::string> header;
+    std::deque<std::string> unescaped; // Storage for fields that contained "" escapes
+
+    // Scan up to maxRows rows (0 for no limit) into columns, returning the number read.
+    // When fixedWidth is set, extra fields are dropped and missing ones left empty. A row that
+    // runs into the end of the text is only read when no more text can follow
+    size_t scanRows(size_t maxRows, Columns& columns, bool fixedWidth);
+
+    // scanRows, reading more from the source and scanning again while the text runs out first
+    size_t scan(size_t maxRows, Columns& columns, bool fixedWidth);
+
+    // Replace the text with its unread part followed by at least as much again from the source
+    void readMore();
+
+    // Make text, a string value, the text to read from its start
+    void setText(const Value& text);
+    void addField(Columns& columns, size_t column, size_t begin, size_t end, bool fixedWidth);
+    Value makeColumn(const std::vector<std::string_view>& fields) const;
+
+public:
+    // text must be a string value; the reader keeps its storage alive
+    CsvReader(const Value& text, char delimiter);
+
+    // Reads source as the rows are asked for, so only the rows of one table are held at a time
+    CsvReader(std::shared_ptr<InputStream> source, char delimiter);
+
+    // Read up to maxRows data rows (0 for all of them) as a map from header name to column.
+    // Columns whose fields are all numbers are packed number arrays, other columns are string arrays.
+    // Returns nil once there are no rows left
+    Value readTable(size_t maxRows);
+};
+
+// Iterator over a CSV file in tables of at most a fixed number of rows
+class CsvChunkIterator : public Iterator {
+private:
+    std::shared_ptr<CsvReader> reader;
+    size_t rowsPerChunk;
+
+public:
+    CsvChunkIterator(std::shared_ptr<CsvReader> reader, size_t rowsPerChunk);
+    bool next(Value& out) override;
+};
+
+} // namespace SimpScript
+
+#endif // CSV_H
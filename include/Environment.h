@@ -23,6 +23,12 @@ public:
     // Define a new variable in the current environment
     void define(const std::string& name, const Value& value);
     
+    // Get a reference to a variable in the current environment, defining it as nil if needed
+    Value& slot(const std::string& name);
+    
+    // Find a variable in this or an enclosing environment, or nullptr if it is undefined
+    Value* lookup(const std::string& name);
+    
     // Get the value of a variable by name
     Value get(const std::string& name);
     
@@ -32,6 +38,9 @@ public:
     // Check if a variable exists in the current environment
     bool exists(const std::string& name) const;
     
+    // Remove every variable, releasing functions whose closures refer back to this environment
+    void clear();
+    
     // Get the enclosing environment
     std::shared_ptr<Environment> getEnclosing() const;
 };
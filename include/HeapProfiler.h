@@ -0,0 +1,111 @@
+#ifndef HEAP_PROFILER_H
+#define HEAP_PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SimpScript {
+
+// Heap profiler behind --heap-profile. It follows the storage of arrays made by array
+// literals, strings made by concatenation and interpolation, and closures made by function
+// definitions, each attributed to the kind of object and the source line that made it.
+// Storage is counted from when it is made until its last reference goes, at the size it
+// had when it was made.
+class HeapProfiler {
+public:
+    enum class Kind { ARRAY, STRING, CLOSURE };
+
+private:
+    struct Site {
+        Kind kind;
+        int line;
+        uint64_t allocatedBytes = 0;
+        uint64_t allocations = 0;
+        uint64_t liveBytes = 0;
+        uint64_t liveObjects = 0;
+        uint64_t exitBytes = 0; // Live when the script ended
+    };
+
+    mutable std::mutex mutex;
+    std::vector<Site> sites{Site{Kind::ARRAY, 0}}; // By site id; 0 is no site
+    std::map<std::pair<Kind, int>, uint32_t> ids;
+
+    std::string script;
+    std::ostream* snapshots; // Where snapshots go, or nullptr
+    uint64_t interval;       // Bytes allocated between snapshots
+    uint64_t nextSnapshot;
+    size_t snapshotCount = 0;
+
+    uint64_t allocatedBytes = 0;
+    uint64_t allocations = 0;
+    uint64_t liveBytes = 0;
+    uint64_t liveObjects = 0;
+    uint64_t peakBytes = 0;
+    uint64_t exitBytes = 0;
+
+    void writeSnapshot(const char* reason); // With the mutex held
+
+public:
+    // The site the calling thread is making objects for, or 0; see HeapSite
+    static thread_local uint32_t currentSite;
+
+    HeapProfiler(const std::string& script, std::ostream* snapshots, uint64_t interval);
+
+    HeapProfiler(const HeapProfiler&) = delete;
+    HeapProfiler& operator=(const HeapProfiler&) = delete;
+
+    uint32_t site(Kind kind, int line);
+
+    void allocate(uint32_t site, size_t bytes);
+    void release(uint32_t site, size_t bytes);
+
+    // Own object, counting it against site until the last reference to it goes
+    template <typename T>
+    std::shared_ptr<T> track(T* object, uint32_t site, size_t bytes) {
+        allocate(site, bytes);
+        return std::shared_ptr<T>(object, [this, site, bytes](T* tracked) {
+            delete tracked;
+            release(site, bytes);
+        });
+    }
+
+    // Snapshot of what is live now, written to the snapshot stream
+    void snapshot(const char* reason);
+
+    // The snapshot as the script ends, while its values are still held; report() shows what
+    // was live then
+    void finish();
+
+    // Peak live bytes, the sites that allocated most, and what each still holds
+    void report(std::ostream& out, size_t limit = 20) const;
+};
+
+// The profiler while --heap-profile is on, otherwise nullptr. Places that make tracked
+// objects check it first, so with the profiler off they cost one branch
+extern HeapProfiler* heapProfiler;
+
+// Marks the objects the calling thread makes while it is in scope as made at a site
+class HeapSite {
+private:
+    uint32_t previous;
+
+public:
+    HeapSite(HeapProfiler& profiler, HeapProfiler::Kind kind, int line) : previous(HeapProfiler::currentSite) {
+        HeapProfiler::currentSite = profiler.site(kind, line);
+    }
+    ~HeapSite() { HeapProfiler::currentSite = previous; }
+
+    HeapSite(const HeapSite&) = delete;
+    HeapSite& operator=(const HeapSite&) = delete;
+};
+
+} // namespace SimpScript
+
+#endif // HEAP_PROFILER_H
@@ -4,9 +4,12 @@
 #include "AST.h"
 #include "Value.h"
 #include "Environment.h"
+#include "Regex.h"
 #include <memory>
+#include <ostream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace SimpScript {
 
@@ -16,27 +19,57 @@ public:
     explicit RuntimeError(const std::string& message);
 };
 
-// Custom exception for return statements
-class ReturnValue : public std::runtime_error {
-private:
-    Value value;
-
-public:
-    explicit ReturnValue(const Value& value);
-    Value getValue() const;
-};
+class InputStream;
+class OutputStream;
+class Profiler;
+class Scheduler;
+class ThreadPool;
 
+// Runs scripts. Interpreters share no mutable state, so a host can run one per thread;
+// each reads and writes only the streams it was given
 class Interpreter {
 private:
     std::shared_ptr<Environment> environment;
     std::shared_ptr<Environment> globals;
+    std::shared_ptr<InputStream> input; // Shared by ask, lines(stdin) and read_all(stdin)
+    std::ostream* output; // show, shownl and stdout
+    std::ostream* errors; // stderr
+    std::vector<std::weak_ptr<OutputStream>> writers; // Files opened for writing, flushed at exit
+    RegexCache regexes; // Patterns passed to the regex builtins as strings
+    std::unique_ptr<ThreadPool> pool; // Started by the first parallel builtin call
+    std::unique_ptr<Scheduler> tasks; // Created by the first spawn or channel
+    bool worker = false; // Runs calls for another interpreter, whose globals it borrows
+    Profiler* profiler = nullptr; // Told about calls and lines while --profile is on
+    
+    // Set by a return statement; statements are skipped until the function call takes the value
+    bool returning = false;
+    Value returnValue;
 
     // Setup global environment with native functions
     void setupGlobals();
+    
+    // Register a file opened by the script so it is flushed when the interpreter exits
+    void trackWriter(const std::shared_ptr<OutputStream>& writer);
+    
+    // Resolve the pattern argument of a regex builtin: a regex literal or a pattern string
+    std::shared_ptr<Regex> regexFrom(const Value& pattern, const std::string& function);
 
 public:
+    // Interpreter on the process's standard streams
     Interpreter();
     
+    // Interpreter on streams of the host's choosing
+    Interpreter(std::shared_ptr<InputStream> input, std::ostream& output, std::ostream& errors);
+    
+    // Interpreter for a worker thread, sharing the globals and streams of parent but with its
+    // own call frames
+    Interpreter(Interpreter& parent, std::shared_ptr<Environment> globals);
+    
+    ~Interpreter();
+    
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
+    
     // Evaluate an AST node and return its value
     Value evaluate(ASTNode* node);
     
@@ -48,6 +81,28 @@ public:
     std::shared_ptr<Environment> getGlobals();
     void setEnvironment(std::shared_ptr<Environment> env);
     
+    // Standard streams of the running script
+    std::shared_ptr<InputStream> getInput();
+    std::ostream& getOutput();
+    
+    // Replace the script's stdin, such as for the next request on a server
+    void setInput(std::shared_ptr<InputStream> stream);
+    
+    // Return statement state
+    void setReturn(Value value);
+    bool isReturning() const { return returning; }
+    Value clearReturn(); // Returns the pending value
+    
+    // Pool that runs parallel_map and parallel_reduce; SIMPSCRIPT_THREADS overrides its size
+    ThreadPool& threadPool();
+    
+    // Scheduler for the tasks started with spawn, which run on this interpreter's thread
+    Scheduler& scheduler();
+    
+    // Attach a profiler, or detach it with nullptr; it must outlive the interpreter's calls
+    void setProfiler(Profiler* profiler) { this->profiler = profiler; }
+    Profiler* getProfiler() const { return profiler; }
+    
     // Helper methods for the REPL
     void defineVariable(const std::string& name, const Value& value);
     Value getVariable(const std::string& name);
@@ -0,0 +1,103 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "AST.h"
+#include "JitSite.h"
+#include "Value.h"
+#include "X86Assembler.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace SimpScript {
+
+class Interpreter;
+
+// The values machine code keeps unboxed, in 8-byte frame slots
+enum class JitType : uint8_t { NONE, INT, FLOAT, BOOL };
+
+// Passed to machine code: rsp must stay above stackLimit, or the code bails out
+struct JitContext {
+    uintptr_t stackLimit;
+};
+
+// A variable machine code takes from the environment it runs in, and maybe writes back
+struct JitInput {
+    std::string name;
+    int slot;
+    JitType type;
+    bool written;
+};
+
+// Machine code for one loop or function, specialized to the types its variables had when it
+// was compiled. The entry takes a frame of slots and returns 0, or nonzero when a guard failed
+// or it ran out of stack and the interpreter has to take over
+class JitCode {
+public:
+    using Entry = int (*)(int64_t* frame, const JitContext* context);
+
+    std::unique_ptr<ExecutableCode> machineCode;
+    Entry entry = nullptr;
+    std::vector<JitInput> inputs;    // Loop variables, or function parameters
+    std::vector<std::string> absent; // Names that must not resolve where the code runs
+    size_t frameSlots = 0;
+    int resultSlot = -1;             // A function's return value, or a loop's last body value
+    int tagSlot = -1;                // The type of a loop's last body value, if it changed
+    JitType resultType = JitType::NONE;
+    bool selfCall = false;           // A function that calls itself by name
+};
+
+// Template JIT for x86-64 Linux, turned on with --jit. Loops that run hot are compiled at the
+// top of an iteration and continue there in machine code; functions that are called often are
+// compiled on their next call. Only integer, float and boolean arithmetic on variables is
+// compiled, along with if, while, for, return and calls of a function to itself. Machine code
+// checks that each variable still has the type it was compiled for, and bails out when a check
+// fails or an operation would raise an error: a loop goes back to the state at the start of the
+// iteration and a function to the start of the call, and the interpreter runs them from there.
+class Jit {
+private:
+    std::mutex mutex;
+    // Kept until exit, since sites point at them. Clones of a loop or function definition share
+    // one site, so there is at most one of these per loop and function in the source
+    std::vector<std::unique_ptr<JitCode>> compiled;
+    std::string problem;
+    std::atomic<uint64_t> loops{0};
+    std::atomic<uint64_t> functions{0};
+    std::atomic<uint64_t> bailouts{0};
+
+    template <typename Build>
+    JitCode* compile(JitSite& site, Build build);
+
+public:
+    static constexpr uint32_t loopThreshold = 100; // Iterations of one run of a loop
+    static constexpr uint32_t callThreshold = 100; // Calls of a function
+
+    Jit();
+
+    bool available() const { return problem.empty(); }
+    const std::string& unavailableReason() const { return problem; }
+
+    // Run the rest of a loop that has just crossed loopThreshold in machine code. Returns false
+    // if it cannot be compiled or bailed out, leaving the interpreter to carry on from the next
+    // condition check; result is updated as the interpreted loop would update it
+    bool runLoop(JitSite& site, const ASTNode* condition, const ASTNode* body, const ASTNode* increment,
+                 Interpreter& interpreter, Value& result);
+
+    // Call a function in machine code once it is hot. Returns false when the interpreter has to
+    // make the call
+    bool call(UserFunction& function, std::vector<Value>& arguments, Value& result);
+
+    // One line: what was compiled and how often machine code bailed out
+    void summary(std::ostream& out) const;
+};
+
+// The JIT while --jit is on, or nullptr
+extern Jit* jit;
+
+} // namespace SimpScript
+
+#endif // JIT_H
@@ -0,0 +1,21 @@
+#ifndef JIT_SITE_H
+#define JIT_SITE_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace SimpScript {
+
+class JitCode;
+
+// What the JIT knows about one loop or function: how often it has run, and the machine code
+// compiled for it once it ran hot, or that it cannot be compiled (see Jit.h)
+struct JitSite {
+    std::atomic<uint32_t> hotness{0};
+    std::atomic<JitCode*> code{nullptr};
+    std::atomic<bool> rejected{false};
+};
+
+} // namespace SimpScript
+
+#endif // JIT_SITE_H
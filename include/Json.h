@@ -0,0 +1,93 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include "Value.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace SimpScript {
+
+// JSON object or array that has not been parsed yet. Lazy parsing only checks that the
+// brackets of a document balance and are nested no deeper than the eager parser allows;
+// a deferred value is parsed one level deep the first time it is used, and the
+// containers inside it are deferred in turn
+struct DeferredJson {
+    std::shared_ptr<const char> text; // Points at the opening bracket
+    size_t length;
+    bool object;
+
+    std::once_flag parseOnce;
+    Value parsed;
+
+    DeferredJson(std::shared_ptr<const char> text, size_t length, bool object);
+
+    // The parsed value, building it on first use
+    const Value& value();
+};
+
+// Parses JSON text into values: objects become maps, arrays become arrays, and strings
+// without escapes point into the source text instead of being copied
+class JsonParser {
+private:
+    std::shared_ptr<const char> source;
+    const char* begin;
+    const char* current;
+    const char* end;
+    bool lazy;
+    int depth = 0;
+
+    static const int maxDepth = 512;
+
+    JsonParser(std::shared_ptr<const char> source, size_t length, bool lazy);
+
+    Value parseValue();
+    Value parseObject();
+    Value parseArray();
+    Value parseString();
+    // The contents of the string at current: a view into the source, or into unescaped if it had escapes
+    std::string_view readString(std::string& unescaped);
+    Value parseNumber();
+    Value parseLiteral(std::string_view word, Value value);
+    Value defer();
+    void skipWhitespace();
+    void skipString();
+    void expect(char c);
+    [[noreturn]] void error(const std::string& message) const;
+
+public:
+    // text must be a string value; parsed strings keep its storage alive
+    JsonParser(const Value& text, bool lazy);
+
+    // Parse a whole document. Containers are deferred when the parser is lazy
+    Value parse();
+
+    // Parse the object or array of a deferred value, deferring the containers inside it
+    static Value parseLevel(const DeferredJson& json);
+};
+
+// Serializes values as JSON. When a sink is given, it is handed the output string each
+// time it grows past a threshold, so large documents can be written out in pieces
+class JsonWriter {
+public:
+    using Sink = std::function<void(std::string&)>;
+
+private:
+    static const size_t spillThreshold = 1 << 16;
+
+    std::string& out;
+    Sink sink;
+
+    void writeString(std::string_view text);
+    void spillIfFull();
+
+public:
+    explicit JsonWriter(std::string& out, Sink sink = nullptr);
+    void write(const Value& value);
+};
+
+} // namespace SimpScript
+
+#endif // JSON_H
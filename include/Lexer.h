@@ -12,14 +12,16 @@ class Lexer {
 private:
     std::string source;
     int position = 0;
-    int line = 1;
+    int line = 1; // Position of currentChar
     int column = 1;
+    int tokenLine = 1; // Where the token being scanned starts
+    int tokenColumn = 1;
     char currentChar = '\0';
 
     // Lookup table for keywords
-    static std::unordered_map<std::string, TokenType> keywords;
+    static const std::unordered_map<std::string, TokenType>& keywords();
     // Lookup table for natural language operators
-    static std::unordered_map<std::string, TokenType> naturalOperators;
+    static const std::unordered_map<std::string, TokenType>& naturalOperators();
 
     // Methods for lexer operation
     void advance();
@@ -36,6 +38,7 @@ private:
     Token handleNumber();
     Token handleIdentifier();
     Token handleString();
+    Token handleRegex(); // re"..." - backslashes are kept for the regex compiler
     Token handleOperator();
     Token handleWord(); // For multi-word operators like "greater than"
 
@@ -0,0 +1,27 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "Value.h"
+
+namespace SimpScript {
+
+class Interpreter;
+
+// Data-parallel builtins. Workers call the function with call frames of their own, against a
+// snapshot of the variables it captures taken when the builtin is called. Functions that print,
+// read input, define functions, assign variables outside themselves or call anything that does
+// run on the calling thread instead, one element at a time.
+
+// Whether function can be called from several threads at once
+bool isParallelSafe(const Value& function);
+
+// parallel_map(fn, items) - fn applied to every element of an array or range, in order
+Value parallelMap(Interpreter& interpreter, const Value& function, const Value& items);
+
+// parallel_reduce(fn, items, init) - fn(...fn(fn(init, x0), x1)..., xn). Elements are folded in
+// chunks that are combined in order, so fn must be associative
+Value parallelReduce(Interpreter& interpreter, const Value& function, const Value& items, const Value& initial);
+
+} // namespace SimpScript
+
+#endif // PARALLEL_H
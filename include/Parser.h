@@ -4,6 +4,8 @@
 #include "Token.h"
 #include "AST.h"
 #include "Lexer.h"
+#include "Regex.h"
+#include <iostream>
 #include <memory>
 #include <vector>
 #include <string>
@@ -20,7 +22,9 @@ public:
 class Parser {
 private:
     Lexer& lexer;
+    std::ostream& errors; // Where parse() reports the error it recovered from
     Token currentToken;
+    RegexCache regexes; // Identical regex literals share one compiled pattern
     
     // Helper methods for parsing
     void advance();
@@ -31,9 +35,11 @@ private:
     // Parsing methods for different grammar rules
     std::unique_ptr<ASTNode> program();
     std::unique_ptr<ASTNode> statement();
+    std::unique_ptr<ASTNode> bareStatement(); // statement() without the source location
     std::unique_ptr<ASTNode> ifStatement();
     std::unique_ptr<ASTNode> whileStatement();
     std::unique_ptr<ASTNode> forStatement();
+    std::unique_ptr<ASTNode> forEachStatement();
     std::unique_ptr<ASTNode> block();
     std::unique_ptr<ASTNode> expressionStatement();
     std::unique_ptr<ASTNode> printStatement(bool newline);
@@ -50,6 +56,7 @@ private:
     std::unique_ptr<ASTNode> factor();
     std::unique_ptr<ASTNode> unary();
     std::unique_ptr<ASTNode> primary();
+    std::unique_ptr<ASTNode> interpolatedString(const std::string& text);
     std::unique_ptr<ASTNode> call();
     std::unique_ptr<ASTNode> arrayAccess(std::unique_ptr<ASTNode> array);
     
@@ -60,7 +67,7 @@ private:
     ParseError error(const std::string& message);
 
 public:
-    explicit Parser(Lexer& lexer);
+    explicit Parser(Lexer& lexer, std::ostream& errors = std::cerr);
     
     // Parse the input and build an AST
     std::unique_ptr<ASTNode> parse();
@@ -0,0 +1,69 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace SimpScript {
+
+// Hardware events counted by PerfCounters, in the order of perfEventNames
+enum class PerfEvent {
+    CYCLES,
+    INSTRUCTIONS,
+    L1D_MISSES,    // Level 1 data cache read misses
+    LLC_MISSES,    // Last level cache misses
+    BRANCH_MISSES,
+    COUNT
+};
+
+constexpr size_t perfEventCount = static_cast<size_t>(PerfEvent::COUNT);
+
+// Short names, as used in the benchmark JSON
+extern const char* const perfEventNames[perfEventCount];
+
+// Counts of the events over some stretch of code. Events the machine or the kernel's
+// permissions would not count are missing
+struct PerfSample {
+    uint64_t values[perfEventCount] = {};
+    bool present[perfEventCount] = {};
+
+    bool has(PerfEvent event) const { return present[static_cast<size_t>(event)]; }
+    uint64_t get(PerfEvent event) const { return values[static_cast<size_t>(event)]; }
+    double ipc() const; // Instructions per cycle, or 0 without both counts
+
+    PerfSample& operator+=(const PerfSample& other);
+};
+
+// Hardware performance counters for the calling thread, through Linux perf_event_open.
+// Only user-space events are counted, which most kernels allow without privileges; when
+// none of the events can be opened, available() is false and samples come back empty.
+class PerfCounters {
+private:
+    int fds[perfEventCount];
+    std::string problem; // Why the first event that failed could not be opened
+
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const;
+    const std::string& unavailableReason() const { return problem; }
+
+    // Zero the counters and start counting
+    void start();
+    // Stop counting and read the counts since start(), scaled up if the kernel had to share
+    // the hardware counters between events
+    PerfSample stop();
+};
+
+// One line per phase, "name cycles instructions IPC ...", with a header
+void printPerfTable(std::ostream& out, const std::string names[], const PerfSample samples[], size_t count);
+
+} // namespace SimpScript
+
+#endif // PERF_COUNTERS_H
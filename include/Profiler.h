@@ -0,0 +1,118 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SimpScript {
+
+// Sampling profiler behind --profile. While it is attached, the interpreter keeps a shadow
+// stack of the calls it is in and the line each of them has reached; a SIGPROF timer copies
+// that stack every interval of CPU time and counts the copies. Sampling from a signal rather
+// than a thread keeps the process single threaded, which libstdc++ relies on to keep
+// reference counting cheap. Only the interpreter's own calls are profiled.
+class Profiler {
+public:
+    static constexpr size_t maxDepth = 256; // Deeper calls are counted against the frame at this depth
+
+private:
+    struct Frame {
+        std::atomic<uint32_t> function{0}; // Id from intern(); 0 is the top level of the script
+        std::atomic<uint32_t> line{0};     // 0 until a statement of the call has started
+    };
+
+    // A distinct stack and innermost line, with the number of samples that found it. The
+    // signal handler may not allocate, so stacks live in a fixed table and arena
+    struct Bucket {
+        size_t count = 0; // 0 for an unused bucket
+        uint32_t hash = 0;
+        uint32_t line = 0;
+        uint32_t offset = 0; // Function ids in arena, from the outermost call in
+        uint32_t length = 0;
+    };
+
+    static constexpr size_t tableSize = 1 << 14;
+    static constexpr size_t arenaSize = 1 << 18;
+
+    Frame frames[maxDepth];
+    std::atomic<size_t> depth{1};
+
+    std::vector<std::string> names{"<main>"}; // By function id
+    std::unordered_map<std::string, uint32_t> ids;
+
+    std::chrono::microseconds interval;
+    bool running = false;
+
+    std::vector<Bucket> table;
+    std::vector<uint32_t> arena;
+    size_t arenaUsed = 0;
+    size_t samples = 0;
+    size_t dropped = 0; // Samples of new stacks once the table or arena was full
+    std::atomic_flag sampling = ATOMIC_FLAG_INIT;
+
+    static void onSignal(int signal);
+    void sample();
+
+public:
+    explicit Profiler(std::chrono::microseconds interval = std::chrono::milliseconds(1));
+    ~Profiler();
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // Only one profiler can be sampling at a time, since there is one SIGPROF timer
+    void start();
+    void stop();
+
+    // Id for a function name, the same for every call of it
+    uint32_t intern(const std::string& name);
+
+    void enter(uint32_t function) {
+        size_t current = depth.load(std::memory_order_relaxed);
+        if (current < maxDepth) {
+            frames[current].function.store(function, std::memory_order_relaxed);
+            frames[current].line.store(0, std::memory_order_relaxed);
+        }
+        depth.store(current + 1, std::memory_order_release);
+    }
+
+    void leave() {
+        depth.store(depth.load(std::memory_order_relaxed) - 1, std::memory_order_release);
+    }
+
+    // Record the line the innermost call has reached
+    void setLine(int line) {
+        size_t current = depth.load(std::memory_order_relaxed);
+        if (current <= maxDepth) {
+            frames[current - 1].line.store(static_cast<uint32_t>(line), std::memory_order_relaxed);
+        }
+    }
+
+    // Hot functions, with the time spent in them and in what they call, and hot lines
+    void report(std::ostream& out, const std::string& script, size_t limit = 20) const;
+
+    // One line per distinct stack, "outer;inner count", the input format of flame graph tools
+    void writeCollapsed(std::ostream& out) const;
+};
+
+// Marks a call on the profiler's shadow stack for as long as it is in scope
+class ProfileScope {
+private:
+    Profiler& profiler;
+
+public:
+    ProfileScope(Profiler& profiler, uint32_t function) : profiler(profiler) { profiler.enter(function); }
+    ~ProfileScope() { profiler.leave(); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+} // namespace SimpScript
+
+#endif // PROFILER_H
@@ -0,0 +1,123 @@
+#ifndef REGEX_H
+#define REGEX_H
+
+#include "Value.h"
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace SimpScript {
+
+// Compiled regular expression. Patterns are compiled to a Thompson NFA; searches run a
+// DFA that is built lazily from it, one state at a time, so every search is linear in
+// the length of the text. Matches are leftmost-longest; a Scan carried from one search
+// to the next keeps a loop over all the matches in a text linear too. Patterns that
+// start with a literal are found with memchr before the automaton is started.
+//
+// Supported syntax: literals, ., [classes], \d \w \s (and \D \W \S), * + ? {m,n},
+// alternation with |, grouping with ( ), and the anchors ^ and $.
+class Regex : public Handle {
+private:
+    enum class Op { BYTE, SPLIT, JUMP, BEGIN, END, MATCH };
+
+    struct Instruction {
+        Op op;
+        int next;
+        int alternative; // Second branch of a SPLIT
+        int set;         // Index into sets for BYTE
+    };
+
+    struct Dfa;
+    struct Scratch;
+
+    std::string pattern;
+    std::vector<Instruction> program;
+    std::vector<std::bitset<256>> sets;
+    std::string prefix;          // Literal that every match starts with
+    bool literal = false;        // The whole pattern is the prefix
+    bool anchored = false;       // The pattern starts with ^
+    std::array<uint8_t, 256> byteClass; // Bytes no instruction tells apart share a class
+    int classCount = 0;
+
+    // Each DFA belongs to one search at a time; a search that finds it busy uses the NFA instead
+    std::unique_ptr<Dfa> fullDfa;   // Anchored, for matches() and for how far a match from a start reaches
+    std::unique_ptr<Dfa> searchDfa; // Unanchored, for finding where the first match ends
+
+    explicit Regex(const std::string& pattern);
+
+    // Add the BYTE instructions reachable from pc without consuming input to out, and set match
+    // if MATCH is reachable. With keepEnds, $ is not decided yet and END instructions are added too
+    void closure(int pc, bool atStart, bool atEnd, bool keepEnds, Scratch& scratch,
+                 std::vector<int>& out, bool& match) const;
+
+    int dfaState(Dfa& dfa, std::vector<int>& seeds, bool atStart) const;
+    int dfaStep(Dfa& dfa, int state, unsigned char byte) const;
+    int dfaStart(Dfa& dfa, bool atStart) const;
+
+    // Returns 1 with the end of the earliest match, 0 for no match, or -1 if the DFA grew too large
+    int dfaEarliestEnd(Dfa& dfa, std::string_view text, size_t from, size_t& end) const;
+    int dfaMatchesAll(Dfa& dfa, std::string_view text) const;
+
+public:
+    // What searches over one text have learned about how far matches reach from points in it
+    class Scan {
+    private:
+        friend class Regex;
+        const Regex* regex = nullptr;
+        const char* text = nullptr;
+        size_t size = 0;
+        uint64_t generation = 0; // Of the DFA whose states the keys name
+        std::unordered_map<uint64_t, size_t> reach; // (position, state) -> furthest match end, or npos
+    };
+
+private:
+    // Returns 1 with the end of the longest match starting at from, 0 for none, or -1 if the DFA
+    // grew too large. Records what it finds in scan, and stops early where scan already knows
+    int dfaLongestEnd(Dfa& dfa, std::string_view text, size_t from, Scan& scan, size_t& end) const;
+
+    // NFA simulation that tracks where each thread started. New threads stop at limit
+    bool nfaSearch(std::string_view text, size_t from, size_t limit, size_t& begin, size_t& end) const;
+
+    // Next position at or after from where the literal prefix occurs, or npos
+    size_t findPrefix(std::string_view text, size_t from) const;
+
+public:
+    ~Regex() override;
+
+    // Compile a pattern; throws RuntimeError if it is invalid
+    static std::shared_ptr<Regex> compile(const std::string& pattern);
+
+    // Whether the whole text matches
+    bool matches(std::string_view text) const;
+
+    // Find the leftmost-longest match at or after from. Loops over the matches in one text pass
+    // the same scan to every search so they do not scan the rest of the text again each time
+    bool search(std::string_view text, size_t from, size_t& begin, size_t& end) const;
+    bool search(std::string_view text, size_t from, size_t& begin, size_t& end, Scan& scan) const;
+
+    const std::string& getPattern() const;
+    std::string describe() const override;
+    bool threadSafe() const override { return true; } // The lazily built DFAs are locked
+};
+
+// Compiled patterns by pattern string, so each distinct pattern is compiled once
+class RegexCache {
+private:
+    static const size_t capacity = 256;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<Regex>> patterns;
+
+public:
+    std::shared_ptr<Regex> get(const std::string& pattern);
+};
+
+} // namespace SimpScript
+
+#endif // REGEX_H
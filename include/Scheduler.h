@@ -0,0 +1,188 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "Channel.h"
+#include "Value.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <ucontext.h>
+
+namespace SimpScript {
+
+class Environment;
+class Interpreter;
+class Scheduler;
+
+// A function call started with spawn, running as a coroutine on its own stack
+class Task : public Handle {
+private:
+    friend class Scheduler;
+
+    enum class State { READY, RUNNING, BLOCKED, DONE };
+
+    size_t id;
+    State state = State::READY;
+    Value function;
+    std::vector<Value> arguments;
+    Value result;
+    ucontext_t context;
+    char* stack = nullptr; // Allocated when the task first runs; the main task runs on the thread's stack
+    const void* stackBottom = nullptr; // Stack bounds reported to AddressSanitizer
+    size_t stackExtent = 0;
+    uintptr_t stackLimit = 0; // Calls below this address fail rather than overflow; 0 for no limit
+    bool cancelled = false;
+    const void* waitingOn = nullptr; // Queue the task is blocked in, so stale entries can be skipped
+    int waitingFd = -1;              // Descriptor the task waits to read from
+
+    // Interpreter state while the task is switched out
+    std::shared_ptr<Environment> environment;
+    bool returning = false;
+    Value returnValue;
+
+    std::deque<std::shared_ptr<Task>> joiners; // Tasks in wait() for this one
+
+public:
+    Task(size_t id, Value function, std::vector<Value> arguments);
+
+    bool isDone() const { return state == State::DONE; }
+    std::string describe() const override;
+};
+
+// Bounded queue of values between the tasks of one thread. Senders wait while it is full and
+// receivers while it is empty, letting other tasks run; once closed, receivers drain what is
+// left and then get nil
+class TaskChannel : public Channel {
+private:
+    Scheduler& scheduler;
+    std::thread::id owner; // Only tasks of this thread may use the channel
+    size_t capacity;
+    std::deque<Value> items;
+    bool closed = false;
+    std::deque<std::shared_ptr<Task>> senders;
+    std::deque<std::shared_ptr<Task>> receivers;
+
+    void checkThread() const;
+
+public:
+    TaskChannel(Scheduler& scheduler, size_t capacity);
+
+    void send(Value value) override;
+    bool receive(Value& out) override;
+    bool trySend(Value& value) override;
+    bool tryReceive(Value& out) override;
+
+    std::string describe() const override;
+    void close() override;
+};
+
+// Runs the tasks of one interpreter on its thread, switching between them only when the
+// running task blocks on a channel, on another task or on input that is not ready yet.
+// The code that started the interpreter runs as the main task.
+class Scheduler {
+private:
+    static constexpr size_t stackSize = 8 << 20; // Reserved, not committed, per task, as big as a main thread's
+    static constexpr size_t stackReserve = 256 << 10; // Left free below the deepest call, for builtins and machine code
+    static constexpr size_t cachedStacks = 64;
+
+    Interpreter& interpreter;
+    std::unordered_map<Task*, std::shared_ptr<Task>> live; // Spawned tasks that have not finished
+    std::shared_ptr<Task> main;
+    std::shared_ptr<Task> current;
+    std::deque<std::shared_ptr<Task>> ready;
+    std::vector<std::shared_ptr<Task>> inputWaiters;
+    std::shared_ptr<Task> finished; // Stack to recycle once we are off it
+    Task* switching = nullptr;      // Task that is switching away, for AddressSanitizer
+    std::vector<char*> stacks;      // Recycled stacks
+    std::exception_ptr failure;     // First error in a spawned task, rethrown in the main task
+    size_t spawned = 0;
+    Scheduler* previousActive = nullptr;
+
+    // Where a task starts running on its own stack
+    static void entry();
+
+    // Next task to run, waiting for input if every runnable task is waiting for it; nullptr
+    // if every task is blocked for good
+    std::shared_ptr<Task> next();
+
+    // Next task to run. When none can, the main task is woken with a deadlock error, or the
+    // error is thrown if the main task is the one blocking
+    std::shared_ptr<Task> runnable();
+
+    // Wait up to timeout milliseconds (-1 for no limit) for input that a task is blocked on;
+    // false if no task is waiting for input
+    bool pollInput(int timeout = -1);
+
+    // Save the running task and switch to target; throws in the resumed task if it was cancelled
+    void switchTo(const std::shared_ptr<Task>& target);
+
+    // Switch away from the running task, which must be blocked or queued to run again
+    void suspend();
+
+    // Give a task that has not run yet a stack to start on
+    void prepare(Task& task);
+
+    // Release the stack of a task that finished, once we are running on another one
+    void recycle();
+
+    // Tell AddressSanitizer, in builds that use it, that the thread moves between stacks
+    void startSwitch(void** fakeStack, const Task& target);
+    void finishSwitch(void* fakeStack);
+
+    // Mark a task done and wake what waits for it
+    void complete(const std::shared_ptr<Task>& task);
+
+public:
+    explicit Scheduler(Interpreter& interpreter);
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Start function(arguments) as a task; it first runs when the current task blocks or yields
+    std::shared_ptr<Task> spawn(Value function, std::vector<Value> arguments);
+
+    // Let other tasks run before the current one continues
+    void yield();
+
+    // Block the current task in queue until it is woken
+    void block(std::deque<std::shared_ptr<Task>>& queue);
+
+    // Make the first or every task blocked in queue runnable
+    void wakeOne(std::deque<std::shared_ptr<Task>>& queue);
+    void wakeAll(std::deque<std::shared_ptr<Task>>& queue);
+
+    // The task's result, once it has finished
+    Value wait(const std::shared_ptr<Task>& task);
+
+    // Called by the main task when its program ends: run the other tasks until they finish or
+    // can make no more progress, then cancel the rest
+    void finish();
+
+    // Unwind every unfinished task without running it further
+    void cancel();
+
+    // Called before a read from fd that may block. With other tasks to run, the current
+    // task waits until fd is readable and they run in the meantime
+    static void waitReadable(int fd);
+
+    // For a task waiting on another thread: whether this thread has other tasks, which should
+    // run in the meantime rather than the thread blocking
+    static bool hasTasks();
+
+    // Let the other tasks of this thread run, checking for input without waiting; false if none could
+    static bool runOthers();
+
+    // Called as a script function starts. Throws if the running task is close to the end of its
+    // stack, so runaway recursion is an error rather than a crash
+    static void checkStack();
+};
+
+} // namespace SimpScript
+
+#endif // SCHEDULER_H
@@ -0,0 +1,83 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "AST.h"
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace SimpScript {
+
+// Messages on the server socket are frames: a type byte, the payload length as 4 bytes
+// little-endian, then the payload. A request is PATH, any number of ARG and INPUT frames,
+// then RUN. The reply is OUTPUT and ERROR frames as the script writes, then EXIT with the
+// exit status as its payload.
+enum class FrameType : char {
+    PATH = 'P',   // Script to run
+    ARG = 'A',    // One element of the args array
+    INPUT = 'I',  // Part of the script's stdin
+    RUN = 'R',    // End of request
+    OUTPUT = 'O', // Part of stdout
+    ERROR = 'E',  // Part of stderr
+    EXIT = 'X'    // Exit status, "0" or "1"
+};
+
+// Longest payload a frame may have; a peer that announces more is dropped
+constexpr uint32_t maxFrameSize = 16 << 20;
+
+// Returns false if the peer has gone away
+bool writeFrame(int fd, FrameType type, std::string_view payload);
+
+// Returns false at end of stream, on a malformed or oversized frame, or if the deadline passes
+bool readFrame(int fd, FrameType& type, std::string& payload,
+               std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+
+// Connect to a server socket; returns -1 on failure
+int connectToServer(const std::string& socketPath);
+
+// Runs scripts for clients on a Unix domain socket. Each worker thread keeps an interpreter
+// constructed ahead of its next request, and parsed scripts are cached until the file changes.
+class ScriptServer {
+private:
+    // A client has this long to send its whole request, and may send this much in total
+    static constexpr std::chrono::seconds requestTimeout{10};
+    static constexpr size_t maxRequestSize = size_t(256) << 20;
+
+    struct CompiledScript {
+        std::unique_ptr<ASTNode> program;
+        timespec modified;
+        off_t size;
+    };
+
+    std::string socketPath;
+    size_t threads;
+    int listener = -1;
+
+    std::mutex cacheMutex;
+    std::unordered_map<std::string, std::shared_ptr<CompiledScript>> cache;
+
+    // The parsed script at path, reparsing it if the file changed; throws on errors
+    std::shared_ptr<CompiledScript> compile(const std::string& path);
+
+    void workerLoop();
+
+public:
+    ScriptServer(const std::string& socketPath, size_t threads);
+    ~ScriptServer();
+
+    ScriptServer(const ScriptServer&) = delete;
+    ScriptServer& operator=(const ScriptServer&) = delete;
+
+    // Listen and serve until the process is stopped; throws if the socket cannot be opened
+    void run();
+};
+
+} // namespace SimpScript
+
+#endif // SERVER_H
@@ -0,0 +1,31 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "AST.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace SimpScript {
+
+// How the output of the workers is put together
+enum class ShardMerge {
+    ORDERED, // Worker by worker, so lines come out in the order of the input
+    BY_KEY   // Merged line by line on the first tab-separated field; each worker's output must be sorted on it
+};
+
+struct ShardOptions {
+    std::string inputPath;
+    size_t workers = 1;
+    ShardMerge merge = ShardMerge::ORDERED;
+};
+
+// Run a parsed program in options.workers forked processes. The input file is mapped and
+// split at line boundaries into that many slices; each worker reads its slice as stdin and
+// sees its number in `shard` and the number of workers in `shards`. Returns the exit status
+// for the whole run, which is 1 if any worker failed.
+int runSharded(const std::unique_ptr<ASTNode>& program, const ShardOptions& options);
+
+} // namespace SimpScript
+
+#endif // SHARD_H
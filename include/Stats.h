@@ -0,0 +1,85 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace SimpScript {
+
+class Value;
+
+// Runtime statistics for --stats and stats(): what the interpreter spends its time on.
+// They are only kept in builds configured with SIMPSCRIPT_STATS; otherwise every
+// SIMPSCRIPT_COUNT below expands to nothing and no counter exists.
+
+// Node types counted when evaluated, in the order of nodeKindNames
+enum class NodeKind {
+    LITERAL, REGEX_LITERAL, INTERPOLATED_STRING, VARIABLE, BINARY_OP, UNARY_OP, ARRAY_LITERAL,
+    ARRAY_ACCESS, SLICE, FUNCTION_CALL, BLOCK, ASSIGNMENT, ARRAY_ASSIGNMENT, IF, WHILE, FOR,
+    FOR_EACH, FUNCTION_DEF, RETURN, PRINT, SPAWN, INPUT, PROGRAM, COUNT
+};
+
+// Value types, as Value::Type, for copies
+constexpr size_t valueTypeCount = 12;
+
+struct RuntimeStats {
+    uint64_t nodes[static_cast<size_t>(NodeKind::COUNT)] = {};
+    uint64_t environments = 0;  // Environment frames created
+    uint64_t lookups = 0;       // Variable gets, assigns and in-place lookups
+    uint64_t lookupDepth = 0;   // Enclosing frames walked by them, past the innermost
+    uint64_t mapLookups = 0;    // Map key searches
+    uint64_t valueCopies[valueTypeCount] = {}; // Copy constructions and assignments, by type
+    uint64_t arrayCopies = 0;   // Array storage copied on write
+    uint64_t arrayCopyElements = 0;
+    uint64_t mapCopies = 0;     // Map storage copied on write
+    uint64_t stringBytes = 0;   // Bytes of string storage allocated
+    uint64_t userCalls = 0;
+    uint64_t nativeCalls = 0;
+
+    RuntimeStats& operator+=(const RuntimeStats& other);
+};
+
+#ifdef SIMPSCRIPT_STATS
+
+// The calling thread's counters; each thread counts on its own, without synchronization
+extern thread_local RuntimeStats* threadStatsPointer;
+RuntimeStats& registerThreadStats();
+
+inline RuntimeStats& threadStats() {
+    return threadStatsPointer != nullptr ? *threadStatsPointer : registerThreadStats();
+}
+
+#define SIMPSCRIPT_COUNT(counter) (::SimpScript::threadStats().counter++)
+#define SIMPSCRIPT_COUNT_BY(counter, amount) (::SimpScript::threadStats().counter += (amount))
+#define SIMPSCRIPT_COUNT_NODE(kind) (::SimpScript::threadStats().nodes[static_cast<size_t>(::SimpScript::NodeKind::kind)]++)
+
+#else
+
+#define SIMPSCRIPT_COUNT(counter) ((void)0)
+#define SIMPSCRIPT_COUNT_BY(counter, amount) ((void)0)
+#define SIMPSCRIPT_COUNT_NODE(kind) ((void)0)
+
+#endif
+
+// Whether this build keeps statistics
+constexpr bool statsEnabled() {
+#ifdef SIMPSCRIPT_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Totals over every thread so far
+RuntimeStats collectStats();
+
+// The totals as a map of counter names to counts; counters that are zero are left out
+Value statsValue(const RuntimeStats& stats);
+
+// A readable table of the totals
+void printStats(std::ostream& out, const RuntimeStats& stats);
+
+} // namespace SimpScript
+
+#endif // STATS_H
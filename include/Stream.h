@@ -0,0 +1,115 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "Value.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <ostream>
+
+namespace SimpScript {
+
+// Buffered line-oriented input over a file descriptor or a memory-mapped file.
+// Lines are handed out as string views into the read buffer, so reading a line
+// does not copy it. A view keeps its buffer alive for as long as it is referenced.
+class InputStream : public Handle {
+private:
+    static constexpr size_t chunkSize = 1 << 20;
+
+    std::string name;
+    int fd;             // -1 when the whole input is mapped
+    bool ownsFd;
+    bool exhausted;
+    bool closed = false;
+    std::shared_ptr<const char> buffer;
+    char* writable = nullptr; // The current chunk, when reading from a descriptor
+    size_t capacity = 0;
+    size_t size = 0;          // Bytes of valid data in buffer
+    size_t position = 0;      // Start of the unread data
+    std::ostream* tied = nullptr; // Flushed before blocking on the terminal
+
+    InputStream(const std::string& name, int fd, bool ownsFd);
+
+    // Read more data after the unread tail of the buffer; returns false at end of input
+    bool refill();
+
+public:
+    ~InputStream() override;
+
+    // Standard input, read in large chunks with plain read() calls
+    static std::shared_ptr<InputStream> standardInput();
+
+    // Open a file, memory-mapping it when it is a regular file
+    static std::shared_ptr<InputStream> open(const std::string& path);
+
+    // Input that reads from a string, such as the stdin a host hands to an embedded script
+    static std::shared_ptr<InputStream> fromString(std::string text, const std::string& name);
+
+    // Input that reads length bytes of memory kept alive by data, such as a slice of a mapped file
+    static std::shared_ptr<InputStream> fromMemory(std::shared_ptr<const char> data, size_t length, const std::string& name);
+
+    // Flush output before each read that may block, so prompts appear before the input is awaited
+    void tie(std::ostream* output);
+
+    // Read the next line without its line terminator; returns false at end of input
+    bool readLine(Value& line);
+
+    // Read everything that is left
+    Value readAll();
+
+    // Read what is available next, waiting for it if there is none; returns false at end of input.
+    // Mapped and in-memory input comes back in one piece
+    bool readChunk(Value& chunk);
+
+    std::string describe() const override;
+    void close() override;
+};
+
+// Buffered writer. Files get their own buffer which is written out when it fills up,
+// on flush() and on close(); console streams write through to their iostream
+class OutputStream : public Handle {
+private:
+    static const size_t flushThreshold = 1 << 16;
+
+    std::string name;
+    int fd = -1;
+    std::ostream* console = nullptr;
+    std::string buffer;
+    bool closed = false;
+
+    explicit OutputStream(const std::string& name);
+
+    void writeBuffer();
+
+public:
+    ~OutputStream() override;
+
+    // Open a file for writing, truncating it unless append is set
+    static std::shared_ptr<OutputStream> open(const std::string& path, bool append);
+
+    // Write through to an existing iostream such as std::cout
+    static std::shared_ptr<OutputStream> wrap(std::ostream& stream, const std::string& name);
+
+    void write(std::string_view text);
+    void write(const Value& value); // Formats the value straight into the buffer
+    void writeJson(const Value& value); // Serializes the value into the buffer, writing it out as it fills
+    void flush();
+
+    bool isClosed() const;
+    std::string describe() const override;
+    void close() override;
+};
+
+// Iterator over the lines of an input stream, for use in for-each loops
+class LineIterator : public Iterator {
+private:
+    std::shared_ptr<InputStream> stream;
+
+public:
+    explicit LineIterator(std::shared_ptr<InputStream> stream);
+    bool next(Value& out) override;
+};
+
+} // namespace SimpScript
+
+#endif // STREAM_H
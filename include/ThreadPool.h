@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SimpScript {
+
+// Work-stealing thread pool. Each worker takes jobs from the back of its own queue and,
+// when that is empty, steals from the front of the others, so uneven jobs balance out.
+class ThreadPool {
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // One per worker
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued{0};  // Jobs waiting in any queue
+    std::atomic<size_t> next{0};    // Queue that receives the next job
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void push(std::function<void()> job);
+
+    // Run one job, preferring the queue of worker self; false if every queue was empty
+    bool runOne(size_t self);
+
+    void workerLoop(size_t self);
+
+public:
+    // threads counts the calling thread, which works too while it waits
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const;
+
+    // Run task(i) for every i in [0, count) and wait for all of them. If tasks throw,
+    // the first exception is rethrown once the rest have finished
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+};
+
+} // namespace SimpScript
+
+#endif // THREAD_POOL_H
@@ -16,6 +16,7 @@ enum class TokenType {
     INTEGER,
     FLOAT,
     STRING,
+    REGEX,      // re"..."
     IDENTIFIER,
     
     // Arithmetic operators
@@ -69,6 +70,7 @@ enum class TokenType {
     ELSE,
     WHILE,
     FOR,
+    IN,
     FUNCTION,
     RETURN,
     SHOW,
@@ -78,7 +80,10 @@ enum class TokenType {
     ENDIF,
     ENDWHILE,
     ENDFOR,
-    ENDFUNCTION
+    ENDFUNCTION,
+    SPAWN,
+    TRUE,       // Boolean literals, which cannot be assigned
+    FALSE
 };
 
 // Token class to store token type and its value
@@ -0,0 +1,46 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <ostream>
+#include <string>
+
+namespace SimpScript {
+
+// Execution tracing behind --trace. Each thread records begin and end events into a ring
+// buffer of its own, which keeps its most recent events; writeTrace puts them together as
+// Chrome trace_event JSON, for chrome://tracing or Perfetto.
+//
+// Tracing is switched on once, before the script is parsed. Everything that records an
+// event checks `tracing` first, so with tracing off an event site costs a single branch.
+extern bool tracing;
+
+// Start recording on every thread, with timestamps counted from now
+void startTracing();
+
+// Stable copy of a name for events; the same pointer for every call with the same name
+const char* traceName(const std::string& name);
+
+// Out of line, so the event sites stay small; call only while tracing
+void traceBegin(const char* category, const char* name);
+void traceEnd(const char* category, const char* name);
+
+// Write every thread's events as a JSON object with a traceEvents array
+void writeTrace(std::ostream& out);
+
+// Records a begin event now and the matching end event when it goes out of scope
+class TraceScope {
+private:
+    const char* category;
+    const char* name;
+
+public:
+    TraceScope(const char* category, const char* name) : category(category), name(name) { traceBegin(category, name); }
+    ~TraceScope() { traceEnd(category, name); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+} // namespace SimpScript
+
+#endif // TRACE_H
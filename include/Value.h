@@ -1,25 +1,51 @@
 #ifndef VALUE_H
 #define VALUE_H
 
+#include "JitSite.h"
+#include "Stats.h"
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <functional>
 #include <variant>
 #include <memory>
+#include <mutex>
+#include <string_view>
 
 namespace SimpScript {
 
 // Forward declarations
 class ASTNode;
 class Environment;
+class Interpreter;
+struct Effects;
+
+// Sequence produced on demand, such as the lines of a file
+class Iterator {
+public:
+    virtual ~Iterator() = default;
+    // Store the next element in out, or return false when the sequence is exhausted
+    virtual bool next(class Value& out) = 0;
+};
+
+// Interpreter-managed resource, such as an input stream
+class Handle {
+public:
+    virtual ~Handle() = default;
+    virtual std::string describe() const = 0;
+    // Release the underlying resource; further use of the handle is an error
+    virtual void close() {}
+    // Whether several threads may use the handle at once
+    virtual bool threadSafe() const { return false; }
+};
 
 // Represents callable functions (both native and user-defined)
 class Callable {
 public:
     virtual ~Callable() = default;
     virtual int arity() const = 0;
-    virtual class Value call(std::vector<class Value>& arguments) = 0;
+    // The interpreter supplies the call frames; each thread running script code has its own
+    virtual class Value call(Interpreter& interpreter, std::vector<class Value>& arguments) = 0;
 };
 
 // Native function (C++ implemented)
@@ -27,26 +53,108 @@ class NativeFunction : public Callable {
 private:
     int _arity;
     std::function<class Value(std::vector<class Value>&)> function;
+    bool pure; // No I/O and no effect on interpreter state, so safe to call from worker threads
 
 public:
-    NativeFunction(int arity, std::function<class Value(std::vector<class Value>&)> function);
+    NativeFunction(int arity, std::function<class Value(std::vector<class Value>&)> function, bool pure = false);
     int arity() const override;
-    class Value call(std::vector<class Value>& arguments) override;
+    bool isPure() const;
+    class Value call(Interpreter& interpreter, std::vector<class Value>& arguments) override;
 };
 
 // User-defined function
 class UserFunction : public Callable {
 private:
+    std::string name;
     std::vector<std::string> parameters;
     std::unique_ptr<ASTNode> body;
     std::shared_ptr<Environment> closure;
+    const char* traceLabel; // The name for trace events, while tracing
+    std::shared_ptr<JitSite> jitSite; // Shared by every function made by one definition
+
+    class Value invoke(Interpreter& interpreter, std::vector<class Value>& arguments);
 
 public:
-    UserFunction(const std::vector<std::string>& parameters, 
+    UserFunction(const std::string& name,
+                 const std::vector<std::string>& parameters, 
                  std::unique_ptr<ASTNode> body,
-                 std::shared_ptr<Environment> closure);
+                 std::shared_ptr<Environment> closure,
+                 std::shared_ptr<JitSite> jitSite = std::make_shared<JitSite>());
     int arity() const override;
-    class Value call(std::vector<class Value>& arguments) override;
+    class Value call(Interpreter& interpreter, std::vector<class Value>& arguments) override;
+    
+    const std::string& getName() const;
+    const std::vector<std::string>& getParameters() const;
+    std::shared_ptr<Environment> getClosure() const;
+    const ASTNode* getBody() const;
+    JitSite& getJitSite();
+    
+    // What the body reads, writes and calls
+    void collectEffects(Effects& effects) const;
+    
+    // The same function with its captured variables taken from another environment
+    std::shared_ptr<UserFunction> withClosure(std::shared_ptr<Environment> environment) const;
+};
+
+// Lazy integer sequence produced by range(); elements are computed on demand
+struct Range {
+    int start;
+    int stop;
+    int step;
+
+    int size() const;
+    int at(int index) const;
+};
+
+class Value;
+
+// Window onto shared character storage. Substrings point into their parent's buffer;
+// the pointer shares ownership of whatever holds the characters (a string, a read buffer, a mapped file)
+struct StringRef {
+    std::shared_ptr<const char> chars;
+    size_t length;
+};
+
+// Window onto shared array storage. Copies and slices share the owner until one of them is mutated
+struct ArrayRef {
+    std::shared_ptr<std::vector<Value>> owner;
+    size_t offset;
+    size_t length;
+};
+
+// Packed storage for arrays of numbers, such as the numeric columns of a CSV file.
+// Scripts see an ordinary array; the generic form is only built if something asks for it
+struct NumberStorage {
+    std::vector<double> numbers;
+    bool integral = false; // Every element is a whole number that fits in an int
+    
+    std::once_flag expandOnce;
+    std::vector<Value> expanded;
+};
+
+// Window onto packed number storage
+struct NumberArrayRef {
+    std::shared_ptr<NumberStorage> owner;
+    size_t offset;
+    size_t length;
+};
+
+class Map;
+struct DeferredJson;
+
+// Read-only view of the elements of an array value
+class ArraySpan {
+private:
+    const Value* first;
+    size_t count;
+
+public:
+    ArraySpan(const Value* first, size_t count) : first(first), count(count) {}
+    const Value* begin() const;
+    const Value* end() const;
+    const Value& operator[](size_t index) const;
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
 };
 
 // Represents a runtime value in SimpScript
@@ -60,6 +168,10 @@ public:
         FLOAT,
         STRING,
         ARRAY,
+        MAP,
+        RANGE,
+        ITERATOR,
+        HANDLE,
         FUNCTION,
         NATIVE_FUNCTION
     };
@@ -74,23 +186,57 @@ private:
         bool,                 // BOOLEAN
         int,                  // INTEGER
         double,               // FLOAT
-        std::string,          // STRING
-        ArrayType,            // ARRAY
+        StringRef,            // STRING
+        ArrayRef,             // ARRAY
+        NumberArrayRef,       // ARRAY (packed numbers)
+        std::shared_ptr<Map>, // MAP
+        std::shared_ptr<DeferredJson>, // ARRAY or MAP (unparsed JSON)
+        Range,                // RANGE
+        std::shared_ptr<Iterator>, // ITERATOR
+        std::shared_ptr<Handle>,   // HANDLE
         FunctionType          // FUNCTION
     > data;
     
     Type type;
 
+    // The parsed form of an unparsed JSON value, or nullptr for any other value
+    const Value* parsedJson() const;
+
 public:
     // Constructors
     Value(); // NIL value
     explicit Value(bool value);
     explicit Value(int value);
     explicit Value(double value);
+    explicit Value(const char* value);
     explicit Value(const std::string& value);
+    explicit Value(std::string&& value);
     explicit Value(const ArrayType& array);
+    explicit Value(ArrayType&& array);
+    Value(std::shared_ptr<const char> chars, size_t length); // string view
+    explicit Value(std::shared_ptr<NumberStorage> numbers);  // packed array
+    explicit Value(std::shared_ptr<Map> map);
+    explicit Value(std::shared_ptr<DeferredJson> json);     // array or map parsed on first use
+    explicit Value(const Range& range);
+    explicit Value(std::shared_ptr<Iterator> iterator);
+    explicit Value(std::shared_ptr<Handle> handle);
     explicit Value(const FunctionType& function);
 
+#ifdef SIMPSCRIPT_STATS
+    // Copies are counted by type; moves are not
+    Value(const Value& other) : data(other.data), type(other.type) {
+        SIMPSCRIPT_COUNT(valueCopies[static_cast<size_t>(type)]);
+    }
+    Value(Value&& other) noexcept = default;
+    Value& operator=(const Value& other) {
+        data = other.data;
+        type = other.type;
+        SIMPSCRIPT_COUNT(valueCopies[static_cast<size_t>(type)]);
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept = default;
+#endif
+
     // Type checking
     bool isNil() const;
     bool isBoolean() const;
@@ -99,6 +245,12 @@ public:
     bool isNumber() const;
     bool isString() const;
     bool isArray() const;
+    bool isPackedArray() const;
+    bool isMap() const;
+    bool isDeferredJson() const;
+    bool isRange() const;
+    bool isIterator() const;
+    bool isHandle() const;
     bool isFunction() const;
     
     Type getType() const;
@@ -108,21 +260,33 @@ public:
     int asInteger() const;
     double asFloat() const;
     std::string asString() const;
-    ArrayType& asArray();
-    const ArrayType& asArray() const;
+    std::string_view asStringView() const;
+    ArraySpan asArray() const;
+    ArrayType& mutableArray(); // detaches shared storage before writing
+    const Map& asMap() const;
+    Map& mutableMap();         // detaches shared storage before writing
+    const Range& asRange() const;
+    std::shared_ptr<Iterator> asIterator() const;
+    std::shared_ptr<Handle> asHandle() const;
+    std::shared_ptr<DeferredJson> asDeferredJson() const;
     FunctionType asFunction() const;
 
     // Array operations
-    Value& at(int index);
     const Value& at(int index) const;
+    Value element(int index) const; // Like at(), but reads packed arrays without expanding them
     void set(int index, const Value& value);
     int size() const;
     
+    // Zero-copy slice [begin, end) of an array or string, sharing the parent's storage
+    Value slice(int begin, int end) const;
+    
     // Function operations
-    Value call(std::vector<Value>& args);
+    Value call(Interpreter& interpreter, std::vector<Value>& args);
     
     // Utility methods
     std::string toString() const;
+    void appendTo(std::string& out) const;   // toString() without the temporary
+    size_t formattedLengthHint() const;      // Estimated length of toString(), for pre-sizing buffers
     bool isTruthy() const;
     
     // Operators
@@ -140,6 +304,39 @@ public:
     bool operator>=(const Value& rhs) const;
 };
 
+// String-keyed map that remembers insertion order. Small maps, such as parsed JSON
+// records, are searched linearly; the hash index is only built once a map grows
+class Map {
+private:
+    static const size_t indexThreshold = 8;
+
+    std::vector<std::string> keys;
+    std::vector<Value> values;
+    std::unordered_map<std::string, size_t> index; // Empty until there are more than indexThreshold keys
+
+    size_t position(const std::string& key) const; // keys.size() if not present
+
+public:
+    // Returns nullptr if the key is not present
+    const Value* find(const std::string& key) const;
+    void set(const std::string& key, const Value& value);
+    
+    size_t size() const { return keys.size(); }
+    const std::string& keyAt(size_t position) const { return keys[position]; }
+    const Value& valueAt(size_t position) const { return values[position]; }
+};
+
+inline const Value* ArraySpan::begin() const { return first; }
+inline const Value* ArraySpan::end() const { return first + count; }
+inline const Value& ArraySpan::operator[](size_t index) const { return first[index]; }
+
+// Integers are 32 bits and wrap around on overflow, as they do in code the JIT compiles. The
+// arithmetic is done on unsigned values, where wrapping is defined
+inline int wrappingAdd(int a, int b) { return static_cast<int>(static_cast<unsigned>(a) + static_cast<unsigned>(b)); }
+inline int wrappingSub(int a, int b) { return static_cast<int>(static_cast<unsigned>(a) - static_cast<unsigned>(b)); }
+inline int wrappingMul(int a, int b) { return static_cast<int>(static_cast<unsigned>(a) * static_cast<unsigned>(b)); }
+inline int wrappingNegate(int a) { return static_cast<int>(0u - static_cast<unsigned>(a)); }
+
 } // namespace SimpScript
 
 #endif // VALUE_H 
\ No newline at end of file
@@ -0,0 +1,127 @@
+#ifndef X86_ASSEMBLER_H
+#define X86_ASSEMBLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SimpScript {
+
+// General purpose registers, by their encoding
+enum class Reg : uint8_t { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7, R12 = 12 };
+
+enum class Xmm : uint8_t { XMM0 = 0, XMM1 = 1, XMM2 = 2 };
+
+// Condition codes, by their encoding in jcc and setcc
+enum class Condition : uint8_t {
+    BELOW = 0x2,          // Unsigned <, or carry; unordered after ucomisd
+    ABOVE_EQUAL = 0x3,
+    EQUAL = 0x4,
+    NOT_EQUAL = 0x5,
+    BELOW_EQUAL = 0x6,
+    ABOVE = 0x7,
+    PARITY = 0xA,         // Unordered after ucomisd
+    NO_PARITY = 0xB,
+    LESS = 0xC,
+    GREATER_EQUAL = 0xD,
+    LESS_EQUAL = 0xE,
+    GREATER = 0xF
+};
+
+// Two-operand integer instructions, by their opcode with a register destination in r/m
+enum class AluOp : uint8_t { ADD = 0x01, OR = 0x09, AND = 0x21, SUB = 0x29, XOR = 0x31, CMP = 0x39 };
+
+// Scalar double instructions, by their opcode after the 0F escape
+enum class SseOp : uint8_t { ADD = 0x58, MUL = 0x59, SUB = 0x5C, DIV = 0x5E };
+
+// Encodes the handful of x86-64 instructions the JIT's templates use into a byte buffer.
+// Memory operands are a base register plus a 32-bit displacement. Jumps go to labels, which
+// may be bound before or after the jumps to them.
+class X86Assembler {
+public:
+    using Label = size_t;
+
+private:
+    std::vector<uint8_t> code;
+    std::vector<size_t> labels;                     // Bound positions, or unbound
+    std::vector<std::pair<size_t, Label>> fixups;   // rel32 fields to patch, and their targets
+
+    void byte(uint8_t value);
+    void int32(int32_t value);
+    void rex(bool wide, uint8_t reg, uint8_t base, bool always = false);
+    void memory(uint8_t reg, Reg base, int32_t displacement);
+    void direct(uint8_t reg, uint8_t rm);
+    void relative(Label target);
+
+public:
+    Label newLabel();
+    void bind(Label label);
+
+    // Stack and registers
+    void push(Reg reg);
+    void pop(Reg reg);
+    void mov(Reg destination, Reg source);       // 64-bit
+    void movImm32(Reg destination, int32_t value);
+    void movImm64(Reg destination, uint64_t value);
+    void lea(Reg destination, Reg base, int32_t displacement);
+
+    // Loads and stores; 32-bit loads zero the upper half of the register
+    void load32(Reg destination, Reg base, int32_t displacement);
+    void store32(Reg base, int32_t displacement, Reg source);
+    void load64(Reg destination, Reg base, int32_t displacement);
+    void store64(Reg base, int32_t displacement, Reg source);
+    void loadDouble(Xmm destination, Reg base, int32_t displacement);
+    void storeDouble(Reg base, int32_t displacement, Xmm source);
+
+    // 32-bit integer arithmetic
+    void alu32(AluOp op, Reg destination, Reg source);
+    void aluImm32(AluOp op, Reg destination, int32_t value);
+    void aluImm64(AluOp op, Reg destination, int32_t value);
+    void cmp64(Reg left, Reg base, int32_t displacement); // left with a 64-bit memory operand
+    void test32(Reg left, Reg right);
+    void imul32(Reg destination, Reg source);
+    void neg32(Reg reg);
+    void cdq();
+    void idiv32(Reg divisor);                            // edx:eax by divisor
+    void xchg32(Reg reg);                                // With eax
+    void setcc(Condition condition, Reg destination);   // Low byte of rax to rdx
+    void movzx8(Reg destination, Reg source);
+
+    // Scalar doubles
+    void sse(SseOp op, Xmm destination, Xmm source);
+    void ucomisd(Xmm left, Xmm right);
+    void xorpd(Xmm destination, Xmm source);
+    void movapd(Xmm destination, Xmm source);
+    void movqToXmm(Xmm destination, Reg source);
+    void movqFromXmm(Reg destination, Xmm source);
+    void cvtsi2sd(Xmm destination, Reg source);         // From a 32-bit integer
+
+    // Control flow
+    void jmp(Label target);
+    void jcc(Condition condition, Label target);
+    void call(Label target);
+    void ret();
+
+    // The encoded instructions, with every jump resolved
+    std::vector<uint8_t> finish();
+};
+
+// Machine code copied into pages of its own, which are made executable and no longer writable
+class ExecutableCode {
+private:
+    void* pages = nullptr;
+    size_t length = 0;
+
+public:
+    explicit ExecutableCode(const std::vector<uint8_t>& code);
+    ~ExecutableCode();
+
+    ExecutableCode(const ExecutableCode&) = delete;
+    ExecutableCode& operator=(const ExecutableCode&) = delete;
+
+    const void* address() const { return pages; }
+};
+
+} // namespace SimpScript
+
+#endif // X86_ASSEMBLER_H
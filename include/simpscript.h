@@ -0,0 +1,122 @@
+#ifndef SIMPSCRIPT_H
+#define SIMPSCRIPT_H
+
+/*
+ * C embedding API for libsimpscript.
+ *
+ * Compile a script once with simpscript_compile() and run it as often as needed with
+ * simpscript_execute(). Variables set with simpscript_set_*() are globals of the
+ * interpreter and stay defined across runs, as do the variables a script assigns.
+ *
+ * An interpreter must only be used by one thread at a time; use one interpreter per
+ * thread to run scripts concurrently. A compiled program can be run by any interpreter,
+ * on any thread, including several at once.
+ *
+ * Functions that can fail return NULL or -1 and leave a message for
+ * simpscript_last_error(). Values returned to the caller are owned by the caller and
+ * released with simpscript_value_free().
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct simpscript_interpreter simpscript_interpreter;
+typedef struct simpscript_program simpscript_program;
+typedef struct simpscript_value simpscript_value;
+
+typedef enum {
+    SIMPSCRIPT_NIL,
+    SIMPSCRIPT_BOOL,
+    SIMPSCRIPT_INT,
+    SIMPSCRIPT_NUMBER,
+    SIMPSCRIPT_STRING,
+    SIMPSCRIPT_ARRAY,
+    SIMPSCRIPT_MAP,
+    SIMPSCRIPT_OTHER /* Ranges, functions and handles */
+} simpscript_type;
+
+/* Interpreters */
+
+/* Interpreter that reads the process's stdin and writes its stdout and stderr */
+simpscript_interpreter* simpscript_interpreter_new(void);
+
+/* Interpreter that reads input from the given text and collects what the script prints,
+   for simpscript_output() */
+simpscript_interpreter* simpscript_interpreter_new_captured(const char* input, size_t length);
+
+void simpscript_interpreter_free(simpscript_interpreter* interpreter);
+
+/* Message for the last failed call on this interpreter, or "" */
+const char* simpscript_last_error(const simpscript_interpreter* interpreter);
+
+/* What a captured interpreter has printed since it was created or last cleared.
+   The text stays valid until the next call on the interpreter */
+const char* simpscript_output(simpscript_interpreter* interpreter, size_t* length);
+void simpscript_clear_output(simpscript_interpreter* interpreter);
+
+/* Programs */
+
+simpscript_program* simpscript_compile(simpscript_interpreter* interpreter, const char* source, size_t length);
+void simpscript_program_free(simpscript_program* program);
+
+/* Run a program; returns the value of its last statement, or NULL on error */
+simpscript_value* simpscript_execute(simpscript_interpreter* interpreter, const simpscript_program* program);
+
+/* Global variables */
+
+int simpscript_set(simpscript_interpreter* interpreter, const char* name, const simpscript_value* value);
+int simpscript_set_int(simpscript_interpreter* interpreter, const char* name, int value);
+int simpscript_set_number(simpscript_interpreter* interpreter, const char* name, double value);
+int simpscript_set_string(simpscript_interpreter* interpreter, const char* name, const char* text, size_t length);
+
+/* A global's current value, or NULL if it is not defined */
+simpscript_value* simpscript_get(simpscript_interpreter* interpreter, const char* name);
+
+/* Native functions */
+
+/* Called with the arguments of a script call. Return a new value (or NULL for nil);
+   the interpreter takes ownership of it. Call simpscript_raise() to fail the call */
+typedef simpscript_value* (*simpscript_native)(simpscript_interpreter* interpreter,
+                                               const simpscript_value* const* args,
+                                               size_t count, void* userdata);
+
+/* Define a global function; arity -1 accepts any number of arguments */
+int simpscript_register(simpscript_interpreter* interpreter, const char* name, int arity,
+                        simpscript_native function, void* userdata);
+
+/* Make the running native function fail with a runtime error once it returns */
+void simpscript_raise(simpscript_interpreter* interpreter, const char* message);
+
+/* Values */
+
+simpscript_value* simpscript_nil(void);
+simpscript_value* simpscript_bool(int value);
+simpscript_value* simpscript_int(int value);
+simpscript_value* simpscript_number(double value);
+simpscript_value* simpscript_string(const char* text, size_t length);
+simpscript_value* simpscript_array(const simpscript_value* const* elements, size_t count);
+simpscript_value* simpscript_value_copy(const simpscript_value* value);
+void simpscript_value_free(simpscript_value* value);
+
+simpscript_type simpscript_value_type(const simpscript_value* value);
+int simpscript_value_bool(const simpscript_value* value);     /* Truthiness */
+int simpscript_value_int(const simpscript_value* value);      /* Numbers are truncated, others are 0 */
+double simpscript_value_number(const simpscript_value* value); /* Non-numbers are 0 */
+
+/* The string, or the value formatted as the script would print it. Valid while the value is */
+const char* simpscript_value_string(simpscript_value* value, size_t* length);
+
+/* Elements of arrays, characters of strings, entries of maps */
+size_t simpscript_value_size(const simpscript_value* value);
+simpscript_value* simpscript_value_at(const simpscript_value* value, size_t index); /* Arrays */
+simpscript_value* simpscript_value_get(const simpscript_value* value, const char* key); /* Maps */
+simpscript_value* simpscript_value_key_at(const simpscript_value* value, size_t index); /* Maps */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIMPSCRIPT_H */
@@ -1,9 +1,17 @@
 #include "AST.h"
 #include "Interpreter.h"
 #include "Environment.h"
+#include "HeapProfiler.h"
+#include "Jit.h"
 #include "Value.h"
+#include "Stream.h"
+#include "Regex.h"
+#include "Profiler.h"
+#include "Scheduler.h"
+#include "Stats.h"
+#include "Trace.h"
 #include <stdexcept>
-#include <iostream>
+#include <ostream>
 
 namespace SimpScript {
 
@@ -27,6 +35,7 @@ LiteralNode::LiteralNode(const std::string& value) : value(value) {}
 LiteralNode::LiteralNode(bool value) : value(value) {}
 
 Value LiteralNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(LITERAL);
     if (std::holds_alternative<int>(value)) {
         return Value(std::get<int>(value));
     } else if (std::holds_alternative<double>(value)) {
@@ -40,10 +49,61 @@ Value LiteralNode::evaluate(Interpreter& interpreter) {
     return Value(); // nil
 }
 
+// RegexLiteralNode implementation
+RegexLiteralNode::RegexLiteralNode(std::shared_ptr<Regex> regex) : regex(std::move(regex)) {}
+
+Value RegexLiteralNode::evaluate(Interpreter&) {
+    SIMPSCRIPT_COUNT_NODE(REGEX_LITERAL);
+    return Value(std::static_pointer_cast<Handle>(regex));
+}
+
+// InterpolatedStringNode implementation
+InterpolatedStringNode::InterpolatedStringNode(std::vector<std::string> literals, std::vector<std::unique_ptr<ASTNode>> expressions)
+    : literals(std::move(literals)), expressions(std::move(expressions)), literalLength(0) {
+    for (const auto& literal : this->literals) {
+        literalLength += literal.size();
+    }
+}
+
+Value InterpolatedStringNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(INTERPOLATED_STRING);
+    // Evaluate every embedded expression first so the output can be sized up front.
+    // Typical literals have only a few holes, which stay on the stack.
+    constexpr size_t inlineCount = 8;
+    Value inlineValues[inlineCount];
+    std::vector<Value> overflowValues;
+    Value* values = inlineValues;
+    if (expressions.size() > inlineCount) {
+        overflowValues.resize(expressions.size());
+        values = overflowValues.data();
+    }
+    
+    size_t estimate = literalLength;
+    for (size_t i = 0; i < expressions.size(); i++) {
+        values[i] = expressions[i]->evaluate(interpreter);
+        estimate += values[i].formattedLengthHint();
+    }
+    
+    std::string result;
+    result.reserve(estimate);
+    result += literals[0];
+    for (size_t i = 0; i < expressions.size(); i++) {
+        values[i].appendTo(result);
+        result += literals[i + 1];
+    }
+    
+    if (heapProfiler != nullptr) {
+        HeapSite site(*heapProfiler, HeapProfiler::Kind::STRING, getLine());
+        return Value(std::move(result));
+    }
+    return Value(std::move(result));
+}
+
 // VariableNode implementation
 VariableNode::VariableNode(const std::string& name) : name(name) {}
 
 Value VariableNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(VARIABLE);
     return interpreter.getEnvironment()->get(name);
 }
 
@@ -52,11 +112,16 @@ BinaryOpNode::BinaryOpNode(OpType opType, std::unique_ptr<ASTNode> left, std::un
     : opType(opType), left(std::move(left)), right(std::move(right)) {}
 
 Value BinaryOpNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(BINARY_OP);
     Value leftVal = left->evaluate(interpreter);
     Value rightVal = right->evaluate(interpreter);
     
     switch (opType) {
         case OpType::ADD:
+            if (heapProfiler != nullptr) {
+                HeapSite site(*heapProfiler, HeapProfiler::Kind::STRING, getLine());
+                return leftVal + rightVal;
+            }
             return leftVal + rightVal;
         case OpType::SUB:
             return leftVal - rightVal;
@@ -92,6 +157,7 @@ UnaryOpNode::UnaryOpNode(OpType opType, std::unique_ptr<ASTNode> operand)
     : opType(opType), operand(std::move(operand)) {}
 
 Value UnaryOpNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(UNARY_OP);
     Value val = operand->evaluate(interpreter);
     
     switch (opType) {
@@ -99,7 +165,7 @@ Value UnaryOpNode::evaluate(Interpreter& interpreter) {
             return Value(!val.isTruthy());
         case OpType::NEGATIVE:
             if (val.isInteger()) {
-                return Value(-val.asInteger());
+                return Value(wrappingNegate(val.asInteger()));
             } else if (val.isFloat()) {
                 return Value(-val.asFloat());
             }
@@ -114,13 +180,18 @@ ArrayLiteralNode::ArrayLiteralNode(std::vector<std::unique_ptr<ASTNode>> element
     : elements(std::move(elements)) {}
 
 Value ArrayLiteralNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(ARRAY_LITERAL);
     std::vector<Value> values;
     
     for (const auto& element : elements) {
         values.push_back(element->evaluate(interpreter));
     }
     
-    return Value(values);
+    if (heapProfiler != nullptr) {
+        HeapSite site(*heapProfiler, HeapProfiler::Kind::ARRAY, getLine());
+        return Value(std::move(values));
+    }
+    return Value(std::move(values));
 }
 
 // ArrayAccessNode implementation
@@ -128,25 +199,87 @@ ArrayAccessNode::ArrayAccessNode(std::unique_ptr<ASTNode> array, std::unique_ptr
     : array(std::move(array)), index(std::move(index)) {}
 
 Value ArrayAccessNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(ARRAY_ACCESS);
     Value arrayVal = array->evaluate(interpreter);
     Value indexVal = index->evaluate(interpreter);
+    return access(arrayVal, indexVal);
+}
+
+Value ArrayAccessNode::access(const Value& arrayVal, const Value& indexVal) {
+    if (arrayVal.isMap()) {
+        if (!indexVal.isString()) {
+            throw std::runtime_error("Map key must be a string");
+        }
+        const Value* found = arrayVal.asMap().find(indexVal.asString());
+        return found != nullptr ? *found : Value();
+    }
+    
+    if (!indexVal.isInteger()) {
+        throw std::runtime_error("Array index must be an integer");
+    }
+    
+    if (arrayVal.isRange()) {
+        return Value(arrayVal.asRange().at(indexVal.asInteger()));
+    }
+    
+    if (arrayVal.isString()) {
+        int position = indexVal.asInteger();
+        if (position < 0 || position >= arrayVal.size()) {
+            throw std::runtime_error("String index out of bounds");
+        }
+        return arrayVal.slice(position, position + 1);
+    }
     
     if (!arrayVal.isArray()) {
         throw std::runtime_error("Cannot index non-array value");
     }
     
-    if (!indexVal.isInteger()) {
-        throw std::runtime_error("Array index must be an integer");
+    return arrayVal.element(indexVal.asInteger());
+}
+
+// SliceNode implementation
+SliceNode::SliceNode(std::unique_ptr<ASTNode> array, std::unique_ptr<ASTNode> begin, std::unique_ptr<ASTNode> end)
+    : array(std::move(array)), begin(std::move(begin)), end(std::move(end)) {}
+
+Value SliceNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(SLICE);
+    Value arrayVal = array->evaluate(interpreter);
+    Value beginVal;
+    if (begin) {
+        beginVal = begin->evaluate(interpreter);
+    }
+    Value endVal;
+    if (end) {
+        endVal = end->evaluate(interpreter);
+    }
+    return slice(arrayVal, begin ? &beginVal : nullptr, end ? &endVal : nullptr);
+}
+
+Value SliceNode::slice(const Value& arrayVal, const Value* beginVal, const Value* endVal) {
+    int first = 0;
+    int last = arrayVal.isArray() || arrayVal.isString() ? arrayVal.size() : 0;
+    if (beginVal != nullptr) {
+        if (!beginVal->isInteger()) {
+            throw std::runtime_error("Slice bounds must be integers");
+        }
+        first = beginVal->asInteger();
+    }
+    if (endVal != nullptr) {
+        if (!endVal->isInteger()) {
+            throw std::runtime_error("Slice bounds must be integers");
+        }
+        last = endVal->asInteger();
     }
     
-    return arrayVal.at(indexVal.asInteger());
+    return arrayVal.slice(first, last);
 }
 
 // FunctionCallNode implementation
 FunctionCallNode::FunctionCallNode(const std::string& name, std::vector<std::unique_ptr<ASTNode>> arguments)
-    : name(name), arguments(std::move(arguments)) {}
+    : name(name), arguments(std::move(arguments)), traceLabel(tracing ? traceName(name) : nullptr) {}
 
 Value FunctionCallNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(FUNCTION_CALL);
     // Evaluate function value
     Value function = interpreter.getEnvironment()->get(name);
     
@@ -156,8 +289,32 @@ Value FunctionCallNode::evaluate(Interpreter& interpreter) {
         args.push_back(arg->evaluate(interpreter));
     }
     
-    // Call function
-    return function.call(args);
+    if (tracing || interpreter.getProfiler() != nullptr) {
+        return callInstrumented(interpreter, function, args);
+    }
+    return function.call(interpreter, args);
+}
+
+// Call the function while tracing or profiling. Builtins are traced here, where their name is
+// known; user functions trace their own calls
+Value FunctionCallNode::callInstrumented(Interpreter& interpreter, Value& function, std::vector<Value>& args) {
+    if (tracing && function.isFunction() && dynamic_cast<NativeFunction*>(function.asFunction().get()) != nullptr) {
+        TraceScope scope("native", traceLabel);
+        return callProfiled(interpreter, function, args);
+    }
+    return callProfiled(interpreter, function, args);
+}
+
+// Call the function, on the profiler's shadow stack when there is one
+Value FunctionCallNode::callProfiled(Interpreter& interpreter, Value& function, std::vector<Value>& args) {
+    if (Profiler* profiler = interpreter.getProfiler()) {
+        if (profileId == 0) {
+            profileId = profiler->intern(name);
+        }
+        ProfileScope scope(*profiler, profileId);
+        return function.call(interpreter, args);
+    }
+    return function.call(interpreter, args);
 }
 
 // BlockNode implementation
@@ -165,10 +322,18 @@ BlockNode::BlockNode(std::vector<std::unique_ptr<ASTNode>> statements)
     : statements(std::move(statements)) {}
 
 Value BlockNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(BLOCK);
     Value result;
+    Profiler* profiler = interpreter.getProfiler();
     
     for (const auto& statement : statements) {
+        if (profiler != nullptr) {
+            profiler->setLine(statement->getLine());
+        }
         result = statement->evaluate(interpreter);
+        if (interpreter.isReturning()) {
+            break;
+        }
     }
     
     return result;
@@ -179,14 +344,15 @@ AssignmentNode::AssignmentNode(const std::string& name, std::unique_ptr<ASTNode>
     : name(name), expression(std::move(expression)) {}
 
 Value AssignmentNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(ASSIGNMENT);
     Value value = expression->evaluate(interpreter);
     
-    try {
-        // Try to assign to existing variable
-        interpreter.getEnvironment()->assign(name, value);
-    } catch (const std::runtime_error&) {
-        // Variable doesn't exist, define it
-        interpreter.getEnvironment()->define(name, value);
+    // Assign to an existing variable, or define it in the current scope
+    Environment& environment = *interpreter.getEnvironment();
+    if (Value* target = environment.lookup(name)) {
+        *target = value;
+    } else {
+        environment.define(name, value);
     }
     
     return value;
@@ -197,27 +363,56 @@ ArrayAssignmentNode::ArrayAssignmentNode(std::unique_ptr<ASTNode> array, std::un
     : array(std::move(array)), index(std::move(index)), value(std::move(value)) {}
 
 Value ArrayAssignmentNode::evaluate(Interpreter& interpreter) {
-    Value arrayVal = array->evaluate(interpreter);
+    SIMPSCRIPT_COUNT_NODE(ARRAY_ASSIGNMENT);
     Value indexVal = index->evaluate(interpreter);
     Value val = value->evaluate(interpreter);
     
-    if (!arrayVal.isArray()) {
-        throw std::runtime_error("Cannot index non-array value");
+    // Update a named array or map in place; its storage is only copied if shared with another value
+    if (auto* variable = dynamic_cast<VariableNode*>(array.get())) {
+        Value* target = interpreter.getEnvironment()->lookup(variable->getName());
+        if (target == nullptr) {
+            throw std::runtime_error("Undefined variable '" + variable->getName() + "'");
+        }
+        assign(*target, indexVal, val);
+        return val;
     }
     
     if (!indexVal.isInteger()) {
         throw std::runtime_error("Array index must be an integer");
     }
     
+    Value arrayVal = array->evaluate(interpreter);
+    if (!arrayVal.isArray()) {
+        throw std::runtime_error("Cannot index non-array value");
+    }
+    
     arrayVal.set(indexVal.asInteger(), val);
     return val;
 }
 
+void ArrayAssignmentNode::assign(Value& target, const Value& indexVal, const Value& val) {
+    if (target.isMap()) {
+        if (!indexVal.isString()) {
+            throw std::runtime_error("Map key must be a string");
+        }
+        target.mutableMap().set(indexVal.asString(), val);
+        return;
+    }
+    if (!indexVal.isInteger()) {
+        throw std::runtime_error("Array index must be an integer");
+    }
+    if (!target.isArray()) {
+        throw std::runtime_error("Cannot index non-array value");
+    }
+    target.set(indexVal.asInteger(), val);
+}
+
 // IfNode implementation
 IfNode::IfNode(std::unique_ptr<ASTNode> condition, std::unique_ptr<ASTNode> thenBranch, std::unique_ptr<ASTNode> elseBranch)
     : condition(std::move(condition)), thenBranch(std::move(thenBranch)), elseBranch(std::move(elseBranch)) {}
 
 Value IfNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(IF);
     if (condition->evaluate(interpreter).isTruthy()) {
         return thenBranch->evaluate(interpreter);
     } else if (elseBranch) {
@@ -228,30 +423,42 @@ Value IfNode::evaluate(Interpreter& interpreter) {
 }
 
 // WhileNode implementation
-WhileNode::WhileNode(std::unique_ptr<ASTNode> condition, std::unique_ptr<ASTNode> body)
-    : condition(std::move(condition)), body(std::move(body)) {}
+WhileNode::WhileNode(std::unique_ptr<ASTNode> condition, std::unique_ptr<ASTNode> body, std::shared_ptr<JitSite> jitSite)
+    : condition(std::move(condition)), body(std::move(body)), jitSite(std::move(jitSite)) {}
 
 Value WhileNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(WHILE);
     Value result;
+    uint32_t iterations = 0;
     
     while (condition->evaluate(interpreter).isTruthy()) {
         result = body->evaluate(interpreter);
+        if (interpreter.isReturning()) {
+            break;
+        }
+        // Once the loop is hot, machine code may run the remaining iterations
+        if (jit != nullptr && ++iterations == Jit::loopThreshold &&
+            jit->runLoop(*jitSite, condition.get(), body.get(), nullptr, interpreter, result)) {
+            break;
+        }
     }
     
     return result;
 }
 
 // ForNode implementation
-ForNode::ForNode(std::unique_ptr<ASTNode> initialization, std::unique_ptr<ASTNode> condition, std::unique_ptr<ASTNode> increment, std::unique_ptr<ASTNode> body)
-    : initialization(std::move(initialization)), condition(std::move(condition)), increment(std::move(increment)), body(std::move(body)) {}
+ForNode::ForNode(std::unique_ptr<ASTNode> initialization, std::unique_ptr<ASTNode> condition, std::unique_ptr<ASTNode> increment, std::unique_ptr<ASTNode> body, std::shared_ptr<JitSite> jitSite)
+    : initialization(std::move(initialization)), condition(std::move(condition)), increment(std::move(increment)), body(std::move(body)), jitSite(std::move(jitSite)) {}
 
 Value ForNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(FOR);
     // Create a new environment for the loop
     auto enclosing = interpreter.getEnvironment();
     auto loopEnv = std::make_shared<Environment>(enclosing);
     interpreter.setEnvironment(loopEnv);
     
     Value result;
+    uint32_t iterations = 0;
     
     try {
         // Initialize
@@ -260,7 +467,101 @@ Value ForNode::evaluate(Interpreter& interpreter) {
         // Loop
         while (condition->evaluate(interpreter).isTruthy()) {
             result = body->evaluate(interpreter);
+            if (interpreter.isReturning()) {
+                break;
+            }
             increment->evaluate(interpreter);
+            if (jit != nullptr && ++iterations == Jit::loopThreshold &&
+                jit->runLoop(*jitSite, condition.get(), body.get(), increment.get(), interpreter, result)) {
+                break;
+            }
+        }
+    } catch (...) {
+        // Restore environment on error
+        interpreter.setEnvironment(enclosing);
+        throw;
+    }
+    
+    // Restore environment
+    interpreter.setEnvironment(enclosing);
+    
+    return result;
+}
+
+// ForEachNode implementation
+ForEachNode::ForEachNode(const std::string& variable, std::unique_ptr<ASTNode> sequence, std::unique_ptr<ASTNode> body)
+    : variable(variable), sequence(std::move(sequence)), body(std::move(body)) {}
+
+Value ForEachNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(FOR_EACH);
+    Value items = sequence->evaluate(interpreter);
+    
+    // Create a new environment for the loop
+    auto enclosing = interpreter.getEnvironment();
+    auto loopEnv = std::make_shared<Environment>(enclosing);
+    interpreter.setEnvironment(loopEnv);
+    
+    // The loop variable is bound once; each iteration overwrites the slot in place
+    Value& current = loopEnv->slot(variable);
+    Value result;
+    
+    try {
+        if (items.isRange()) {
+            // Ranges are never materialized, elements are computed as we go
+            const Range& range = items.asRange();
+            long long element = range.start;
+            for (int i = 0, count = range.size(); i < count; i++) {
+                current = Value(static_cast<int>(element));
+                result = body->evaluate(interpreter);
+                if (interpreter.isReturning()) {
+                    break;
+                }
+                element += range.step;
+            }
+        } else if (items.isPackedArray()) {
+            for (int i = 0, count = items.size(); i < count; i++) {
+                current = items.element(i);
+                result = body->evaluate(interpreter);
+                if (interpreter.isReturning()) {
+                    break;
+                }
+            }
+        } else if (items.isArray()) {
+            for (const Value& element : items.asArray()) {
+                current = element;
+                result = body->evaluate(interpreter);
+                if (interpreter.isReturning()) {
+                    break;
+                }
+            }
+        } else if (items.isMap()) {
+            // Maps iterate over their keys in insertion order
+            const Map& map = items.asMap();
+            for (size_t i = 0; i < map.size(); i++) {
+                current = Value(map.keyAt(i));
+                result = body->evaluate(interpreter);
+                if (interpreter.isReturning()) {
+                    break;
+                }
+            }
+        } else if (items.isString()) {
+            for (int i = 0, count = items.size(); i < count; i++) {
+                current = items.slice(i, i + 1);
+                result = body->evaluate(interpreter);
+                if (interpreter.isReturning()) {
+                    break;
+                }
+            }
+        } else if (items.isIterator()) {
+            auto iterator = items.asIterator();
+            while (iterator->next(current)) {
+                result = body->evaluate(interpreter);
+                if (interpreter.isReturning()) {
+                    break;
+                }
+            }
+        } else {
+            throw std::runtime_error("Can only iterate over arrays, maps, strings, ranges and iterators");
         }
     } catch (...) {
         // Restore environment on error
@@ -275,16 +576,25 @@ Value ForNode::evaluate(Interpreter& interpreter) {
 }
 
 // FunctionDefNode implementation
-FunctionDefNode::FunctionDefNode(const std::string& name, const std::vector<std::string>& parameters, std::unique_ptr<ASTNode> body)
-    : name(name), parameters(parameters), body(std::move(body)) {}
+FunctionDefNode::FunctionDefNode(const std::string& name, const std::vector<std::string>& parameters, std::unique_ptr<ASTNode> body, std::shared_ptr<JitSite> jitSite)
+    : name(name), parameters(parameters), body(std::move(body)), jitSite(std::move(jitSite)) {}
 
 Value FunctionDefNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(FUNCTION_DEF);
     // Create the function object
-    auto function = std::make_shared<UserFunction>(
-        parameters,
-        body->clone(),
-        interpreter.getEnvironment()
-    );
+    std::shared_ptr<UserFunction> function;
+    if (heapProfiler != nullptr) {
+        function = heapProfiler->track(new UserFunction(name, parameters, body->clone(), interpreter.getEnvironment(), jitSite),
+                                       heapProfiler->site(HeapProfiler::Kind::CLOSURE, getLine()), sizeof(UserFunction));
+    } else {
+        function = std::make_shared<UserFunction>(
+            name,
+            parameters,
+            body->clone(),
+            interpreter.getEnvironment(),
+            jitSite
+        );
+    }
     
     // Define the function in the current environment
     interpreter.getEnvironment()->define(name, Value(function));
@@ -297,8 +607,10 @@ ReturnNode::ReturnNode(std::unique_ptr<ASTNode> expression)
     : expression(std::move(expression)) {}
 
 Value ReturnNode::evaluate(Interpreter& interpreter) {
-    Value value = expression->evaluate(interpreter);
-    throw ReturnValue(value);
+    SIMPSCRIPT_COUNT_NODE(RETURN);
+    // Statements stop executing until the enclosing function call takes the value
+    interpreter.setReturn(expression->evaluate(interpreter));
+    return Value();
 }
 
 // PrintNode implementation
@@ -306,22 +618,66 @@ PrintNode::PrintNode(std::unique_ptr<ASTNode> expression, bool newline)
     : expression(std::move(expression)), newline(newline) {}
 
 Value PrintNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(PRINT);
     Value value = expression->evaluate(interpreter);
+    if (tracing) {
+        TraceScope scope("io", "write");
+        write(interpreter.getOutput(), value, newline);
+        return value;
+    }
+    write(interpreter.getOutput(), value, newline);
+    return value;
+}
+
+void PrintNode::write(std::ostream& output, const Value& value, bool newline) {
+    if (value.isString()) {
+        output << value.asStringView();
+    } else {
+        output << value.toString();
+    }
     
     if (newline) {
-        std::cout << value.toString() << std::endl;
-    } else {
-        std::cout << value.toString();
+        output << std::endl;
+    }
+}
+
+// SpawnNode implementation
+SpawnNode::SpawnNode(const std::string& name, std::vector<std::unique_ptr<ASTNode>> arguments)
+    : name(name), arguments(std::move(arguments)) {}
+
+Value SpawnNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(SPAWN);
+    // The function and its arguments are evaluated now; the call runs when the task is scheduled
+    Value function = interpreter.getEnvironment()->get(name);
+    std::vector<Value> args;
+    for (const auto& arg : arguments) {
+        args.push_back(arg->evaluate(interpreter));
     }
     
-    return value;
+    auto task = interpreter.scheduler().spawn(std::move(function), std::move(args));
+    return Value(std::static_pointer_cast<Handle>(task));
 }
 
 // InputNode implementation
-Value InputNode::evaluate(Interpreter&) {
-    std::string input;
-    std::getline(std::cin, input);
-    return Value(input);
+Value InputNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(INPUT);
+    Value line("");
+    if (tracing) {
+        TraceScope scope("io", "read");
+        interpreter.getInput()->readLine(line);
+        return line;
+    }
+    interpreter.getInput()->readLine(line);
+    return line;
+}
+
+// CoverageNode implementation
+CoverageNode::CoverageNode(std::unique_ptr<ASTNode> statement, std::atomic<uint64_t>* executions)
+    : statement(std::move(statement)), executions(executions) {}
+
+Value CoverageNode::evaluate(Interpreter& interpreter) {
+    executions->fetch_add(1, std::memory_order_relaxed);
+    return statement->evaluate(interpreter);
 }
 
 // ProgramNode implementation
@@ -329,17 +685,32 @@ ProgramNode::ProgramNode(std::vector<std::unique_ptr<ASTNode>> statements)
     : statements(std::move(statements)) {}
 
 Value ProgramNode::evaluate(Interpreter& interpreter) {
+    SIMPSCRIPT_COUNT_NODE(PROGRAM);
     Value result;
     
     for (const auto& statement : statements) {
         result = statement->evaluate(interpreter);
+        if (interpreter.isReturning()) {
+            break;
+        }
     }
     
     return result;
 }
 
 // Clone methods for AST nodes
-std::unique_ptr<ASTNode> LiteralNode::clone() const {
+std::unique_ptr<ASTNode> ASTNode::clone() const {
+    auto node = cloneNode();
+    node->setLocation(line, column);
+    return node;
+}
+
+void ASTNode::setLocation(int line, int column) {
+    this->line = line;
+    this->column = column;
+}
+
+std::unique_ptr<ASTNode> LiteralNode::cloneNode() const {
     if (std::holds_alternative<int>(value)) {
         return std::make_unique<LiteralNode>(std::get<int>(value));
     } else if (std::holds_alternative<double>(value)) {
@@ -352,11 +723,23 @@ std::unique_ptr<ASTNode> LiteralNode::clone() const {
     return std::make_unique<LiteralNode>(0);
 }
 
-std::unique_ptr<ASTNode> VariableNode::clone() const {
+std::unique_ptr<ASTNode> InterpolatedStringNode::cloneNode() const {
+    std::vector<std::unique_ptr<ASTNode>> clonedExpressions;
+    for (const auto& expression : expressions) {
+        clonedExpressions.push_back(expression->clone());
+    }
+    return std::make_unique<InterpolatedStringNode>(literals, std::move(clonedExpressions));
+}
+
+std::unique_ptr<ASTNode> RegexLiteralNode::cloneNode() const {
+    return std::make_unique<RegexLiteralNode>(regex);
+}
+
+std::unique_ptr<ASTNode> VariableNode::cloneNode() const {
     return std::make_unique<VariableNode>(name);
 }
 
-std::unique_ptr<ASTNode> BinaryOpNode::clone() const {
+std::unique_ptr<ASTNode> BinaryOpNode::cloneNode() const {
     return std::make_unique<BinaryOpNode>(
         opType,
         left->clone(),
@@ -364,14 +747,14 @@ std::unique_ptr<ASTNode> BinaryOpNode::clone() const {
     );
 }
 
-std::unique_ptr<ASTNode> UnaryOpNode::clone() const {
+std::unique_ptr<ASTNode> UnaryOpNode::cloneNode() const {
     return std::make_unique<UnaryOpNode>(
         opType,
         operand->clone()
     );
 }
 
-std::unique_ptr<ASTNode> ArrayLiteralNode::clone() const {
+std::unique_ptr<ASTNode> ArrayLiteralNode::cloneNode() const {
     std::vector<std::unique_ptr<ASTNode>> clonedElements;
     for (const auto& element : elements) {
         clonedElements.push_back(element->clone());
@@ -379,14 +762,22 @@ std::unique_ptr<ASTNode> ArrayLiteralNode::clone() const {
     return std::make_unique<ArrayLiteralNode>(std::move(clonedElements));
 }
 
-std::unique_ptr<ASTNode> ArrayAccessNode::clone() const {
+std::unique_ptr<ASTNode> ArrayAccessNode::cloneNode() const {
     return std::make_unique<ArrayAccessNode>(
         array->clone(),
         index->clone()
     );
 }
 
-std::unique_ptr<ASTNode> FunctionCallNode::clone() const {
+std::unique_ptr<ASTNode> SliceNode::cloneNode() const {
+    return std::make_unique<SliceNode>(
+        array->clone(),
+        begin ? begin->clone() : nullptr,
+        end ? end->clone() : nullptr
+    );
+}
+
+std::unique_ptr<ASTNode> FunctionCallNode::cloneNode() const {
     std::vector<std::unique_ptr<ASTNode>> clonedArgs;
     for (const auto& arg : arguments) {
         clonedArgs.push_back(arg->clone());
@@ -394,7 +785,7 @@ std::unique_ptr<ASTNode> FunctionCallNode::clone() const {
     return std::make_unique<FunctionCallNode>(name, std::move(clonedArgs));
 }
 
-std::unique_ptr<ASTNode> BlockNode::clone() const {
+std::unique_ptr<ASTNode> BlockNode::cloneNode() const {
     std::vector<std::unique_ptr<ASTNode>> clonedStatements;
     for (const auto& statement : statements) {
         clonedStatements.push_back(statement->clone());
@@ -402,14 +793,14 @@ std::unique_ptr<ASTNode> BlockNode::clone() const {
     return std::make_unique<BlockNode>(std::move(clonedStatements));
 }
 
-std::unique_ptr<ASTNode> AssignmentNode::clone() const {
+std::unique_ptr<ASTNode> AssignmentNode::cloneNode() const {
     return std::make_unique<AssignmentNode>(
         name,
         expression->clone()
     );
 }
 
-std::unique_ptr<ASTNode> ArrayAssignmentNode::clone() const {
+std::unique_ptr<ASTNode> ArrayAssignmentNode::cloneNode() const {
     return std::make_unique<ArrayAssignmentNode>(
         array->clone(),
         index->clone(),
@@ -417,7 +808,7 @@ std::unique_ptr<ASTNode> ArrayAssignmentNode::clone() const {
     );
 }
 
-std::unique_ptr<ASTNode> IfNode::clone() const {
+std::unique_ptr<ASTNode> IfNode::cloneNode() const {
     std::unique_ptr<ASTNode> clonedElse = nullptr;
     if (elseBranch) {
         clonedElse = elseBranch->clone();
@@ -429,43 +820,66 @@ std::unique_ptr<ASTNode> IfNode::clone() const {
     );
 }
 
-std::unique_ptr<ASTNode> WhileNode::clone() const {
+std::unique_ptr<ASTNode> WhileNode::cloneNode() const {
     return std::make_unique<WhileNode>(
         condition->clone(),
-        body->clone()
+        body->clone(),
+        jitSite
     );
 }
 
-std::unique_ptr<ASTNode> ForNode::clone() const {
+std::unique_ptr<ASTNode> ForNode::cloneNode() const {
     return std::make_unique<ForNode>(
         initialization->clone(),
         condition->clone(),
         increment->clone(),
+        body->clone(),
+        jitSite
+    );
+}
+
+std::unique_ptr<ASTNode> ForEachNode::cloneNode() const {
+    return std::make_unique<ForEachNode>(
+        variable,
+        sequence->clone(),
         body->clone()
     );
 }
 
-std::unique_ptr<ASTNode> FunctionDefNode::clone() const {
+std::unique_ptr<ASTNode> FunctionDefNode::cloneNode() const {
     return std::make_unique<FunctionDefNode>(
         name,
         parameters,
-        body->clone()
+        body->clone(),
+        jitSite
     );
 }
 
-std::unique_ptr<ASTNode> ReturnNode::clone() const {
+std::unique_ptr<ASTNode> CoverageNode::cloneNode() const {
+    return std::make_unique<CoverageNode>(statement->clone(), executions);
+}
+
+std::unique_ptr<ASTNode> ReturnNode::cloneNode() const {
     return std::make_unique<ReturnNode>(expression->clone());
 }
 
-std::unique_ptr<ASTNode> PrintNode::clone() const {
+std::unique_ptr<ASTNode> PrintNode::cloneNode() const {
     return std::make_unique<PrintNode>(expression->clone(), newline);
 }
 
-std::unique_ptr<ASTNode> InputNode::clone() const {
+std::unique_ptr<ASTNode> SpawnNode::cloneNode() const {
+    std::vector<std::unique_ptr<ASTNode>> clonedArgs;
+    for (const auto& arg : arguments) {
+        clonedArgs.push_back(arg->clone());
+    }
+    return std::make_unique<SpawnNode>(name, std::move(clonedArgs));
+}
+
+std::unique_ptr<ASTNode> InputNode::cloneNode() const {
     return std::make_unique<InputNode>();
 }
 
-std::unique_ptr<ASTNode> ProgramNode::clone() const {
+std::unique_ptr<ASTNode> ProgramNode::cloneNode() const {
     std::vector<std::unique_ptr<ASTNode>> clonedStatements;
     for (const auto& statement : statements) {
         clonedStatements.push_back(statement->clone());
@@ -473,4 +887,138 @@ std::unique_ptr<ASTNode> ProgramNode::clone() const {
     return std::make_unique<ProgramNode>(std::move(clonedStatements));
 }
 
+// Effect collection for AST nodes
+void InterpolatedStringNode::collectEffects(Effects& effects) const {
+    for (const auto& expression : expressions) {
+        expression->collectEffects(effects);
+    }
+}
+
+void VariableNode::collectEffects(Effects& effects) const {
+    effects.read.insert(name);
+}
+
+void BinaryOpNode::collectEffects(Effects& effects) const {
+    left->collectEffects(effects);
+    right->collectEffects(effects);
+}
+
+void UnaryOpNode::collectEffects(Effects& effects) const {
+    operand->collectEffects(effects);
+}
+
+void ArrayLiteralNode::collectEffects(Effects& effects) const {
+    for (const auto& element : elements) {
+        element->collectEffects(effects);
+    }
+}
+
+void ArrayAccessNode::collectEffects(Effects& effects) const {
+    array->collectEffects(effects);
+    index->collectEffects(effects);
+}
+
+void SliceNode::collectEffects(Effects& effects) const {
+    array->collectEffects(effects);
+    if (begin) {
+        begin->collectEffects(effects);
+    }
+    if (end) {
+        end->collectEffects(effects);
+    }
+}
+
+void FunctionCallNode::collectEffects(Effects& effects) const {
+    effects.read.insert(name);
+    effects.called.insert(name);
+    for (const auto& argument : arguments) {
+        argument->collectEffects(effects);
+    }
+}
+
+void BlockNode::collectEffects(Effects& effects) const {
+    for (const auto& statement : statements) {
+        statement->collectEffects(effects);
+    }
+}
+
+void AssignmentNode::collectEffects(Effects& effects) const {
+    effects.assigned.insert(name);
+    expression->collectEffects(effects);
+}
+
+void ArrayAssignmentNode::collectEffects(Effects& effects) const {
+    // Writing an element of a named array writes the variable itself
+    if (auto* variable = dynamic_cast<const VariableNode*>(array.get())) {
+        effects.assigned.insert(variable->getName());
+    }
+    array->collectEffects(effects);
+    index->collectEffects(effects);
+    value->collectEffects(effects);
+}
+
+void IfNode::collectEffects(Effects& effects) const {
+    condition->collectEffects(effects);
+    thenBranch->collectEffects(effects);
+    if (elseBranch) {
+        elseBranch->collectEffects(effects);
+    }
+}
+
+void WhileNode::collectEffects(Effects& effects) const {
+    condition->collectEffects(effects);
+    body->collectEffects(effects);
+}
+
+void ForNode::collectEffects(Effects& effects) const {
+    initialization->collectEffects(effects);
+    condition->collectEffects(effects);
+    increment->collectEffects(effects);
+    body->collectEffects(effects);
+}
+
+void ForEachNode::collectEffects(Effects& effects) const {
+    // The loop variable gets a scope of its own, but counting it as assigned is the safe side
+    effects.assigned.insert(variable);
+    sequence->collectEffects(effects);
+    body->collectEffects(effects);
+}
+
+void FunctionDefNode::collectEffects(Effects& effects) const {
+    effects.assigned.insert(name);
+    effects.opaque = true;
+}
+
+void CoverageNode::collectEffects(Effects& effects) const {
+    statement->collectEffects(effects);
+}
+
+void ReturnNode::collectEffects(Effects& effects) const {
+    expression->collectEffects(effects);
+}
+
+void PrintNode::collectEffects(Effects& effects) const {
+    effects.io = true;
+    expression->collectEffects(effects);
+}
+
+void SpawnNode::collectEffects(Effects& effects) const {
+    // Tasks belong to the interpreter's thread
+    effects.read.insert(name);
+    effects.opaque = true;
+    for (const auto& argument : arguments) {
+        argument->collectEffects(effects);
+    }
+}
+
+void InputNode::collectEffects(Effects& effects) const {
+    effects.io = true;
+}
+
+void ProgramNode::collectEffects(Effects& effects) const {
+    for (const auto& statement : statements) {
+        statement->collectEffects(effects);
+    }
+}
+
 } // namespace SimpScript 
\ No newline at end of file
@@ -0,0 +1,194 @@
+#include "Channel.h"
+#include "Interpreter.h"
+#include "Scheduler.h"
+#include <thread>
+
+namespace SimpScript {
+
+// ChannelIterator implementation
+ChannelIterator::ChannelIterator(std::shared_ptr<Channel> channel) : channel(std::move(channel)) {}
+
+bool ChannelIterator::next(Value& out) {
+    return channel->receive(out);
+}
+
+// A value that shares no mutable storage with the sender. Arrays and maps the sender holds
+// the only reference to are reused; shared ones are copied by mutableArray and mutableMap
+static Value transferable(Value value) {
+    switch (value.getType()) {
+        case Value::Type::ARRAY:
+            // Packed numbers are never written in place, so they can be shared as they are
+            if (!value.isPackedArray()) {
+                for (Value& element : value.mutableArray()) {
+                    element = transferable(std::move(element));
+                }
+            }
+            return value;
+        case Value::Type::MAP: {
+            Map& map = value.mutableMap();
+            for (size_t i = 0; i < map.size(); i++) {
+                map.set(map.keyAt(i), transferable(map.valueAt(i)));
+            }
+            return value;
+        }
+        case Value::Type::ITERATOR:
+            throw RuntimeError("Cannot send an iterator to another thread");
+        case Value::Type::FUNCTION:
+        case Value::Type::NATIVE_FUNCTION:
+            throw RuntimeError("Cannot send a function to another thread");
+        case Value::Type::HANDLE:
+            if (!value.asHandle()->threadSafe()) {
+                throw RuntimeError("Cannot send " + value.asHandle()->describe() + " to another thread");
+            }
+            return value;
+        default:
+            return value;
+    }
+}
+
+// SharedChannel implementation
+SharedChannel::SharedChannel(size_t capacity) : queue(capacity) {}
+
+// A side that is about to wait announces itself, then fences and checks the queue once more.
+// The other side fences between changing the queue and looking for waiters, so at least one
+// of them sees the other and no wakeup is lost
+void SharedChannel::wakeSenders() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waitingSenders.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        notFull.notify_one();
+    }
+}
+
+void SharedChannel::wakeReceivers() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waitingReceivers.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        notEmpty.notify_one();
+    }
+}
+
+void SharedChannel::send(Value value) {
+    Value message = transferable(std::move(value));
+    for (int attempt = 0; attempt < spinLimit; attempt++) {
+        if (closed.load(std::memory_order_acquire)) {
+            throw RuntimeError("Cannot send on closed " + describe());
+        }
+        if (queue.tryPush(message)) {
+            wakeReceivers();
+            return;
+        }
+        if (attempt >= spinLimit / 4) {
+            std::this_thread::yield();
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    waitingSenders.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool ran = true;
+    while (!queue.tryPush(message)) {
+        if (closed.load(std::memory_order_acquire)) {
+            waitingSenders.fetch_sub(1, std::memory_order_relaxed);
+            throw RuntimeError("Cannot send on closed " + describe());
+        }
+        if (!Scheduler::hasTasks()) {
+            notFull.wait(lock);
+        } else if (!ran) {
+            notFull.wait_for(lock, retryInterval);
+            ran = true;
+        } else {
+            // Another task may be the receiver, and the lock must not be held while it runs
+            waitingSenders.fetch_sub(1, std::memory_order_relaxed);
+            lock.unlock();
+            ran = Scheduler::runOthers();
+            lock.lock();
+            waitingSenders.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+    waitingSenders.fetch_sub(1, std::memory_order_relaxed);
+    lock.unlock();
+    wakeReceivers();
+}
+
+bool SharedChannel::receive(Value& out) {
+    for (int attempt = 0; attempt < spinLimit; attempt++) {
+        if (tryReceive(out)) {
+            return true;
+        }
+        // Values sent before the channel was closed are still delivered
+        if (closed.load(std::memory_order_acquire)) {
+            return tryReceive(out);
+        }
+        if (attempt >= spinLimit / 4) {
+            std::this_thread::yield();
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    waitingReceivers.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool received;
+    bool ran = true;
+    while (!(received = queue.tryPop(out))) {
+        if (closed.load(std::memory_order_acquire)) {
+            received = queue.tryPop(out);
+            break;
+        }
+        if (!Scheduler::hasTasks()) {
+            notEmpty.wait(lock);
+        } else if (!ran) {
+            notEmpty.wait_for(lock, retryInterval);
+            ran = true;
+        } else {
+            // Another task may be the sender, and the lock must not be held while it runs
+            waitingReceivers.fetch_sub(1, std::memory_order_relaxed);
+            lock.unlock();
+            ran = Scheduler::runOthers();
+            lock.lock();
+            waitingReceivers.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+    waitingReceivers.fetch_sub(1, std::memory_order_relaxed);
+    lock.unlock();
+    if (received) {
+        wakeSenders();
+    }
+    return received;
+}
+
+bool SharedChannel::trySend(Value& value) {
+    if (closed.load(std::memory_order_acquire)) {
+        throw RuntimeError("Cannot send on closed " + describe());
+    }
+    Value message = transferable(std::move(value));
+    if (!queue.tryPush(message)) {
+        value = std::move(message);
+        return false;
+    }
+    wakeReceivers();
+    return true;
+}
+
+bool SharedChannel::tryReceive(Value& out) {
+    if (!queue.tryPop(out)) {
+        return false;
+    }
+    wakeSenders();
+    return true;
+}
+
+std::string SharedChannel::describe() const {
+    return "<shared channel>";
+}
+
+void SharedChannel::close() {
+    closed.store(true, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(mutex);
+    notFull.notify_all();
+    notEmpty.notify_all();
+}
+
+} // namespace SimpScript
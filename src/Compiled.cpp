@@ -0,0 +1,98 @@
+#include "Compiled.h"
+#include "Stream.h"
+#include <iostream>
+
+namespace SimpScript {
+
+int runCompiled(const std::function<void(Interpreter&)>& program) {
+    std::ios::sync_with_stdio(false);
+    try {
+        Interpreter interpreter;
+        program(interpreter);
+    } catch (const RuntimeError& e) {
+        std::cerr << "Runtime error: " << e.what() << std::endl;
+        return 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+Value callFunction(Interpreter& interpreter, Value function, std::vector<Value> arguments) {
+    return function.call(interpreter, arguments);
+}
+
+Value compiledFunction(int arity, std::function<Value(std::vector<Value>&)> function) {
+    // Compiled functions read and assign the program's globals, so they are not pure and
+    // parallel builtins run them on the calling thread
+    return Value(std::static_pointer_cast<Callable>(std::make_shared<NativeFunction>(arity, std::move(function))));
+}
+
+Value interpolate(std::initializer_list<Value> parts) {
+    size_t estimate = 0;
+    for (const Value& part : parts) {
+        estimate += part.formattedLengthHint();
+    }
+    std::string result;
+    result.reserve(estimate);
+    for (const Value& part : parts) {
+        part.appendTo(result);
+    }
+    return Value(std::move(result));
+}
+
+Value readInput(Interpreter& interpreter) {
+    Value line("");
+    interpreter.getInput()->readLine(line);
+    return line;
+}
+
+Value negate(const Value& value) {
+    if (value.isInteger()) {
+        return Value(wrappingNegate(value.asInteger()));
+    } else if (value.isFloat()) {
+        return Value(-value.asFloat());
+    }
+    throw std::runtime_error("Cannot negate non-numeric value");
+}
+
+void undefinedVariable(const std::string& name) {
+    throw std::runtime_error("Undefined variable '" + name + "'");
+}
+
+// ForEachCursor implementation
+ForEachCursor::ForEachCursor(Value items) : items(std::move(items)) {
+    const Value& sequence = this->items;
+    if (sequence.isRange()) {
+        count = sequence.asRange().size();
+    } else if (sequence.isArray() || sequence.isString()) {
+        count = sequence.size();
+    } else if (sequence.isMap()) {
+        count = static_cast<int>(sequence.asMap().size());
+    } else if (!sequence.isIterator()) {
+        throw std::runtime_error("Can only iterate over arrays, maps, strings, ranges and iterators");
+    }
+}
+
+bool ForEachCursor::next(Value& current) {
+    if (items.isIterator()) {
+        return items.asIterator()->next(current);
+    }
+    if (position >= count) {
+        return false;
+    }
+    if (items.isRange()) {
+        current = Value(items.asRange().at(position));
+    } else if (items.isArray()) {
+        current = items.element(position);
+    } else if (items.isMap()) {
+        current = Value(items.asMap().keyAt(static_cast<size_t>(position)));
+    } else {
+        current = items.slice(position, position + 1);
+    }
+    position++;
+    return true;
+}
+
+} // namespace SimpScript
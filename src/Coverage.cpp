@@ -0,0 +1,52 @@
+#include "Coverage.h"
+#include <algorithm>
+#include <iomanip>
+#include <map>
+
+namespace SimpScript {
+
+Coverage* coverage = nullptr;
+
+// Coverage implementation
+Coverage::Coverage(const std::string& script) : script(script) {}
+
+Coverage::Counter* Coverage::counter(int line) {
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.emplace_back(line);
+    return &counters.back();
+}
+
+// Count by line, in line order
+static std::map<int, uint64_t> countsByLine(const std::deque<Coverage::Counter>& counters) {
+    std::map<int, uint64_t> lines;
+    for (const auto& counter : counters) {
+        uint64_t& count = lines[counter.line];
+        count = std::max(count, counter.executions.load(std::memory_order_relaxed));
+    }
+    return lines;
+}
+
+void Coverage::writeLcov(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto lines = countsByLine(counters);
+    size_t hit = 0;
+    out << "TN:\nSF:" << script << "\n";
+    for (const auto& [line, count] : lines) {
+        out << "DA:" << line << "," << count << "\n";
+        if (count > 0) {
+            hit++;
+        }
+    }
+    out << "LH:" << hit << "\nLF:" << lines.size() << "\nend_of_record\n";
+}
+
+void Coverage::summary(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto lines = countsByLine(counters);
+    size_t hit = std::count_if(lines.begin(), lines.end(), [](const auto& entry) { return entry.second > 0; });
+    double percent = lines.empty() ? 100.0 : 100.0 * static_cast<double>(hit) / static_cast<double>(lines.size());
+    out << "Coverage of " << script << ": " << hit << " of " << lines.size() << " lines executed ("
+        << std::fixed << std::setprecision(1) << percent << std::defaultfloat << "%)" << std::endl;
+}
+
+} // namespace SimpScript
@@ -0,0 +1,911 @@
+#include "CppEmitter.h"
+#include "Interpreter.h"
+#include "Environment.h"
+#include "Value.h"
+#include <algorithm>
+#include <iomanip>
+
+namespace SimpScript {
+
+// EmitError implementation
+EmitError::EmitError(const std::string& message) : std::runtime_error(message) {}
+
+// A C++ string literal holding text exactly, embedded nulls included
+static std::string cppString(const std::string& text) {
+    std::ostringstream out;
+    out << "std::string(\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c >= 0x20 && c < 0x7f && c != '?') {
+            out << c;
+        } else {
+            // Three octal digits, so a digit after the escape cannot extend it
+            out << '\\' << std::oct << std::setw(3) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        }
+    }
+    out << "\", " << text.size() << ")";
+    return out.str();
+}
+
+static std::string cppDouble(double value) {
+    std::ostringstream out;
+    out << std::setprecision(17) << value;
+    std::string text = out.str();
+    if (text.find_first_of(".e") == std::string::npos) {
+        text += ".0";
+    }
+    return text;
+}
+
+// CppEmitter implementation
+CppEmitter::CppEmitter(const std::string& script) : script(script), builtinScope(Interpreter().getGlobals()) {}
+
+// Strip the counting wrapper --coverage puts around statements
+const ASTNode* CppEmitter::unwrap(const ASTNode* node) {
+    while (auto* counted = dynamic_cast<const CoverageNode*>(node)) {
+        node = counted->statement.get();
+    }
+    return node;
+}
+
+void CppEmitter::unsupported(const ASTNode* node, const std::string& what) {
+    throw EmitError("--emit-cpp cannot lower " + what + " (line " + std::to_string(node->getLine()) + ")");
+}
+
+std::vector<const ASTNode*> CppEmitter::children(const ASTNode* node) {
+    std::vector<const ASTNode*> result;
+    auto add = [&result](const std::unique_ptr<ASTNode>& child) {
+        if (child) {
+            result.push_back(child.get());
+        }
+    };
+    if (auto* n = dynamic_cast<const InterpolatedStringNode*>(node)) {
+        for (const auto& child : n->expressions) add(child);
+    } else if (auto* n = dynamic_cast<const BinaryOpNode*>(node)) {
+        add(n->left);
+        add(n->right);
+    } else if (auto* n = dynamic_cast<const UnaryOpNode*>(node)) {
+        add(n->operand);
+    } else if (auto* n = dynamic_cast<const ArrayLiteralNode*>(node)) {
+        for (const auto& child : n->elements) add(child);
+    } else if (auto* n = dynamic_cast<const ArrayAccessNode*>(node)) {
+        add(n->array);
+        add(n->index);
+    } else if (auto* n = dynamic_cast<const SliceNode*>(node)) {
+        add(n->array);
+        add(n->begin);
+        add(n->end);
+    } else if (auto* n = dynamic_cast<const FunctionCallNode*>(node)) {
+        for (const auto& child : n->arguments) add(child);
+    } else if (auto* n = dynamic_cast<const BlockNode*>(node)) {
+        for (const auto& child : n->statements) add(child);
+    } else if (auto* n = dynamic_cast<const AssignmentNode*>(node)) {
+        add(n->expression);
+    } else if (auto* n = dynamic_cast<const ArrayAssignmentNode*>(node)) {
+        add(n->index);
+        add(n->value);
+        add(n->array);
+    } else if (auto* n = dynamic_cast<const IfNode*>(node)) {
+        add(n->condition);
+        add(n->thenBranch);
+        add(n->elseBranch);
+    } else if (auto* n = dynamic_cast<const WhileNode*>(node)) {
+        add(n->condition);
+        add(n->body);
+    } else if (auto* n = dynamic_cast<const ForNode*>(node)) {
+        add(n->initialization);
+        add(n->condition);
+        add(n->increment);
+        add(n->body);
+    } else if (auto* n = dynamic_cast<const ForEachNode*>(node)) {
+        add(n->sequence);
+        add(n->body);
+    } else if (auto* n = dynamic_cast<const FunctionDefNode*>(node)) {
+        add(n->body);
+    } else if (auto* n = dynamic_cast<const ReturnNode*>(node)) {
+        add(n->expression);
+    } else if (auto* n = dynamic_cast<const PrintNode*>(node)) {
+        add(n->expression);
+    } else if (auto* n = dynamic_cast<const SpawnNode*>(node)) {
+        for (const auto& child : n->arguments) add(child);
+    } else if (auto* n = dynamic_cast<const CoverageNode*>(node)) {
+        add(n->statement);
+    } else if (auto* n = dynamic_cast<const ProgramNode*>(node)) {
+        for (const auto& child : n->statements) add(child);
+    }
+    return result;
+}
+
+// Whether evaluating node can change anything another expression could see
+bool CppEmitter::effectful(const ASTNode* node) {
+    if (dynamic_cast<const FunctionCallNode*>(node) || dynamic_cast<const InputNode*>(node) ||
+        dynamic_cast<const AssignmentNode*>(node) || dynamic_cast<const ArrayAssignmentNode*>(node) ||
+        dynamic_cast<const PrintNode*>(node)) {
+        return true;
+    }
+    for (const ASTNode* child : children(node)) {
+        if (effectful(child)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+CppEmitter::Variable* CppEmitter::addVariable(Scope& scope, const std::string& name, const std::string& cppName) {
+    scope.variables.push_back(std::make_unique<Variable>());
+    Variable* variable = scope.variables.back().get();
+    variable->name = name;
+    variable->cppName = cppName;
+    return variable;
+}
+
+// The builtin of that name, or nullptr
+const Value* CppEmitter::builtinValue(const std::string& name) const {
+    return builtinScope->lookup(name);
+}
+
+// Give every name assigned in the scope a variable. A function's assignments go to its
+// parameters, then the globals, then its own locals
+void CppEmitter::collectAssignments(const ASTNode* node, Scope& scope) {
+    if (auto* definition = dynamic_cast<const FunctionDefNode*>(node)) {
+        if (scope.function != nullptr) {
+            unsupported(node, "function '" + definition->name + "' defined inside another function");
+        }
+        auto it = functions.find(definition->name);
+        if (it == functions.end() || it->second != definition) {
+            unsupported(node, "function '" + definition->name + "' defined inside a block");
+        }
+        return;
+    }
+    if (auto* assignment = dynamic_cast<const AssignmentNode*>(node)) {
+        const std::string& name = assignment->name;
+        if (functions.count(name) != 0) {
+            unsupported(node, "assignment to function '" + name + "'");
+        }
+        if (scope.names.count(name) == 0 && (scope.function == nullptr || globals->names.count(name) == 0)) {
+            std::string prefix = scope.function == nullptr ? "g_" : "l_";
+            scope.names[name] = addVariable(scope, name, prefix + name);
+        }
+    }
+    for (const ASTNode* child : children(node)) {
+        collectAssignments(child, scope);
+    }
+}
+
+CppEmitter::Binding CppEmitter::resolve(const std::string& name, Scope& scope, const std::vector<Variable*>& loops) {
+    for (auto it = loops.rbegin(); it != loops.rend(); ++it) {
+        if ((*it)->name == name) {
+            return Binding{Binding::Kind::VARIABLE, *it, nullptr};
+        }
+    }
+    auto local = scope.names.find(name);
+    if (local != scope.names.end()) {
+        return Binding{Binding::Kind::VARIABLE, local->second, nullptr};
+    }
+    auto global = globals->names.find(name);
+    if (global != globals->names.end()) {
+        return Binding{Binding::Kind::VARIABLE, global->second, nullptr};
+    }
+    auto function = functions.find(name);
+    if (function != functions.end()) {
+        return Binding{Binding::Kind::FUNCTION, nullptr, function->second};
+    }
+    if (builtinValue(name) != nullptr) {
+        return Binding{Binding::Kind::BUILTIN, nullptr, nullptr};
+    }
+    return Binding{Binding::Kind::UNDEFINED, nullptr, nullptr};
+}
+
+// Bind the names node uses, and note what each variable is assigned
+void CppEmitter::collect(const ASTNode* node, Scope& scope, std::vector<Variable*>& loops) {
+    if (dynamic_cast<const RegexLiteralNode*>(node)) {
+        unsupported(node, "a regex literal");
+    }
+    if (dynamic_cast<const SpawnNode*>(node)) {
+        unsupported(node, "spawn");
+    }
+    if (auto* variable = dynamic_cast<const VariableNode*>(node)) {
+        bindings[node] = resolve(variable->name, scope, loops);
+    } else if (auto* call = dynamic_cast<const FunctionCallNode*>(node)) {
+        bindings[node] = resolve(call->name, scope, loops);
+    } else if (auto* assignment = dynamic_cast<const AssignmentNode*>(node)) {
+        Binding binding = resolve(assignment->name, scope, loops);
+        binding.variable->assigned.push_back(assignment->expression.get());
+        bindings[node] = binding;
+    } else if (auto* element = dynamic_cast<const ArrayAssignmentNode*>(node)) {
+        if (!dynamic_cast<const VariableNode*>(element->array.get())) {
+            unsupported(node, "assignment into an element of a temporary");
+        }
+    } else if (auto* loop = dynamic_cast<const ForEachNode*>(node)) {
+        collect(loop->sequence.get(), scope, loops);
+
+        Variable* variable = addVariable(scope, loop->variable, "k" + std::to_string(++loopCount) + "_" + loop->variable);
+        variable->loop = true;
+        auto* sequence = dynamic_cast<const FunctionCallNode*>(loop->sequence.get());
+        bool range = sequence != nullptr && sequence->name == "range" &&
+                     bindings[sequence].kind == Binding::Kind::BUILTIN;
+        variable->seed = range ? Type::INT : Type::VALUE;
+        bindings[node] = Binding{Binding::Kind::VARIABLE, variable, nullptr};
+
+        loops.push_back(variable);
+        collect(loop->body.get(), scope, loops);
+        loops.pop_back();
+        return;
+    }
+    for (const ASTNode* child : children(node)) {
+        collect(child, scope, loops);
+    }
+}
+
+CppEmitter::Type CppEmitter::join(Type a, Type b) {
+    if (a == Type::NONE) {
+        return b;
+    }
+    if (b == Type::NONE || a == b) {
+        return a;
+    }
+    return Type::VALUE;
+}
+
+static bool numeric(int type) {
+    return type == 1 || type == 2;
+}
+
+CppEmitter::Type CppEmitter::typeOf(const ASTNode* node) const {
+    node = unwrap(node);
+    if (auto* literal = dynamic_cast<const LiteralNode*>(node)) {
+        if (std::holds_alternative<int>(literal->value)) return Type::INT;
+        if (std::holds_alternative<double>(literal->value)) return Type::FLOAT;
+        if (std::holds_alternative<bool>(literal->value)) return Type::BOOL;
+        return Type::VALUE;
+    }
+    if (dynamic_cast<const VariableNode*>(node)) {
+        const Binding& binding = bindings.at(node);
+        if (binding.kind == Binding::Kind::VARIABLE) {
+            return binding.variable->type;
+        }
+        return Type::VALUE;
+    }
+    if (dynamic_cast<const AssignmentNode*>(node) != nullptr) {
+        return bindings.at(node).variable->type;
+    }
+    if (auto* unary = dynamic_cast<const UnaryOpNode*>(node)) {
+        if (unary->opType == UnaryOpNode::OpType::NOT) {
+            return Type::BOOL;
+        }
+        Type operand = typeOf(unary->operand.get());
+        return operand == Type::NONE || numeric(static_cast<int>(operand)) ? operand : Type::VALUE;
+    }
+    if (auto* binary = dynamic_cast<const BinaryOpNode*>(node)) {
+        using Op = BinaryOpNode::OpType;
+        Type left = typeOf(binary->left.get());
+        Type right = typeOf(binary->right.get());
+        switch (binary->opType) {
+            case Op::EQ: case Op::NEQ: case Op::GT: case Op::LT: case Op::GTE: case Op::LTE:
+            case Op::AND: case Op::OR:
+                return Type::BOOL;
+            default:
+                break;
+        }
+        if (left == Type::NONE || right == Type::NONE) {
+            return Type::NONE;
+        }
+        if (binary->opType == Op::MOD) {
+            return left == Type::INT && right == Type::INT ? Type::INT : Type::VALUE;
+        }
+        if (numeric(static_cast<int>(left)) && numeric(static_cast<int>(right))) {
+            return left == Type::INT && right == Type::INT ? Type::INT : Type::FLOAT;
+        }
+        return Type::VALUE;
+    }
+    return Type::VALUE;
+}
+
+// Each variable holds the join of its seed and everything assigned to it. Variables start
+// with nothing and widen until nothing changes; any still with nothing are boxed, and the
+// rest widen again around them
+void CppEmitter::inferTypes() {
+    std::vector<Variable*> all;
+    for (const auto& scope : scopes) {
+        for (const auto& variable : scope->variables) {
+            all.push_back(variable.get());
+        }
+    }
+    while (true) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (Variable* variable : all) {
+                Type type = variable->seed;
+                for (const ASTNode* expression : variable->assigned) {
+                    type = join(type, typeOf(expression));
+                }
+                type = join(type, variable->type);
+                if (type != variable->type) {
+                    variable->type = type;
+                    changed = true;
+                }
+            }
+        }
+        bool boxed = false;
+        for (Variable* variable : all) {
+            if (variable->type == Type::NONE) {
+                variable->type = Type::VALUE;
+                boxed = true;
+            }
+        }
+        if (!boxed) {
+            return;
+        }
+    }
+}
+
+std::string CppEmitter::cppType(Type type) {
+    switch (type) {
+        case Type::INT:
+            return "int";
+        case Type::FLOAT:
+            return "double";
+        case Type::BOOL:
+            return "bool";
+        default:
+            return "Value";
+    }
+}
+
+std::string CppEmitter::initialValue(Type type) {
+    switch (type) {
+        case Type::INT:
+            return " = 0";
+        case Type::FLOAT:
+            return " = 0.0";
+        case Type::BOOL:
+            return " = false";
+        default:
+            return "";
+    }
+}
+
+std::string CppEmitter::box(const Code& code) {
+    return code.type == Type::VALUE ? code.text : "Value(" + code.text + ")";
+}
+
+std::string CppEmitter::truth(const Code& code) {
+    switch (code.type) {
+        case Type::INT:
+            return "(" + code.text + " != 0)";
+        case Type::FLOAT:
+            return "(" + code.text + " != 0.0)";
+        case Type::BOOL:
+            return code.text;
+        default:
+            return code.text + ".isTruthy()";
+    }
+}
+
+std::string CppEmitter::convert(const Code& code, Type type) {
+    if (code.type == type) {
+        return code.text;
+    }
+    if (type == Type::VALUE) {
+        return box(code);
+    }
+    throw EmitError("--emit-cpp inferred conflicting types");
+}
+
+std::string CppEmitter::literal(const std::string& text) {
+    literals.push_back(cppString(text));
+    return "s_" + std::to_string(literals.size() - 1);
+}
+
+std::string CppEmitter::builtin(const std::string& name) {
+    if (std::find(builtins.begin(), builtins.end(), name) == builtins.end()) {
+        builtins.push_back(name);
+    }
+    return "b_" + name;
+}
+
+// Operands are evaluated left to right, as the interpreter does. C++ leaves the order of
+// function arguments and most operands open, so when a later operand has effects an earlier
+// one could see, they are evaluated into temporaries first
+std::string CppEmitter::sequence(const std::vector<const ASTNode*>& operands, const std::vector<std::string>& texts,
+                                 const std::function<std::string(const std::vector<std::string>&)>& build) {
+    size_t variable = 0;
+    bool later = false;
+    for (size_t i = 0; i < operands.size(); i++) {
+        if (!dynamic_cast<const LiteralNode*>(unwrap(operands[i]))) {
+            variable++;
+        }
+        later = later || (i > 0 && effectful(operands[i]));
+    }
+    if (variable < 2 || !later) {
+        return build(texts);
+    }
+    std::string text = "[&]() { ";
+    std::vector<std::string> temporaries;
+    for (size_t i = 0; i < texts.size(); i++) {
+        temporaries.push_back("t" + std::to_string(i));
+        text += "auto " + temporaries.back() + " = " + texts[i] + "; ";
+    }
+    return text + "return " + build(temporaries) + "; }()";
+}
+
+CppEmitter::Code CppEmitter::assignment(const Variable& variable, const Code& value) {
+    return Code{"(" + variable.cppName + " = " + convert(value, variable.type) + ")", variable.type};
+}
+
+CppEmitter::Code CppEmitter::binary(const BinaryOpNode* node) {
+    using Op = BinaryOpNode::OpType;
+    Code left = expression(node->left.get());
+    Code right = expression(node->right.get());
+    std::vector<const ASTNode*> operands{node->left.get(), node->right.get()};
+    bool numbers = numeric(static_cast<int>(left.type)) && numeric(static_cast<int>(right.type));
+    bool integers = left.type == Type::INT && right.type == Type::INT;
+
+    auto infix = [&](const std::string& op, Type type, bool boxed) {
+        std::vector<std::string> texts{boxed ? box(left) : left.text, boxed ? box(right) : right.text};
+        return Code{sequence(operands, texts, [&op](const std::vector<std::string>& t) {
+            return "(" + t[0] + " " + op + " " + t[1] + ")";
+        }), type};
+    };
+    auto helper = [&](const std::string& function, Type type) {
+        return Code{sequence(operands, {left.text, right.text}, [&function](const std::vector<std::string>& t) {
+            return function + "(" + t[0] + ", " + t[1] + ")";
+        }), type};
+    };
+    // a > b and a >= b as the interpreter defines them, as !(a <= b) and !(a < b), which differ
+    // from > and >= for NaN
+    auto negated = [&](const std::string& op, bool boxed) {
+        std::vector<std::string> texts{boxed ? box(left) : left.text, boxed ? box(right) : right.text};
+        return Code{sequence(operands, texts, [&op](const std::vector<std::string>& t) {
+            return "!(" + t[0] + " " + op + " " + t[1] + ")";
+        }), Type::BOOL};
+    };
+
+    Type arithmetic = integers ? Type::INT : Type::FLOAT;
+    switch (node->opType) {
+        // Integer arithmetic wraps on overflow, as in the interpreter
+        case Op::ADD:
+            if (integers) return helper("wrappingAdd", Type::INT);
+            return numbers ? infix("+", arithmetic, false) : infix("+", Type::VALUE, true);
+        case Op::SUB:
+            if (integers) return helper("wrappingSub", Type::INT);
+            return numbers ? infix("-", arithmetic, false) : infix("-", Type::VALUE, true);
+        case Op::MUL:
+            if (integers) return helper("wrappingMul", Type::INT);
+            return numbers ? infix("*", arithmetic, false) : infix("*", Type::VALUE, true);
+        case Op::DIV:
+            if (integers) return helper("divideIntegers", Type::INT);
+            return numbers ? helper("divideFloats", Type::FLOAT) : infix("/", Type::VALUE, true);
+        case Op::MOD:
+            return integers ? helper("moduloIntegers", Type::INT) : infix("%", Type::VALUE, true);
+        case Op::EQ:
+            return infix("==", Type::BOOL, !(numbers || (left.type == Type::BOOL && right.type == Type::BOOL)));
+        case Op::NEQ:
+            return infix("!=", Type::BOOL, !(numbers || (left.type == Type::BOOL && right.type == Type::BOOL)));
+        case Op::LT:
+            return infix("<", Type::BOOL, !numbers);
+        case Op::LTE:
+            return infix("<=", Type::BOOL, !numbers);
+        case Op::GT:
+            return integers ? infix(">", Type::BOOL, false) : negated("<=", !numbers);
+        case Op::GTE:
+            return integers ? infix(">=", Type::BOOL, false) : negated("<", !numbers);
+        case Op::AND:
+        case Op::OR: {
+            // Both sides are evaluated, so & and | rather than && and ||
+            std::string op = node->opType == Op::AND ? "&" : "|";
+            return Code{sequence(operands, {truth(left), truth(right)}, [&op](const std::vector<std::string>& t) {
+                return "static_cast<bool>(" + t[0] + " " + op + " " + t[1] + ")";
+            }), Type::BOOL};
+        }
+    }
+    throw EmitError("--emit-cpp found an unknown binary operator");
+}
+
+CppEmitter::Code CppEmitter::call(const FunctionCallNode* node) {
+    std::vector<const ASTNode*> operands;
+    std::vector<std::string> arguments;
+    for (const auto& argument : node->arguments) {
+        operands.push_back(argument.get());
+        arguments.push_back(box(expression(argument.get())));
+    }
+    auto list = [](const std::vector<std::string>& texts) {
+        std::string text;
+        for (size_t i = 0; i < texts.size(); i++) {
+            text += (i > 0 ? ", " : "") + texts[i];
+        }
+        return text;
+    };
+
+    const Binding& binding = bindings.at(node);
+    std::string function;
+    switch (binding.kind) {
+        case Binding::Kind::UNDEFINED:
+            return Code{"(undefinedVariable(\"" + node->name + "\"), Value())", Type::VALUE};
+        case Binding::Kind::VARIABLE:
+            function = box(Code{binding.variable->cppName, binding.variable->type});
+            break;
+        case Binding::Kind::BUILTIN:
+            function = builtin(node->name);
+            break;
+        case Binding::Kind::FUNCTION:
+            if (binding.function->parameters.size() == arguments.size()) {
+                // A direct call; the arity check the interpreter makes has passed
+                std::string name = "f_" + node->name;
+                return Code{sequence(operands, arguments, [&name, &list](const std::vector<std::string>& t) {
+                    return name + "(" + list(t) + ")";
+                }), Type::VALUE};
+            }
+            // Through the function value, which reports the wrong number of arguments
+            if (std::find(functionValues.begin(), functionValues.end(), node->name) == functionValues.end()) {
+                functionValues.push_back(node->name);
+            }
+            function = "fv_" + node->name;
+            break;
+    }
+    // A braced list is evaluated left to right
+    return Code{"callFunction(*interpreter, " + function + ", {" + list(arguments) + "})", Type::VALUE};
+}
+
+CppEmitter::Code CppEmitter::expression(const ASTNode* node) {
+    node = unwrap(node);
+    if (auto* literal = dynamic_cast<const LiteralNode*>(node)) {
+        if (std::holds_alternative<int>(literal->value)) {
+            return Code{std::to_string(std::get<int>(literal->value)), Type::INT};
+        } else if (std::holds_alternative<double>(literal->value)) {
+            return Code{cppDouble(std::get<double>(literal->value)), Type::FLOAT};
+        } else if (std::holds_alternative<bool>(literal->value)) {
+            return Code{std::get<bool>(literal->value) ? "true" : "false", Type::BOOL};
+        }
+        return Code{this->literal(std::get<std::string>(literal->value)), Type::VALUE};
+    }
+    if (auto* interpolated = dynamic_cast<const InterpolatedStringNode*>(node)) {
+        std::string text = "interpolate({";
+        bool first = true;
+        auto part = [&text, &first](const std::string& code) {
+            text += (first ? "" : ", ") + code;
+            first = false;
+        };
+        for (size_t i = 0; i < interpolated->literals.size(); i++) {
+            if (!interpolated->literals[i].empty()) {
+                part(this->literal(interpolated->literals[i]));
+            }
+            if (i < interpolated->expressions.size()) {
+                part(box(expression(interpolated->expressions[i].get())));
+            }
+        }
+        return Code{text + "})", Type::VALUE};
+    }
+    if (auto* variable = dynamic_cast<const VariableNode*>(node)) {
+        const Binding& binding = bindings.at(node);
+        switch (binding.kind) {
+            case Binding::Kind::VARIABLE:
+                return Code{binding.variable->cppName, binding.variable->type};
+            case Binding::Kind::FUNCTION:
+                if (std::find(functionValues.begin(), functionValues.end(), variable->name) == functionValues.end()) {
+                    functionValues.push_back(variable->name);
+                }
+                return Code{"fv_" + variable->name, Type::VALUE};
+            case Binding::Kind::BUILTIN:
+                return Code{builtin(variable->name), Type::VALUE};
+            case Binding::Kind::UNDEFINED:
+                return Code{"(undefinedVariable(\"" + variable->name + "\"), Value())", Type::VALUE};
+        }
+    }
+    if (auto* binaryNode = dynamic_cast<const BinaryOpNode*>(node)) {
+        return binary(binaryNode);
+    }
+    if (auto* unary = dynamic_cast<const UnaryOpNode*>(node)) {
+        Code operand = expression(unary->operand.get());
+        if (unary->opType == UnaryOpNode::OpType::NOT) {
+            return Code{"!" + truth(operand), Type::BOOL};
+        }
+        if (operand.type == Type::INT) {
+            return Code{"wrappingNegate(" + operand.text + ")", Type::INT};
+        }
+        if (numeric(static_cast<int>(operand.type))) {
+            return Code{"(-" + operand.text + ")", operand.type};
+        }
+        return Code{"negate(" + box(operand) + ")", Type::VALUE};
+    }
+    if (auto* array = dynamic_cast<const ArrayLiteralNode*>(node)) {
+        std::string text = "Value(std::vector<Value>{";
+        for (size_t i = 0; i < array->elements.size(); i++) {
+            text += (i > 0 ? ", " : "") + box(expression(array->elements[i].get()));
+        }
+        return Code{text + "})", Type::VALUE};
+    }
+    if (auto* access = dynamic_cast<const ArrayAccessNode*>(node)) {
+        std::vector<const ASTNode*> operands{access->array.get(), access->index.get()};
+        std::vector<std::string> texts{box(expression(access->array.get())), box(expression(access->index.get()))};
+        return Code{sequence(operands, texts, [](const std::vector<std::string>& t) {
+            return "ArrayAccessNode::access(" + t[0] + ", " + t[1] + ")";
+        }), Type::VALUE};
+    }
+    if (auto* slice = dynamic_cast<const SliceNode*>(node)) {
+        // The bounds are passed by address, so they always go through temporaries
+        std::string text = "[&]() { Value t0 = " + box(expression(slice->array.get())) + "; ";
+        std::string begin = "nullptr";
+        std::string end = "nullptr";
+        if (slice->begin) {
+            text += "Value t1 = " + box(expression(slice->begin.get())) + "; ";
+            begin = "&t1";
+        }
+        if (slice->end) {
+            text += "Value t2 = " + box(expression(slice->end.get())) + "; ";
+            end = "&t2";
+        }
+        return Code{text + "return SliceNode::slice(t0, " + begin + ", " + end + "); }()", Type::VALUE};
+    }
+    if (auto* callNode = dynamic_cast<const FunctionCallNode*>(node)) {
+        return call(callNode);
+    }
+    if (auto* assign = dynamic_cast<const AssignmentNode*>(node)) {
+        return assignment(*bindings.at(node).variable, expression(assign->expression.get()));
+    }
+    if (auto* element = dynamic_cast<const ArrayAssignmentNode*>(node)) {
+        std::string text = "[&]() { Value t0 = " + box(expression(element->index.get())) + "; Value t1 = " +
+                           box(expression(element->value.get())) + "; ";
+        const Binding& binding = bindings.at(element->array.get());
+        Code target = expression(element->array.get());
+        if (binding.kind == Binding::Kind::VARIABLE && target.type == Type::VALUE) {
+            text += "ArrayAssignmentNode::assign(" + target.text + ", t0, t1); ";
+        } else {
+            // Not an array or map, so this reports the error the interpreter would
+            text += "Value t2 = " + box(target) + "; ArrayAssignmentNode::assign(t2, t0, t1); ";
+        }
+        return Code{text + "return t1; }()", Type::VALUE};
+    }
+    if (dynamic_cast<const InputNode*>(node)) {
+        return Code{"readInput(*interpreter)", Type::VALUE};
+    }
+    unsupported(node, "this statement inside an expression");
+}
+
+void CppEmitter::statement(std::ostringstream& out, const ASTNode* node, const std::string& indent,
+                           const std::string& result) {
+    node = unwrap(node);
+    std::string inner = indent + "    ";
+    auto clear = [&]() {
+        if (!result.empty()) {
+            out << indent << result << " = Value();\n";
+        }
+    };
+
+    if (auto* block = dynamic_cast<const BlockNode*>(node)) {
+        // A block's value is that of its last statement
+        for (size_t i = 0; i < block->statements.size(); i++) {
+            statement(out, block->statements[i].get(), indent, i + 1 == block->statements.size() ? result : "");
+        }
+        if (block->statements.empty()) {
+            clear();
+        }
+    } else if (auto* branch = dynamic_cast<const IfNode*>(node)) {
+        out << indent << "if (" << truth(expression(branch->condition.get())) << ") {\n";
+        statement(out, branch->thenBranch.get(), inner, result);
+        if (branch->elseBranch) {
+            out << indent << "} else {\n";
+            statement(out, branch->elseBranch.get(), inner, result);
+        } else if (!result.empty()) {
+            out << indent << "} else {\n" << inner << result << " = Value();\n";
+        }
+        out << indent << "}\n";
+    } else if (auto* loop = dynamic_cast<const WhileNode*>(node)) {
+        clear();
+        out << indent << "while (" << truth(expression(loop->condition.get())) << ") {\n";
+        statement(out, loop->body.get(), inner, result);
+        out << indent << "}\n";
+    } else if (auto* loop = dynamic_cast<const ForNode*>(node)) {
+        clear();
+        out << indent << "(void)" << expression(loop->initialization.get()).text << ";\n";
+        out << indent << "while (" << truth(expression(loop->condition.get())) << ") {\n";
+        statement(out, loop->body.get(), inner, result);
+        out << inner << "(void)" << expression(loop->increment.get()).text << ";\n";
+        out << indent << "}\n";
+    } else if (auto* loop = dynamic_cast<const ForEachNode*>(node)) {
+        clear();
+        const Variable& variable = *bindings.at(node).variable;
+        std::string id = variable.cppName.substr(1, variable.cppName.find('_') - 1);
+        Code sequence = expression(loop->sequence.get());
+        out << indent << "{\n";
+        if (variable.seed == Type::INT) {
+            // A range, counted through without making a Value for each element
+            out << inner << "Range r" << id << " = " << sequence.text << ".asRange();\n";
+            out << inner << "long long e" << id << " = r" << id << ".start;\n";
+            out << inner << "for (int i" << id << " = 0, n" << id << " = r" << id << ".size(); i" << id << " < n"
+                << id << "; i" << id << "++) {\n";
+            out << inner << "    " << variable.cppName << " = "
+                << convert(Code{"static_cast<int>(e" + id + ")", Type::INT}, variable.type) << ";\n";
+            statement(out, loop->body.get(), inner + "    ", result);
+            out << inner << "    e" << id << " += r" << id << ".step;\n";
+            out << inner << "}\n";
+        } else {
+            out << inner << "ForEachCursor c" << id << "(" << box(sequence) << ");\n";
+            out << inner << "while (c" << id << ".next(" << variable.cppName << ")) {\n";
+            statement(out, loop->body.get(), inner + "    ", result);
+            out << inner << "}\n";
+        }
+        out << indent << "}\n";
+    } else if (dynamic_cast<const FunctionDefNode*>(node)) {
+        // Lowered on its own, ahead of the program
+        clear();
+    } else if (auto* returnNode = dynamic_cast<const ReturnNode*>(node)) {
+        Code value = expression(returnNode->expression.get());
+        if (currentFunction != nullptr) {
+            out << indent << "return " << box(value) << ";\n";
+        } else {
+            // A return outside any function ends the program
+            out << indent << "(void)" << value.text << ";\n" << indent << "return;\n";
+        }
+    } else if (auto* print = dynamic_cast<const PrintNode*>(node)) {
+        std::string value = box(expression(print->expression.get()));
+        if (!result.empty()) {
+            out << indent << result << " = " << value << ";\n";
+            value = result;
+        }
+        out << indent << "PrintNode::write(interpreter->getOutput(), " << value << ", "
+            << (print->newline ? "true" : "false") << ");\n";
+    } else {
+        Code value = expression(node);
+        if (!result.empty()) {
+            out << indent << result << " = " << box(value) << ";\n";
+        } else {
+            out << indent << (effectful(node) ? "" : "(void)") << value.text << ";\n";
+        }
+    }
+}
+
+void CppEmitter::function(std::ostringstream& out, const FunctionDefNode* node) {
+    currentFunction = node;
+    Scope* scope = nullptr;
+    for (const auto& candidate : scopes) {
+        if (candidate->function == node) {
+            scope = candidate.get();
+        }
+    }
+
+    out << "Value f_" << node->name << "(";
+    for (size_t i = 0; i < node->parameters.size(); i++) {
+        out << (i > 0 ? ", " : "") << "Value " << scope->names.at(node->parameters[i])->cppName;
+    }
+    out << ") {\n";
+    for (const auto& variable : scope->variables) {
+        bool parameter = std::find(node->parameters.begin(), node->parameters.end(), variable->name) !=
+                         node->parameters.end() && !variable->loop;
+        if (!parameter) {
+            out << "    " << cppType(variable->type) << " " << variable->cppName << initialValue(variable->type) << ";\n";
+        }
+    }
+    // Without a return, a function's value is that of the last statement it ran
+    out << "    Value result;\n";
+    statement(out, node->body.get(), "    ", "result");
+    out << "    return result;\n}\n\n";
+    currentFunction = nullptr;
+}
+
+void CppEmitter::emit(const ASTNode& root, std::ostream& out) {
+    auto* program = dynamic_cast<const ProgramNode*>(&root);
+    if (program == nullptr) {
+        throw EmitError("--emit-cpp expects a whole program");
+    }
+
+    // Functions are defined at the top level and visible everywhere
+    for (const auto& node : program->statements) {
+        if (auto* definition = dynamic_cast<const FunctionDefNode*>(unwrap(node.get()))) {
+            if (functions.count(definition->name) != 0) {
+                unsupported(definition, "a second definition of function '" + definition->name + "'");
+            }
+            functions[definition->name] = definition;
+            functionOrder.push_back(definition);
+        }
+    }
+
+    scopes.push_back(std::make_unique<Scope>());
+    globals = scopes.back().get();
+    for (const auto& node : program->statements) {
+        collectAssignments(node.get(), *globals);
+    }
+    for (const FunctionDefNode* definition : functionOrder) {
+        scopes.push_back(std::make_unique<Scope>());
+        Scope& scope = *scopes.back();
+        scope.function = definition;
+        for (const std::string& parameter : definition->parameters) {
+            if (scope.names.count(parameter) == 0) {
+                Variable* variable = addVariable(scope, parameter, "l_" + parameter);
+                variable->seed = Type::VALUE;
+                scope.names[parameter] = variable;
+            }
+        }
+        collectAssignments(definition->body.get(), scope);
+    }
+
+    std::vector<Variable*> loops;
+    for (const auto& node : program->statements) {
+        if (!dynamic_cast<const FunctionDefNode*>(unwrap(node.get()))) {
+            collect(node.get(), *globals, loops);
+        }
+    }
+    for (size_t i = 1; i < scopes.size(); i++) {
+        collect(scopes[i]->function->body.get(), *scopes[i], loops);
+    }
+    inferTypes();
+
+    // Lower the functions and the program first, which finds the literals and builtins they use
+    std::ostringstream code;
+    for (const FunctionDefNode* definition : functionOrder) {
+        function(code, definition);
+    }
+    code << "void program() {\n";
+    for (const auto& variable : globals->variables) {
+        if (variable->loop) {
+            code << "    " << cppType(variable->type) << " " << variable->cppName << initialValue(variable->type) << ";\n";
+        }
+    }
+    for (const auto& node : program->statements) {
+        statement(code, node.get(), "    ", "");
+    }
+    code << "}\n";
+
+    out << "// Generated by simpscript --emit-cpp from " << script << ". Build it against libsimpscript:\n"
+        << "//   g++ -std=c++17 -O2 -I<simpscript>/include program.cpp -L<build> -lsimpscript -pthread\n"
+        << "#include \"Compiled.h\"\n\n"
+        << "using namespace SimpScript;\n\n"
+        << "namespace {\n\n"
+        << "Interpreter* interpreter;\n";
+
+    if (!builtins.empty()) {
+        out << "\n// Builtins\n";
+        for (const std::string& name : builtins) {
+            out << "Value b_" << name << ";\n";
+        }
+    }
+    if (!literals.empty()) {
+        out << "\n// String literals\n";
+        for (size_t i = 0; i < literals.size(); i++) {
+            out << "const Value s_" << i << "(" << literals[i] << ");\n";
+        }
+    }
+    out << "\n// Globals\n";
+    for (const auto& variable : globals->variables) {
+        if (!variable->loop) {
+            out << cppType(variable->type) << " " << variable->cppName << initialValue(variable->type) << ";\n";
+        }
+    }
+    if (!functionOrder.empty()) {
+        out << "\n// Functions, and their values where they are passed around\n";
+        for (const FunctionDefNode* definition : functionOrder) {
+            out << "Value f_" << definition->name << "(";
+            for (size_t i = 0; i < definition->parameters.size(); i++) {
+                out << (i > 0 ? ", " : "") << "Value";
+            }
+            out << ");\n";
+        }
+        for (const std::string& name : functionValues) {
+            out << "Value fv_" << name << ";\n";
+        }
+    }
+    out << "\n" << code.str() << "\n} // namespace\n\n";
+
+    out << "int main() {\n"
+        << "    return runCompiled([](Interpreter& running) {\n"
+        << "        interpreter = &running;\n";
+    for (const std::string& name : builtins) {
+        out << "        b_" << name << " = running.getEnvironment()->get(" << cppString(name) << ");\n";
+    }
+    for (const std::string& name : functionValues) {
+        const FunctionDefNode* definition = functions.at(name);
+        out << "        fv_" << name << " = compiledFunction(" << definition->parameters.size()
+            << ", [](std::vector<Value>& arguments) { return f_" << name << "(";
+        for (size_t i = 0; i < definition->parameters.size(); i++) {
+            out << (i > 0 ? ", " : "") << "arguments[" << i << "]";
+        }
+        out << "); });\n";
+    }
+    out << "        program();\n"
+        << "    });\n"
+        << "}\n";
+}
+
+} // namespace SimpScript
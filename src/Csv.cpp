@@ -0,0 +1,296 @@
+#include "Csv.h"
+#include "Interpreter.h"
+#include "Stream.h"
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__PCLMUL__)
+#include <wmmintrin.h>
+#endif
+
+namespace SimpScript {
+
+// Bitmask of the bytes in a 64-byte block equal to c
+static inline uint64_t matchMask(const char* block, char c) {
+#if defined(__SSE2__)
+    const __m128i needle = _mm_set1_epi8(c);
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16));
+        uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle)));
+        mask |= static_cast<uint64_t>(bits) << (i * 16);
+    }
+    return mask;
+#else
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i++) {
+        mask |= static_cast<uint64_t>(block[i] == c) << i;
+    }
+    return mask;
+#endif
+}
+
+// Each bit becomes the XOR of itself and all lower bits, so the bits between
+// an opening and a closing quote are set
+static inline uint64_t prefixXor(uint64_t bits) {
+#if defined(__PCLMUL__)
+    __m128i product = _mm_clmulepi64_si128(_mm_set_epi64x(0, static_cast<long long>(bits)),
+                                           _mm_set1_epi8(static_cast<char>(0xFF)), 0);
+    return static_cast<uint64_t>(_mm_cvtsi128_si64(product));
+#else
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+#endif
+}
+
+// CsvReader implementation
+CsvReader::CsvReader(const Value& text, char delimiter) : delimiter(delimiter) {
+    setText(text);
+}
+
+CsvReader::CsvReader(std::shared_ptr<InputStream> source, char delimiter)
+    : delimiter(delimiter), source(std::move(source)) {}
+
+void CsvReader::setText(const Value& text) {
+    std::string_view view = text.asStringView();
+    // Share ownership of the text through an empty slice of it
+    Value keepAlive = text.slice(0, 0);
+    data = std::shared_ptr<const char>(std::make_shared<Value>(keepAlive), view.data());
+    size = view.size();
+    position = 0;
+}
+
+void CsvReader::readMore() {
+    size_t tail = size - position;
+    Value chunk;
+    if (!source->readChunk(chunk)) {
+        source.reset();
+        return;
+    }
+    if (tail == 0) {
+        setText(chunk);
+        return;
+    }
+
+    // Growing by at least the unread part keeps rescanning a long partial table linear
+    std::string text(data.get() + position, tail);
+    text.append(chunk.asStringView());
+    while (text.size() < 2 * tail) {
+        if (!source->readChunk(chunk)) {
+            source.reset();
+            break;
+        }
+        text.append(chunk.asStringView());
+    }
+    setText(Value(std::move(text)));
+}
+
+void CsvReader::addField(Columns& columns, size_t column, size_t begin, size_t end, bool fixedWidth) {
+    if (column >= columns.size()) {
+        if (fixedWidth) {
+            return;
+        }
+        columns.resize(column + 1);
+    }
+
+    std::string_view field(data.get() + begin, end - begin);
+    if (!field.empty() && field.back() == '\r') {
+        field.remove_suffix(1);
+    }
+
+    if (field.size() >= 2 && field.front() == '"' && field.back() == '"') {
+        field = field.substr(1, field.size() - 2);
+        if (field.find("\"\"") != std::string_view::npos) {
+            std::string& text = unescaped.emplace_back();
+            text.reserve(field.size());
+            for (size_t i = 0; i < field.size(); i++) {
+                text += field[i];
+                if (field[i] == '"' && i + 1 < field.size() && field[i + 1] == '"') {
+                    i++;
+                }
+            }
+            field = text;
+        }
+    }
+
+    columns[column].push_back(field);
+}
+
+size_t CsvReader::scanRows(size_t maxRows, Columns& columns, bool fixedWidth) {
+    size_t rows = 0;
+    size_t column = 0;
+    size_t fieldStart = position;
+    uint64_t insideCarry = 0; // All ones when the previous block ended inside quotes
+    const char* base = data.get();
+
+    // Pads the final partial block; zero bytes never match a quote, delimiter or newline
+    char tail[64];
+
+    for (size_t blockStart = position; blockStart < size; blockStart += 64) {
+        const char* block = base + blockStart;
+        if (size - blockStart < 64) {
+            std::memset(tail, 0, sizeof(tail));
+            std::memcpy(tail, block, size - blockStart);
+            block = tail;
+        }
+
+        uint64_t quotes = matchMask(block, '"');
+        uint64_t newlines = matchMask(block, '\n');
+        uint64_t inside = prefixXor(quotes) ^ insideCarry;
+        insideCarry = static_cast<uint64_t>(static_cast<int64_t>(inside) >> 63);
+        uint64_t boundaries = (matchMask(block, delimiter) | newlines) & ~inside;
+
+        while (boundaries != 0) {
+            int bit = __builtin_ctzll(boundaries);
+            boundaries &= boundaries - 1;
+            size_t end = blockStart + bit;
+
+            if ((newlines >> bit) & 1) {
+                // Blank lines are skipped
+                bool blank = column == 0 && (end == fieldStart || (end == fieldStart + 1 && base[fieldStart] == '\r'));
+                if (!blank) {
+                    addField(columns, column, fieldStart, end, fixedWidth);
+                    for (size_t c = column + 1; c < columns.size(); c++) {
+                        columns[c].emplace_back();
+                    }
+                    rows++;
+                }
+                column = 0;
+                fieldStart = end + 1;
+                if (rows == maxRows && maxRows != 0) {
+                    position = fieldStart;
+                    return rows;
+                }
+            } else {
+                addField(columns, column, fieldStart, end, fixedWidth);
+                column++;
+                fieldStart = end + 1;
+            }
+        }
+    }
+
+    if (source != nullptr) {
+        position = fieldStart;
+        return rows;
+    }
+
+    // Last row without a trailing newline
+    if (fieldStart < size || column > 0) {
+        addField(columns, column, fieldStart, size, fixedWidth);
+        for (size_t c = column + 1; c < columns.size(); c++) {
+            columns[c].emplace_back();
+        }
+        rows++;
+    }
+    position = size;
+    return rows;
+}
+
+size_t CsvReader::scan(size_t maxRows, Columns& columns, bool fixedWidth) {
+    size_t width = columns.size();
+    while (true) {
+        size_t start = position;
+        size_t rows = scanRows(maxRows, columns, fixedWidth);
+        if (source == nullptr || (maxRows != 0 && rows == maxRows)) {
+            return rows;
+        }
+        // Fields point into the text that readMore replaces, so the rows are scanned again
+        columns.assign(width, {});
+        unescaped.clear();
+        position = start;
+        readMore();
+    }
+}
+
+Value CsvReader::makeColumn(const std::vector<std::string_view>& fields) const {
+    // Pack the column if every field is a number
+    auto numbers = std::make_shared<NumberStorage>();
+    numbers->numbers.reserve(fields.size());
+    numbers->integral = true;
+    bool numeric = !fields.empty();
+
+    for (std::string_view field : fields) {
+        const char* first = field.data();
+        const char* last = first + field.size();
+        int whole;
+        auto wholeResult = std::from_chars(first, last, whole);
+        if (!field.empty() && wholeResult.ec == std::errc() && wholeResult.ptr == last) {
+            numbers->numbers.push_back(whole);
+            continue;
+        }
+        double number;
+        auto result = std::from_chars(first, last, number);
+        if (field.empty() || result.ec != std::errc() || result.ptr != last) {
+            numeric = false;
+            break;
+        }
+        numbers->integral = false;
+        numbers->numbers.push_back(number);
+    }
+
+    if (numeric) {
+        return Value(numbers);
+    }
+
+    // Otherwise a string array whose elements point into the source text
+    const char* begin = data.get();
+    const char* end = begin + size;
+    std::vector<Value> strings;
+    strings.reserve(fields.size());
+    for (std::string_view field : fields) {
+        if (field.data() >= begin && field.data() < end) {
+            strings.emplace_back(std::shared_ptr<const char>(data, field.data()), field.size());
+        } else {
+            strings.emplace_back(std::string(field));
+        }
+    }
+    return Value(std::move(strings));
+}
+
+Value CsvReader::readTable(size_t maxRows) {
+    if (header.empty()) {
+        Columns names;
+        if (scan(1, names, false) == 0) {
+            return Value();
+        }
+        for (const auto& name : names) {
+            header.emplace_back(name.empty() ? std::string_view() : name[0]);
+        }
+    }
+
+    Columns columns(header.size());
+    if (scan(maxRows, columns, true) == 0) {
+        return Value();
+    }
+
+    auto table = std::make_shared<Map>();
+    for (size_t i = 0; i < header.size(); i++) {
+        table->set(header[i], makeColumn(columns[i]));
+    }
+    unescaped.clear();
+    return Value(table);
+}
+
+// CsvChunkIterator implementation
+CsvChunkIterator::CsvChunkIterator(std::shared_ptr<CsvReader> reader, size_t rowsPerChunk)
+    : reader(reader), rowsPerChunk(rowsPerChunk) {}
+
+bool CsvChunkIterator::next(Value& out) {
+    Value table = reader->readTable(rowsPerChunk);
+    if (table.isNil()) {
+        return false;
+    }
+    out = table;
+    return true;
+}
+
+} // namespace SimpScript
@@ -0,0 +1,291 @@
+#include "simpscript.h"
+#include "Environment.h"
+#include "Interpreter.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Stream.h"
+#include <sstream>
+
+using namespace SimpScript;
+
+struct simpscript_interpreter {
+    std::ostringstream captured; // Output of captured interpreters
+    std::string output;          // Last text handed out by simpscript_output()
+    std::unique_ptr<Interpreter> interpreter;
+    std::string error;
+    std::string raised;          // Set by simpscript_raise() while a native function runs
+    bool raising = false;
+};
+
+struct simpscript_program {
+    std::unique_ptr<ASTNode> root;
+};
+
+struct simpscript_value {
+    Value value;
+    std::string text; // Storage for simpscript_value_string()
+};
+
+static simpscript_value* wrap(Value value) {
+    return new simpscript_value{std::move(value), std::string()};
+}
+
+// Run body, turning an exception into the interpreter's last error
+template <typename Result, typename Body>
+static Result guarded(simpscript_interpreter* interpreter, Result failure, Body body) {
+    interpreter->error.clear();
+    try {
+        return body();
+    } catch (const std::exception& e) {
+        interpreter->error = e.what();
+    } catch (...) {
+        interpreter->error = "Unknown error";
+    }
+    return failure;
+}
+
+// Interpreters
+
+simpscript_interpreter* simpscript_interpreter_new(void) {
+    auto* result = new simpscript_interpreter();
+    result->interpreter = std::make_unique<Interpreter>();
+    return result;
+}
+
+simpscript_interpreter* simpscript_interpreter_new_captured(const char* input, size_t length) {
+    auto* result = new simpscript_interpreter();
+    result->interpreter = std::make_unique<Interpreter>(
+        InputStream::fromString(std::string(input != nullptr ? input : "", input != nullptr ? length : 0), "stdin"),
+        result->captured, result->captured);
+    return result;
+}
+
+void simpscript_interpreter_free(simpscript_interpreter* interpreter) {
+    delete interpreter;
+}
+
+const char* simpscript_last_error(const simpscript_interpreter* interpreter) {
+    return interpreter->error.c_str();
+}
+
+const char* simpscript_output(simpscript_interpreter* interpreter, size_t* length) {
+    interpreter->output = interpreter->captured.str();
+    if (length != nullptr) {
+        *length = interpreter->output.size();
+    }
+    return interpreter->output.c_str();
+}
+
+void simpscript_clear_output(simpscript_interpreter* interpreter) {
+    interpreter->captured.str(std::string());
+    interpreter->captured.clear();
+}
+
+// Programs
+
+simpscript_program* simpscript_compile(simpscript_interpreter* interpreter, const char* source, size_t length) {
+    return guarded(interpreter, static_cast<simpscript_program*>(nullptr), [&]() -> simpscript_program* {
+        // The parser reports the error it stopped at instead of throwing it
+        std::ostringstream errors;
+        Lexer lexer(std::string(source, length));
+        Parser parser(lexer, errors);
+        auto root = parser.parse();
+        std::string message = errors.str();
+        if (!message.empty()) {
+            while (!message.empty() && message.back() == '\n') {
+                message.pop_back();
+            }
+            throw ParseError(message);
+        }
+        return new simpscript_program{std::move(root)};
+    });
+}
+
+void simpscript_program_free(simpscript_program* program) {
+    delete program;
+}
+
+simpscript_value* simpscript_execute(simpscript_interpreter* interpreter, const simpscript_program* program) {
+    return guarded(interpreter, static_cast<simpscript_value*>(nullptr), [&]() -> simpscript_value* {
+        return wrap(interpreter->interpreter->execute(program->root));
+    });
+}
+
+// Global variables
+
+int simpscript_set(simpscript_interpreter* interpreter, const char* name, const simpscript_value* value) {
+    return guarded(interpreter, -1, [&] {
+        interpreter->interpreter->defineVariable(name, value->value);
+        return 0;
+    });
+}
+
+int simpscript_set_int(simpscript_interpreter* interpreter, const char* name, int value) {
+    interpreter->interpreter->defineVariable(name, Value(value));
+    return 0;
+}
+
+int simpscript_set_number(simpscript_interpreter* interpreter, const char* name, double value) {
+    interpreter->interpreter->defineVariable(name, Value(value));
+    return 0;
+}
+
+int simpscript_set_string(simpscript_interpreter* interpreter, const char* name, const char* text, size_t length) {
+    interpreter->interpreter->defineVariable(name, Value(std::string(text, length)));
+    return 0;
+}
+
+simpscript_value* simpscript_get(simpscript_interpreter* interpreter, const char* name) {
+    interpreter->error.clear();
+    const Value* value = interpreter->interpreter->getGlobals()->lookup(name);
+    if (value == nullptr) {
+        interpreter->error = std::string("Undefined variable '") + name + "'";
+        return nullptr;
+    }
+    return wrap(*value);
+}
+
+// Native functions
+
+int simpscript_register(simpscript_interpreter* interpreter, const char* name, int arity,
+                        simpscript_native function, void* userdata) {
+    auto native = std::make_shared<NativeFunction>(arity, [interpreter, function, userdata](std::vector<Value>& args) -> Value {
+        std::vector<simpscript_value> values;
+        values.reserve(args.size());
+        for (Value& arg : args) {
+            values.push_back(simpscript_value{std::move(arg), std::string()});
+        }
+        std::vector<const simpscript_value*> pointers;
+        pointers.reserve(values.size());
+        for (const auto& value : values) {
+            pointers.push_back(&value);
+        }
+
+        std::unique_ptr<simpscript_value> result(function(interpreter, pointers.data(), pointers.size(), userdata));
+        if (interpreter->raising) {
+            interpreter->raising = false;
+            throw RuntimeError(interpreter->raised);
+        }
+        return result ? std::move(result->value) : Value();
+    });
+    interpreter->interpreter->defineVariable(name, Value(std::static_pointer_cast<Callable>(native)));
+    return 0;
+}
+
+void simpscript_raise(simpscript_interpreter* interpreter, const char* message) {
+    interpreter->raised = message;
+    interpreter->raising = true;
+}
+
+// Values
+
+simpscript_value* simpscript_nil(void) {
+    return wrap(Value());
+}
+
+simpscript_value* simpscript_bool(int value) {
+    return wrap(Value(value != 0));
+}
+
+simpscript_value* simpscript_int(int value) {
+    return wrap(Value(value));
+}
+
+simpscript_value* simpscript_number(double value) {
+    return wrap(Value(value));
+}
+
+simpscript_value* simpscript_string(const char* text, size_t length) {
+    return wrap(Value(std::string(text, length)));
+}
+
+simpscript_value* simpscript_array(const simpscript_value* const* elements, size_t count) {
+    std::vector<Value> values;
+    values.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        values.push_back(elements[i]->value);
+    }
+    return wrap(Value(std::move(values)));
+}
+
+simpscript_value* simpscript_value_copy(const simpscript_value* value) {
+    return wrap(value->value);
+}
+
+void simpscript_value_free(simpscript_value* value) {
+    delete value;
+}
+
+simpscript_type simpscript_value_type(const simpscript_value* value) {
+    switch (value->value.getType()) {
+        case Value::Type::NIL: return SIMPSCRIPT_NIL;
+        case Value::Type::BOOLEAN: return SIMPSCRIPT_BOOL;
+        case Value::Type::INTEGER: return SIMPSCRIPT_INT;
+        case Value::Type::FLOAT: return SIMPSCRIPT_NUMBER;
+        case Value::Type::STRING: return SIMPSCRIPT_STRING;
+        case Value::Type::ARRAY: return SIMPSCRIPT_ARRAY;
+        case Value::Type::MAP: return SIMPSCRIPT_MAP;
+        default: return SIMPSCRIPT_OTHER;
+    }
+}
+
+int simpscript_value_bool(const simpscript_value* value) {
+    return value->value.isTruthy() ? 1 : 0;
+}
+
+int simpscript_value_int(const simpscript_value* value) {
+    return value->value.isNumber() ? value->value.asInteger() : 0;
+}
+
+double simpscript_value_number(const simpscript_value* value) {
+    return value->value.isNumber() ? value->value.asFloat() : 0.0;
+}
+
+const char* simpscript_value_string(simpscript_value* value, size_t* length) {
+    value->text = value->value.isString() ? std::string(value->value.asStringView()) : value->value.toString();
+    if (length != nullptr) {
+        *length = value->text.size();
+    }
+    return value->text.c_str();
+}
+
+size_t simpscript_value_size(const simpscript_value* value) {
+    const Value& target = value->value;
+    if (target.isArray() || target.isMap() || target.isString() || target.isRange()) {
+        return static_cast<size_t>(target.size());
+    }
+    return 0;
+}
+
+simpscript_value* simpscript_value_at(const simpscript_value* value, size_t index) {
+    const Value& target = value->value;
+    if (index >= simpscript_value_size(value)) {
+        return nullptr;
+    }
+    int position = static_cast<int>(index);
+    if (target.isArray()) {
+        return wrap(target.element(position));
+    }
+    if (target.isString()) {
+        return wrap(target.slice(position, position + 1));
+    }
+    if (target.isRange()) {
+        return wrap(Value(target.asRange().at(position)));
+    }
+    return nullptr;
+}
+
+simpscript_value* simpscript_value_get(const simpscript_value* value, const char* key) {
+    if (!value->value.isMap()) {
+        return nullptr;
+    }
+    const Value* found = value->value.asMap().find(key);
+    return found != nullptr ? wrap(*found) : nullptr;
+}
+
+simpscript_value* simpscript_value_key_at(const simpscript_value* value, size_t index) {
+    if (!value->value.isMap() || index >= simpscript_value_size(value)) {
+        return nullptr;
+    }
+    return wrap(Value(value->value.asMap().keyAt(index)));
+}
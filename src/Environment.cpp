@@ -1,30 +1,53 @@
 #include "Environment.h"
+#include "Stats.h"
 #include <stdexcept>
 #include <sstream>
 
 namespace SimpScript {
 
 // Constructor for global environment
-Environment::Environment() : enclosing(nullptr) {}
+Environment::Environment() : enclosing(nullptr) {
+    SIMPSCRIPT_COUNT(environments);
+}
 
 // Constructor for local environment with an enclosing environment
-Environment::Environment(std::shared_ptr<Environment> enclosing) : enclosing(enclosing) {}
+Environment::Environment(std::shared_ptr<Environment> enclosing) : enclosing(enclosing) {
+    SIMPSCRIPT_COUNT(environments);
+}
 
 // Define a variable in the current environment
 void Environment::define(const std::string& name, const Value& value) {
     values[name] = value;
 }
 
+// Get a stable reference to a variable in the current environment
+Value& Environment::slot(const std::string& name) {
+    return values[name];
+}
+
+// Find a variable for in-place updates
+Value* Environment::lookup(const std::string& name) {
+    SIMPSCRIPT_COUNT(lookups);
+    for (Environment* env = this; env != nullptr; env = env->enclosing.get()) {
+        auto it = env->values.find(name);
+        if (it != env->values.end()) {
+            return &it->second;
+        }
+        SIMPSCRIPT_COUNT(lookupDepth);
+    }
+    return nullptr;
+}
+
 // Get a variable's value from the environment
 Value Environment::get(const std::string& name) {
-    auto it = values.find(name);
-    if (it != values.end()) {
-        return it->second;
-    }
-    
-    // If not found in current environment, look in the enclosing one
-    if (enclosing != nullptr) {
-        return enclosing->get(name);
+    // Look in this environment, then in the enclosing ones
+    SIMPSCRIPT_COUNT(lookups);
+    for (Environment* env = this; env != nullptr; env = env->enclosing.get()) {
+        auto it = env->values.find(name);
+        if (it != env->values.end()) {
+            return it->second;
+        }
+        SIMPSCRIPT_COUNT(lookupDepth);
     }
     
     // Variable not found
@@ -35,16 +58,15 @@ Value Environment::get(const std::string& name) {
 
 // Assign a new value to an existing variable
 void Environment::assign(const std::string& name, const Value& value) {
-    auto it = values.find(name);
-    if (it != values.end()) {
-        it->second = value;
-        return;
-    }
-    
-    // If not found in current environment, try to assign in the enclosing one
-    if (enclosing != nullptr) {
-        enclosing->assign(name, value);
-        return;
+    // Assign in the innermost environment that has the variable
+    SIMPSCRIPT_COUNT(lookups);
+    for (Environment* env = this; env != nullptr; env = env->enclosing.get()) {
+        auto it = env->values.find(name);
+        if (it != env->values.end()) {
+            it->second = value;
+            return;
+        }
+        SIMPSCRIPT_COUNT(lookupDepth);
     }
     
     // Variable not found
@@ -63,4 +85,11 @@ std::shared_ptr<Environment> Environment::getEnclosing() const {
     return enclosing;
 }
 
+void Environment::clear() {
+    // Destroying a value can release the last reference to another environment, so the map
+    // is emptied before anything in it is destroyed
+    auto released = std::move(values);
+    values.clear();
+}
+
 } // namespace SimpScript 
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "HeapProfiler.h"
+#include <algorithm>
+#include <iomanip>
+
+namespace SimpScript {
+
+HeapProfiler* heapProfiler = nullptr;
+thread_local uint32_t HeapProfiler::currentSite = 0;
+
+static const char* kindName(HeapProfiler::Kind kind) {
+    switch (kind) {
+        case HeapProfiler::Kind::ARRAY:
+            return "array";
+        case HeapProfiler::Kind::STRING:
+            return "string";
+        case HeapProfiler::Kind::CLOSURE:
+            return "closure";
+    }
+    return "object";
+}
+
+// HeapProfiler implementation
+HeapProfiler::HeapProfiler(const std::string& script, std::ostream* snapshots, uint64_t interval)
+    : script(script), snapshots(snapshots), interval(interval), nextSnapshot(interval) {}
+
+uint32_t HeapProfiler::site(Kind kind, int line) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = ids.find({kind, line});
+    if (it != ids.end()) {
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(sites.size());
+    sites.push_back(Site{kind, line});
+    ids.emplace(std::make_pair(kind, line), id);
+    return id;
+}
+
+void HeapProfiler::allocate(uint32_t site, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Site& entry = sites[site];
+    entry.allocatedBytes += bytes;
+    entry.allocations++;
+    entry.liveBytes += bytes;
+    entry.liveObjects++;
+    allocatedBytes += bytes;
+    allocations++;
+    liveBytes += bytes;
+    liveObjects++;
+    peakBytes = std::max(peakBytes, liveBytes);
+
+    // Snapshots come at fixed amounts of allocation rather than fixed times, so two runs of
+    // the same script take them at the same points and can be diffed
+    if (interval > 0 && allocatedBytes >= nextSnapshot) {
+        writeSnapshot("interval");
+        nextSnapshot = (allocatedBytes / interval + 1) * interval;
+    }
+}
+
+void HeapProfiler::release(uint32_t site, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sites[site].liveBytes -= bytes;
+    sites[site].liveObjects--;
+    liveBytes -= bytes;
+    liveObjects--;
+}
+
+void HeapProfiler::snapshot(const char* reason) {
+    std::lock_guard<std::mutex> lock(mutex);
+    writeSnapshot(reason);
+}
+
+void HeapProfiler::finish() {
+    std::lock_guard<std::mutex> lock(mutex);
+    exitBytes = liveBytes;
+    for (Site& entry : sites) {
+        entry.exitBytes = entry.liveBytes;
+    }
+    writeSnapshot("exit");
+}
+
+// A header line, then "live bytes<TAB>live objects<TAB>kind<TAB>script:line" for every site
+// holding something, in site order so that snapshots of two runs line up
+void HeapProfiler::writeSnapshot(const char* reason) {
+    snapshotCount++;
+    if (snapshots == nullptr) {
+        return;
+    }
+    std::ostream& out = *snapshots;
+    out << "# snapshot " << snapshotCount << " (" << reason << "): " << allocatedBytes << " bytes allocated, "
+        << liveBytes << " bytes live in " << liveObjects << " objects\n";
+    for (const auto& [key, id] : ids) {
+        const Site& entry = sites[id];
+        if (entry.liveObjects > 0) {
+            out << entry.liveBytes << "\t" << entry.liveObjects << "\t" << kindName(entry.kind) << "\t" << script
+                << ":" << entry.line << "\n";
+        }
+    }
+    out.flush();
+}
+
+void HeapProfiler::report(std::ostream& out, size_t limit) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "Heap profile of " << script << ": " << allocatedBytes << " bytes in " << allocations
+        << " objects allocated, peak " << peakBytes << " bytes live, " << exitBytes << " bytes live at exit" << std::endl;
+    if (allocations == 0) {
+        return;
+    }
+
+    std::vector<const Site*> sorted;
+    for (size_t id = 1; id < sites.size(); id++) {
+        // Sums of numbers mark a site too, without ever making a string there
+        if (sites[id].allocations > 0) {
+            sorted.push_back(&sites[id]);
+        }
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const Site* a, const Site* b) { return a->allocatedBytes > b->allocatedBytes; });
+    if (sorted.size() > limit) {
+        sorted.resize(limit);
+    }
+
+    out << std::endl << "  allocated bytes     objects   live at exit  site" << std::endl;
+    for (const Site* entry : sorted) {
+        out << std::setw(17) << entry->allocatedBytes << std::setw(12) << entry->allocations << std::setw(15)
+            << entry->exitBytes << "  " << kindName(entry->kind) << " at " << script << ":" << entry->line << std::endl;
+    }
+}
+
+} // namespace SimpScript
@@ -2,9 +2,23 @@
 #include "AST.h"
 #include "Value.h"
 #include "Environment.h"
+#include "Stream.h"
+#include "Csv.h"
+#include "Json.h"
+#include "Parallel.h"
+#include "Channel.h"
+#include "Scheduler.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <thread>
 #include <iostream>
 #include <string>
 #include <functional>
+#include <algorithm>
 
 namespace SimpScript {
 
@@ -12,42 +26,106 @@ namespace SimpScript {
 RuntimeError::RuntimeError(const std::string& message)
     : std::runtime_error(message) {}
 
-// ReturnValue implementation
-ReturnValue::ReturnValue(const Value& value)
-    : std::runtime_error("Return value"), value(value) {}
+// What now_ns() and clock() count from. Script integers are 32 bits, so times are measured from
+// here rather than the clock's own epoch and returned as floats, which hold whole nanoseconds
+// exactly for over a hundred days
+static const std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
 
-Value ReturnValue::getValue() const {
-    return value;
+static double nanosecondsSinceStart() {
+    return static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - clockStart).count());
+}
+
+// Resolve the source argument of an input builtin: an input handle such as stdin, or a file path
+static std::shared_ptr<InputStream> inputStreamFrom(const Value& source, const std::string& function) {
+    if (source.isHandle()) {
+        if (auto stream = std::dynamic_pointer_cast<InputStream>(source.asHandle())) {
+            return stream;
+        }
+    } else if (source.isString()) {
+        return InputStream::open(source.asString());
+    }
+    throw RuntimeError(function + "() expects stdin or a file path");
+}
+
+// Resolve the channel argument of a channel builtin
+static std::shared_ptr<Channel> channelFrom(const Value& target, const std::string& function) {
+    if (target.isHandle()) {
+        if (auto channel = std::dynamic_pointer_cast<Channel>(target.asHandle())) {
+            return channel;
+        }
+    }
+    throw RuntimeError(function + "() expects a channel");
+}
+
+// Resolve the target argument of an output builtin
+static std::shared_ptr<OutputStream> outputStreamFrom(const Value& target, const std::string& function) {
+    if (target.isHandle()) {
+        if (auto stream = std::dynamic_pointer_cast<OutputStream>(target.asHandle())) {
+            return stream;
+        }
+    }
+    throw RuntimeError(function + "() expects a handle opened for writing");
 }
 
 // Interpreter implementation
-Interpreter::Interpreter() {
+Interpreter::Interpreter() : Interpreter(InputStream::standardInput(), std::cout, std::cerr) {}
+
+Interpreter::Interpreter(std::shared_ptr<InputStream> input, std::ostream& output, std::ostream& errors)
+    : input(std::move(input)), output(&output), errors(&errors) {
+    this->input->tie(this->output);
     globals = std::make_shared<Environment>();
     environment = globals;
     
     setupGlobals();
 }
 
+Interpreter::Interpreter(Interpreter& parent, std::shared_ptr<Environment> globals)
+    : environment(globals), globals(globals), input(parent.input), output(parent.output), errors(parent.errors),
+      worker(true) {}
+
+Interpreter::~Interpreter() {
+    // Unfinished tasks unwind while everything they use is still there
+    tasks.reset();
+    
+    // Writers can outlive the interpreter through reference cycles, so close them explicitly
+    for (const auto& weak : writers) {
+        if (auto writer = weak.lock()) {
+            writer->close();
+        }
+    }
+    
+    // Functions defined at the top level hold the globals in their closures; break the cycle
+    if (!worker) {
+        globals->clear();
+    }
+}
+
 void Interpreter::setupGlobals() {
     // Setup built-in functions and values here
     
     // Function to print text without a newline
-    auto show = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
-        std::cout << args[0].toString();
+    auto show = std::make_shared<NativeFunction>(1, [this](std::vector<Value>& args) -> Value {
+        *output << args[0].toString();
         return Value();
     });
     
     // Function to print text with a newline
-    auto shownl = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
-        std::cout << args[0].toString() << std::endl;
+    auto shownl = std::make_shared<NativeFunction>(1, [this](std::vector<Value>& args) -> Value {
+        *output << args[0].toString() << std::endl;
         return Value();
     });
     
     // Function to read a line from standard input
-    auto ask = std::make_shared<NativeFunction>(0, [](std::vector<Value>& args) -> Value {
-        std::string input;
-        std::getline(std::cin, input);
-        return Value(input);
+    auto ask = std::make_shared<NativeFunction>(0, [this](std::vector<Value>&) -> Value {
+        Value line("");
+        if (tracing) {
+            TraceScope scope("io", "read");
+            input->readLine(line);
+            return line;
+        }
+        input->readLine(line);
+        return line;
     });
     
     // Newline constant for use in string concatenation
@@ -63,8 +141,458 @@ void Interpreter::setupGlobals() {
     auto size = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
         Value& target = args[0];
         return Value(target.size());
-    });
+    }, true);
     globals->define("size", Value(size));
+    
+    // range(stop), range(start, stop) or range(start, stop, step) - a lazy integer sequence
+    auto range = std::make_shared<NativeFunction>(-1, [](std::vector<Value>& args) -> Value {
+        if (args.empty() || args.size() > 3) {
+            throw RuntimeError("range() takes 1 to 3 arguments");
+        }
+        for (const Value& arg : args) {
+            if (!arg.isInteger()) {
+                throw RuntimeError("range() arguments must be integers");
+            }
+        }
+        
+        Range result{0, 0, 1};
+        if (args.size() == 1) {
+            result.stop = args[0].asInteger();
+        } else {
+            result.start = args[0].asInteger();
+            result.stop = args[1].asInteger();
+            if (args.size() == 3) {
+                result.step = args[2].asInteger();
+            }
+        }
+        
+        if (result.step == 0) {
+            throw RuntimeError("range() step must not be zero");
+        }
+        return Value(result);
+    }, true);
+    globals->define("range", Value(range));
+    
+    // slice(value, begin) or slice(value, begin, end) - a view sharing the array or string storage
+    auto slice = std::make_shared<NativeFunction>(-1, [](std::vector<Value>& args) -> Value {
+        if (args.size() < 2 || args.size() > 3) {
+            throw RuntimeError("slice() takes 2 or 3 arguments");
+        }
+        if (!args[0].isArray() && !args[0].isString()) {
+            throw RuntimeError("slice() expects an array or string");
+        }
+        if (!args[1].isInteger() || (args.size() == 3 && !args[2].isInteger())) {
+            throw RuntimeError("slice() bounds must be integers");
+        }
+        int end = args.size() == 3 ? args[2].asInteger() : args[0].size();
+        return args[0].slice(args[1].asInteger(), end);
+    }, true);
+    globals->define("slice", Value(slice));
+    
+    // Streaming input: lines(stdin) or lines("file") for for-each loops, read_all() for everything at once
+    globals->define("stdin", Value(std::static_pointer_cast<Handle>(input)));
+    
+    auto lines = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
+        return Value(std::make_shared<LineIterator>(inputStreamFrom(args[0], "lines")));
+    });
+    globals->define("lines", Value(lines));
+    
+    auto readAll = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
+        return inputStreamFrom(args[0], "read_all")->readAll();
+    });
+    globals->define("read_all", Value(readAll));
+    
+    // File I/O: open(path) or open(path, mode) with mode "r", "w" or "a"
+    globals->define("stdout", Value(std::static_pointer_cast<Handle>(OutputStream::wrap(*output, "stdout"))));
+    globals->define("stderr", Value(std::static_pointer_cast<Handle>(OutputStream::wrap(*errors, "stderr"))));
+    
+    auto open = std::make_shared<NativeFunction>(-1, [this](std::vector<Value>& args) -> Value {
+        if (args.empty() || args.size() > 2 || !args[0].isString()) {
+            throw RuntimeError("open() expects a file path and an optional mode");
+        }
+        std::string mode = args.size() == 2 ? args[1].asString() : "r";
+        if (mode == "r") {
+            return Value(std::static_pointer_cast<Handle>(InputStream::open(args[0].asString())));
+        }
+        if (mode == "w" || mode == "a") {
+            auto writer = OutputStream::open(args[0].asString(), mode == "a");
+            trackWriter(writer);
+            return Value(std::static_pointer_cast<Handle>(writer));
+        }
+        throw RuntimeError("open() mode must be \"r\", \"w\" or \"a\"");
+    });
+    globals->define("open", Value(open));
+    
+    // read(handle) - the next line, or nil at the end of the input
+    auto read = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
+        Value line;
+        if (!inputStreamFrom(args[0], "read")->readLine(line)) {
+            return Value();
+        }
+        return line;
+    });
+    globals->define("read", Value(read));
+    
+    auto readLines = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
+        return Value(std::make_shared<LineIterator>(inputStreamFrom(args[0], "read_lines")));
+    });
+    globals->define("read_lines", Value(readLines));
+    
+    auto write = std::make_shared<NativeFunction>(2, [](std::vector<Value>& args) -> Value {
+        outputStreamFrom(args[0], "write")->write(args[1]);
+        return Value();
+    });
+    globals->define("write", Value(write));
+    
+    auto writeln = std::make_shared<NativeFunction>(2, [](std::vector<Value>& args) -> Value {
+        auto writer = outputStreamFrom(args[0], "writeln");
+        writer->write(args[1]);
+        writer->write(std::string_view("\n"));
+        return Value();
+    });
+    globals->define("writeln", Value(writeln));
+    
+    auto flush = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
+        outputStreamFrom(args[0], "flush")->flush();
+        return Value();
+    });
+    globals->define("flush", Value(flush));
+    
+    auto close = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
+        if (!args[0].isHandle()) {
+            throw RuntimeError("close() expects a file handle");
+        }
+        args[0].asHandle()->close();
+        return Value();
+    });
+    globals->define("close", Value(close));
+    
+    // read_csv(source), read_csv(source, rows) or read_csv(source, rows, delimiter).
+    // Returns a map from column name to column; with rows > 0, an iterator over tables of that many rows
+    auto readCsv = std::make_shared<NativeFunction>(-1, [](std::vector<Value>& args) -> Value {
+        if (args.empty() || args.size() > 3) {
+            throw RuntimeError("read_csv() takes 1 to 3 arguments");
+        }
+        if (args.size() >= 2 && !args[1].isInteger()) {
+            throw RuntimeError("read_csv() row count must be an integer");
+        }
+        if (args.size() == 3 && (!args[2].isString() || args[2].size() != 1)) {
+            throw RuntimeError("read_csv() delimiter must be a single character");
+        }
+        
+        char delimiter = args.size() == 3 ? args[2].asStringView()[0] : ',';
+        auto stream = inputStreamFrom(args[0], "read_csv");
+        int rows = args.size() >= 2 ? args[1].asInteger() : 0;
+        if (rows > 0) {
+            // Read as the chunks are asked for, so a pipe never has to fit in memory
+            auto reader = std::make_shared<CsvReader>(stream, delimiter);
+            return Value(std::static_pointer_cast<Iterator>(
+                std::make_shared<CsvChunkIterator>(reader, static_cast<size_t>(rows))));
+        }
+        return CsvReader(stream->readAll(), delimiter).readTable(0);
+    });
+    globals->define("read_csv", Value(readCsv));
+    
+    // keys(map) - the keys of a map in insertion order
+    auto keys = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
+        if (!args[0].isMap()) {
+            throw RuntimeError("keys() expects a map");
+        }
+        const Map& map = args[0].asMap();
+        std::vector<Value> result;
+        result.reserve(map.size());
+        for (size_t i = 0; i < map.size(); i++) {
+            result.emplace_back(map.keyAt(i));
+        }
+        return Value(std::move(result));
+    }, true);
+    globals->define("keys", Value(keys));
+    
+    // json_parse(text) or json_parse(text, true). The lazy form only parses the parts of the document that are used
+    auto jsonParse = std::make_shared<NativeFunction>(-1, [](std::vector<Value>& args) -> Value {
+        if (args.empty() || args.size() > 2 || !args[0].isString()) {
+            throw RuntimeError("json_parse() expects a string and an optional lazy flag");
+        }
+        if (args.size() == 2 && !args[1].isBoolean()) {
+            throw RuntimeError("json_parse() lazy flag must be true or false");
+        }
+        return JsonParser(args[0], args.size() == 2 && args[1].asBoolean()).parse();
+    }, true);
+    globals->define("json_parse", Value(jsonParse));
+    
+    auto jsonStringify = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
+        std::string text;
+        text.reserve(args[0].formattedLengthHint());
+        JsonWriter(text).write(args[0]);
+        return Value(std::move(text));
+    }, true);
+    globals->define("json_stringify", Value(jsonStringify));
+    
+    // json_write(file, value) - serialize straight into a writer's buffer
+    auto jsonWrite = std::make_shared<NativeFunction>(2, [](std::vector<Value>& args) -> Value {
+        outputStreamFrom(args[0], "json_write")->writeJson(args[1]);
+        return Value();
+    });
+    globals->define("json_write", Value(jsonWrite));
+    
+    // Regular expressions. The pattern is a re"..." literal or a string; matches are leftmost-longest
+    auto regexText = [](const Value& text, const std::string& function) {
+        if (!text.isString()) {
+            throw RuntimeError(function + "() expects a string to search");
+        }
+        return text.asStringView();
+    };
+    
+    // match(pattern, text) - whether the whole text matches
+    auto match = std::make_shared<NativeFunction>(2, [this, regexText](std::vector<Value>& args) -> Value {
+        auto regex = regexFrom(args[0], "match");
+        return Value(regex->matches(regexText(args[1], "match")));
+    }, true);
+    globals->define("match", Value(match));
+    
+    // search(pattern, text) - the first match, or nil
+    auto search = std::make_shared<NativeFunction>(2, [this, regexText](std::vector<Value>& args) -> Value {
+        auto regex = regexFrom(args[0], "search");
+        size_t begin;
+        size_t end;
+        if (!regex->search(regexText(args[1], "search"), 0, begin, end)) {
+            return Value();
+        }
+        return args[1].slice(static_cast<int>(begin), static_cast<int>(end));
+    }, true);
+    globals->define("search", Value(search));
+    
+    // find_all(pattern, text) - every non-overlapping match, as slices of the text
+    auto findAll = std::make_shared<NativeFunction>(2, [this, regexText](std::vector<Value>& args) -> Value {
+        auto regex = regexFrom(args[0], "find_all");
+        std::string_view text = regexText(args[1], "find_all");
+        std::vector<Value> matches;
+        Regex::Scan scan;
+        size_t begin;
+        size_t end;
+        for (size_t from = 0; regex->search(text, from, begin, end, scan);) {
+            matches.push_back(args[1].slice(static_cast<int>(begin), static_cast<int>(end)));
+            from = end > begin ? end : end + 1; // Step over empty matches
+        }
+        return Value(std::move(matches));
+    }, true);
+    globals->define("find_all", Value(findAll));
+    
+    // replace_re(pattern, text, replacement) - replace every match
+    auto replaceRe = std::make_shared<NativeFunction>(3, [this, regexText](std::vector<Value>& args) -> Value {
+        auto regex = regexFrom(args[0], "replace_re");
+        std::string_view text = regexText(args[1], "replace_re");
+        if (!args[2].isString()) {
+            throw RuntimeError("replace_re() replacement must be a string");
+        }
+        std::string_view replacement = args[2].asStringView();
+        
+        std::string result;
+        result.reserve(text.size());
+        size_t copied = 0;
+        Regex::Scan scan;
+        size_t begin;
+        size_t end;
+        for (size_t from = 0; regex->search(text, from, begin, end, scan);) {
+            result.append(text.data() + copied, begin - copied);
+            result += replacement;
+            copied = end;
+            if (end == begin) {
+                // Keep the character after an empty match and search on from the next one
+                if (end < text.size()) {
+                    result += text[end];
+                }
+                copied = end + 1;
+            }
+            from = copied;
+        }
+        if (copied < text.size()) {
+            result.append(text.data() + copied, text.size() - copied);
+        }
+        return Value(std::move(result));
+    }, true);
+    globals->define("replace_re", Value(replaceRe));
+    
+    // Parallel builtins
+    // parallel_map(fn, items) - fn applied to every element, spread over the cores when fn allows it
+    auto parallelMapBuiltin = std::make_shared<NativeFunction>(2, [this](std::vector<Value>& args) -> Value {
+        return parallelMap(*this, args[0], args[1]);
+    });
+    globals->define("parallel_map", Value(parallelMapBuiltin));
+    
+    // parallel_reduce(fn, items, init) - fold with an associative fn, chunks reduced in parallel
+    auto parallelReduceBuiltin = std::make_shared<NativeFunction>(3, [this](std::vector<Value>& args) -> Value {
+        return parallelReduce(*this, args[0], args[1], args[2]);
+    });
+    globals->define("parallel_reduce", Value(parallelReduceBuiltin));
+    
+    // Tasks and channels. spawn f(args) starts a task; tasks switch when they block
+    // channel() or channel(capacity) - a queue between tasks, holding one value unless told otherwise
+    auto channel = std::make_shared<NativeFunction>(-1, [this](std::vector<Value>& args) -> Value {
+        if (args.size() > 1 || (args.size() == 1 && (!args[0].isInteger() || args[0].asInteger() < 1))) {
+            throw RuntimeError("channel() expects an optional capacity of at least 1");
+        }
+        size_t capacity = args.empty() ? 1 : static_cast<size_t>(args[0].asInteger());
+        return Value(std::static_pointer_cast<Handle>(std::make_shared<TaskChannel>(scheduler(), capacity)));
+    });
+    globals->define("channel", Value(channel));
+    
+    // shared_channel(capacity) - a queue between threads, such as parallel_map workers.
+    // Values are copied as they are sent, so sender and receiver never share them
+    auto sharedChannel = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
+        if (!args[0].isInteger() || args[0].asInteger() < 1) {
+            throw RuntimeError("shared_channel() expects a capacity of at least 1");
+        }
+        auto capacity = static_cast<size_t>(args[0].asInteger());
+        return Value(std::static_pointer_cast<Handle>(std::make_shared<SharedChannel>(capacity)));
+    }, true);
+    globals->define("shared_channel", Value(sharedChannel));
+    
+    // The other channel builtins are pure: a shared channel is safe to use from worker threads,
+    // and a task channel refuses to be used from any thread but its own
+    
+    // send(channel, value) - waits while the channel is full
+    auto send = std::make_shared<NativeFunction>(2, [](std::vector<Value>& args) -> Value {
+        channelFrom(args[0], "send")->send(std::move(args[1]));
+        return Value();
+    }, true);
+    globals->define("send", Value(send));
+    
+    // recv(channel) - waits for the next value; nil once the channel is closed and empty
+    auto recv = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
+        Value value;
+        channelFrom(args[0], "recv")->receive(value);
+        return value;
+    }, true);
+    globals->define("recv", Value(recv));
+    
+    // try_send(channel, value) - true if the value was sent, false if the channel is full
+    auto trySend = std::make_shared<NativeFunction>(2, [](std::vector<Value>& args) -> Value {
+        return Value(channelFrom(args[0], "try_send")->trySend(args[1]));
+    }, true);
+    globals->define("try_send", Value(trySend));
+    
+    // try_recv(channel) - the next value, or nil if none is queued
+    auto tryRecv = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
+        Value value;
+        channelFrom(args[0], "try_recv")->tryReceive(value);
+        return value;
+    }, true);
+    globals->define("try_recv", Value(tryRecv));
+    
+    // recv_all(channel) - every value sent until the channel is closed, for for-each loops
+    auto recvAll = std::make_shared<NativeFunction>(1, [](std::vector<Value>& args) -> Value {
+        return Value(std::static_pointer_cast<Iterator>(std::make_shared<ChannelIterator>(channelFrom(args[0], "recv_all"))));
+    }, true);
+    globals->define("recv_all", Value(recvAll));
+    
+    // wait(task) - the task's result once it has finished
+    auto wait = std::make_shared<NativeFunction>(1, [this](std::vector<Value>& args) -> Value {
+        std::shared_ptr<Task> task;
+        if (args[0].isHandle()) {
+            task = std::dynamic_pointer_cast<Task>(args[0].asHandle());
+        }
+        if (!task) {
+            throw RuntimeError("wait() expects a task");
+        }
+        return scheduler().wait(task);
+    });
+    globals->define("wait", Value(wait));
+    
+    // yield() - let the other tasks run first
+    auto yield = std::make_shared<NativeFunction>(0, [this](std::vector<Value>&) -> Value {
+        scheduler().yield();
+        return Value();
+    });
+    globals->define("yield", Value(yield));
+    
+    // stats() - runtime counters so far, as a map; empty unless built with SIMPSCRIPT_STATS
+    auto stats = std::make_shared<NativeFunction>(0, [](std::vector<Value>&) -> Value {
+        return statsValue(collectStats());
+    }, true);
+    globals->define("stats", Value(stats));
+    
+    // now_ns() and clock() - a monotonic clock, in nanoseconds or seconds since the program started
+    auto nowNs = std::make_shared<NativeFunction>(0, [](std::vector<Value>&) -> Value {
+        return Value(nanosecondsSinceStart());
+    }, true);
+    globals->define("now_ns", Value(nowNs));
+    
+    auto clock = std::make_shared<NativeFunction>(0, [](std::vector<Value>&) -> Value {
+        return Value(nanosecondsSinceStart() / 1e9);
+    }, true);
+    globals->define("clock", Value(clock));
+    
+    // bench(fn, iterations) - time calls of fn with no arguments, after a tenth as many untimed
+    // warmup calls. Each call's result is kept until its time is taken, so the work is always
+    // done and freeing it is not timed. Returns a map of min, median and mean nanoseconds per call
+    auto bench = std::make_shared<NativeFunction>(2, [this](std::vector<Value>& args) -> Value {
+        if (!args[0].isFunction()) {
+            throw RuntimeError("bench() expects a function");
+        }
+        if (!args[1].isInteger() || args[1].asInteger() <= 0) {
+            throw RuntimeError("bench() iterations must be a positive integer");
+        }
+        auto function = args[0].asFunction();
+        int iterations = args[1].asInteger();
+        
+        // Checked once here rather than on every timed call (negative arity means variadic)
+        if (function->arity() > 0) {
+            throw RuntimeError("bench() expects a function that takes no arguments, not " +
+                               std::to_string(function->arity()));
+        }
+        
+        std::vector<Value> noArguments;
+        for (int i = 0; i < std::max(1, iterations / 10); i++) {
+            noArguments.clear();
+            function->call(*this, noArguments);
+        }
+        
+        std::vector<double> times;
+        times.reserve(iterations);
+        for (int i = 0; i < iterations; i++) {
+            noArguments.clear();
+            auto start = std::chrono::steady_clock::now();
+            Value result = function->call(*this, noArguments);
+            auto end = std::chrono::steady_clock::now();
+            times.push_back(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+        }
+        
+        double total = 0;
+        for (double time : times) {
+            total += time;
+        }
+        std::sort(times.begin(), times.end());
+        size_t middle = times.size() / 2;
+        double median = times.size() % 2 == 1 ? times[middle] : (times[middle - 1] + times[middle]) / 2;
+        
+        auto result = std::make_shared<Map>();
+        result->set("iterations", Value(iterations));
+        result->set("min", Value(times.front()));
+        result->set("median", Value(median));
+        result->set("mean", Value(total / static_cast<double>(iterations)));
+        return Value(result);
+    });
+    globals->define("bench", Value(bench));
+}
+
+std::shared_ptr<Regex> Interpreter::regexFrom(const Value& pattern, const std::string& function) {
+    if (pattern.isHandle()) {
+        if (auto regex = std::dynamic_pointer_cast<Regex>(pattern.asHandle())) {
+            return regex;
+        }
+    } else if (pattern.isString()) {
+        return regexes.get(pattern.asString());
+    }
+    throw RuntimeError(function + "() expects a regex or a pattern string");
+}
+
+void Interpreter::trackWriter(const std::shared_ptr<OutputStream>& writer) {
+    // Forget writers that have already been released before adding the new one
+    writers.erase(std::remove_if(writers.begin(), writers.end(),
+                                 [](const std::weak_ptr<OutputStream>& weak) { return weak.expired(); }),
+                  writers.end());
+    writers.push_back(writer);
 }
 
 // Evaluate an AST node
@@ -74,7 +602,60 @@ Value Interpreter::evaluate(ASTNode* node) {
 
 // Execute a program
 Value Interpreter::execute(const std::unique_ptr<ASTNode>& program) {
-    return program->evaluate(*this);
+    Value result;
+    std::exception_ptr error;
+    try {
+        result = program->evaluate(*this);
+        
+        // The program ends once the tasks it spawned have finished
+        if (tasks) {
+            tasks->finish();
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    
+    // After an error the other tasks are abandoned
+    if (error) {
+        if (tasks) {
+            tasks->cancel();
+        }
+        std::rethrow_exception(error);
+    }
+    
+    // A return outside any function ends the program; the next one starts afresh
+    if (returning) {
+        result = clearReturn();
+    }
+    return result;
+}
+
+void Interpreter::setReturn(Value value) {
+    returnValue = std::move(value);
+    returning = true;
+}
+
+Value Interpreter::clearReturn() {
+    returning = false;
+    return std::move(returnValue);
+}
+
+ThreadPool& Interpreter::threadPool() {
+    if (!pool) {
+        size_t threads = std::thread::hardware_concurrency();
+        if (const char* setting = std::getenv("SIMPSCRIPT_THREADS")) {
+            threads = std::strtoul(setting, nullptr, 10);
+        }
+        pool = std::make_unique<ThreadPool>(threads > 0 ? threads : 1);
+    }
+    return *pool;
+}
+
+Scheduler& Interpreter::scheduler() {
+    if (!tasks) {
+        tasks = std::make_unique<Scheduler>(*this);
+    }
+    return *tasks;
 }
 
 // Environment access for functions
@@ -90,6 +671,20 @@ void Interpreter::setEnvironment(std::shared_ptr<Environment> env) {
     environment = env;
 }
 
+std::shared_ptr<InputStream> Interpreter::getInput() {
+    return input;
+}
+
+std::ostream& Interpreter::getOutput() {
+    return *output;
+}
+
+void Interpreter::setInput(std::shared_ptr<InputStream> stream) {
+    input = std::move(stream);
+    input->tie(output);
+    globals->define("stdin", Value(std::static_pointer_cast<Handle>(input)));
+}
+
 // Helper methods for the REPL
 void Interpreter::defineVariable(const std::string& name, const Value& value) {
     globals->define(name, value);
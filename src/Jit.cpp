@@ -0,0 +1,1090 @@
+#include "Jit.h"
+#include "Environment.h"
+#include "Interpreter.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+
+namespace SimpScript {
+
+Jit* jit = nullptr;
+
+// Machine code may use this much of the stack below where the interpreter calls into it.
+// Task stacks keep more than this free below the deepest script call
+static const uintptr_t nativeStackBudget = 128 * 1024;
+
+// What machine code returns
+enum Status : int { FINISHED = 0, GUARD_FAILED = 1, OUT_OF_STACK = 2 };
+
+// Where on this thread's stack a call last ran out of stack in machine code. Until the
+// interpreter has unwound above it, the calls it makes in its place stay interpreted, or each
+// level of a deep recursion would try machine code again and run out again
+static thread_local uintptr_t exhaustedAt = 0;
+
+// Why a loop or function is left to the interpreter
+struct Unsupported {};
+
+// What a loop's last body value is, in its tag slot
+enum ResultTag : int32_t { UNCHANGED = 0, NIL = 1, INT_RESULT = 2, FLOAT_RESULT = 3, BOOL_RESULT = 4 };
+
+static bool matches(const Value& value, JitType type) {
+    switch (type) {
+        case JitType::INT:
+            return value.isInteger();
+        case JitType::FLOAT:
+            return value.isFloat();
+        case JitType::BOOL:
+            return value.isBoolean();
+        case JitType::NONE:
+            break;
+    }
+    return false;
+}
+
+static JitType typeOf(const Value& value) {
+    if (value.isInteger()) return JitType::INT;
+    if (value.isFloat()) return JitType::FLOAT;
+    if (value.isBoolean()) return JitType::BOOL;
+    return JitType::NONE;
+}
+
+// Integers and booleans are kept in the low 4 bytes of their slots
+static void unbox(const Value& value, JitType type, int64_t& slot) {
+    if (type == JitType::FLOAT) {
+        double number = value.asFloat();
+        std::memcpy(&slot, &number, sizeof number);
+    } else {
+        int32_t number = type == JitType::INT ? value.asInteger() : (value.asBoolean() ? 1 : 0);
+        std::memcpy(&slot, &number, sizeof number);
+    }
+}
+
+static Value box(const int64_t& slot, JitType type) {
+    if (type == JitType::FLOAT) {
+        double number;
+        std::memcpy(&number, &slot, sizeof number);
+        return Value(number);
+    }
+    int32_t number;
+    std::memcpy(&number, &slot, sizeof number);
+    return type == JitType::INT ? Value(static_cast<int>(number)) : Value(number != 0);
+}
+
+// Lowers the body of a loop or function to machine code, one template per node. Expression
+// values end up in eax, or xmm0 for floats, with the left operands of binary operators pushed
+// on the machine stack meanwhile. Variables live in frame slots addressed from rbx; r12 holds
+// the JitContext.
+//
+// Before generating code the compiler works out, as the interpreter would at run time, which
+// scope each assignment defines or updates a variable in, and the type each variable holds.
+// Anything it cannot pin down to an integer, float or boolean is Unsupported.
+class JitCompiler {
+public:
+    enum class Mode { LOOP, FUNCTION };
+
+private:
+    struct Scope {
+        int id;
+        std::unordered_map<std::string, int> defined; // Names defined so far, and their slots
+    };
+
+    Mode mode;
+    std::vector<Scope> scopes; // Open, innermost last. The first is the loop's environment or the call's
+    std::vector<Scope> initial;
+    int scopeCount = 0;
+    std::map<std::pair<int, std::string>, int> slotOf;
+    std::vector<JitType> slotTypes;
+    std::vector<std::string> slotNames;
+    std::unordered_map<const ASTNode*, int> slots;       // Of variable reads and assignments
+    std::unordered_map<const ASTNode*, JitType> types;   // Of expressions
+    std::vector<std::string> absent;
+    bool changed = false;
+    bool settled = false; // On the last pass, when every type has to be known
+
+    // Functions
+    const std::string* functionName = nullptr;
+    size_t parameterCount = 0;
+    JitType returnType = JitType::NONE;
+    bool selfCall = false;
+
+    // Code generation
+    X86Assembler assembler;
+    X86Assembler::Label entryLabel = 0;
+    X86Assembler::Label bailLabel = 0;
+    X86Assembler::Label exitLabel = 0;
+    int resultSlot = -1;
+    int tagSlot = -1;
+
+    int newSlot(const std::string& name, JitType type);
+    int readSlot(const std::string& name);
+    int assignSlot(const std::string& name);
+    void merge(int slot, JitType type);
+    JitType known(JitType type) const;
+    static bool numeric(JitType type);
+
+    void analyzeStatement(const ASTNode* node);
+    JitType analyzeExpression(const ASTNode* node);
+    void analyzeBranches(const ASTNode* first, const ASTNode* second);
+    void analyze(const std::vector<const ASTNode*>& roots);
+
+    static int32_t offset(int slot) { return slot * 8; }
+    void load(int slot, JitType type);
+    void store(int slot, JitType type);
+    void pushValue(JitType type);
+    void leftToDouble(JitType type);
+    void rightToDouble(JitType type);
+    void truth(JitType type);
+    void setTag(ResultTag tag);
+    void tailValue(JitType type);
+    void prologue();
+    void epilogue();
+    void emitStatement(const ASTNode* node, bool tail);
+    void emitExpression(const ASTNode* node);
+    void emitBinary(const BinaryOpNode* node);
+    void emitCall(const FunctionCallNode* node);
+    std::unique_ptr<JitCode> finish();
+
+public:
+    explicit JitCompiler(Mode mode) : mode(mode) {}
+
+    // A loop continuing in environment; increment is nullptr for while loops
+    std::unique_ptr<JitCode> compileLoop(const ASTNode* condition, const ASTNode* body, const ASTNode* increment,
+                                         Environment& environment);
+
+    // A function called with arguments of these types
+    std::unique_ptr<JitCode> compileFunction(const UserFunction& function, const std::vector<Value>& arguments);
+};
+
+// Analysis
+
+int JitCompiler::newSlot(const std::string& name, JitType type) {
+    slotTypes.push_back(type);
+    slotNames.push_back(name);
+    return static_cast<int>(slotTypes.size()) - 1;
+}
+
+int JitCompiler::readSlot(const std::string& name) {
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+        auto found = scope->defined.find(name);
+        if (found != scope->defined.end()) {
+            return found->second;
+        }
+    }
+    // A global, or a variable not assigned on every path to here
+    throw Unsupported();
+}
+
+// The slot an assignment writes: the variable of that name in the innermost scope that has
+// one, or a new one in the innermost scope
+int JitCompiler::assignSlot(const std::string& name) {
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+        auto found = scope->defined.find(name);
+        if (found != scope->defined.end()) {
+            return found->second;
+        }
+    }
+    if (functionName != nullptr && name == *functionName) {
+        // Calls by that name would stop reaching the function
+        throw Unsupported();
+    }
+    if (mode == Mode::LOOP && scopes.size() == 1) {
+        // New variables in the loop's own environment outlive it, which machine code cannot arrange
+        throw Unsupported();
+    }
+    Scope& scope = scopes.back();
+    auto key = std::make_pair(scope.id, name);
+    auto existing = slotOf.find(key);
+    int slot;
+    if (existing != slotOf.end()) {
+        slot = existing->second;
+    } else {
+        slot = newSlot(name, JitType::NONE);
+        slotOf.emplace(key, slot);
+        // Were it defined where the code runs, the assignment would update that variable instead
+        if (std::find(absent.begin(), absent.end(), name) == absent.end()) {
+            absent.push_back(name);
+        }
+    }
+    scope.defined[name] = slot;
+    return slot;
+}
+
+// A variable keeps one type throughout
+void JitCompiler::merge(int slot, JitType type) {
+    if (type == JitType::NONE) {
+        return;
+    }
+    if (slotTypes[slot] == JitType::NONE) {
+        slotTypes[slot] = type;
+        changed = true;
+    } else if (slotTypes[slot] != type) {
+        throw Unsupported();
+    }
+}
+
+JitType JitCompiler::known(JitType type) const {
+    if (settled && type == JitType::NONE) {
+        throw Unsupported();
+    }
+    return type;
+}
+
+bool JitCompiler::numeric(JitType type) {
+    return type == JitType::INT || type == JitType::FLOAT;
+}
+
+void JitCompiler::analyzeBranches(const ASTNode* first, const ASTNode* second) {
+    std::vector<Scope> before = scopes;
+    analyzeStatement(first);
+    std::vector<Scope> afterFirst = scopes;
+    scopes = before;
+    if (second != nullptr) {
+        analyzeStatement(second);
+    }
+    // Defined afterwards only if defined on both paths
+    for (size_t i = 0; i < scopes.size(); i++) {
+        for (auto it = scopes[i].defined.begin(); it != scopes[i].defined.end();) {
+            if (afterFirst[i].defined.count(it->first) == 0) {
+                it = scopes[i].defined.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void JitCompiler::analyzeStatement(const ASTNode* node) {
+    if (auto* block = dynamic_cast<const BlockNode*>(node)) {
+        for (const auto& statement : block->statements) {
+            analyzeStatement(statement.get());
+        }
+    } else if (auto* branch = dynamic_cast<const IfNode*>(node)) {
+        known(analyzeExpression(branch->condition.get()));
+        analyzeBranches(branch->thenBranch.get(), branch->elseBranch.get());
+    } else if (auto* loop = dynamic_cast<const WhileNode*>(node)) {
+        known(analyzeExpression(loop->condition.get()));
+        // The body may not run, so what it defines is not defined afterwards
+        std::vector<Scope> before = scopes;
+        analyzeStatement(loop->body.get());
+        scopes = before;
+    } else if (auto* loop = dynamic_cast<const ForNode*>(node)) {
+        // A for loop has an environment of its own, which new variables go into
+        scopes.push_back(Scope{++scopeCount, {}});
+        analyzeExpression(loop->initialization.get());
+        known(analyzeExpression(loop->condition.get()));
+        analyzeStatement(loop->body.get());
+        analyzeExpression(loop->increment.get());
+        scopes.pop_back();
+    } else if (auto* returnNode = dynamic_cast<const ReturnNode*>(node)) {
+        if (mode != Mode::FUNCTION) {
+            throw Unsupported();
+        }
+        JitType type = known(analyzeExpression(returnNode->expression.get()));
+        if (type != JitType::NONE) {
+            if (returnType == JitType::NONE) {
+                returnType = type;
+                changed = true;
+            } else if (returnType != type) {
+                throw Unsupported();
+            }
+        }
+    } else {
+        analyzeExpression(node);
+    }
+}
+
+JitType JitCompiler::analyzeExpression(const ASTNode* node) {
+    JitType type = JitType::NONE;
+    if (auto* literal = dynamic_cast<const LiteralNode*>(node)) {
+        if (std::holds_alternative<int>(literal->value)) {
+            type = JitType::INT;
+        } else if (std::holds_alternative<double>(literal->value)) {
+            type = JitType::FLOAT;
+        } else if (std::holds_alternative<bool>(literal->value)) {
+            type = JitType::BOOL;
+        } else {
+            throw Unsupported();
+        }
+    } else if (auto* variable = dynamic_cast<const VariableNode*>(node)) {
+        int slot = readSlot(variable->name);
+        slots[node] = slot;
+        type = known(slotTypes[slot]);
+    } else if (auto* assignment = dynamic_cast<const AssignmentNode*>(node)) {
+        type = known(analyzeExpression(assignment->expression.get()));
+        int slot = assignSlot(assignment->name);
+        slots[node] = slot;
+        merge(slot, type);
+    } else if (auto* unary = dynamic_cast<const UnaryOpNode*>(node)) {
+        JitType operand = known(analyzeExpression(unary->operand.get()));
+        if (unary->opType == UnaryOpNode::OpType::NOT) {
+            type = JitType::BOOL;
+        } else if (operand == JitType::BOOL) {
+            throw Unsupported();
+        } else {
+            type = operand;
+        }
+    } else if (auto* binary = dynamic_cast<const BinaryOpNode*>(node)) {
+        using Op = BinaryOpNode::OpType;
+        JitType left = known(analyzeExpression(binary->left.get()));
+        JitType right = known(analyzeExpression(binary->right.get()));
+        bool unknown = left == JitType::NONE || right == JitType::NONE;
+        switch (binary->opType) {
+            case Op::AND:
+            case Op::OR:
+                type = JitType::BOOL;
+                break;
+            case Op::EQ:
+            case Op::NEQ:
+                // Booleans equal only booleans; the interpreter would compare them unequal to numbers
+                if (!unknown && !(numeric(left) && numeric(right)) && !(left == JitType::BOOL && right == JitType::BOOL)) {
+                    throw Unsupported();
+                }
+                type = JitType::BOOL;
+                break;
+            case Op::LT:
+            case Op::LTE:
+            case Op::GT:
+            case Op::GTE:
+                if (!unknown && !(numeric(left) && numeric(right))) {
+                    throw Unsupported();
+                }
+                type = JitType::BOOL;
+                break;
+            case Op::MOD:
+                if (!unknown && (left != JitType::INT || right != JitType::INT)) {
+                    throw Unsupported();
+                }
+                type = unknown ? JitType::NONE : JitType::INT;
+                break;
+            case Op::ADD:
+            case Op::SUB:
+            case Op::MUL:
+            case Op::DIV:
+                if (unknown) {
+                    break;
+                }
+                if (!numeric(left) || !numeric(right)) {
+                    throw Unsupported();
+                }
+                type = left == JitType::INT && right == JitType::INT ? JitType::INT : JitType::FLOAT;
+                break;
+        }
+    } else if (auto* call = dynamic_cast<const FunctionCallNode*>(node)) {
+        // Only a function calling itself, which cannot have been redefined while it runs
+        if (mode != Mode::FUNCTION || call->name != *functionName || call->arguments.size() != parameterCount) {
+            throw Unsupported();
+        }
+        for (const Scope& scope : scopes) {
+            if (scope.defined.count(call->name) != 0) {
+                throw Unsupported();
+            }
+        }
+        for (size_t i = 0; i < call->arguments.size(); i++) {
+            JitType argument = known(analyzeExpression(call->arguments[i].get()));
+            if (settled && argument != slotTypes[i]) {
+                throw Unsupported();
+            }
+        }
+        selfCall = true;
+        type = known(returnType);
+    } else {
+        throw Unsupported();
+    }
+    types[node] = type;
+    return type;
+}
+
+// Walk the code until the types of its variables stop changing; new variables start with no
+// type and take that of the first value assigned to them
+void JitCompiler::analyze(const std::vector<const ASTNode*>& roots) {
+    initial = scopes;
+    do {
+        changed = false;
+        scopes = initial;
+        scopeCount = 0;
+        for (const ASTNode* root : roots) {
+            analyzeStatement(root);
+        }
+    } while (changed);
+
+    settled = true;
+    scopes = initial;
+    scopeCount = 0;
+    for (const ASTNode* root : roots) {
+        analyzeStatement(root);
+    }
+}
+
+// Code generation
+
+void JitCompiler::load(int slot, JitType type) {
+    if (type == JitType::FLOAT) {
+        assembler.loadDouble(Xmm::XMM0, Reg::RBX, offset(slot));
+    } else {
+        assembler.load32(Reg::RAX, Reg::RBX, offset(slot));
+    }
+}
+
+void JitCompiler::store(int slot, JitType type) {
+    if (type == JitType::FLOAT) {
+        assembler.storeDouble(Reg::RBX, offset(slot), Xmm::XMM0);
+    } else {
+        assembler.store32(Reg::RBX, offset(slot), Reg::RAX);
+    }
+}
+
+void JitCompiler::pushValue(JitType type) {
+    if (type == JitType::FLOAT) {
+        assembler.movqFromXmm(Reg::RAX, Xmm::XMM0);
+    }
+    assembler.push(Reg::RAX);
+}
+
+// The left operand, popped into rcx, as a double in xmm1
+void JitCompiler::leftToDouble(JitType type) {
+    if (type == JitType::INT) {
+        assembler.cvtsi2sd(Xmm::XMM1, Reg::RCX);
+    } else {
+        assembler.movqToXmm(Xmm::XMM1, Reg::RCX);
+    }
+}
+
+// The right operand as a double in xmm0
+void JitCompiler::rightToDouble(JitType type) {
+    if (type == JitType::INT) {
+        assembler.cvtsi2sd(Xmm::XMM0, Reg::RAX);
+    }
+}
+
+// The value as 0 or 1 in eax, as isTruthy() would give it
+void JitCompiler::truth(JitType type) {
+    if (type == JitType::INT) {
+        assembler.test32(Reg::RAX, Reg::RAX);
+        assembler.setcc(Condition::NOT_EQUAL, Reg::RAX);
+        assembler.movzx8(Reg::RAX, Reg::RAX);
+    } else if (type == JitType::FLOAT) {
+        // NaN is truthy: it is not equal to zero
+        assembler.xorpd(Xmm::XMM1, Xmm::XMM1);
+        assembler.ucomisd(Xmm::XMM0, Xmm::XMM1);
+        assembler.setcc(Condition::NOT_EQUAL, Reg::RAX);
+        assembler.setcc(Condition::PARITY, Reg::RCX);
+        assembler.alu32(AluOp::OR, Reg::RAX, Reg::RCX);
+        assembler.movzx8(Reg::RAX, Reg::RAX);
+    }
+}
+
+void JitCompiler::setTag(ResultTag tag) {
+    assembler.movImm32(Reg::RCX, tag);
+    assembler.store32(Reg::RBX, offset(tagSlot), Reg::RCX);
+}
+
+// Record the value just computed as the loop body's value
+void JitCompiler::tailValue(JitType type) {
+    store(resultSlot, type);
+    setTag(type == JitType::INT ? INT_RESULT : type == JitType::FLOAT ? FLOAT_RESULT : BOOL_RESULT);
+}
+
+void JitCompiler::prologue() {
+    assembler.push(Reg::RBP);
+    assembler.mov(Reg::RBP, Reg::RSP);
+    assembler.push(Reg::RBX);
+    assembler.push(Reg::R12);
+    assembler.mov(Reg::RBX, Reg::RDI);
+    assembler.mov(Reg::R12, Reg::RSI);
+}
+
+// Whatever is left on the machine stack when a guard fails is dropped here
+void JitCompiler::epilogue() {
+    assembler.bind(exitLabel);
+    assembler.lea(Reg::RSP, Reg::RBP, -16);
+    assembler.pop(Reg::R12);
+    assembler.pop(Reg::RBX);
+    assembler.pop(Reg::RBP);
+    assembler.ret();
+}
+
+void JitCompiler::emitStatement(const ASTNode* node, bool tail) {
+    if (auto* block = dynamic_cast<const BlockNode*>(node)) {
+        // A block's value is that of its last statement
+        for (size_t i = 0; i < block->statements.size(); i++) {
+            emitStatement(block->statements[i].get(), tail && i + 1 == block->statements.size());
+        }
+        if (tail && block->statements.empty()) {
+            setTag(NIL);
+        }
+    } else if (auto* branch = dynamic_cast<const IfNode*>(node)) {
+        X86Assembler::Label otherwise = assembler.newLabel();
+        X86Assembler::Label end = assembler.newLabel();
+        emitExpression(branch->condition.get());
+        truth(types.at(branch->condition.get()));
+        assembler.test32(Reg::RAX, Reg::RAX);
+        assembler.jcc(Condition::EQUAL, otherwise);
+        emitStatement(branch->thenBranch.get(), tail);
+        assembler.jmp(end);
+        assembler.bind(otherwise);
+        if (branch->elseBranch) {
+            emitStatement(branch->elseBranch.get(), tail);
+        } else if (tail) {
+            setTag(NIL);
+        }
+        assembler.bind(end);
+    } else if (auto* loop = dynamic_cast<const WhileNode*>(node)) {
+        X86Assembler::Label head = assembler.newLabel();
+        X86Assembler::Label end = assembler.newLabel();
+        if (tail) {
+            setTag(NIL);
+        }
+        assembler.bind(head);
+        emitExpression(loop->condition.get());
+        truth(types.at(loop->condition.get()));
+        assembler.test32(Reg::RAX, Reg::RAX);
+        assembler.jcc(Condition::EQUAL, end);
+        emitStatement(loop->body.get(), tail);
+        assembler.jmp(head);
+        assembler.bind(end);
+    } else if (auto* loop = dynamic_cast<const ForNode*>(node)) {
+        X86Assembler::Label head = assembler.newLabel();
+        X86Assembler::Label end = assembler.newLabel();
+        if (tail) {
+            setTag(NIL);
+        }
+        emitExpression(loop->initialization.get());
+        assembler.bind(head);
+        emitExpression(loop->condition.get());
+        truth(types.at(loop->condition.get()));
+        assembler.test32(Reg::RAX, Reg::RAX);
+        assembler.jcc(Condition::EQUAL, end);
+        emitStatement(loop->body.get(), tail);
+        emitExpression(loop->increment.get());
+        assembler.jmp(head);
+        assembler.bind(end);
+    } else if (auto* returnNode = dynamic_cast<const ReturnNode*>(node)) {
+        emitExpression(returnNode->expression.get());
+        store(resultSlot, returnType);
+        assembler.movImm32(Reg::RAX, FINISHED);
+        assembler.jmp(exitLabel);
+    } else {
+        emitExpression(node);
+        if (tail) {
+            tailValue(types.at(node));
+        }
+    }
+}
+
+void JitCompiler::emitExpression(const ASTNode* node) {
+    JitType type = types.at(node);
+    if (auto* literal = dynamic_cast<const LiteralNode*>(node)) {
+        if (type == JitType::FLOAT) {
+            double number = std::get<double>(literal->value);
+            uint64_t bits;
+            std::memcpy(&bits, &number, sizeof bits);
+            assembler.movImm64(Reg::RAX, bits);
+            assembler.movqToXmm(Xmm::XMM0, Reg::RAX);
+        } else if (type == JitType::INT) {
+            assembler.movImm32(Reg::RAX, std::get<int>(literal->value));
+        } else {
+            assembler.movImm32(Reg::RAX, std::get<bool>(literal->value) ? 1 : 0);
+        }
+    } else if (dynamic_cast<const VariableNode*>(node)) {
+        load(slots.at(node), type);
+    } else if (auto* assignment = dynamic_cast<const AssignmentNode*>(node)) {
+        emitExpression(assignment->expression.get());
+        store(slots.at(node), type);
+    } else if (auto* unary = dynamic_cast<const UnaryOpNode*>(node)) {
+        emitExpression(unary->operand.get());
+        if (unary->opType == UnaryOpNode::OpType::NOT) {
+            truth(types.at(unary->operand.get()));
+            assembler.aluImm32(AluOp::XOR, Reg::RAX, 1);
+        } else if (type == JitType::INT) {
+            assembler.neg32(Reg::RAX);
+        } else {
+            assembler.movImm64(Reg::RAX, 0x8000000000000000ULL);
+            assembler.movqToXmm(Xmm::XMM1, Reg::RAX);
+            assembler.xorpd(Xmm::XMM0, Xmm::XMM1);
+        }
+    } else if (auto* binary = dynamic_cast<const BinaryOpNode*>(node)) {
+        emitBinary(binary);
+    } else if (auto* call = dynamic_cast<const FunctionCallNode*>(node)) {
+        emitCall(call);
+    }
+}
+
+void JitCompiler::emitBinary(const BinaryOpNode* node) {
+    using Op = BinaryOpNode::OpType;
+    JitType left = types.at(node->left.get());
+    JitType right = types.at(node->right.get());
+    bool logical = node->opType == Op::AND || node->opType == Op::OR;
+
+    // Both operands are evaluated, left first, as the interpreter does
+    emitExpression(node->left.get());
+    if (logical) {
+        truth(left);
+    }
+    pushValue(logical ? JitType::BOOL : left);
+    emitExpression(node->right.get());
+    if (logical) {
+        truth(right);
+    }
+    assembler.pop(Reg::RCX);
+
+    if (logical) {
+        assembler.alu32(node->opType == Op::AND ? AluOp::AND : AluOp::OR, Reg::RAX, Reg::RCX);
+        return;
+    }
+
+    bool integers = (left == JitType::INT && right == JitType::INT) || (left == JitType::BOOL && right == JitType::BOOL);
+    switch (node->opType) {
+        case Op::ADD:
+        case Op::SUB:
+        case Op::MUL:
+        case Op::DIV:
+        case Op::MOD:
+            if (integers) {
+                // 32-bit arithmetic wraps as the interpreter's int arithmetic does
+                if (node->opType == Op::ADD) {
+                    assembler.alu32(AluOp::ADD, Reg::RAX, Reg::RCX);
+                } else if (node->opType == Op::SUB) {
+                    assembler.alu32(AluOp::SUB, Reg::RCX, Reg::RAX);
+                    assembler.mov(Reg::RAX, Reg::RCX);
+                } else if (node->opType == Op::MUL) {
+                    assembler.imul32(Reg::RAX, Reg::RCX);
+                } else {
+                    // Division by zero raises an error and INT_MIN / -1 traps, so leave both
+                    // to the interpreter
+                    assembler.test32(Reg::RAX, Reg::RAX);
+                    assembler.jcc(Condition::EQUAL, bailLabel);
+                    assembler.aluImm32(AluOp::CMP, Reg::RAX, -1);
+                    assembler.jcc(Condition::EQUAL, bailLabel);
+                    assembler.xchg32(Reg::RCX);
+                    assembler.cdq();
+                    assembler.idiv32(Reg::RCX);
+                    if (node->opType == Op::MOD) {
+                        assembler.mov(Reg::RAX, Reg::RDX);
+                    }
+                }
+            } else {
+                leftToDouble(left);
+                rightToDouble(right);
+                SseOp op = SseOp::ADD;
+                if (node->opType == Op::SUB) {
+                    op = SseOp::SUB;
+                } else if (node->opType == Op::MUL) {
+                    op = SseOp::MUL;
+                } else if (node->opType == Op::DIV) {
+                    // Division by zero raises an error; NaN is not zero
+                    X86Assembler::Label nonzero = assembler.newLabel();
+                    assembler.xorpd(Xmm::XMM2, Xmm::XMM2);
+                    assembler.ucomisd(Xmm::XMM0, Xmm::XMM2);
+                    assembler.jcc(Condition::PARITY, nonzero);
+                    assembler.jcc(Condition::EQUAL, bailLabel);
+                    assembler.bind(nonzero);
+                    op = SseOp::DIV;
+                }
+                assembler.sse(op, Xmm::XMM1, Xmm::XMM0);
+                assembler.movapd(Xmm::XMM0, Xmm::XMM1);
+            }
+            return;
+        default:
+            break;
+    }
+
+    if (integers) {
+        Condition condition = Condition::EQUAL;
+        switch (node->opType) {
+            case Op::NEQ: condition = Condition::NOT_EQUAL; break;
+            case Op::LT: condition = Condition::LESS; break;
+            case Op::LTE: condition = Condition::LESS_EQUAL; break;
+            case Op::GT: condition = Condition::GREATER; break;
+            case Op::GTE: condition = Condition::GREATER_EQUAL; break;
+            default: break;
+        }
+        assembler.alu32(AluOp::CMP, Reg::RCX, Reg::RAX);
+        assembler.setcc(condition, Reg::RAX);
+        assembler.movzx8(Reg::RAX, Reg::RAX);
+        return;
+    }
+
+    // Compared as doubles, as the interpreter compares numbers. ucomisd reports NaN as
+    // unordered, which makes < and <= false and so > and >=, defined as their negations, true
+    leftToDouble(left);
+    rightToDouble(right);
+    switch (node->opType) {
+        case Op::EQ:
+        case Op::NEQ:
+            assembler.ucomisd(Xmm::XMM1, Xmm::XMM0);
+            if (node->opType == Op::EQ) {
+                assembler.setcc(Condition::EQUAL, Reg::RAX);
+                assembler.setcc(Condition::NO_PARITY, Reg::RCX);
+                assembler.alu32(AluOp::AND, Reg::RAX, Reg::RCX);
+            } else {
+                assembler.setcc(Condition::NOT_EQUAL, Reg::RAX);
+                assembler.setcc(Condition::PARITY, Reg::RCX);
+                assembler.alu32(AluOp::OR, Reg::RAX, Reg::RCX);
+            }
+            break;
+        default: {
+            // Flags of right against left
+            Condition condition = Condition::ABOVE;
+            if (node->opType == Op::LTE) {
+                condition = Condition::ABOVE_EQUAL;
+            } else if (node->opType == Op::GT) {
+                condition = Condition::BELOW;
+            } else if (node->opType == Op::GTE) {
+                condition = Condition::BELOW_EQUAL;
+            }
+            assembler.ucomisd(Xmm::XMM0, Xmm::XMM1);
+            assembler.setcc(condition, Reg::RAX);
+            break;
+        }
+    }
+    assembler.movzx8(Reg::RAX, Reg::RAX);
+}
+
+// Arguments are pushed as they are evaluated, then copied into a new frame below them
+void JitCompiler::emitCall(const FunctionCallNode* node) {
+    size_t count = node->arguments.size();
+    for (const auto& argument : node->arguments) {
+        emitExpression(argument.get());
+        pushValue(types.at(argument.get()));
+    }
+    int32_t frameBytes = static_cast<int32_t>(slotTypes.size() * 8);
+    assembler.aluImm64(AluOp::SUB, Reg::RSP, frameBytes);
+    for (size_t i = 0; i < count; i++) {
+        assembler.load64(Reg::RAX, Reg::RSP, frameBytes + static_cast<int32_t>(8 * (count - 1 - i)));
+        assembler.store64(Reg::RSP, offset(static_cast<int>(i)), Reg::RAX);
+    }
+    assembler.mov(Reg::RDI, Reg::RSP);
+    assembler.mov(Reg::RSI, Reg::R12);
+    assembler.call(entryLabel);
+    // A guard failed somewhere in the callee, so the whole call goes back to the interpreter
+    assembler.test32(Reg::RAX, Reg::RAX);
+    assembler.jcc(Condition::NOT_EQUAL, exitLabel);
+    if (returnType == JitType::FLOAT) {
+        assembler.loadDouble(Xmm::XMM0, Reg::RSP, offset(resultSlot));
+    } else {
+        assembler.load32(Reg::RAX, Reg::RSP, offset(resultSlot));
+    }
+    assembler.aluImm64(AluOp::ADD, Reg::RSP, frameBytes + static_cast<int32_t>(8 * count));
+}
+
+std::unique_ptr<JitCode> JitCompiler::finish() {
+    auto code = std::make_unique<JitCode>();
+    code->machineCode = std::make_unique<ExecutableCode>(assembler.finish());
+    code->entry = reinterpret_cast<JitCode::Entry>(const_cast<void*>(code->machineCode->address()));
+    code->absent = absent;
+    code->frameSlots = slotTypes.size();
+    code->resultSlot = resultSlot;
+    code->tagSlot = tagSlot;
+    code->resultType = returnType;
+    code->selfCall = selfCall;
+    return code;
+}
+
+std::unique_ptr<JitCode> JitCompiler::compileLoop(const ASTNode* condition, const ASTNode* body,
+                                                  const ASTNode* increment, Environment& environment) {
+    // Every variable the loop reads or assigns has to exist with a type machine code handles,
+    // or be local to a for loop inside it
+    std::vector<const ASTNode*> roots{condition, body};
+    if (increment != nullptr) {
+        roots.push_back(increment);
+    }
+    std::vector<std::string> names;
+    std::vector<const ASTNode*> pending(roots);
+    while (!pending.empty()) {
+        const ASTNode* node = pending.back();
+        pending.pop_back();
+        if (auto* variable = dynamic_cast<const VariableNode*>(node)) {
+            names.push_back(variable->name);
+        } else if (auto* assignment = dynamic_cast<const AssignmentNode*>(node)) {
+            names.push_back(assignment->name);
+            pending.push_back(assignment->expression.get());
+        } else if (auto* block = dynamic_cast<const BlockNode*>(node)) {
+            for (const auto& statement : block->statements) pending.push_back(statement.get());
+        } else if (auto* branch = dynamic_cast<const IfNode*>(node)) {
+            pending.push_back(branch->condition.get());
+            pending.push_back(branch->thenBranch.get());
+            if (branch->elseBranch) pending.push_back(branch->elseBranch.get());
+        } else if (auto* loop = dynamic_cast<const WhileNode*>(node)) {
+            pending.push_back(loop->condition.get());
+            pending.push_back(loop->body.get());
+        } else if (auto* loop = dynamic_cast<const ForNode*>(node)) {
+            pending.push_back(loop->initialization.get());
+            pending.push_back(loop->condition.get());
+            pending.push_back(loop->increment.get());
+            pending.push_back(loop->body.get());
+        } else if (auto* unary = dynamic_cast<const UnaryOpNode*>(node)) {
+            pending.push_back(unary->operand.get());
+        } else if (auto* binary = dynamic_cast<const BinaryOpNode*>(node)) {
+            pending.push_back(binary->left.get());
+            pending.push_back(binary->right.get());
+        } else if (!dynamic_cast<const LiteralNode*>(node)) {
+            throw Unsupported();
+        }
+    }
+
+    std::vector<JitInput> inputs;
+    scopes.push_back(Scope{0, {}});
+    for (const std::string& name : names) {
+        if (scopes[0].defined.count(name) != 0) {
+            continue;
+        }
+        const Value* value = environment.lookup(name);
+        if (value == nullptr) {
+            continue;
+        }
+        JitType type = typeOf(*value);
+        if (type == JitType::NONE) {
+            throw Unsupported();
+        }
+        int slot = newSlot(name, type);
+        scopes[0].defined[name] = slot;
+        inputs.push_back(JitInput{name, slot, type, false});
+    }
+    analyze(roots);
+    tagSlot = newSlot("", JitType::INT);
+    resultSlot = newSlot("", JitType::NONE);
+    for (JitInput& input : inputs) {
+        for (const auto& [node, slot] : slots) {
+            if (slot == input.slot && dynamic_cast<const AssignmentNode*>(node)) {
+                input.written = true;
+            }
+        }
+    }
+
+    // Each iteration starts by saving the frame to a second copy after it, which bailing out
+    // restores, so the interpreter redoes the iteration from its start
+    int32_t saved = static_cast<int32_t>(slotTypes.size() * 8);
+    exitLabel = assembler.newLabel();
+    bailLabel = assembler.newLabel();
+    X86Assembler::Label head = assembler.newLabel();
+    X86Assembler::Label done = assembler.newLabel();
+    prologue();
+    assembler.bind(head);
+    for (size_t slot = 0; slot < slotTypes.size(); slot++) {
+        assembler.load64(Reg::RAX, Reg::RBX, offset(static_cast<int>(slot)));
+        assembler.store64(Reg::RBX, saved + offset(static_cast<int>(slot)), Reg::RAX);
+    }
+    emitExpression(condition);
+    truth(types.at(condition));
+    assembler.test32(Reg::RAX, Reg::RAX);
+    assembler.jcc(Condition::EQUAL, done);
+    emitStatement(body, true);
+    if (increment != nullptr) {
+        emitExpression(increment);
+    }
+    assembler.jmp(head);
+    assembler.bind(done);
+    assembler.movImm32(Reg::RAX, FINISHED);
+    assembler.jmp(exitLabel);
+    assembler.bind(bailLabel);
+    for (size_t slot = 0; slot < slotTypes.size(); slot++) {
+        assembler.load64(Reg::RAX, Reg::RBX, saved + offset(static_cast<int>(slot)));
+        assembler.store64(Reg::RBX, offset(static_cast<int>(slot)), Reg::RAX);
+    }
+    assembler.movImm32(Reg::RAX, GUARD_FAILED);
+    epilogue();
+
+    std::unique_ptr<JitCode> code = finish();
+    code->inputs = inputs;
+    code->frameSlots = 2 * slotTypes.size();
+    return code;
+}
+
+std::unique_ptr<JitCode> JitCompiler::compileFunction(const UserFunction& function, const std::vector<Value>& arguments) {
+    const std::vector<std::string>& parameters = function.getParameters();
+    if (arguments.size() != parameters.size()) {
+        throw Unsupported();
+    }
+    functionName = &function.getName();
+    parameterCount = parameters.size();
+
+    // Parameters take the first slots, where a call of the function to itself puts its arguments
+    std::vector<JitInput> inputs;
+    scopes.push_back(Scope{0, {}});
+    for (size_t i = 0; i < parameters.size(); i++) {
+        JitType type = typeOf(arguments[i]);
+        if (type == JitType::NONE || scopes[0].defined.count(parameters[i]) != 0) {
+            throw Unsupported();
+        }
+        int slot = newSlot(parameters[i], type);
+        scopes[0].defined[parameters[i]] = slot;
+        inputs.push_back(JitInput{parameters[i], slot, type, false});
+    }
+    const ASTNode* body = function.getBody();
+    analyze({body});
+    if (returnType == JitType::NONE) {
+        throw Unsupported();
+    }
+    resultSlot = newSlot("", returnType);
+
+    exitLabel = assembler.newLabel();
+    bailLabel = assembler.newLabel();
+    entryLabel = assembler.newLabel();
+    assembler.bind(entryLabel);
+    prologue();
+    X86Assembler::Label overflow = assembler.newLabel();
+    assembler.cmp64(Reg::RSP, Reg::R12, 0);
+    assembler.jcc(Condition::BELOW, overflow);
+    emitStatement(body, false);
+    // Falling off the end returns the last statement's value, which is left to the interpreter
+    assembler.bind(bailLabel);
+    assembler.movImm32(Reg::RAX, GUARD_FAILED);
+    assembler.jmp(exitLabel);
+    assembler.bind(overflow);
+    assembler.movImm32(Reg::RAX, OUT_OF_STACK);
+    epilogue();
+
+    std::unique_ptr<JitCode> code = finish();
+    code->inputs = inputs;
+    return code;
+}
+
+// Jit implementation
+Jit::Jit() {
+#if !defined(__x86_64__)
+    problem = "machine code is only generated for x86-64";
+#endif
+}
+
+template <typename Build>
+JitCode* Jit::compile(JitSite& site, Build build) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (JitCode* code = site.code.load(std::memory_order_acquire)) {
+        return code;
+    }
+    if (site.rejected.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    try {
+        compiled.push_back(build());
+    } catch (const Unsupported&) {
+        site.rejected.store(true, std::memory_order_relaxed);
+        return nullptr;
+    }
+    JitCode* code = compiled.back().get();
+    site.code.store(code, std::memory_order_release);
+    return code;
+}
+
+bool Jit::runLoop(JitSite& site, const ASTNode* condition, const ASTNode* body, const ASTNode* increment,
+                  Interpreter& interpreter, Value& result) {
+    if (!available() || site.rejected.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    Environment& environment = *interpreter.getEnvironment();
+    JitCode* code = site.code.load(std::memory_order_acquire);
+    if (code == nullptr) {
+        code = compile(site, [&] { return JitCompiler(JitCompiler::Mode::LOOP).compileLoop(condition, body, increment, environment); });
+        if (code == nullptr) {
+            return false;
+        }
+        loops++;
+    }
+
+    // The variables have to have the types the code was compiled for
+    std::vector<Value*> locations(code->inputs.size());
+    std::vector<int64_t> frame(code->frameSlots);
+    for (size_t i = 0; i < code->inputs.size(); i++) {
+        const JitInput& input = code->inputs[i];
+        locations[i] = environment.lookup(input.name);
+        if (locations[i] == nullptr || !matches(*locations[i], input.type)) {
+            return false;
+        }
+        unbox(*locations[i], input.type, frame[input.slot]);
+    }
+    for (const std::string& name : code->absent) {
+        if (environment.lookup(name) != nullptr) {
+            return false;
+        }
+    }
+
+    char marker;
+    JitContext context{reinterpret_cast<uintptr_t>(&marker) - nativeStackBudget};
+    int status = code->entry(frame.data(), &context);
+
+    for (size_t i = 0; i < code->inputs.size(); i++) {
+        const JitInput& input = code->inputs[i];
+        if (input.written) {
+            *locations[i] = box(frame[input.slot], input.type);
+        }
+    }
+    int32_t tag;
+    std::memcpy(&tag, &frame[code->tagSlot], sizeof tag);
+    if (tag == NIL) {
+        result = Value();
+    } else if (tag != UNCHANGED) {
+        result = box(frame[code->resultSlot],
+                     tag == INT_RESULT ? JitType::INT : tag == FLOAT_RESULT ? JitType::FLOAT : JitType::BOOL);
+    }
+    if (status != FINISHED) {
+        bailouts++;
+        return false;
+    }
+    return true;
+}
+
+bool Jit::call(UserFunction& function, std::vector<Value>& arguments, Value& result) {
+    char marker;
+    uintptr_t stack = reinterpret_cast<uintptr_t>(&marker);
+    if (stack < exhaustedAt) {
+        return false;
+    }
+    exhaustedAt = 0;
+    JitSite& site = function.getJitSite();
+    JitCode* code = site.code.load(std::memory_order_acquire);
+    if (code == nullptr) {
+        if (!available() || site.rejected.load(std::memory_order_relaxed) ||
+            site.hotness.fetch_add(1, std::memory_order_relaxed) + 1 < callThreshold) {
+            return false;
+        }
+        code = compile(site, [&] { return JitCompiler(JitCompiler::Mode::FUNCTION).compileFunction(function, arguments); });
+        if (code == nullptr) {
+            return false;
+        }
+        functions++;
+    }
+
+    if (arguments.size() != code->inputs.size()) {
+        return false;
+    }
+    std::vector<int64_t> frame(code->frameSlots);
+    for (size_t i = 0; i < arguments.size(); i++) {
+        if (!matches(arguments[i], code->inputs[i].type)) {
+            return false;
+        }
+        unbox(arguments[i], code->inputs[i].type, frame[code->inputs[i].slot]);
+    }
+    Environment& closure = *function.getClosure();
+    for (const std::string& name : code->absent) {
+        if (closure.lookup(name) != nullptr) {
+            return false;
+        }
+    }
+    if (code->selfCall) {
+        // The name the body calls has to still mean this function
+        const Value* self = closure.lookup(function.getName());
+        if (self == nullptr || !self->isFunction() || self->asFunction().get() != &function) {
+            return false;
+        }
+    }
+
+    JitContext context{stack - nativeStackBudget};
+    int status = code->entry(frame.data(), &context);
+    if (status != FINISHED) {
+        if (status == OUT_OF_STACK) {
+            exhaustedAt = stack;
+        }
+        bailouts++;
+        return false;
+    }
+    result = box(frame[code->resultSlot], code->resultType);
+    return true;
+}
+
+void Jit::summary(std::ostream& out) const {
+    out << "JIT: compiled " << loops << " loops and " << functions << " functions, " << bailouts << " bailouts"
+        << std::endl;
+}
+
+} // namespace SimpScript
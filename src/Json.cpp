@@ -0,0 +1,503 @@
+#include "Json.h"
+#include "Interpreter.h"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+namespace SimpScript {
+
+// DeferredJson implementation
+DeferredJson::DeferredJson(std::shared_ptr<const char> text, size_t length, bool object)
+    : text(std::move(text)), length(length), object(object) {}
+
+const Value& DeferredJson::value() {
+    std::call_once(parseOnce, [this]() { parsed = JsonParser::parseLevel(*this); });
+    return parsed;
+}
+
+// JsonParser implementation
+JsonParser::JsonParser(std::shared_ptr<const char> source, size_t length, bool lazy)
+    : source(std::move(source)), lazy(lazy) {
+    begin = current = this->source.get();
+    end = begin + length;
+}
+
+JsonParser::JsonParser(const Value& text, bool lazy)
+    : JsonParser(std::shared_ptr<const char>(std::make_shared<Value>(text), text.asStringView().data()),
+                 text.asStringView().size(), lazy) {}
+
+Value JsonParser::parse() {
+    Value result = parseValue();
+    skipWhitespace();
+    if (current != end) {
+        error("unexpected text after the document");
+    }
+    return result;
+}
+
+Value JsonParser::parseLevel(const DeferredJson& json) {
+    JsonParser parser(json.text, json.length, true);
+    return json.object ? parser.parseObject() : parser.parseArray();
+}
+
+void JsonParser::error(const std::string& message) const {
+    int line = 1;
+    int column = 1;
+    for (const char* c = begin; c < current && c < end; c++) {
+        if (*c == '\n') {
+            line++;
+            column = 1;
+        } else {
+            column++;
+        }
+    }
+    throw RuntimeError("Invalid JSON: " + message + " at line " + std::to_string(line) +
+                       ", column " + std::to_string(column));
+}
+
+void JsonParser::skipWhitespace() {
+    while (current < end && (*current == ' ' || *current == '\n' || *current == '\r' || *current == '\t')) {
+        current++;
+    }
+}
+
+void JsonParser::expect(char c) {
+    skipWhitespace();
+    if (current == end || *current != c) {
+        error(std::string("expected '") + c + "'");
+    }
+    current++;
+}
+
+Value JsonParser::parseValue() {
+    skipWhitespace();
+    if (current == end) {
+        error("unexpected end of input");
+    }
+
+    switch (*current) {
+        case '{':
+            return lazy ? defer() : parseObject();
+        case '[':
+            return lazy ? defer() : parseArray();
+        case '"':
+            return parseString();
+        case 't':
+            return parseLiteral("true", Value(true));
+        case 'f':
+            return parseLiteral("false", Value(false));
+        case 'n':
+            return parseLiteral("null", Value());
+        default:
+            if (*current == '-' || (*current >= '0' && *current <= '9')) {
+                return parseNumber();
+            }
+            error("unexpected character");
+    }
+}
+
+Value JsonParser::parseObject() {
+    if (++depth > maxDepth) {
+        error("nesting is too deep");
+    }
+    expect('{');
+    auto map = std::make_shared<Map>();
+
+    skipWhitespace();
+    if (current < end && *current == '}') {
+        current++;
+        depth--;
+        return Value(map);
+    }
+
+    std::string unescaped;
+    while (true) {
+        skipWhitespace();
+        if (current == end || *current != '"') {
+            error("expected a string key");
+        }
+        std::string key(readString(unescaped));
+        expect(':');
+        map->set(key, parseValue());
+
+        skipWhitespace();
+        if (current < end && *current == ',') {
+            current++;
+        } else if (current < end && *current == '}') {
+            current++;
+            break;
+        } else {
+            error("expected ',' or '}'");
+        }
+    }
+
+    depth--;
+    return Value(map);
+}
+
+Value JsonParser::parseArray() {
+    if (++depth > maxDepth) {
+        error("nesting is too deep");
+    }
+    expect('[');
+    std::vector<Value> elements;
+
+    skipWhitespace();
+    if (current < end && *current == ']') {
+        current++;
+        depth--;
+        return Value(std::move(elements));
+    }
+
+    while (true) {
+        elements.push_back(parseValue());
+
+        skipWhitespace();
+        if (current < end && *current == ',') {
+            current++;
+        } else if (current < end && *current == ']') {
+            current++;
+            break;
+        } else {
+            error("expected ',' or ']'");
+        }
+    }
+
+    depth--;
+    return Value(std::move(elements));
+}
+
+// Append a code point as UTF-8
+static void appendUtf8(std::string& out, unsigned int code) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+std::string_view JsonParser::readString(std::string& unescaped) {
+    const char* start = ++current;
+
+    // Fast path: most strings have no escapes and can be used where they are
+    while (current < end && *current != '"' && *current != '\\') {
+        if (static_cast<unsigned char>(*current) < 0x20) {
+            error("control character in string");
+        }
+        current++;
+    }
+    if (current == end) {
+        error("unterminated string");
+    }
+    if (*current == '"') {
+        return std::string_view(start, static_cast<size_t>(current++ - start));
+    }
+
+    unescaped.assign(start, current);
+    while (true) {
+        if (current == end) {
+            error("unterminated string");
+        }
+        char c = *current++;
+        if (c == '"') {
+            return unescaped;
+        }
+        if (static_cast<unsigned char>(c) < 0x20) {
+            current--;
+            error("control character in string");
+        }
+        if (c != '\\') {
+            unescaped += c;
+            continue;
+        }
+
+        if (current == end) {
+            error("unterminated string");
+        }
+        switch (*current++) {
+            case '"': unescaped += '"'; break;
+            case '\\': unescaped += '\\'; break;
+            case '/': unescaped += '/'; break;
+            case 'b': unescaped += '\b'; break;
+            case 'f': unescaped += '\f'; break;
+            case 'n': unescaped += '\n'; break;
+            case 'r': unescaped += '\r'; break;
+            case 't': unescaped += '\t'; break;
+            case 'u': {
+                auto readHex = [this]() {
+                    unsigned int code = 0;
+                    if (end - current < 4 ||
+                        std::from_chars(current, current + 4, code, 16).ptr != current + 4) {
+                        error("invalid \\u escape");
+                    }
+                    current += 4;
+                    return code;
+                };
+                unsigned int code = readHex();
+                if (code >= 0xD800 && code <= 0xDBFF) {
+                    // A high surrogate must be followed by an escaped low surrogate
+                    if (end - current < 2 || current[0] != '\\' || current[1] != 'u') {
+                        error("unpaired surrogate in \\u escape");
+                    }
+                    current += 2;
+                    unsigned int low = readHex();
+                    if (low < 0xDC00 || low > 0xDFFF) {
+                        error("unpaired surrogate in \\u escape");
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                    error("unpaired surrogate in \\u escape");
+                }
+                appendUtf8(unescaped, code);
+                break;
+            }
+            default:
+                current--;
+                error("invalid escape in string");
+        }
+    }
+}
+
+Value JsonParser::parseString() {
+    std::string unescaped;
+    std::string_view text = readString(unescaped);
+    if (text.data() == unescaped.data()) {
+        return Value(std::move(unescaped));
+    }
+    return Value(std::shared_ptr<const char>(source, text.data()), text.size());
+}
+
+Value JsonParser::parseNumber() {
+    const char* start = current;
+    bool integral = true;
+    auto digits = [this]() {
+        const char* first = current;
+        while (current < end && *current >= '0' && *current <= '9') {
+            current++;
+        }
+        return current > first;
+    };
+
+    if (*current == '-') {
+        current++;
+    }
+    if (current < end && *current == '0') {
+        current++;
+    } else if (!digits()) {
+        error("invalid number");
+    }
+    if (current < end && *current == '.') {
+        integral = false;
+        current++;
+        if (!digits()) {
+            error("invalid number");
+        }
+    }
+    if (current < end && (*current == 'e' || *current == 'E')) {
+        integral = false;
+        current++;
+        if (current < end && (*current == '+' || *current == '-')) {
+            current++;
+        }
+        if (!digits()) {
+            error("invalid number");
+        }
+    }
+
+    if (integral) {
+        int number;
+        auto result = std::from_chars(start, current, number);
+        if (result.ec == std::errc()) {
+            return Value(number);
+        }
+        // Too large for an integer; fall back to a float
+    }
+    double number;
+    std::from_chars(start, current, number);
+    return Value(number);
+}
+
+Value JsonParser::parseLiteral(std::string_view word, Value value) {
+    if (static_cast<size_t>(end - current) < word.size() ||
+        std::string_view(current, word.size()) != word) {
+        error("unexpected character");
+    }
+    current += word.size();
+    return value;
+}
+
+void JsonParser::skipString() {
+    current++;
+    while (true) {
+        const void* quote = std::memchr(current, '"', static_cast<size_t>(end - current));
+        if (quote == nullptr) {
+            current = end;
+            error("unterminated string");
+        }
+        current = static_cast<const char*>(quote) + 1;
+
+        // The quote is escaped if an odd number of backslashes precede it
+        size_t backslashes = 0;
+        for (const char* c = current - 2; c >= begin && *c == '\\'; c--) {
+            backslashes++;
+        }
+        if (backslashes % 2 == 0) {
+            return;
+        }
+    }
+}
+
+Value JsonParser::defer() {
+    const char* start = current;
+    int nesting = 0;
+
+    // Find the matching bracket without parsing what lies between
+    while (current < end) {
+        char c = *current;
+        if (c == '"') {
+            skipString();
+            continue;
+        }
+        // Deferred levels are parsed one at a time, but what is made of them is still recursive
+        if ((c == '{' || c == '[') && depth + nesting >= maxDepth) {
+            error("nesting is too deep");
+        }
+        current++;
+        if (c == '{' || c == '[') {
+            nesting++;
+        } else if (c == '}' || c == ']') {
+            if (--nesting == 0) {
+                auto json = std::make_shared<DeferredJson>(std::shared_ptr<const char>(source, start),
+                                                          static_cast<size_t>(current - start), *start == '{');
+                return Value(json);
+            }
+        }
+    }
+
+    current = start;
+    error("unclosed " + std::string(*start == '{' ? "object" : "array"));
+}
+
+// JsonWriter implementation
+JsonWriter::JsonWriter(std::string& out, Sink sink) : out(out), sink(std::move(sink)) {}
+
+void JsonWriter::spillIfFull() {
+    if (sink && out.size() >= spillThreshold) {
+        sink(out);
+    }
+}
+
+void JsonWriter::writeString(std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
+
+    out += '"';
+    size_t run = 0; // Start of the characters that need no escaping
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c != '"' && c != '\\' && c >= 0x20) {
+            continue;
+        }
+
+        out.append(text.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xF];
+                break;
+        }
+    }
+    out.append(text.data() + run, text.size() - run);
+    out += '"';
+}
+
+void JsonWriter::write(const Value& value) {
+    char buffer[32];
+
+    // Unparsed JSON is written out as it was read
+    if (value.isDeferredJson()) {
+        auto json = value.asDeferredJson();
+        out.append(json->text.get(), json->length);
+        spillIfFull();
+        return;
+    }
+
+    switch (value.getType()) {
+        case Value::Type::NIL:
+            out += "null";
+            break;
+        case Value::Type::BOOLEAN:
+            out += value.asBoolean() ? "true" : "false";
+            break;
+        case Value::Type::INTEGER: {
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), value.asInteger());
+            out.append(buffer, result.ptr);
+            break;
+        }
+        case Value::Type::FLOAT: {
+            // JSON has no infinities or NaN
+            double number = value.asFloat();
+            if (!std::isfinite(number)) {
+                out += "null";
+                break;
+            }
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+            out.append(buffer, result.ptr);
+            break;
+        }
+        case Value::Type::STRING:
+            writeString(value.asStringView());
+            break;
+        case Value::Type::ARRAY:
+        case Value::Type::RANGE: {
+            out += '[';
+            for (int i = 0, count = value.size(); i < count; i++) {
+                if (i > 0) out += ',';
+                if (value.isRange()) {
+                    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value.asRange().at(i));
+                    out.append(buffer, result.ptr);
+                } else {
+                    write(value.element(i));
+                }
+                spillIfFull();
+            }
+            out += ']';
+            break;
+        }
+        case Value::Type::MAP: {
+            const Map& map = value.asMap();
+            out += '{';
+            for (size_t i = 0; i < map.size(); i++) {
+                if (i > 0) out += ',';
+                writeString(map.keyAt(i));
+                out += ':';
+                write(map.valueAt(i));
+                spillIfFull();
+            }
+            out += '}';
+            break;
+        }
+        default:
+            throw RuntimeError("Cannot convert " + value.toString() + " to JSON");
+    }
+}
+
+} // namespace SimpScript
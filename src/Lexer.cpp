@@ -4,35 +4,45 @@
 
 namespace SimpScript {
 
-// Initialize static lookup tables
-std::unordered_map<std::string, TokenType> Lexer::keywords = {
-    {"if", TokenType::IF},
-    {"else", TokenType::ELSE},
-    {"while", TokenType::WHILE},
-    {"for", TokenType::FOR},
-    {"function", TokenType::FUNCTION},
-    {"return", TokenType::RETURN},
-    {"show", TokenType::SHOW},
-    {"shownl", TokenType::SHOWNL},
-    {"nextl", TokenType::NEXTL},
-    {"ask", TokenType::ASK},
-    {"endif", TokenType::ENDIF},
-    {"endwhile", TokenType::ENDWHILE},
-    {"endfor", TokenType::ENDFOR},
-    {"endfunction", TokenType::ENDFUNCTION},
-    {"and", TokenType::AND},
-    {"or", TokenType::OR},
-    {"not", TokenType::NOT}
-};
+// Lookup tables, built on first use and never modified, so lexers on any thread can share them
+const std::unordered_map<std::string, TokenType>& Lexer::keywords() {
+    static const std::unordered_map<std::string, TokenType> table = {
+        {"if", TokenType::IF},
+        {"else", TokenType::ELSE},
+        {"while", TokenType::WHILE},
+        {"for", TokenType::FOR},
+        {"in", TokenType::IN},
+        {"function", TokenType::FUNCTION},
+        {"return", TokenType::RETURN},
+        {"show", TokenType::SHOW},
+        {"shownl", TokenType::SHOWNL},
+        {"nextl", TokenType::NEXTL},
+        {"ask", TokenType::ASK},
+        {"endif", TokenType::ENDIF},
+        {"endwhile", TokenType::ENDWHILE},
+        {"endfor", TokenType::ENDFOR},
+        {"endfunction", TokenType::ENDFUNCTION},
+        {"spawn", TokenType::SPAWN},
+        {"true", TokenType::TRUE},
+        {"false", TokenType::FALSE},
+        {"and", TokenType::AND},
+        {"or", TokenType::OR},
+        {"not", TokenType::NOT}
+    };
+    return table;
+}
 
-std::unordered_map<std::string, TokenType> Lexer::naturalOperators = {
-    {"equals", TokenType::EQUALS},
-    {"isnt", TokenType::ISNT},
-    {"greater than", TokenType::GREATER_THAN},
-    {"less than", TokenType::LESS_THAN},
-    {"at least", TokenType::AT_LEAST},
-    {"at most", TokenType::AT_MOST}
-};
+const std::unordered_map<std::string, TokenType>& Lexer::naturalOperators() {
+    static const std::unordered_map<std::string, TokenType> table = {
+        {"equals", TokenType::EQUALS},
+        {"isnt", TokenType::ISNT},
+        {"greater than", TokenType::GREATER_THAN},
+        {"less than", TokenType::LESS_THAN},
+        {"at least", TokenType::AT_LEAST},
+        {"at most", TokenType::AT_MOST}
+    };
+    return table;
+}
 
 // Constructor
 Lexer::Lexer(const std::string& source) : source(source) {
@@ -43,6 +53,14 @@ Lexer::Lexer(const std::string& source) : source(source) {
 
 // Helper methods
 void Lexer::advance() {
+    // line and column are those of currentChar, so they move on once a newline is passed
+    if (currentChar == '\n') {
+        line++;
+        column = 1;
+    } else {
+        column++;
+    }
+    
     position++;
     if (position >= source.length()) {
         currentChar = '\0'; // End of file
@@ -50,12 +68,6 @@ void Lexer::advance() {
     }
     
     currentChar = source[position];
-    column++;
-    
-    if (currentChar == '\n') {
-        line++;
-        column = 1;
-    }
 }
 
 void Lexer::skipWhitespace() {
@@ -101,25 +113,24 @@ bool Lexer::isAtEnd() const {
 
 // Token creation helpers
 Token Lexer::makeToken(TokenType type) const {
-    return Token(type, line, column);
+    return Token(type, tokenLine, tokenColumn);
 }
 
 Token Lexer::makeToken(TokenType type, int value) const {
-    return Token(type, value, line, column);
+    return Token(type, value, tokenLine, tokenColumn);
 }
 
 Token Lexer::makeToken(TokenType type, double value) const {
-    return Token(type, value, line, column);
+    return Token(type, value, tokenLine, tokenColumn);
 }
 
 Token Lexer::makeToken(TokenType type, const std::string& value) const {
-    return Token(type, value, line, column);
+    return Token(type, value, tokenLine, tokenColumn);
 }
 
 // Handle specific token types
 Token Lexer::handleNumber() {
     int startPos = position;
-    int startCol = column;
     bool isFloat = false;
     
     // Process integer part
@@ -141,9 +152,9 @@ Token Lexer::handleNumber() {
     std::string numberStr = source.substr(startPos, position - startPos);
     
     if (isFloat) {
-        return Token(TokenType::FLOAT, std::stod(numberStr), line, startCol);
+        return makeToken(TokenType::FLOAT, std::stod(numberStr));
     } else {
-        return Token(TokenType::INTEGER, std::stoi(numberStr), line, startCol);
+        return makeToken(TokenType::INTEGER, std::stoi(numberStr));
     }
 }
 
@@ -158,9 +169,14 @@ Token Lexer::handleIdentifier() {
     // Extract the identifier
     std::string identifier = source.substr(startPos, position - startPos);
     
+    // re immediately followed by a string is a regex literal
+    if (identifier == "re" && currentChar == '"') {
+        return handleRegex();
+    }
+    
     // Check if it's a keyword
-    auto it = keywords.find(identifier);
-    if (it != keywords.end()) {
+    auto it = keywords().find(identifier);
+    if (it != keywords().end()) {
         return makeToken(it->second);
     }
     
@@ -189,6 +205,28 @@ Token Lexer::handleString() {
     return makeToken(TokenType::STRING, str);
 }
 
+Token Lexer::handleRegex() {
+    advance(); // Skip the opening quote
+    
+    // \" puts a quote in the pattern without ending the literal
+    std::string pattern;
+    while (currentChar != '"' && !isAtEnd()) {
+        if (currentChar == '\\' && peek() == '"') {
+            advance();
+        }
+        pattern += currentChar;
+        advance();
+    }
+    
+    if (isAtEnd()) {
+        return makeToken(TokenType::ERROR, "Unterminated regular expression");
+    }
+    
+    advance(); // Skip the closing quote
+    
+    return makeToken(TokenType::REGEX, pattern);
+}
+
 Token Lexer::handleWord() {
     int startPos = position;
     int startCol = column;
@@ -221,8 +259,8 @@ Token Lexer::handleWord() {
         std::string twoWords = firstWord + " " + source.substr(secondWordStart, position - secondWordStart);
         twoWords = twoWords.substr(0, twoWords.find_last_not_of(" \t") + 1); // Trim right
         
-        auto it = naturalOperators.find(twoWords);
-        if (it != naturalOperators.end()) {
+        auto it = naturalOperators().find(twoWords);
+        if (it != naturalOperators().end()) {
             return makeToken(it->second);
         }
         
@@ -362,6 +400,9 @@ Token Lexer::nextToken() {
     // Skip whitespace and comments
     skipWhitespace();
     
+    tokenLine = line;
+    tokenColumn = column;
+    
     if (isAtEnd()) {
         return makeToken(TokenType::END_OF_FILE);
     }
@@ -396,6 +437,8 @@ Token Lexer::peekToken() {
     int oldPosition = position;
     int oldLine = line;
     int oldColumn = column;
+    int oldTokenLine = tokenLine;
+    int oldTokenColumn = tokenColumn;
     char oldChar = currentChar;
     
     // Get the next token
@@ -405,6 +448,8 @@ Token Lexer::peekToken() {
     position = oldPosition;
     line = oldLine;
     column = oldColumn;
+    tokenLine = oldTokenLine;
+    tokenColumn = oldTokenColumn;
     currentChar = oldChar;
     
     return token;
@@ -0,0 +1,248 @@
+#include "Parallel.h"
+#include "AST.h"
+#include "Environment.h"
+#include "Interpreter.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <unordered_set>
+
+namespace SimpScript {
+
+// Inputs smaller than this are not worth waking the pool for
+static const size_t minimumParallelCount = 32;
+
+// Chunks per thread; more chunks balance better, fewer cost less to schedule
+static const size_t chunksPerThread = 8;
+
+// Elements of an array or range, readable from any thread
+class Sequence {
+private:
+    const Value& items;
+    size_t count;
+
+public:
+    Sequence(const Value& items, const std::string& function) : items(items) {
+        if (!items.isArray() && !items.isRange()) {
+            throw RuntimeError(function + "() expects an array or a range");
+        }
+        // Sizing parses deferred JSON here, before any worker looks at it
+        count = static_cast<size_t>(items.size());
+    }
+
+    size_t size() const { return count; }
+
+    Value at(size_t index) const {
+        if (items.isRange()) {
+            return Value(items.asRange().at(static_cast<int>(index)));
+        }
+        return items.element(static_cast<int>(index));
+    }
+};
+
+// Values that several threads may read at once. Iterators and streams have a position, and
+// task channels belong to one thread; arrays and maps are searched for them
+static bool shareable(const Value& value) {
+    if (value.isIterator()) {
+        return false;
+    }
+    if (value.isHandle()) {
+        return value.asHandle()->threadSafe();
+    }
+    if (value.isDeferredJson() || value.isPackedArray()) {
+        return true; // Plain data
+    }
+    if (value.isArray()) {
+        for (const Value& element : value.asArray()) {
+            if (!shareable(element)) {
+                return false;
+            }
+        }
+    } else if (value.isMap()) {
+        const Map& map = value.asMap();
+        for (size_t i = 0; i < map.size(); i++) {
+            if (!shareable(map.valueAt(i))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool isParameter(const UserFunction& function, const std::string& name) {
+    const auto& parameters = function.getParameters();
+    return std::find(parameters.begin(), parameters.end(), name) != parameters.end();
+}
+
+static bool parallelSafe(const Callable* callable, std::unordered_set<const Callable*>& visited) {
+    if (const auto* native = dynamic_cast<const NativeFunction*>(callable)) {
+        return native->isPure();
+    }
+    const auto* function = dynamic_cast<const UserFunction*>(callable);
+    if (function == nullptr) {
+        return false;
+    }
+    if (!visited.insert(function).second) {
+        return true; // Recursive call, already being checked
+    }
+
+    Effects effects;
+    function->collectEffects(effects);
+    if (effects.io || effects.opaque) {
+        return false;
+    }
+
+    // Assignments that resolve outside the function would write shared state
+    Environment& closure = *function->getClosure();
+    for (const auto& name : effects.assigned) {
+        if (!isParameter(*function, name) && closure.lookup(name) != nullptr) {
+            return false;
+        }
+    }
+
+    // Callees must be safe too; a function passed in as an argument cannot be checked up front
+    for (const auto& name : effects.called) {
+        if (isParameter(*function, name)) {
+            return false;
+        }
+        const Value* callee = closure.lookup(name);
+        if (callee == nullptr || !callee->isFunction() || !parallelSafe(callee->asFunction().get(), visited)) {
+            return false;
+        }
+    }
+
+    for (const auto& name : effects.read) {
+        const Value* captured = isParameter(*function, name) ? nullptr : closure.lookup(name);
+        if (captured != nullptr && !shareable(*captured)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isParallelSafe(const Value& function) {
+    if (!function.isFunction()) {
+        return false;
+    }
+    std::unordered_set<const Callable*> visited;
+    return parallelSafe(function.asFunction().get(), visited);
+}
+
+// A copy of function that reads its captured variables from a snapshot of their current values,
+// so workers never look into an environment the calling thread owns
+static Value isolate(const Value& function) {
+    auto user = std::dynamic_pointer_cast<UserFunction>(function.asFunction());
+    if (!user) {
+        return function; // Pure natives hold no script state
+    }
+
+    Effects effects;
+    user->collectEffects(effects);
+    Environment& closure = *user->getClosure();
+    auto snapshot = std::make_shared<Environment>();
+    for (const auto* names : {&effects.read, &effects.called}) {
+        for (const auto& name : *names) {
+            if (isParameter(*user, name)) {
+                continue;
+            }
+            if (const Value* captured = closure.lookup(name)) {
+                snapshot->define(name, *captured);
+            }
+        }
+    }
+    return Value(std::static_pointer_cast<Callable>(user->withClosure(snapshot)));
+}
+
+// Split the elements into chunks for the pool, or return 0 to run on the calling thread
+static size_t chunkCount(Interpreter& interpreter, const Value& function, const Value& items, size_t count) {
+    if (count < minimumParallelCount || !isParallelSafe(function)) {
+        return 0;
+    }
+    size_t threads = interpreter.threadPool().size();
+    if (threads == 1 || !shareable(items)) {
+        return 0;
+    }
+    return std::min(count, threads * chunksPerThread);
+}
+
+// Run work(worker, function, chunk, begin, end) for every chunk on the pool. Each chunk gets its own
+// interpreter and its own copy of the function
+template <typename Work>
+static void forEachChunk(Interpreter& interpreter, const Value& function, size_t count, size_t chunks, Work work) {
+    auto globals = interpreter.getGlobals();
+    interpreter.threadPool().parallelFor(chunks, [&](size_t chunk) {
+        Interpreter worker(interpreter, globals);
+        Value isolated = isolate(function);
+        work(worker, isolated, chunk, chunk * count / chunks, (chunk + 1) * count / chunks);
+    });
+}
+
+Value parallelMap(Interpreter& interpreter, const Value& function, const Value& items) {
+    if (!function.isFunction()) {
+        throw RuntimeError("parallel_map() expects a function");
+    }
+    Sequence sequence(items, "parallel_map");
+    size_t count = sequence.size();
+    std::vector<Value> results(count);
+
+    auto mapRange = [&sequence, &results](Interpreter& runner, Value& fn, size_t begin, size_t end) {
+        std::vector<Value> args(1);
+        for (size_t i = begin; i < end; i++) {
+            args.assign(1, sequence.at(i));
+            results[i] = fn.call(runner, args);
+        }
+    };
+
+    size_t chunks = chunkCount(interpreter, function, items, count);
+    if (chunks == 0) {
+        Value fn = function;
+        mapRange(interpreter, fn, 0, count);
+    } else {
+        forEachChunk(interpreter, function, count, chunks,
+                     [&mapRange](Interpreter& runner, Value& chunkFn, size_t, size_t begin, size_t end) {
+            mapRange(runner, chunkFn, begin, end);
+        });
+    }
+    return Value(std::move(results));
+}
+
+Value parallelReduce(Interpreter& interpreter, const Value& function, const Value& items, const Value& initial) {
+    if (!function.isFunction()) {
+        throw RuntimeError("parallel_reduce() expects a function");
+    }
+    Sequence sequence(items, "parallel_reduce");
+    size_t count = sequence.size();
+
+    auto fold = [&sequence](Interpreter& runner, Value& fn, Value accumulator, size_t begin, size_t end) {
+        std::vector<Value> args(2);
+        for (size_t i = begin; i < end; i++) {
+            args[0] = std::move(accumulator);
+            args[1] = sequence.at(i);
+            accumulator = fn.call(runner, args);
+        }
+        return accumulator;
+    };
+
+    Value fn = function;
+    size_t chunks = shareable(initial) ? chunkCount(interpreter, function, items, count) : 0;
+    if (chunks == 0) {
+        return fold(interpreter, fn, initial, 0, count);
+    }
+
+    // Each chunk folds from its own first element; the chunk results are then folded into init
+    std::vector<Value> partials(chunks);
+    forEachChunk(interpreter, function, count, chunks,
+                 [&sequence, &partials, &fold](Interpreter& runner, Value& chunkFn, size_t chunk, size_t begin, size_t end) {
+        partials[chunk] = fold(runner, chunkFn, sequence.at(begin), begin + 1, end);
+    });
+
+    Value accumulator = initial;
+    std::vector<Value> args(2);
+    for (Value& partial : partials) {
+        args[0] = std::move(accumulator);
+        args[1] = std::move(partial);
+        accumulator = fn.call(interpreter, args);
+    }
+    return accumulator;
+}
+
+} // namespace SimpScript
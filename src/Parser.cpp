@@ -1,6 +1,6 @@
 #include "Parser.h"
+#include "Coverage.h"
 #include <sstream>
-#include <iostream>  // Added for std::cerr
 
 namespace SimpScript {
 
@@ -9,8 +9,8 @@ ParseError::ParseError(const std::string& message)
     : std::runtime_error(message) {}
 
 // Parser implementation
-Parser::Parser(Lexer& lexer) 
-    : lexer(lexer), currentToken(TokenType::ERROR, 0, 0) {  // Initialize currentToken with a dummy token
+Parser::Parser(Lexer& lexer, std::ostream& errors) 
+    : lexer(lexer), errors(errors), currentToken(TokenType::ERROR, 0, 0) {  // Initialize currentToken with a dummy token
     advance(); // Initialize currentToken with the first real token
 }
 
@@ -52,7 +52,7 @@ std::unique_ptr<ASTNode> Parser::parse() {
         return program();
     } catch (const ParseError& e) {
         // Print error and try to recover
-        std::cerr << e.what() << std::endl;
+        errors << e.what() << std::endl;
         synchronize();
         
         // Return a dummy program node
@@ -101,7 +101,20 @@ std::unique_ptr<ASTNode> Parser::program() {
     return std::make_unique<ProgramNode>(std::move(statements));
 }
 
+// Statements, calls, primaries and sums record the line and column they start at
 std::unique_ptr<ASTNode> Parser::statement() {
+    int line = currentToken.getLine();
+    int column = currentToken.getColumn();
+    auto node = bareStatement();
+    node->setLocation(line, column);
+    if (coverage != nullptr) {
+        node = std::make_unique<CoverageNode>(std::move(node), &coverage->counter(line)->executions);
+        node->setLocation(line, column);
+    }
+    return node;
+}
+
+std::unique_ptr<ASTNode> Parser::bareStatement() {
     if (match(TokenType::IF)) {
         return ifStatement();
     }
@@ -155,6 +168,11 @@ std::unique_ptr<ASTNode> Parser::whileStatement() {
 }
 
 std::unique_ptr<ASTNode> Parser::forStatement() {
+    // For-each syntax: for name in sequence
+    if (check(TokenType::IDENTIFIER) && lexer.peekToken().getType() == TokenType::IN) {
+        return forEachStatement();
+    }
+    
     // For loop syntax: for init; condition; increment
     
     // Parse initialization
@@ -179,6 +197,22 @@ std::unique_ptr<ASTNode> Parser::forStatement() {
                                      std::move(body));
 }
 
+std::unique_ptr<ASTNode> Parser::forEachStatement() {
+    std::string variable = currentToken.getStringValue();
+    advance();
+    consume(TokenType::IN, "Expect 'in' after loop variable");
+    
+    // Parse the sequence (array, string or range)
+    auto sequence = expression();
+    
+    // Parse body
+    auto body = block();
+    
+    consume(TokenType::ENDFOR, "Expect 'endfor' after for loop");
+    
+    return std::make_unique<ForEachNode>(variable, std::move(sequence), std::move(body));
+}
+
 std::unique_ptr<ASTNode> Parser::block() {
     std::vector<std::unique_ptr<ASTNode>> statements;
     
@@ -205,7 +239,9 @@ std::unique_ptr<ASTNode> Parser::printStatement(bool newline) {
 
 std::unique_ptr<ASTNode> Parser::functionDeclaration() {
     // Parse function name
-    consume(TokenType::IDENTIFIER, "Expect function name");
+    if (!check(TokenType::IDENTIFIER)) {
+        throw error("Expect function name");
+    }
     std::string name = currentToken.getStringValue();
     advance();
     
@@ -215,7 +251,9 @@ std::unique_ptr<ASTNode> Parser::functionDeclaration() {
     
     if (!check(TokenType::RIGHT_PAREN)) {
         do {
-            consume(TokenType::IDENTIFIER, "Expect parameter name");
+            if (!check(TokenType::IDENTIFIER)) {
+                throw error("Expect parameter name");
+            }
             parameters.push_back(currentToken.getStringValue());
             advance();
         } while (match(TokenType::COMMA));
@@ -425,6 +463,8 @@ std::unique_ptr<ASTNode> Parser::comparison() {
 }
 
 std::unique_ptr<ASTNode> Parser::term() {
+    int line = currentToken.getLine();
+    int column = currentToken.getColumn();
     auto expr = factor();
     
     while (true) {
@@ -457,6 +497,7 @@ std::unique_ptr<ASTNode> Parser::term() {
         }
         
         expr = std::make_unique<BinaryOpNode>(nodeOpType, std::move(expr), std::move(right));
+        expr->setLocation(line, column);
     }
     
     return expr;
@@ -506,7 +547,7 @@ std::unique_ptr<ASTNode> Parser::factor() {
 }
 
 std::unique_ptr<ASTNode> Parser::unary() {
-    if (match(TokenType::MINUS) || match(TokenType::NOT)) {
+    if (check(TokenType::MINUS) || check(TokenType::NOT)) {
         TokenType op = currentToken.getType();
         advance();
         auto right = unary();
@@ -525,13 +566,32 @@ std::unique_ptr<ASTNode> Parser::unary() {
 }
 
 std::unique_ptr<ASTNode> Parser::call() {
+    int line = currentToken.getLine();
+    int column = currentToken.getColumn();
     auto expr = primary();
+    expr->setLocation(line, column);
     
     while (true) {
         if (match(TokenType::LEFT_PAREN)) {
             expr = finishCall(std::move(expr));
+            expr->setLocation(line, column);
         } else if (match(TokenType::LEFT_BRACKET)) {
-            auto index = expression();
+            std::unique_ptr<ASTNode> index = nullptr;
+            if (!check(TokenType::COLON)) {
+                index = expression();
+            }
+            
+            // Slice syntax: a[begin:end] with either bound optional
+            if (match(TokenType::COLON)) {
+                std::unique_ptr<ASTNode> end = nullptr;
+                if (!check(TokenType::RIGHT_BRACKET)) {
+                    end = expression();
+                }
+                consume(TokenType::RIGHT_BRACKET, "Expect ']' after slice");
+                expr = std::make_unique<SliceNode>(std::move(expr), std::move(index), std::move(end));
+                continue;
+            }
+            
             consume(TokenType::RIGHT_BRACKET, "Expect ']' after array index");
             expr = std::make_unique<ArrayAccessNode>(std::move(expr), std::move(index));
         } else {
@@ -564,6 +624,58 @@ std::unique_ptr<ASTNode> Parser::finishCall(std::unique_ptr<ASTNode> callee) {
     return std::make_unique<FunctionCallNode>(name, std::move(arguments));
 }
 
+// Split "text {expr} text" into literal parts and parsed expressions. {{ and }} are literal braces
+std::unique_ptr<ASTNode> Parser::interpolatedString(const std::string& text) {
+    std::vector<std::string> literals;
+    std::vector<std::unique_ptr<ASTNode>> expressions;
+    std::string literal;
+    
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if ((c == '{' || c == '}') && i + 1 < text.size() && text[i + 1] == c) {
+            literal += c;
+            i += 2;
+            continue;
+        }
+        if (c == '}') {
+            throw error("Unmatched '}' in string, use '}}' for a literal brace");
+        }
+        if (c != '{') {
+            literal += c;
+            i++;
+            continue;
+        }
+        
+        size_t close = text.find('}', i + 1);
+        if (close == std::string::npos) {
+            throw error("Unterminated '{' in string");
+        }
+        
+        // Parse the embedded expression with its own lexer
+        Lexer exprLexer(text.substr(i + 1, close - i - 1));
+        Parser exprParser(exprLexer, errors);
+        if (exprParser.check(TokenType::END_OF_FILE)) {
+            throw error("Empty expression in string interpolation");
+        }
+        auto expr = exprParser.expression();
+        if (!exprParser.check(TokenType::END_OF_FILE)) {
+            throw error("Unexpected tokens in string interpolation");
+        }
+        
+        literals.push_back(std::move(literal));
+        literal.clear();
+        expressions.push_back(std::move(expr));
+        i = close + 1;
+    }
+    literals.push_back(std::move(literal));
+    
+    if (expressions.empty()) {
+        return std::make_unique<LiteralNode>(literals[0]);
+    }
+    return std::make_unique<InterpolatedStringNode>(std::move(literals), std::move(expressions));
+}
+
 std::unique_ptr<ASTNode> Parser::primary() {
     if (check(TokenType::INTEGER)) {
         int value = currentToken.getIntValue();
@@ -577,9 +689,30 @@ std::unique_ptr<ASTNode> Parser::primary() {
     }
     if (check(TokenType::STRING)) {
         std::string value = currentToken.getStringValue();
+        if (value.find_first_of("{}") != std::string::npos) {
+            auto node = interpolatedString(value);
+            advance();
+            return node;
+        }
         advance(); // Now advance after getting the value
         return std::make_unique<LiteralNode>(value);
     }
+    if (match(TokenType::TRUE)) {
+        return std::make_unique<LiteralNode>(true);
+    }
+    if (match(TokenType::FALSE)) {
+        return std::make_unique<LiteralNode>(false);
+    }
+    if (check(TokenType::REGEX)) {
+        std::shared_ptr<Regex> regex;
+        try {
+            regex = regexes.get(currentToken.getStringValue());
+        } catch (const std::runtime_error& e) {
+            throw error(e.what());
+        }
+        advance();
+        return std::make_unique<RegexLiteralNode>(regex);
+    }
     if (check(TokenType::IDENTIFIER)) {
         std::string name = currentToken.getStringValue();
         advance(); // Now advance after getting the value
@@ -588,6 +721,23 @@ std::unique_ptr<ASTNode> Parser::primary() {
     if (match(TokenType::ASK)) {
         return std::make_unique<InputNode>();
     }
+    if (match(TokenType::SPAWN)) {
+        if (!check(TokenType::IDENTIFIER)) {
+            throw error("Expect function call after 'spawn'");
+        }
+        std::string name = currentToken.getStringValue();
+        advance();
+        consume(TokenType::LEFT_PAREN, "Expect '(' after function name in spawn");
+        
+        std::vector<std::unique_ptr<ASTNode>> arguments;
+        if (!check(TokenType::RIGHT_PAREN)) {
+            do {
+                arguments.push_back(expression());
+            } while (match(TokenType::COMMA));
+        }
+        consume(TokenType::RIGHT_PAREN, "Expect ')' after function arguments");
+        return std::make_unique<SpawnNode>(name, std::move(arguments));
+    }
     if (match(TokenType::LEFT_PAREN)) {
         auto expr = expression();
         consume(TokenType::RIGHT_PAREN, "Expect ')' after expression");
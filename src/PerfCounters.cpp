@@ -0,0 +1,155 @@
+#include "PerfCounters.h"
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace SimpScript {
+
+const char* const perfEventNames[perfEventCount] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+// PerfSample implementation
+double PerfSample::ipc() const {
+    if (!has(PerfEvent::CYCLES) || !has(PerfEvent::INSTRUCTIONS) || get(PerfEvent::CYCLES) == 0) {
+        return 0;
+    }
+    return static_cast<double>(get(PerfEvent::INSTRUCTIONS)) / static_cast<double>(get(PerfEvent::CYCLES));
+}
+
+PerfSample& PerfSample::operator+=(const PerfSample& other) {
+    for (size_t i = 0; i < perfEventCount; i++) {
+        values[i] += other.values[i];
+        present[i] = present[i] || other.present[i];
+    }
+    return *this;
+}
+
+// The perf_event_attr type and config of each event
+static void describeEvent(PerfEvent event, perf_event_attr& attr) {
+    auto cache = [](uint64_t cache, uint64_t operation, uint64_t result) {
+        return cache | (operation << 8) | (result << 16);
+    };
+    switch (event) {
+        case PerfEvent::CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PerfEvent::INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PerfEvent::L1D_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        case PerfEvent::LLC_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PerfEvent::BRANCH_MISSES:
+        case PerfEvent::COUNT:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+}
+
+// PerfCounters implementation
+PerfCounters::PerfCounters() {
+    for (size_t i = 0; i < perfEventCount; i++) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        describeEvent(static_cast<PerfEvent>(i), attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1; // Threads started while counting, such as parallel_map workers, count too
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // Each event on its own rather than in a group, so one the machine lacks does not
+        // take the others with it
+        fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        if (fds[i] < 0 && problem.empty()) {
+            problem = std::string(perfEventNames[i]) + ": " + std::strerror(errno);
+            if (errno == EACCES || errno == EPERM) {
+                problem += " (see /proc/sys/kernel/perf_event_paranoid)";
+            }
+        }
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+bool PerfCounters::available() const {
+    for (int fd : fds) {
+        if (fd >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PerfCounters::start() {
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+PerfSample PerfCounters::stop() {
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    PerfSample sample;
+    for (size_t i = 0; i < perfEventCount; i++) {
+        uint64_t reading[3]; // Value, time enabled, time running
+        if (fds[i] < 0 || ::read(fds[i], reading, sizeof(reading)) != static_cast<ssize_t>(sizeof(reading))) {
+            continue;
+        }
+        if (reading[2] == 0) {
+            // Enabled but never on the hardware; nothing to scale from
+            continue;
+        }
+        double scale = static_cast<double>(reading[1]) / static_cast<double>(reading[2]);
+        sample.values[i] = static_cast<uint64_t>(static_cast<double>(reading[0]) * scale);
+        sample.present[i] = true;
+    }
+    return sample;
+}
+
+void printPerfTable(std::ostream& out, const std::string names[], const PerfSample samples[], size_t count) {
+    out << std::left << std::setw(10) << "phase" << std::right;
+    for (size_t i = 0; i < perfEventCount; i++) {
+        out << std::setw(15) << perfEventNames[i];
+    }
+    out << std::setw(7) << "IPC" << std::endl;
+    for (size_t row = 0; row < count; row++) {
+        out << std::left << std::setw(10) << names[row] << std::right;
+        for (size_t i = 0; i < perfEventCount; i++) {
+            if (samples[row].present[i]) {
+                out << std::setw(15) << samples[row].values[i];
+            } else {
+                out << std::setw(15) << "-";
+            }
+        }
+        out << std::setw(7) << std::fixed << std::setprecision(2) << samples[row].ipc() << std::defaultfloat << std::endl;
+    }
+}
+
+} // namespace SimpScript
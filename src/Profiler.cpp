@@ -0,0 +1,188 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <signal.h>
+#include <sys/time.h>
+
+namespace SimpScript {
+
+// The profiler the SIGPROF handler samples for
+static std::atomic<Profiler*> activeProfiler{nullptr};
+static struct sigaction previousAction;
+
+// Profiler implementation
+Profiler::Profiler(std::chrono::microseconds interval)
+    : interval(interval), table(tableSize), arena(arenaSize) {}
+
+Profiler::~Profiler() {
+    stop();
+}
+
+void Profiler::start() {
+    Profiler* expected = nullptr;
+    if (!activeProfiler.compare_exchange_strong(expected, this)) {
+        throw std::runtime_error("Another profiler is already running");
+    }
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    action.sa_flags = SA_RESTART; // Reads and writes carry on after a sample
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &previousAction);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = static_cast<time_t>(interval.count() / 1000000);
+    timer.it_interval.tv_usec = static_cast<suseconds_t>(interval.count() % 1000000);
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    running = true;
+}
+
+void Profiler::stop() {
+    if (!running) {
+        return;
+    }
+    struct itimerval timer;
+    std::memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sigaction(SIGPROF, &previousAction, nullptr);
+    activeProfiler.store(nullptr);
+    running = false;
+}
+
+uint32_t Profiler::intern(const std::string& name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(names.size());
+    names.push_back(name);
+    ids.emplace(name, id);
+    return id;
+}
+
+void Profiler::onSignal(int) {
+    int savedErrno = errno;
+    if (Profiler* profiler = activeProfiler.load(std::memory_order_acquire)) {
+        profiler->sample();
+    }
+    errno = savedErrno;
+}
+
+// Runs in the signal handler, on whichever thread the timer interrupted, so it only touches
+// memory set aside beforehand. A sample that arrives while another is being taken is skipped
+void Profiler::sample() {
+    if (sampling.test_and_set(std::memory_order_acquire)) {
+        return;
+    }
+    size_t current = std::min(depth.load(std::memory_order_acquire), maxDepth);
+    uint32_t stack[maxDepth];
+    uint32_t line = 0;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < current; i++) {
+        stack[i] = frames[i].function.load(std::memory_order_relaxed);
+        hash = (hash ^ stack[i]) * 16777619u;
+        // Native functions run no statements, so their time goes to the line that called them
+        if (uint32_t frameLine = frames[i].line.load(std::memory_order_relaxed)) {
+            line = frameLine;
+        }
+    }
+    hash = (hash ^ line) * 16777619u;
+    samples++;
+
+    // Open addressing with linear probing; nothing is ever removed
+    for (size_t probe = 0; probe < tableSize; probe++) {
+        Bucket& bucket = table[(hash + probe) & (tableSize - 1)];
+        if (bucket.count == 0) {
+            if (arenaUsed + current > arenaSize || probe > tableSize / 2) {
+                break;
+            }
+            std::copy(stack, stack + current, arena.begin() + static_cast<std::ptrdiff_t>(arenaUsed));
+            bucket = Bucket{1, hash, line, static_cast<uint32_t>(arenaUsed), static_cast<uint32_t>(current)};
+            arenaUsed += current;
+            sampling.clear(std::memory_order_release);
+            return;
+        }
+        if (bucket.hash == hash && bucket.line == line && bucket.length == current &&
+            std::equal(stack, stack + current, arena.begin() + bucket.offset)) {
+            bucket.count++;
+            sampling.clear(std::memory_order_release);
+            return;
+        }
+    }
+    dropped++;
+    sampling.clear(std::memory_order_release);
+}
+
+void Profiler::report(std::ostream& out, const std::string& script, size_t limit) const {
+    std::map<uint32_t, size_t> self;
+    std::map<uint32_t, size_t> total;
+    std::map<uint32_t, size_t> lines;
+    for (const Bucket& bucket : table) {
+        if (bucket.count == 0 || bucket.length == 0) {
+            continue;
+        }
+        auto stack = arena.begin() + bucket.offset;
+        self[stack[bucket.length - 1]] += bucket.count;
+        // A recursive function counts once per sample towards its total
+        for (uint32_t function : std::set<uint32_t>(stack, stack + bucket.length)) {
+            total[function] += bucket.count;
+        }
+        if (bucket.line != 0) {
+            lines[bucket.line] += bucket.count;
+        }
+    }
+
+    auto percent = [this](size_t count) { return 100.0 * static_cast<double>(count) / static_cast<double>(samples); };
+    auto hottest = [limit](const std::map<uint32_t, size_t>& counts) {
+        std::vector<std::pair<uint32_t, size_t>> sorted(counts.begin(), counts.end());
+        std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+        if (sorted.size() > limit) {
+            sorted.resize(limit);
+        }
+        return sorted;
+    };
+
+    out << "Profile of " << script << ": " << samples << " samples, "
+        << std::chrono::duration<double, std::milli>(interval).count() << " ms of CPU time apart" << std::endl;
+    if (dropped > 0) {
+        out << dropped << " samples of new stacks were dropped once the profiler's tables were full" << std::endl;
+    }
+    if (samples == 0) {
+        return;
+    }
+    out << std::fixed << std::setprecision(1);
+    out << std::endl << "  self%  total%  function" << std::endl;
+    for (const auto& [function, count] : hottest(self)) {
+        out << std::setw(7) << percent(count) << std::setw(8) << percent(total.at(function)) << "  " << names[function] << std::endl;
+    }
+    out << std::endl << "  self%  line" << std::endl;
+    for (const auto& [line, count] : hottest(lines)) {
+        out << std::setw(7) << percent(count) << "  " << script << ":" << line << std::endl;
+    }
+    out << std::defaultfloat;
+}
+
+void Profiler::writeCollapsed(std::ostream& out) const {
+    // Stacks that differ only in their line are one stack here
+    std::map<std::vector<uint32_t>, size_t> stacks;
+    for (const Bucket& bucket : table) {
+        if (bucket.count != 0) {
+            auto stack = arena.begin() + bucket.offset;
+            stacks[std::vector<uint32_t>(stack, stack + bucket.length)] += bucket.count;
+        }
+    }
+    for (const auto& [stack, count] : stacks) {
+        for (size_t i = 0; i < stack.size(); i++) {
+            out << (i == 0 ? "" : ";") << names[stack[i]];
+        }
+        out << " " << count << "\n";
+    }
+}
+
+} // namespace SimpScript
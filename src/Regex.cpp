@@ -0,0 +1,889 @@
+#include "Regex.h"
+#include "Interpreter.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <map>
+
+namespace SimpScript {
+
+namespace {
+
+const size_t maxProgramSize = 100000;
+const int maxRepeat = 1000;
+const size_t checkpointStride = 64; // Positions a Scan remembers are this far apart
+
+// Parsed form of a pattern, before it is compiled to instructions
+struct Node {
+    enum class Kind { SET, BEGIN, END, CONCAT, ALTERNATE, REPEAT };
+
+    Kind kind;
+    int set = -1;
+    int min = 0;
+    int max = 0; // -1 for no upper bound
+    std::vector<Node> children;
+
+    explicit Node(Kind kind) : kind(kind) {}
+};
+
+class PatternParser {
+private:
+    const std::string& pattern;
+    std::vector<std::bitset<256>>& sets;
+    size_t position = 0;
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw RuntimeError("Invalid regular expression '" + pattern + "': " + message);
+    }
+
+    bool atEnd() const { return position >= pattern.size(); }
+
+    bool eat(char c) {
+        if (!atEnd() && pattern[position] == c) {
+            position++;
+            return true;
+        }
+        return false;
+    }
+
+    Node setNode(const std::bitset<256>& set) {
+        Node node(Node::Kind::SET);
+        node.set = static_cast<int>(sets.size());
+        sets.push_back(set);
+        return node;
+    }
+
+    static std::bitset<256> byteSet(unsigned char c) {
+        std::bitset<256> set;
+        set.set(c);
+        return set;
+    }
+
+    static std::bitset<256> rangeSet(unsigned char first, unsigned char last) {
+        std::bitset<256> set;
+        for (int c = first; c <= last; c++) {
+            set.set(c);
+        }
+        return set;
+    }
+
+    // The escape after a backslash, as the set of bytes it matches
+    std::bitset<256> escape() {
+        if (atEnd()) {
+            fail("trailing backslash");
+        }
+        char c = pattern[position++];
+        std::bitset<256> set;
+        switch (c) {
+            case 'd': case 'D':
+                set = rangeSet('0', '9');
+                break;
+            case 'w': case 'W':
+                set = rangeSet('a', 'z') | rangeSet('A', 'Z') | rangeSet('0', '9') | byteSet('_');
+                break;
+            case 's': case 'S':
+                for (char space : std::string_view(" \t\n\r\f\v")) {
+                    set.set(static_cast<unsigned char>(space));
+                }
+                break;
+            case 'n': return byteSet('\n');
+            case 't': return byteSet('\t');
+            case 'r': return byteSet('\r');
+            case 'f': return byteSet('\f');
+            case 'v': return byteSet('\v');
+            case '0': return byteSet('\0');
+            case 'x': {
+                unsigned int code = 0;
+                for (int i = 0; i < 2; i++) {
+                    if (atEnd() || !std::isxdigit(static_cast<unsigned char>(pattern[position]))) {
+                        fail("\\x needs two hex digits");
+                    }
+                    char digit = pattern[position++];
+                    code = code * 16 + (std::isdigit(static_cast<unsigned char>(digit))
+                                            ? digit - '0'
+                                            : std::tolower(static_cast<unsigned char>(digit)) - 'a' + 10);
+                }
+                return byteSet(static_cast<unsigned char>(code));
+            }
+            case 'b': case 'B':
+                fail("word boundaries are not supported");
+            default:
+                if (std::isalnum(static_cast<unsigned char>(c))) {
+                    fail(std::string("unknown escape \\") + c);
+                }
+                return byteSet(static_cast<unsigned char>(c));
+        }
+        return std::isupper(static_cast<unsigned char>(c)) ? ~set : set;
+    }
+
+    // A [...] class; the opening bracket has been consumed
+    std::bitset<256> characterClass() {
+        bool negate = eat('^');
+        std::bitset<256> set;
+        bool first = true;
+
+        while (true) {
+            if (atEnd()) {
+                fail("missing ']'");
+            }
+            if (pattern[position] == ']' && !first) {
+                position++;
+                break;
+            }
+            first = false;
+
+            std::bitset<256> item;
+            if (eat('\\')) {
+                item = escape();
+            } else {
+                item = byteSet(static_cast<unsigned char>(pattern[position++]));
+            }
+
+            // A range needs single bytes on both sides
+            if (item.count() == 1 && position + 1 < pattern.size() &&
+                pattern[position] == '-' && pattern[position + 1] != ']') {
+                position++;
+                std::bitset<256> last;
+                if (eat('\\')) {
+                    last = escape();
+                } else {
+                    last = byteSet(static_cast<unsigned char>(pattern[position++]));
+                }
+                if (last.count() != 1) {
+                    fail("invalid range in class");
+                }
+                int low = 0;
+                int high = 0;
+                while (!item[low]) low++;
+                while (!last[high]) high++;
+                if (high < low) {
+                    fail("invalid range in class");
+                }
+                item = rangeSet(static_cast<unsigned char>(low), static_cast<unsigned char>(high));
+            }
+            set |= item;
+        }
+        return negate ? ~set : set;
+    }
+
+    // Parse {m}, {m,} or {m,n}; leaves position alone and returns false if it is not a count
+    bool count(int& min, int& max) {
+        size_t start = position;
+        auto number = [this](int& value) {
+            size_t first = position;
+            value = 0;
+            while (!atEnd() && std::isdigit(static_cast<unsigned char>(pattern[position]))) {
+                value = std::min(value * 10 + (pattern[position++] - '0'), maxRepeat + 1);
+            }
+            return position > first;
+        };
+
+        position++; // {
+        if (!number(min)) {
+            position = start;
+            return false;
+        }
+        max = min;
+        if (eat(',')) {
+            max = -1;
+            if (!atEnd() && pattern[position] != '}' && !number(max)) {
+                position = start;
+                return false;
+            }
+        }
+        if (!eat('}')) {
+            position = start;
+            return false;
+        }
+        if (min > maxRepeat || max > maxRepeat) {
+            fail("repeat count is larger than " + std::to_string(maxRepeat));
+        }
+        if (max != -1 && max < min) {
+            fail("invalid repeat count");
+        }
+        return true;
+    }
+
+    Node atom() {
+        char c = pattern[position++];
+        switch (c) {
+            case '(': {
+                if (eat('?')) {
+                    if (!eat(':')) {
+                        fail("only (?: groups are supported");
+                    }
+                }
+                Node inner = alternation();
+                if (!eat(')')) {
+                    fail("missing ')'");
+                }
+                return inner;
+            }
+            case '*': case '+': case '?':
+                fail("nothing to repeat");
+            case '[':
+                return setNode(characterClass());
+            case '.':
+                return setNode(~byteSet('\n'));
+            case '^':
+                return Node(Node::Kind::BEGIN);
+            case '$':
+                return Node(Node::Kind::END);
+            case '\\':
+                return setNode(escape());
+            default:
+                return setNode(byteSet(static_cast<unsigned char>(c)));
+        }
+    }
+
+    Node repetition() {
+        Node node = atom();
+        while (!atEnd()) {
+            int min;
+            int max;
+            char c = pattern[position];
+            if (c == '*') {
+                min = 0, max = -1;
+                position++;
+            } else if (c == '+') {
+                min = 1, max = -1;
+                position++;
+            } else if (c == '?') {
+                min = 0, max = 1;
+                position++;
+            } else if (c != '{' || !count(min, max)) {
+                break;
+            }
+
+            if (node.kind == Node::Kind::BEGIN || node.kind == Node::Kind::END) {
+                fail("nothing to repeat");
+            }
+            if (!atEnd() && pattern[position] == '?') {
+                fail("lazy quantifiers are not supported; matches are always leftmost-longest");
+            }
+            Node repeat(Node::Kind::REPEAT);
+            repeat.min = min;
+            repeat.max = max;
+            repeat.children.push_back(std::move(node));
+            node = std::move(repeat);
+        }
+        return node;
+    }
+
+    Node concatenation() {
+        Node node(Node::Kind::CONCAT);
+        while (!atEnd() && pattern[position] != '|' && pattern[position] != ')') {
+            node.children.push_back(repetition());
+        }
+        return node;
+    }
+
+    Node alternation() {
+        Node first = concatenation();
+        if (atEnd() || pattern[position] != '|') {
+            return first;
+        }
+        Node node(Node::Kind::ALTERNATE);
+        node.children.push_back(std::move(first));
+        while (eat('|')) {
+            node.children.push_back(concatenation());
+        }
+        return node;
+    }
+
+public:
+    PatternParser(const std::string& pattern, std::vector<std::bitset<256>>& sets)
+        : pattern(pattern), sets(sets) {}
+
+    Node parse() {
+        Node node = alternation();
+        if (!atEnd()) {
+            fail("unmatched ')'");
+        }
+        return node;
+    }
+};
+
+} // namespace
+
+// Working storage for computing closures: a visited mark per instruction and an explicit stack
+struct Regex::Scratch {
+    std::vector<uint32_t> marks;
+    uint32_t mark = 0;
+    std::vector<int> stack;
+
+    explicit Scratch(size_t size) : marks(size, 0) {}
+
+    // Start a new set of visited instructions
+    void next() {
+        if (++mark == 0) {
+            std::fill(marks.begin(), marks.end(), 0);
+            mark = 1;
+        }
+    }
+};
+
+// A lazily built DFA. Each state is a set of NFA instructions; transitions are
+// computed the first time they are taken
+struct Regex::Dfa {
+    static const size_t maxStates = 4096;
+
+    struct State {
+        std::vector<int> pcs; // BYTE instructions, plus END instructions waiting for the end of the text
+        bool match;           // A match ends here
+        bool matchAtEnd;      // A match ends here if this is the end of the text
+        int future;           // First state with the same pcs; what can match after here depends only on them
+        std::vector<int> next; // Per byte class: the next state, or -1 if not computed yet
+    };
+
+    std::mutex mutex;
+    bool unanchored;
+    uint64_t generation = 0; // Counts resets, which renumber the states
+    std::vector<State> states;
+    std::map<std::vector<int>, int> index;
+    int starts[2] = {-1, -1}; // Start state when not at / at the start of the text
+    Scratch scratch;
+
+    Dfa(bool unanchored, size_t programSize) : unanchored(unanchored), scratch(programSize) {}
+
+    void reset() {
+        states.clear();
+        index.clear();
+        starts[0] = starts[1] = -1;
+        generation++;
+    }
+};
+
+// Regex implementation
+Regex::Regex(const std::string& pattern) : pattern(pattern) {
+    Node root = PatternParser(pattern, sets).parse();
+
+    // Thompson construction: the program starts at instruction 0 and falls through
+    auto add = [this](Op op) {
+        if (program.size() >= maxProgramSize) {
+            throw RuntimeError("Invalid regular expression '" + this->pattern + "': pattern is too large");
+        }
+        program.push_back({op, static_cast<int>(program.size()) + 1, -1, -1});
+        return static_cast<int>(program.size()) - 1;
+    };
+    auto size = [this]() { return static_cast<int>(program.size()); };
+
+    std::function<void(const Node&)> emit = [&](const Node& node) {
+        switch (node.kind) {
+            case Node::Kind::SET:
+                program[add(Op::BYTE)].set = node.set;
+                break;
+            case Node::Kind::BEGIN:
+                add(Op::BEGIN);
+                break;
+            case Node::Kind::END:
+                add(Op::END);
+                break;
+            case Node::Kind::CONCAT:
+                for (const Node& child : node.children) {
+                    emit(child);
+                }
+                break;
+            case Node::Kind::ALTERNATE: {
+                std::vector<int> jumps;
+                for (size_t i = 0; i + 1 < node.children.size(); i++) {
+                    int split = add(Op::SPLIT);
+                    emit(node.children[i]);
+                    jumps.push_back(add(Op::JUMP));
+                    program[split].alternative = size();
+                }
+                emit(node.children.back());
+                for (int jump : jumps) {
+                    program[jump].next = size();
+                }
+                break;
+            }
+            case Node::Kind::REPEAT: {
+                const Node& child = node.children[0];
+                for (int i = 0; i < node.min; i++) {
+                    emit(child);
+                }
+                if (node.max == -1) {
+                    int split = add(Op::SPLIT);
+                    emit(child);
+                    program[add(Op::JUMP)].next = split;
+                    program[split].alternative = size();
+                } else {
+                    for (int i = node.min; i < node.max; i++) {
+                        int split = add(Op::SPLIT);
+                        emit(child);
+                        program[split].alternative = size();
+                    }
+                }
+                break;
+            }
+        }
+    };
+    emit(root);
+    add(Op::MATCH);
+
+    // Literal prefix, used to skip ahead with memchr
+    const std::vector<Node> single = root.kind == Node::Kind::CONCAT ? std::vector<Node>() : std::vector<Node>{root};
+    const std::vector<Node>& parts = root.kind == Node::Kind::CONCAT ? root.children : single;
+    size_t part = 0;
+    if (!parts.empty() && parts[0].kind == Node::Kind::BEGIN) {
+        anchored = true;
+        part++;
+    }
+    while (part < parts.size() && parts[part].kind == Node::Kind::SET && sets[parts[part].set].count() == 1) {
+        const std::bitset<256>& set = sets[parts[part].set];
+        int c = 0;
+        while (!set[c]) c++;
+        prefix += static_cast<char>(c);
+        part++;
+    }
+    literal = !anchored && !prefix.empty() && part == parts.size();
+
+    // Byte classes: a new class starts wherever some set changes membership
+    classCount = 1;
+    byteClass[0] = 0;
+    for (int c = 1; c < 256; c++) {
+        bool boundary = false;
+        for (const auto& set : sets) {
+            if (set[c] != set[c - 1]) {
+                boundary = true;
+                break;
+            }
+        }
+        if (boundary) {
+            classCount++;
+        }
+        byteClass[c] = static_cast<uint8_t>(classCount - 1);
+    }
+
+    fullDfa = std::make_unique<Dfa>(false, program.size());
+    searchDfa = std::make_unique<Dfa>(true, program.size());
+}
+
+Regex::~Regex() = default;
+
+std::shared_ptr<Regex> Regex::compile(const std::string& pattern) {
+    return std::shared_ptr<Regex>(new Regex(pattern));
+}
+
+const std::string& Regex::getPattern() const {
+    return pattern;
+}
+
+std::string Regex::describe() const {
+    return "<regex " + pattern + ">";
+}
+
+void Regex::closure(int pc, bool atStart, bool atEnd, bool keepEnds, Scratch& scratch,
+                    std::vector<int>& out, bool& match) const {
+    scratch.stack.push_back(pc);
+    while (!scratch.stack.empty()) {
+        int current = scratch.stack.back();
+        scratch.stack.pop_back();
+        if (scratch.marks[current] == scratch.mark) {
+            continue;
+        }
+        scratch.marks[current] = scratch.mark;
+
+        const Instruction& instruction = program[current];
+        switch (instruction.op) {
+            case Op::BYTE:
+                out.push_back(current);
+                break;
+            case Op::MATCH:
+                match = true;
+                break;
+            case Op::SPLIT:
+                scratch.stack.push_back(instruction.alternative);
+                scratch.stack.push_back(instruction.next);
+                break;
+            case Op::JUMP:
+                scratch.stack.push_back(instruction.next);
+                break;
+            case Op::BEGIN:
+                if (atStart) {
+                    scratch.stack.push_back(instruction.next);
+                }
+                break;
+            case Op::END:
+                if (keepEnds) {
+                    out.push_back(current);
+                } else if (atEnd) {
+                    scratch.stack.push_back(instruction.next);
+                }
+                break;
+        }
+    }
+}
+
+int Regex::dfaState(Dfa& dfa, std::vector<int>& seeds, bool atStart) const {
+    std::vector<int> pcs;
+    bool match = false;
+    dfa.scratch.next();
+    for (int seed : seeds) {
+        closure(seed, atStart, false, true, dfa.scratch, pcs, match);
+    }
+    std::sort(pcs.begin(), pcs.end());
+
+    std::vector<int> key = pcs;
+    if (match) {
+        key.push_back(-1);
+    }
+    auto found = dfa.index.find(key);
+    if (found != dfa.index.end()) {
+        return found->second;
+    }
+    if (dfa.states.size() >= Dfa::maxStates) {
+        return -1;
+    }
+
+    // Whether one of the waiting $ instructions leads to a match at the end of the text
+    bool matchAtEnd = match;
+    std::vector<int> unused;
+    for (int pc : pcs) {
+        if (program[pc].op == Op::END && !matchAtEnd) {
+            dfa.scratch.next();
+            closure(program[pc].next, false, true, false, dfa.scratch, unused, matchAtEnd);
+        }
+    }
+
+    int id = static_cast<int>(dfa.states.size());
+    std::vector<int> twinKey = pcs;
+    if (!match) {
+        twinKey.push_back(-1);
+    }
+    auto twin = dfa.index.find(twinKey);
+    int future = twin == dfa.index.end() ? id : dfa.states[twin->second].future;
+    dfa.states.push_back({std::move(pcs), match, matchAtEnd, future, std::vector<int>(classCount, -1)});
+    dfa.index.emplace(std::move(key), id);
+    return id;
+}
+
+int Regex::dfaStart(Dfa& dfa, bool atStart) const {
+    int& start = dfa.starts[atStart ? 1 : 0];
+    if (start < 0) {
+        std::vector<int> seeds{0};
+        start = dfaState(dfa, seeds, atStart);
+    }
+    return start;
+}
+
+int Regex::dfaStep(Dfa& dfa, int state, unsigned char byte) const {
+    int cached = dfa.states[state].next[byteClass[byte]];
+    if (cached >= 0) {
+        return cached;
+    }
+
+    std::vector<int> seeds;
+    for (int pc : dfa.states[state].pcs) {
+        const Instruction& instruction = program[pc];
+        if (instruction.op == Op::BYTE && sets[instruction.set][byte]) {
+            seeds.push_back(instruction.next);
+        }
+    }
+    if (dfa.unanchored) {
+        seeds.push_back(0); // A match may also start at the next position
+    }
+
+    int next = dfaState(dfa, seeds, false);
+    if (next >= 0) {
+        dfa.states[state].next[byteClass[byte]] = next;
+    }
+    return next;
+}
+
+size_t Regex::findPrefix(std::string_view text, size_t from) const {
+    if (from >= text.size()) {
+        return std::string_view::npos;
+    }
+    if (prefix.size() == 1) {
+        const void* found = std::memchr(text.data() + from, prefix[0], text.size() - from);
+        return found == nullptr ? std::string_view::npos
+                                : static_cast<size_t>(static_cast<const char*>(found) - text.data());
+    }
+    return text.find(prefix, from);
+}
+
+int Regex::dfaEarliestEnd(Dfa& dfa, std::string_view text, size_t from, size_t& end) const {
+    int state = dfaStart(dfa, from == 0);
+    int restart = prefix.empty() ? -2 : dfaStart(dfa, false);
+    if (state < 0 || restart == -1) {
+        return -1;
+    }
+    if (dfa.states[state].match) {
+        end = from;
+        return 1;
+    }
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(text.data());
+    for (size_t i = from; i < text.size();) {
+        // With no partial match in progress, skip straight to the next place a match can start
+        if (state == restart) {
+            i = findPrefix(text, i);
+            if (i == std::string_view::npos) {
+                return 0;
+            }
+        }
+
+        state = dfaStep(dfa, state, bytes[i++]);
+        if (state < 0) {
+            return -1;
+        }
+        const Dfa::State& current = dfa.states[state];
+        if (current.match) {
+            end = i;
+            return 1;
+        }
+        if (current.pcs.empty()) {
+            return 0;
+        }
+    }
+
+    if (dfa.states[state].matchAtEnd) {
+        end = text.size();
+        return 1;
+    }
+    return 0;
+}
+
+int Regex::dfaMatchesAll(Dfa& dfa, std::string_view text) const {
+    int state = dfaStart(dfa, true);
+    if (state < 0) {
+        return -1;
+    }
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(text.data());
+    for (size_t i = 0; i < text.size(); i++) {
+        state = dfaStep(dfa, state, bytes[i]);
+        if (state < 0) {
+            return -1;
+        }
+        if (dfa.states[state].pcs.empty() && !dfa.states[state].match) {
+            return 0;
+        }
+    }
+    return dfa.states[state].matchAtEnd ? 1 : 0;
+}
+
+int Regex::dfaLongestEnd(Dfa& dfa, std::string_view text, size_t from, Scan& scan, size_t& end) const {
+    int state = dfaStart(dfa, from == 0);
+    if (state < 0) {
+        return -1;
+    }
+    size_t last = dfa.states[state].match ? from : std::string_view::npos;
+
+    // At checkpoints, a state another scan passed through already has its furthest match end
+    // recorded. Otherwise note the checkpoint and fill it in once this scan is over
+    std::vector<uint64_t> checkpoints;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(text.data());
+    size_t i = from;
+    while (i < text.size()) {
+        if (i % checkpointStride == 0) {
+            uint64_t key = static_cast<uint64_t>(i) * Dfa::maxStates + dfa.states[state].future;
+            auto known = scan.reach.find(key);
+            if (known != scan.reach.end()) {
+                if (known->second != std::string_view::npos) {
+                    last = known->second;
+                }
+                break;
+            }
+            checkpoints.push_back(key);
+        }
+
+        state = dfaStep(dfa, state, bytes[i++]);
+        if (state < 0) {
+            return -1;
+        }
+        const Dfa::State& current = dfa.states[state];
+        if (current.match) {
+            last = i;
+        }
+        if (current.pcs.empty()) {
+            break;
+        }
+    }
+    if (i == text.size() && dfa.states[state].matchAtEnd) {
+        last = text.size();
+    }
+
+    for (uint64_t key : checkpoints) {
+        size_t position = static_cast<size_t>(key / Dfa::maxStates);
+        scan.reach[key] = last != std::string_view::npos && last > position ? last : std::string_view::npos;
+    }
+    if (last == std::string_view::npos) {
+        return 0;
+    }
+    end = last;
+    return 1;
+}
+
+bool Regex::nfaSearch(std::string_view text, size_t from, size_t limit, size_t& begin, size_t& end) const {
+    // Threads are kept in order of their start position. When two reach the same
+    // instruction the earlier start wins, which gives leftmost-longest matches
+    struct Thread {
+        int pc;
+        size_t start;
+    };
+    std::vector<Thread> current;
+    std::vector<Thread> next;
+    std::vector<int> reached;
+    Scratch scratch(program.size());
+    scratch.next();
+    bool found = false;
+
+    auto addThread = [&](std::vector<Thread>& list, int pc, size_t start, size_t position) {
+        reached.clear();
+        bool match = false;
+        closure(pc, position == 0, position == text.size(), false, scratch, reached, match);
+        for (int r : reached) {
+            list.push_back({r, start});
+        }
+        if (match && (!found || start < begin || (start == begin && position > end))) {
+            found = true;
+            begin = start;
+            end = position;
+        }
+    };
+
+    for (size_t position = from;; position++) {
+        // Start a new thread here until a match has been found
+        if (!found && position <= limit) {
+            if (current.empty() && !prefix.empty()) {
+                position = findPrefix(text, position);
+                if (position == std::string_view::npos || position > limit) {
+                    break;
+                }
+            }
+            addThread(current, 0, position, position);
+        }
+
+        if (position >= text.size()) {
+            break;
+        }
+        if (current.empty()) {
+            if (found || position >= limit) {
+                break;
+            }
+            continue;
+        }
+
+        unsigned char byte = static_cast<unsigned char>(text[position]);
+        scratch.next();
+        for (const Thread& thread : current) {
+            if (found && thread.start > begin) {
+                continue; // Cannot beat the match already found
+            }
+            const Instruction& instruction = program[thread.pc];
+            if (sets[instruction.set][byte]) {
+                addThread(next, instruction.next, thread.start, position + 1);
+            }
+        }
+        current.swap(next);
+        next.clear();
+    }
+    return found;
+}
+
+bool Regex::matches(std::string_view text) const {
+    {
+        std::unique_lock<std::mutex> lock(fullDfa->mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            int result = dfaMatchesAll(*fullDfa, text);
+            if (result >= 0) {
+                return result == 1;
+            }
+            fullDfa->reset(); // Too many states; start over next time
+        }
+    }
+
+    size_t begin;
+    size_t end;
+    return nfaSearch(text, 0, 0, begin, end) && begin == 0 && end == text.size();
+}
+
+bool Regex::search(std::string_view text, size_t from, size_t& begin, size_t& end) const {
+    Scan scan;
+    return search(text, from, begin, end, scan);
+}
+
+bool Regex::search(std::string_view text, size_t from, size_t& begin, size_t& end, Scan& scan) const {
+    if (from > text.size() || (anchored && from > 0)) {
+        return false;
+    }
+    if (literal) {
+        begin = findPrefix(text, from);
+        end = begin + prefix.size();
+        return begin != std::string_view::npos;
+    }
+
+    // The unanchored DFA rejects texts without a match quickly and tells us where the
+    // leftmost match must start by
+    size_t limit = anchored ? 0 : text.size();
+    {
+        std::unique_lock<std::mutex> lock(searchDfa->mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            size_t earliest;
+            int result = dfaEarliestEnd(*searchDfa, text, from, earliest);
+            if (result == 0) {
+                return false;
+            }
+            if (result > 0) {
+                limit = std::min(limit, earliest);
+            } else {
+                searchDfa->reset();
+            }
+        }
+    }
+
+    // The anchored DFA then tries each start up to there in turn, and finds how far the first
+    // match reaches. Without it, the NFA finds the bounds instead
+    {
+        std::unique_lock<std::mutex> lock(fullDfa->mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            if (scan.regex != this || scan.text != text.data() || scan.size != text.size() ||
+                scan.generation != fullDfa->generation) {
+                scan.regex = this;
+                scan.text = text.data();
+                scan.size = text.size();
+                scan.generation = fullDfa->generation;
+                scan.reach.clear();
+            }
+            for (size_t start = from; start <= limit; start++) {
+                if (!prefix.empty()) {
+                    start = findPrefix(text, start);
+                    if (start == std::string_view::npos || start > limit) {
+                        return false;
+                    }
+                }
+                int result = dfaLongestEnd(*fullDfa, text, start, scan, end);
+                if (result > 0) {
+                    begin = start;
+                    return true;
+                }
+                if (result < 0) {
+                    fullDfa->reset();
+                    return nfaSearch(text, from, limit, begin, end);
+                }
+            }
+            return false;
+        }
+    }
+    return nfaSearch(text, from, limit, begin, end);
+}
+
+// RegexCache implementation
+std::shared_ptr<Regex> RegexCache::get(const std::string& pattern) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = patterns.find(pattern);
+    if (found != patterns.end()) {
+        return found->second;
+    }
+    if (patterns.size() >= capacity) {
+        patterns.clear();
+    }
+    auto regex = Regex::compile(pattern);
+    patterns.emplace(pattern, regex);
+    return regex;
+}
+
+} // namespace SimpScript
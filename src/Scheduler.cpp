@@ -0,0 +1,498 @@
+#include "Scheduler.h"
+#include "Environment.h"
+#include "Interpreter.h"
+#include <cerrno>
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define SIMPSCRIPT_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define SIMPSCRIPT_ASAN 1
+#endif
+#endif
+
+#ifdef SIMPSCRIPT_ASAN
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+namespace SimpScript {
+
+// Thrown into a cancelled task to unwind its stack. Not a std::exception, so nothing
+// on the way up mistakes it for a script error
+struct TaskCancelled {};
+
+// Scheduler with tasks on this thread, for input streams to yield to
+static thread_local Scheduler* active = nullptr;
+
+// Scheduler of the task that entry() is about to start
+static thread_local Scheduler* launching = nullptr;
+
+// Stack limit of the task running on this thread
+static thread_local uintptr_t stackLimit = 0;
+
+// Task implementation
+Task::Task(size_t id, Value function, std::vector<Value> arguments)
+    : id(id), function(std::move(function)), arguments(std::move(arguments)) {}
+
+std::string Task::describe() const {
+    return "<task " + std::to_string(id) + ">";
+}
+
+// TaskChannel implementation
+TaskChannel::TaskChannel(Scheduler& scheduler, size_t capacity)
+    : scheduler(scheduler), owner(std::this_thread::get_id()), capacity(capacity) {}
+
+void TaskChannel::checkThread() const {
+    if (std::this_thread::get_id() != owner) {
+        throw RuntimeError(describe() + " belongs to another thread; use shared_channel() between threads");
+    }
+}
+
+void TaskChannel::send(Value value) {
+    checkThread();
+    while (!closed && items.size() >= capacity) {
+        scheduler.block(senders);
+    }
+    if (closed) {
+        throw RuntimeError("Cannot send on closed " + describe());
+    }
+    items.push_back(std::move(value));
+    scheduler.wakeOne(receivers);
+}
+
+bool TaskChannel::receive(Value& out) {
+    checkThread();
+    while (!closed && items.empty()) {
+        scheduler.block(receivers);
+    }
+    return tryReceive(out);
+}
+
+bool TaskChannel::trySend(Value& value) {
+    checkThread();
+    if (closed) {
+        throw RuntimeError("Cannot send on closed " + describe());
+    }
+    if (items.size() >= capacity) {
+        return false;
+    }
+    items.push_back(std::move(value));
+    scheduler.wakeOne(receivers);
+    return true;
+}
+
+bool TaskChannel::tryReceive(Value& out) {
+    checkThread();
+    if (items.empty()) {
+        return false;
+    }
+    out = std::move(items.front());
+    items.pop_front();
+    scheduler.wakeOne(senders);
+    return true;
+}
+
+std::string TaskChannel::describe() const {
+    return "<channel>";
+}
+
+void TaskChannel::close() {
+    checkThread();
+    closed = true;
+    scheduler.wakeAll(senders);
+    scheduler.wakeAll(receivers);
+}
+
+// Scheduler implementation
+Scheduler::Scheduler(Interpreter& interpreter)
+    : interpreter(interpreter), main(std::make_shared<Task>(0, Value(), std::vector<Value>())), current(main) {
+    main->state = Task::State::RUNNING;
+    main->stackLimit = stackLimit;
+}
+
+Scheduler::~Scheduler() {
+    cancel();
+    recycle();
+    for (char* stack : stacks) {
+        munmap(stack, stackSize);
+    }
+}
+
+std::shared_ptr<Task> Scheduler::spawn(Value function, std::vector<Value> arguments) {
+    if (!function.isFunction()) {
+        throw RuntimeError("spawn expects a function call");
+    }
+    auto task = std::make_shared<Task>(++spawned, std::move(function), std::move(arguments));
+    if (live.empty()) {
+        previousActive = active;
+        active = this;
+    }
+    live.emplace(task.get(), task);
+    ready.push_back(task);
+    return task;
+}
+
+void Scheduler::prepare(Task& task) {
+    char* stack;
+    if (!stacks.empty()) {
+        stack = stacks.back();
+        stacks.pop_back();
+    } else {
+        // Only the pages a task touches are backed by memory, so thousands of tasks stay cheap.
+        // The lowest page is left inaccessible to catch overflows
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+        flags |= MAP_NORESERVE;
+#endif
+#ifdef MAP_STACK
+        flags |= MAP_STACK;
+#endif
+        void* memory = mmap(nullptr, stackSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw RuntimeError("Could not allocate a stack for " + task.describe());
+        }
+        stack = static_cast<char*>(memory);
+        mprotect(stack, static_cast<size_t>(sysconf(_SC_PAGESIZE)), PROT_NONE);
+    }
+
+    task.stack = stack;
+    task.stackBottom = stack;
+    task.stackExtent = stackSize;
+    task.stackLimit = reinterpret_cast<uintptr_t>(stack) + stackReserve;
+    getcontext(&task.context);
+    task.context.uc_stack.ss_sp = stack;
+    task.context.uc_stack.ss_size = stackSize;
+    task.context.uc_link = nullptr;
+    makecontext(&task.context, &Scheduler::entry, 0);
+}
+
+void Scheduler::recycle() {
+    if (!finished) {
+        return;
+    }
+    if (stacks.size() < cachedStacks) {
+        stacks.push_back(finished->stack);
+    } else {
+        munmap(finished->stack, stackSize);
+    }
+    finished->stack = nullptr;
+    finished.reset();
+}
+
+void Scheduler::startSwitch(void** fakeStack, const Task& target) {
+#ifdef SIMPSCRIPT_ASAN
+    __sanitizer_start_switch_fiber(fakeStack, target.stackBottom, target.stackExtent);
+#else
+    (void)fakeStack;
+    (void)target;
+#endif
+}
+
+void Scheduler::finishSwitch(void* fakeStack) {
+#ifdef SIMPSCRIPT_ASAN
+    // Also learns the bounds of the main task's stack the first time it is left
+    __sanitizer_finish_switch_fiber(fakeStack, &switching->stackBottom, &switching->stackExtent);
+#else
+    (void)fakeStack;
+#endif
+}
+
+void Scheduler::entry() {
+    Scheduler* scheduler = launching;
+    scheduler->finishSwitch(nullptr);
+    {
+        std::shared_ptr<Task> task = scheduler->current;
+        scheduler->recycle();
+        stackLimit = task->stackLimit;
+
+        Interpreter& interpreter = scheduler->interpreter;
+        interpreter.setEnvironment(interpreter.getGlobals());
+        try {
+            task->result = task->function.call(interpreter, task->arguments);
+        } catch (const TaskCancelled&) {
+            // Unwound on purpose; there is nothing to report
+        } catch (...) {
+            if (!scheduler->failure) {
+                scheduler->failure = std::current_exception();
+            }
+        }
+        scheduler->complete(task);
+
+        // This stack is released by whichever task runs next
+        scheduler->finished = task;
+        std::shared_ptr<Task> target = scheduler->runnable();
+        if (!target->stack && target != scheduler->main) {
+            scheduler->prepare(*target);
+        }
+        target->state = Task::State::RUNNING;
+        scheduler->current = std::move(target);
+    }
+    launching = scheduler;
+    scheduler->switching = scheduler->finished.get();
+    scheduler->startSwitch(nullptr, *scheduler->current);
+    setcontext(&scheduler->current->context);
+}
+
+void Scheduler::complete(const std::shared_ptr<Task>& task) {
+    task->state = Task::State::DONE;
+    task->function = Value();
+    task->arguments.clear();
+    task->environment.reset();
+    wakeAll(task->joiners);
+
+    live.erase(task.get());
+    if (live.empty()) {
+        active = previousActive;
+    }
+
+    // The main task hears about a failure as soon as it can run
+    if (failure && main->state == Task::State::BLOCKED) {
+        main->state = Task::State::READY;
+        main->waitingOn = nullptr;
+        main->waitingFd = -1;
+        ready.push_front(main);
+    }
+}
+
+std::shared_ptr<Task> Scheduler::next() {
+    while (ready.empty()) {
+        if (!pollInput()) {
+            return nullptr;
+        }
+    }
+    std::shared_ptr<Task> task = std::move(ready.front());
+    ready.pop_front();
+    return task;
+}
+
+std::shared_ptr<Task> Scheduler::runnable() {
+    std::shared_ptr<Task> task = next();
+    if (task) {
+        return task;
+    }
+
+    RuntimeError deadlock("Deadlock: every task is waiting on a channel or another task");
+    if (current == main) {
+        main->state = Task::State::RUNNING;
+        main->waitingOn = nullptr;
+        main->waitingFd = -1;
+        throw deadlock;
+    }
+    if (!failure) {
+        failure = std::make_exception_ptr(deadlock);
+    }
+    main->state = Task::State::READY;
+    main->waitingOn = nullptr;
+    main->waitingFd = -1;
+    return main;
+}
+
+bool Scheduler::pollInput(int timeout) {
+    std::vector<pollfd> descriptors;
+    std::vector<std::shared_ptr<Task>> waiting;
+    for (auto& task : inputWaiters) {
+        if (task->state == Task::State::BLOCKED && task->waitingFd >= 0) {
+            descriptors.push_back(pollfd{task->waitingFd, POLLIN, 0});
+            waiting.push_back(std::move(task));
+        }
+    }
+    inputWaiters.clear();
+    if (waiting.empty()) {
+        return false;
+    }
+
+    int count;
+    do {
+        count = ::poll(descriptors.data(), descriptors.size(), timeout);
+    } while (count < 0 && errno == EINTR);
+
+    // On a poll error every waiter retries its read, which reports the problem
+    for (size_t i = 0; i < waiting.size(); i++) {
+        if (count < 0 || descriptors[i].revents != 0) {
+            waiting[i]->state = Task::State::READY;
+            waiting[i]->waitingFd = -1;
+            ready.push_back(std::move(waiting[i]));
+        } else {
+            inputWaiters.push_back(std::move(waiting[i]));
+        }
+    }
+    return true;
+}
+
+void Scheduler::switchTo(const std::shared_ptr<Task>& target) {
+    std::shared_ptr<Task> self = current;
+    if (target != self) {
+        // Call frames and a pending return belong to the task that is running
+        self->environment = interpreter.getEnvironment();
+        self->returning = interpreter.isReturning();
+        if (self->returning) {
+            self->returnValue = interpreter.clearReturn();
+        }
+
+        if (!target->stack && target != main) {
+            prepare(*target);
+        }
+        target->state = Task::State::RUNNING;
+        current = target;
+        launching = this;
+        switching = self.get();
+        void* fakeStack = nullptr;
+        startSwitch(&fakeStack, *target);
+        swapcontext(&self->context, &target->context);
+
+        // Running again
+        finishSwitch(fakeStack);
+        recycle();
+        stackLimit = self->stackLimit;
+        interpreter.setEnvironment(std::move(self->environment));
+        if (self->returning) {
+            interpreter.setReturn(std::move(self->returnValue));
+        }
+    }
+    self->state = Task::State::RUNNING;
+
+    if (self->cancelled) {
+        throw TaskCancelled();
+    }
+    if (self == main && failure) {
+        std::exception_ptr error = failure;
+        failure = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void Scheduler::suspend() {
+    std::shared_ptr<Task> target = runnable();
+    switchTo(target);
+}
+
+void Scheduler::yield() {
+    if (ready.empty()) {
+        return;
+    }
+    current->state = Task::State::READY;
+    ready.push_back(current);
+    suspend();
+}
+
+void Scheduler::block(std::deque<std::shared_ptr<Task>>& queue) {
+    current->state = Task::State::BLOCKED;
+    current->waitingOn = &queue;
+    queue.push_back(current);
+    suspend();
+}
+
+void Scheduler::wakeOne(std::deque<std::shared_ptr<Task>>& queue) {
+    // Entries left by tasks that were woken some other way are skipped
+    while (!queue.empty()) {
+        std::shared_ptr<Task> task = std::move(queue.front());
+        queue.pop_front();
+        if (task->state == Task::State::BLOCKED && task->waitingOn == &queue) {
+            task->state = Task::State::READY;
+            task->waitingOn = nullptr;
+            ready.push_back(std::move(task));
+            return;
+        }
+    }
+}
+
+void Scheduler::wakeAll(std::deque<std::shared_ptr<Task>>& queue) {
+    while (!queue.empty()) {
+        wakeOne(queue);
+    }
+}
+
+Value Scheduler::wait(const std::shared_ptr<Task>& task) {
+    if (task == current) {
+        throw RuntimeError("A task cannot wait for itself");
+    }
+    while (!task->isDone()) {
+        block(task->joiners);
+    }
+    return task->result;
+}
+
+void Scheduler::finish() {
+    if (current != main) {
+        return;
+    }
+    while (!live.empty()) {
+        // Tasks that are all blocked on each other can never finish
+        if (ready.empty() && !pollInput()) {
+            break;
+        }
+        yield();
+    }
+    cancel();
+}
+
+void Scheduler::cancel() {
+    if (current != main) {
+        return;
+    }
+    inputWaiters.clear();
+    failure = nullptr;
+
+    while (!live.empty()) {
+        std::shared_ptr<Task> task = live.begin()->second;
+        ready.clear();
+        if (!task->stack) {
+            // Never ran, so there is nothing to unwind
+            complete(task);
+            continue;
+        }
+
+        // The task throws from where it is blocked, finishes and comes back here
+        task->cancelled = true;
+        main->state = Task::State::READY;
+        ready.push_back(main);
+        switchTo(task);
+    }
+    ready.clear();
+}
+
+void Scheduler::waitReadable(int fd) {
+    Scheduler* scheduler = active;
+    if (scheduler == nullptr) {
+        return;
+    }
+    pollfd request{fd, POLLIN, 0};
+    while (::poll(&request, 1, 0) == 0) {
+        std::shared_ptr<Task>& self = scheduler->current;
+        self->state = Task::State::BLOCKED;
+        self->waitingFd = fd;
+        scheduler->inputWaiters.push_back(self);
+        scheduler->suspend();
+    }
+}
+
+bool Scheduler::hasTasks() {
+    return active != nullptr;
+}
+
+bool Scheduler::runOthers() {
+    Scheduler* scheduler = active;
+    if (scheduler == nullptr) {
+        return false;
+    }
+    if (scheduler->ready.empty()) {
+        scheduler->pollInput(0);
+    }
+    if (scheduler->ready.empty()) {
+        return false;
+    }
+    scheduler->yield();
+    return true;
+}
+
+void Scheduler::checkStack() {
+    char marker;
+    if (reinterpret_cast<uintptr_t>(&marker) < stackLimit) {
+        throw RuntimeError("Stack overflow: calls nested too deeply in a task");
+    }
+}
+
+} // namespace SimpScript
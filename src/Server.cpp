@@ -0,0 +1,348 @@
+#include "Server.h"
+#include "Interpreter.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Stream.h"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <streambuf>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace SimpScript {
+
+// Frame I/O
+static bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t count = ::write(fd, data, length);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += count;
+        length -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+// Waits no later than deadline, where one is given
+static bool readAll(int fd, char* data, size_t length, std::chrono::steady_clock::time_point deadline) {
+    while (length > 0) {
+        if (deadline != std::chrono::steady_clock::time_point::max()) {
+            auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) {
+                return false;
+            }
+            timeval timeout{static_cast<time_t>(left.count() / 1000000), static_cast<suseconds_t>(left.count() % 1000000)};
+            ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        }
+        ssize_t count = ::read(fd, data, length);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        data += count;
+        length -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+bool writeFrame(int fd, FrameType type, std::string_view payload) {
+    uint32_t length = static_cast<uint32_t>(payload.size());
+    char header[5] = {static_cast<char>(type),
+                      static_cast<char>(length & 0xff), static_cast<char>((length >> 8) & 0xff),
+                      static_cast<char>((length >> 16) & 0xff), static_cast<char>(length >> 24)};
+    return writeAll(fd, header, sizeof(header)) && writeAll(fd, payload.data(), payload.size());
+}
+
+bool readFrame(int fd, FrameType& type, std::string& payload, std::chrono::steady_clock::time_point deadline) {
+    unsigned char header[5];
+    if (!readAll(fd, reinterpret_cast<char*>(header), sizeof(header), deadline)) {
+        return false;
+    }
+    type = static_cast<FrameType>(header[0]);
+    uint32_t length = header[1] | (header[2] << 8) | (header[3] << 16) | (static_cast<uint32_t>(header[4]) << 24);
+    if (length > maxFrameSize) {
+        return false; // Not allocated: the length comes from the peer
+    }
+    payload.resize(length);
+    return readAll(fd, payload.data(), length, deadline);
+}
+
+static sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path is too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+int connectToServer(const std::string& socketPath) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    sockaddr_un address = socketAddress(socketPath);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Stream buffer that sends what a script writes to the client as frames of one type.
+// Flushes from shownl only send once enough has collected or some time has passed, so
+// printing many short lines does not cost a frame each
+class FrameStreamBuf : public std::streambuf {
+private:
+    static constexpr size_t capacity = 1 << 16;
+    static constexpr size_t syncBytes = 4096;
+    static constexpr std::chrono::milliseconds syncInterval{10};
+
+    FrameType type;
+    int fd = -1;
+    bool connected = false;
+    std::vector<char> buffer;
+    std::chrono::steady_clock::time_point lastSend;
+
+    void send() {
+        size_t pending = static_cast<size_t>(pptr() - pbase());
+        if (pending > 0 && connected) {
+            connected = writeFrame(fd, type, std::string_view(pbase(), pending));
+        }
+        setp(buffer.data(), buffer.data() + buffer.size());
+        lastSend = std::chrono::steady_clock::now();
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        send();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        if (static_cast<size_t>(pptr() - pbase()) >= syncBytes ||
+            std::chrono::steady_clock::now() - lastSend >= syncInterval) {
+            send();
+        }
+        return 0;
+    }
+
+public:
+    explicit FrameStreamBuf(FrameType type) : type(type), buffer(capacity) {
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+    // Send everything written so far to the client on fd
+    void attach(int client) {
+        fd = client;
+        connected = true;
+        lastSend = std::chrono::steady_clock::now();
+    }
+
+    // Send what is left and stop writing to the client
+    void detach() {
+        send();
+        connected = false;
+        fd = -1;
+    }
+};
+
+// ScriptServer implementation
+ScriptServer::ScriptServer(const std::string& socketPath, size_t threads)
+    : socketPath(socketPath), threads(threads > 0 ? threads : 1) {}
+
+ScriptServer::~ScriptServer() {
+    if (listener >= 0) {
+        ::close(listener);
+        ::unlink(socketPath.c_str());
+    }
+}
+
+// Modification time of a file, down to the nanosecond where the system records it
+static timespec modificationTime(const struct stat& info) {
+#ifdef __APPLE__
+    return info.st_mtimespec;
+#else
+    return info.st_mtim;
+#endif
+}
+
+std::shared_ptr<ScriptServer::CompiledScript> ScriptServer::compile(const std::string& path) {
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) {
+        throw RuntimeError("Could not open file '" + path + "'");
+    }
+    timespec modified = modificationTime(info);
+
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = cache.find(path);
+        if (it != cache.end() && it->second->size == info.st_size &&
+            it->second->modified.tv_sec == modified.tv_sec &&
+            it->second->modified.tv_nsec == modified.tv_nsec) {
+            return it->second;
+        }
+    }
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw RuntimeError("Could not open file '" + path + "'");
+    }
+    std::stringstream source;
+    source << file.rdbuf();
+
+    // The parser reports the error it stopped at instead of throwing it
+    std::ostringstream errors;
+    Lexer lexer(source.str());
+    Parser parser(lexer, errors);
+    auto compiled = std::make_shared<CompiledScript>();
+    compiled->program = parser.parse();
+    compiled->modified = modified;
+    compiled->size = info.st_size;
+    std::string message = errors.str();
+    if (!message.empty()) {
+        while (!message.empty() && message.back() == '\n') {
+            message.pop_back();
+        }
+        throw ParseError(message);
+    }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache[path] = compiled;
+    return compiled;
+}
+
+void ScriptServer::workerLoop() {
+    FrameStreamBuf outputBuffer(FrameType::OUTPUT);
+    FrameStreamBuf errorBuffer(FrameType::ERROR);
+    std::ostream output(&outputBuffer);
+    std::ostream errors(&errorBuffer);
+
+    while (true) {
+        // Set up the interpreter for the next request before waiting for it
+        auto interpreter = std::make_unique<Interpreter>(InputStream::fromString("", "stdin"), output, errors);
+
+        int client = ::accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE) {
+                continue;
+            }
+            return;
+        }
+
+        // Writes to a client that stops reading its output give up after a while
+        timeval sendTimeout{static_cast<time_t>(requestTimeout.count()), 0};
+        ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+
+        // A client that is slow to send its request, sends too much or sends something malformed
+        // loses its connection, and the worker goes on to the next one
+        std::string path;
+        std::vector<Value> args;
+        std::string input;
+        FrameType type;
+        std::string payload;
+        bool complete = false;
+        auto deadline = std::chrono::steady_clock::now() + requestTimeout;
+        size_t received = 0;
+        try {
+            while (!complete && readFrame(client, type, payload, deadline)) {
+                received += payload.size();
+                if (received > maxRequestSize) {
+                    break;
+                }
+                switch (type) {
+                    case FrameType::PATH: path = payload; break;
+                    case FrameType::ARG: args.emplace_back(payload); break;
+                    case FrameType::INPUT: input += payload; break;
+                    case FrameType::RUN: complete = true; break;
+                    default: break;
+                }
+            }
+        } catch (const std::exception&) {
+            complete = false;
+        }
+        if (!complete) {
+            ::close(client);
+            continue;
+        }
+
+        outputBuffer.attach(client);
+        errorBuffer.attach(client);
+        bool failed = false;
+        try {
+            auto script = compile(path);
+            interpreter->setInput(InputStream::fromString(std::move(input), "stdin"));
+            interpreter->defineVariable("args", Value(std::move(args)));
+            interpreter->execute(script->program);
+        } catch (const ParseError& e) {
+            errors << "Parse error: " << e.what() << '\n';
+            failed = true;
+        } catch (const RuntimeError& e) {
+            errors << "Runtime error: " << e.what() << '\n';
+            failed = true;
+        } catch (const std::exception& e) {
+            errors << "Error: " << e.what() << '\n';
+            failed = true;
+        }
+
+        // Files the script wrote are closed before the client hears that it has finished
+        interpreter.reset();
+        output.flush();
+        errors.flush();
+        outputBuffer.detach();
+        errorBuffer.detach();
+        output.clear();
+        errors.clear();
+        writeFrame(client, FrameType::EXIT, failed ? "1" : "0");
+        ::close(client);
+    }
+}
+
+void ScriptServer::run() {
+    // A client that disconnects early must not take the server down with SIGPIPE
+    std::signal(SIGPIPE, SIG_IGN);
+
+    listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        throw std::runtime_error(std::string("Could not create socket: ") + std::strerror(errno));
+    }
+
+    // A socket file left behind by an earlier server would make bind fail
+    ::unlink(socketPath.c_str());
+    sockaddr_un address = socketAddress(socketPath);
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        ::listen(listener, SOMAXCONN) < 0) {
+        throw std::runtime_error("Could not listen on '" + socketPath + "': " + std::strerror(errno));
+    }
+
+    // Every worker accepts on the listening socket itself, so a request goes straight to an idle one
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; i++) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+} // namespace SimpScript
@@ -0,0 +1,234 @@
+#include "Shard.h"
+#include "Interpreter.h"
+#include "Stream.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <queue>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace SimpScript {
+
+// Map the whole of a regular file read-only; an empty file gives nullptr
+static std::shared_ptr<const char> mapFile(int fd, const std::string& name, size_t& length) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        throw std::runtime_error("'" + name + "' is not a regular file");
+    }
+    length = static_cast<size_t>(info.st_size);
+    if (length == 0) {
+        return nullptr;
+    }
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Could not map '" + name + "': " + std::strerror(errno));
+    }
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    return std::shared_ptr<const char>(static_cast<const char*>(mapping),
+                                       [length](const char* data) { munmap(const_cast<char*>(data), length); });
+}
+
+// Offsets where each worker's slice starts, followed by the end of the input. Slices are
+// about the same size and every one but the last ends just after a newline
+static std::vector<size_t> sliceBoundaries(const char* data, size_t length, size_t workers) {
+    std::vector<size_t> boundaries{0};
+    for (size_t i = 1; i < workers; i++) {
+        // Look from the byte before the target, so a slice can start right at the target
+        size_t target = std::max(boundaries.back(), length / workers * i);
+        size_t from = target > 0 ? target - 1 : 0;
+        const void* newline = from < length ? std::memchr(data + from, '\n', length - from) : nullptr;
+        boundaries.push_back(newline != nullptr ? static_cast<size_t>(static_cast<const char*>(newline) - data) + 1 : length);
+    }
+    boundaries.push_back(length);
+    return boundaries;
+}
+
+// Body of a forked worker: run the program over its slice and exit
+[[noreturn]] static void runWorker(const std::unique_ptr<ASTNode>& program, std::shared_ptr<const char> slice,
+                                   size_t length, size_t index, size_t workers, int outputFd) {
+    if (outputFd >= 0 && ::dup2(outputFd, STDOUT_FILENO) < 0) {
+        ::_exit(1);
+    }
+
+    int status = 0;
+    try {
+        Interpreter interpreter(InputStream::fromMemory(std::move(slice), length, "stdin"), std::cout, std::cerr);
+        interpreter.defineVariable("shard", Value(static_cast<int>(index)));
+        interpreter.defineVariable("shards", Value(static_cast<int>(workers)));
+        interpreter.execute(program);
+    } catch (const RuntimeError& e) {
+        std::cerr << "Runtime error in shard " << index << ": " << e.what() << std::endl;
+        status = 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error in shard " << index << ": " << e.what() << std::endl;
+        status = 1;
+    }
+
+    // The parent's atexit handlers and stdio buffers are not ours to run
+    std::cout.flush();
+    std::cerr.flush();
+    ::_exit(status);
+}
+
+// Write a worker's output file to stdout
+static void copyOutput(FILE* file) {
+    int fd = fileno(file);
+    ::lseek(fd, 0, SEEK_SET);
+    char buffer[1 << 16];
+    ssize_t count;
+    while ((count = ::read(fd, buffer, sizeof(buffer))) != 0) {
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Could not read worker output: ") + std::strerror(errno));
+        }
+        std::cout.write(buffer, count);
+    }
+}
+
+// One worker's output, read a line at a time for merging
+struct OutputCursor {
+    std::shared_ptr<const char> data;
+    size_t length = 0;
+    size_t position = 0;
+    std::string_view line;
+    std::string_view key; // Up to the first tab, or the whole line
+
+    bool next() {
+        if (position >= length) {
+            return false;
+        }
+        const char* start = data.get() + position;
+        const void* newline = std::memchr(start, '\n', length - position);
+        size_t end = newline != nullptr ? static_cast<size_t>(static_cast<const char*>(newline) - data.get()) : length;
+        line = std::string_view(start, end - position);
+        key = line.substr(0, line.find('\t'));
+        position = end + 1;
+        return true;
+    }
+};
+
+// Write the lines of every worker's output to stdout in key order. Lines with equal keys
+// keep the order of the workers, so the merge is stable with respect to the input
+static void mergeOutputs(const std::vector<FILE*>& outputs) {
+    std::vector<OutputCursor> cursors(outputs.size());
+    auto later = [&cursors](size_t a, size_t b) {
+        if (cursors[a].key != cursors[b].key) {
+            return cursors[a].key > cursors[b].key;
+        }
+        return a > b;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> pending(later);
+
+    for (size_t i = 0; i < outputs.size(); i++) {
+        cursors[i].data = mapFile(fileno(outputs[i]), "worker output", cursors[i].length);
+        if (cursors[i].next()) {
+            pending.push(i);
+        }
+    }
+    while (!pending.empty()) {
+        size_t i = pending.top();
+        pending.pop();
+        std::cout.write(cursors[i].line.data(), static_cast<std::streamsize>(cursors[i].line.size()));
+        std::cout.put('\n');
+        if (cursors[i].next()) {
+            pending.push(i);
+        }
+    }
+}
+
+int runSharded(const std::unique_ptr<ASTNode>& program, const ShardOptions& options) {
+    size_t workers = std::max<size_t>(options.workers, 1);
+    int inputFd = ::open(options.inputPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (inputFd < 0) {
+        throw std::runtime_error("Could not open file '" + options.inputPath + "'");
+    }
+    size_t length = 0;
+    std::shared_ptr<const char> input;
+    try {
+        input = mapFile(inputFd, options.inputPath, length);
+    } catch (...) {
+        ::close(inputFd);
+        throw;
+    }
+    ::close(inputFd);
+    std::vector<size_t> boundaries = sliceBoundaries(input.get(), length, workers);
+
+    // In input order the first worker writes straight to stdout and the others to temporary
+    // files, copied out once every worker has finished. Merging needs them all in files
+    bool ordered = options.merge == ShardMerge::ORDERED;
+    std::vector<FILE*> outputs(workers, nullptr);
+    auto closeOutputs = [&outputs] {
+        for (FILE* file : outputs) {
+            if (file != nullptr) {
+                std::fclose(file);
+            }
+        }
+    };
+    for (size_t i = ordered ? 1 : 0; i < workers; i++) {
+        outputs[i] = std::tmpfile();
+        if (outputs[i] == nullptr) {
+            closeOutputs();
+            throw std::runtime_error(std::string("Could not create a temporary file: ") + std::strerror(errno));
+        }
+    }
+
+    // Nothing buffered may be written twice by the children
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+
+    bool failed = false;
+    std::vector<pid_t> children;
+    for (size_t i = 0; i < workers; i++) {
+        pid_t pid = ::fork();
+        if (pid < 0) {
+            std::cerr << "Error: Could not start worker " << i << ": " << std::strerror(errno) << std::endl;
+            failed = true;
+            break;
+        }
+        if (pid == 0) {
+            std::shared_ptr<const char> slice(input, input.get() + boundaries[i]);
+            runWorker(program, std::move(slice), boundaries[i + 1] - boundaries[i], i, workers,
+                      outputs[i] != nullptr ? fileno(outputs[i]) : -1);
+        }
+        children.push_back(pid);
+    }
+
+    for (pid_t child : children) {
+        int status = 0;
+        while (::waitpid(child, &status, 0) < 0 && errno == EINTR) {
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed = true;
+        }
+    }
+
+    try {
+        if (ordered) {
+            for (size_t i = 1; i < children.size(); i++) {
+                copyOutput(outputs[i]);
+            }
+        } else {
+            mergeOutputs(outputs);
+        }
+        std::cout.flush();
+    } catch (...) {
+        closeOutputs();
+        throw;
+    }
+    closeOutputs();
+    return failed ? 1 : 0;
+}
+
+} // namespace SimpScript
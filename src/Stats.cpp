@@ -0,0 +1,131 @@
+#include "Stats.h"
+#include "Value.h"
+#include <climits>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace SimpScript {
+
+static_assert(static_cast<size_t>(Value::Type::NATIVE_FUNCTION) + 1 == valueTypeCount,
+              "valueTypeCount must match Value::Type");
+
+static const char* const nodeKindNames[] = {
+    "literal", "regex_literal", "interpolated_string", "variable", "binary_op", "unary_op", "array_literal",
+    "array_access", "slice", "function_call", "block", "assignment", "array_assignment", "if", "while", "for",
+    "for_each", "function_def", "return", "print", "spawn", "input", "program"
+};
+static_assert(sizeof(nodeKindNames) / sizeof(nodeKindNames[0]) == static_cast<size_t>(NodeKind::COUNT),
+              "nodeKindNames must match NodeKind");
+
+static const char* const valueTypeNames[] = {
+    "nil", "boolean", "integer", "float", "string", "array", "map", "range", "iterator", "handle", "function",
+    "native_function"
+};
+
+// RuntimeStats implementation
+RuntimeStats& RuntimeStats::operator+=(const RuntimeStats& other) {
+    for (size_t i = 0; i < static_cast<size_t>(NodeKind::COUNT); i++) {
+        nodes[i] += other.nodes[i];
+    }
+    for (size_t i = 0; i < valueTypeCount; i++) {
+        valueCopies[i] += other.valueCopies[i];
+    }
+    environments += other.environments;
+    lookups += other.lookups;
+    lookupDepth += other.lookupDepth;
+    mapLookups += other.mapLookups;
+    arrayCopies += other.arrayCopies;
+    arrayCopyElements += other.arrayCopyElements;
+    mapCopies += other.mapCopies;
+    stringBytes += other.stringBytes;
+    userCalls += other.userCalls;
+    nativeCalls += other.nativeCalls;
+    return *this;
+}
+
+#ifdef SIMPSCRIPT_STATS
+
+// Counters of every thread that has counted anything. They are kept after their thread
+// exits, so work done by parallel workers still shows in the totals
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<RuntimeStats>> registry;
+
+thread_local RuntimeStats* threadStatsPointer = nullptr;
+
+RuntimeStats& registerThreadStats() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.push_back(std::make_unique<RuntimeStats>());
+    threadStatsPointer = registry.back().get();
+    return *threadStatsPointer;
+}
+
+// Other threads may still be counting; their latest counts can be slightly behind
+RuntimeStats collectStats() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    RuntimeStats total;
+    for (const auto& stats : registry) {
+        total += *stats;
+    }
+    return total;
+}
+
+#else
+
+RuntimeStats collectStats() {
+    return RuntimeStats();
+}
+
+#endif
+
+// Call visit(name, count) for every counter, in the order they are printed
+template <typename Visit>
+static void forEachCounter(const RuntimeStats& stats, Visit visit) {
+    for (size_t i = 0; i < static_cast<size_t>(NodeKind::COUNT); i++) {
+        visit(std::string("nodes.") + nodeKindNames[i], stats.nodes[i]);
+    }
+    visit("environments", stats.environments);
+    visit("lookups", stats.lookups);
+    visit("lookup_depth", stats.lookupDepth);
+    visit("map_lookups", stats.mapLookups);
+    for (size_t i = 0; i < valueTypeCount; i++) {
+        visit(std::string("copies.") + valueTypeNames[i], stats.valueCopies[i]);
+    }
+    visit("array_copies", stats.arrayCopies);
+    visit("array_copy_elements", stats.arrayCopyElements);
+    visit("map_copies", stats.mapCopies);
+    visit("string_bytes", stats.stringBytes);
+    visit("user_calls", stats.userCalls);
+    visit("native_calls", stats.nativeCalls);
+}
+
+Value statsValue(const RuntimeStats& stats) {
+    auto map = std::make_shared<Map>();
+    forEachCounter(stats, [&map](const std::string& name, uint64_t count) {
+        if (count == 0) {
+            return;
+        }
+        // Counts too large for an integer become floats
+        map->set(name, count <= static_cast<uint64_t>(INT_MAX) ? Value(static_cast<int>(count))
+                                                               : Value(static_cast<double>(count)));
+    });
+    return Value(map);
+}
+
+void printStats(std::ostream& out, const RuntimeStats& stats) {
+    out << "Runtime statistics:" << std::endl;
+    forEachCounter(stats, [&out](const std::string& name, uint64_t count) {
+        if (count != 0) {
+            out << "  " << std::left << std::setw(32) << name << std::right << std::setw(14) << count << std::endl;
+        }
+    });
+    if (stats.lookups != 0) {
+        out << "  " << std::left << std::setw(32) << "average lookup depth" << std::right << std::setw(14)
+            << std::fixed << std::setprecision(2)
+            << static_cast<double>(stats.lookupDepth) / static_cast<double>(stats.lookups) << std::defaultfloat
+            << std::endl;
+    }
+}
+
+} // namespace SimpScript
@@ -0,0 +1,331 @@
+#include "Stream.h"
+#include "Interpreter.h"
+#include "Json.h"
+#include "Scheduler.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace SimpScript {
+
+// InputStream implementation
+InputStream::InputStream(const std::string& name, int fd, bool ownsFd)
+    : name(name), fd(fd), ownsFd(ownsFd), exhausted(fd < 0) {}
+
+InputStream::~InputStream() {
+    if (ownsFd && fd >= 0) {
+        ::close(fd);
+    }
+}
+
+std::shared_ptr<InputStream> InputStream::standardInput() {
+    return std::shared_ptr<InputStream>(new InputStream("stdin", STDIN_FILENO, false));
+}
+
+std::shared_ptr<InputStream> InputStream::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw RuntimeError("Could not open file '" + path + "'");
+    }
+
+    // Regular files are mapped in one piece; lines then point straight into the page cache
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        size_t length = static_cast<size_t>(info.st_size);
+        void* mapping = length > 0 ? mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+        if (mapping != MAP_FAILED) {
+            ::close(fd);
+            std::shared_ptr<InputStream> stream(new InputStream(path, -1, false));
+            if (mapping != nullptr) {
+                madvise(mapping, length, MADV_SEQUENTIAL);
+                stream->buffer = std::shared_ptr<const char>(
+                    static_cast<const char*>(mapping),
+                    [length](const char* data) { munmap(const_cast<char*>(data), length); });
+                stream->size = length;
+            }
+            return stream;
+        }
+    }
+
+    // Pipes, devices and files that cannot be mapped are read in chunks
+    return std::shared_ptr<InputStream>(new InputStream(path, fd, true));
+}
+
+std::shared_ptr<InputStream> InputStream::fromString(std::string text, const std::string& name) {
+    std::shared_ptr<InputStream> stream(new InputStream(name, -1, false));
+    stream->size = text.size();
+    auto owner = std::make_shared<const std::string>(std::move(text));
+    stream->buffer = std::shared_ptr<const char>(owner, owner->data());
+    return stream;
+}
+
+std::shared_ptr<InputStream> InputStream::fromMemory(std::shared_ptr<const char> data, size_t length, const std::string& name) {
+    std::shared_ptr<InputStream> stream(new InputStream(name, -1, false));
+    stream->buffer = std::move(data);
+    stream->size = length;
+    return stream;
+}
+
+void InputStream::tie(std::ostream* output) {
+    tied = output;
+}
+
+bool InputStream::refill() {
+    if (exhausted) {
+        return false;
+    }
+
+    // Start a new chunk when the current one is full. Lines already handed out may
+    // still point into the old chunk, so only the unread tail is moved
+    if (writable == nullptr || size == capacity) {
+        size_t tail = size - position;
+        size_t newCapacity = std::max(chunkSize, tail * 2);
+        std::shared_ptr<char> chunk(new char[newCapacity], std::default_delete<char[]>());
+        if (tail > 0) {
+            std::memcpy(chunk.get(), buffer.get() + position, tail);
+        }
+        writable = chunk.get();
+        buffer = chunk;
+        capacity = newCapacity;
+        size = tail;
+        position = 0;
+    }
+
+    // Anything written before a blocking read on the terminal should be visible first
+    if (tied != nullptr) {
+        tied->flush();
+    }
+
+    // Other tasks run while this one waits for input
+    Scheduler::waitReadable(fd);
+
+    ssize_t count;
+    do {
+        count = ::read(fd, writable + size, capacity - size);
+    } while (count < 0 && errno == EINTR);
+
+    if (count <= 0) {
+        exhausted = true;
+        return false;
+    }
+    size += static_cast<size_t>(count);
+    return true;
+}
+
+bool InputStream::readLine(Value& line) {
+    if (closed) {
+        throw RuntimeError("Cannot read from closed " + describe());
+    }
+    size_t scanned = position;
+
+    while (true) {
+        const void* newline = scanned < size
+            ? std::memchr(buffer.get() + scanned, '\n', size - scanned)
+            : nullptr;
+
+        if (newline != nullptr || (exhausted && position < size)) {
+            const char* start = buffer.get() + position;
+            size_t length = newline != nullptr
+                ? static_cast<size_t>(static_cast<const char*>(newline) - start)
+                : size - position;
+            position += newline != nullptr ? length + 1 : length;
+
+            if (length > 0 && start[length - 1] == '\r') {
+                length--;
+            }
+            line = Value(std::shared_ptr<const char>(buffer, start), length);
+            return true;
+        }
+
+        if (exhausted) {
+            return false;
+        }
+
+        // Everything up to size has been searched; refill may move it to the front of a new chunk
+        size_t tail = size - position;
+        refill();
+        scanned = position + tail;
+    }
+}
+
+Value InputStream::readAll() {
+    if (closed) {
+        throw RuntimeError("Cannot read from closed " + describe());
+    }
+    while (refill()) {
+    }
+
+    Value result(std::shared_ptr<const char>(buffer, buffer.get() + position), size - position);
+    position = size;
+    return result;
+}
+
+bool InputStream::readChunk(Value& chunk) {
+    if (closed) {
+        throw RuntimeError("Cannot read from closed " + describe());
+    }
+    if (position == size && !refill()) {
+        return false;
+    }
+    chunk = Value(std::shared_ptr<const char>(buffer, buffer.get() + position), size - position);
+    position = size;
+    return true;
+}
+
+std::string InputStream::describe() const {
+    return "<input " + name + ">";
+}
+
+void InputStream::close() {
+    if (ownsFd && fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    buffer.reset();
+    writable = nullptr;
+    size = position = capacity = 0;
+    exhausted = true;
+    closed = true;
+}
+
+// OutputStream implementation
+OutputStream::OutputStream(const std::string& name) : name(name) {}
+
+OutputStream::~OutputStream() {
+    close();
+}
+
+std::shared_ptr<OutputStream> OutputStream::open(const std::string& path, bool append) {
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+    int fd = ::open(path.c_str(), flags, 0644);
+    if (fd < 0) {
+        throw RuntimeError("Could not open file '" + path + "' for writing");
+    }
+
+    std::shared_ptr<OutputStream> stream(new OutputStream(path));
+    stream->fd = fd;
+    stream->buffer.reserve(flushThreshold * 2);
+    return stream;
+}
+
+std::shared_ptr<OutputStream> OutputStream::wrap(std::ostream& stream, const std::string& name) {
+    std::shared_ptr<OutputStream> wrapper(new OutputStream(name));
+    wrapper->console = &stream;
+    return wrapper;
+}
+
+void OutputStream::write(std::string_view text) {
+    if (closed) {
+        throw RuntimeError("Cannot write to closed " + describe());
+    }
+    if (console != nullptr) {
+        console->write(text.data(), text.size());
+        return;
+    }
+
+    buffer += text;
+    if (buffer.size() >= flushThreshold) {
+        writeBuffer();
+    }
+}
+
+void OutputStream::write(const Value& value) {
+    if (value.isString()) {
+        write(value.asStringView());
+        return;
+    }
+    if (closed || console != nullptr) {
+        std::string text = value.toString();
+        write(text);
+        return;
+    }
+
+    value.appendTo(buffer);
+    if (buffer.size() >= flushThreshold) {
+        writeBuffer();
+    }
+}
+
+void OutputStream::writeJson(const Value& value) {
+    if (closed) {
+        throw RuntimeError("Cannot write to closed " + describe());
+    }
+    if (console != nullptr) {
+        std::string chunk;
+        JsonWriter(chunk, [this](std::string& text) {
+            console->write(text.data(), text.size());
+            text.clear();
+        }).write(value);
+        console->write(chunk.data(), chunk.size());
+        return;
+    }
+
+    JsonWriter(buffer, [this](std::string&) { writeBuffer(); }).write(value);
+    if (buffer.size() >= flushThreshold) {
+        writeBuffer();
+    }
+}
+
+void OutputStream::writeBuffer() {
+    size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t count = ::write(fd, buffer.data() + written, buffer.size() - written);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            buffer.clear();
+            throw RuntimeError("Could not write to " + describe() + ": " + std::strerror(errno));
+        }
+        written += static_cast<size_t>(count);
+    }
+    buffer.clear();
+}
+
+void OutputStream::flush() {
+    if (closed) {
+        return;
+    }
+    if (console != nullptr) {
+        console->flush();
+    } else {
+        writeBuffer();
+    }
+}
+
+bool OutputStream::isClosed() const {
+    return closed;
+}
+
+std::string OutputStream::describe() const {
+    return "<output " + name + ">";
+}
+
+void OutputStream::close() {
+    if (closed) {
+        return;
+    }
+    try {
+        flush();
+    } catch (...) {
+        // Nothing more can be done about a failed write while closing
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    closed = true;
+}
+
+// LineIterator implementation
+LineIterator::LineIterator(std::shared_ptr<InputStream> stream) : stream(stream) {}
+
+bool LineIterator::next(Value& out) {
+    return stream->readLine(out);
+}
+
+} // namespace SimpScript
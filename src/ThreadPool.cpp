@@ -0,0 +1,140 @@
+#include "ThreadPool.h"
+#include <exception>
+
+namespace SimpScript {
+
+// ThreadPool implementation
+ThreadPool::ThreadPool(size_t threads) {
+    size_t count = threads > 1 ? threads - 1 : 0;
+    for (size_t i = 0; i < count; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < count; i++) {
+        workers.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::size() const {
+    return workers.size() + 1;
+}
+
+void ThreadPool::push(std::function<void()> job) {
+    Queue& queue = *queues[next.fetch_add(1, std::memory_order_relaxed) % queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    queued.fetch_add(1);
+}
+
+bool ThreadPool::runOne(size_t self) {
+    std::function<void()> job;
+
+    // Own queue first, newest job first while its data is still in cache
+    if (self < queues.size()) {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+        }
+    }
+
+    // Then steal the oldest job of another queue
+    for (size_t i = 0; !job && i < queues.size(); i++) {
+        Queue& victim = *queues[(self + 1 + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+        }
+    }
+
+    if (!job) {
+        return false;
+    }
+    queued.fetch_sub(1);
+    job();
+    return true;
+}
+
+void ThreadPool::workerLoop(size_t self) {
+    while (true) {
+        if (runOne(self)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+    if (workers.empty()) {
+        for (size_t i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    struct Batch {
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+    } batch;
+    batch.remaining = count;
+
+    for (size_t i = 0; i < count; i++) {
+        push([&batch, &task, i] {
+            std::exception_ptr error;
+            try {
+                task(i);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            // Count down under the lock: the waiting caller frees the batch as soon as it sees zero
+            std::lock_guard<std::mutex> lock(batch.mutex);
+            if (error && !batch.error) {
+                batch.error = error;
+            }
+            if (batch.remaining.fetch_sub(1) == 1) {
+                batch.done.notify_all();
+            }
+        });
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_all();
+
+    // Help out until nothing is left to take, then wait for the jobs still running
+    while (batch.remaining.load() > 0 && runOne(queues.size())) {
+    }
+    {
+        std::unique_lock<std::mutex> lock(batch.mutex);
+        batch.done.wait(lock, [&batch] { return batch.remaining.load() == 0; });
+    }
+
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+} // namespace SimpScript
@@ -76,6 +76,7 @@ std::string Token::toString() const {
         case TokenType::INTEGER: ss << "INTEGER"; break;
         case TokenType::FLOAT: ss << "FLOAT"; break;
         case TokenType::STRING: ss << "STRING"; break;
+        case TokenType::REGEX: ss << "REGEX"; break;
         case TokenType::IDENTIFIER: ss << "IDENTIFIER"; break;
         case TokenType::PLUS: ss << "PLUS"; break;
         case TokenType::MINUS: ss << "MINUS"; break;
@@ -115,6 +116,7 @@ std::string Token::toString() const {
         case TokenType::ELSE: ss << "ELSE"; break;
         case TokenType::WHILE: ss << "WHILE"; break;
         case TokenType::FOR: ss << "FOR"; break;
+        case TokenType::IN: ss << "IN"; break;
         case TokenType::FUNCTION: ss << "FUNCTION"; break;
         case TokenType::RETURN: ss << "RETURN"; break;
         case TokenType::SHOW: ss << "SHOW"; break;
@@ -125,6 +127,9 @@ std::string Token::toString() const {
         case TokenType::ENDWHILE: ss << "ENDWHILE"; break;
         case TokenType::ENDFOR: ss << "ENDFOR"; break;
         case TokenType::ENDFUNCTION: ss << "ENDFUNCTION"; break;
+        case TokenType::SPAWN: ss << "SPAWN"; break;
+        case TokenType::TRUE: ss << "TRUE"; break;
+        case TokenType::FALSE: ss << "FALSE"; break;
         default: ss << "UNKNOWN"; break;
     }
     
@@ -0,0 +1,110 @@
+#include "Trace.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace SimpScript {
+
+bool tracing = false;
+
+namespace {
+
+struct TraceEvent {
+    uint64_t timestamp; // Nanoseconds since startTracing
+    const char* category;
+    const char* name;
+    char phase; // 'B' or 'E'
+};
+
+// One thread's events. Only the owning thread writes; the buffer is read once the script
+// has finished, and outlives the thread so that workers' events are still there
+struct TraceBuffer {
+    static constexpr size_t capacity = 1 << 17; // A power of two
+
+    std::vector<TraceEvent> events = std::vector<TraceEvent>(capacity);
+    std::atomic<size_t> recorded{0}; // Events ever recorded; the ring holds the last capacity of them
+    size_t thread;
+};
+
+std::chrono::steady_clock::time_point epoch;
+
+std::mutex registryMutex; // Taken once per thread, and for names
+std::vector<std::unique_ptr<TraceBuffer>> buffers;
+std::unordered_set<std::string> names;
+
+thread_local TraceBuffer* threadBuffer = nullptr;
+
+TraceBuffer& currentBuffer() {
+    if (threadBuffer == nullptr) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffers.push_back(std::make_unique<TraceBuffer>());
+        buffers.back()->thread = buffers.size();
+        threadBuffer = buffers.back().get();
+    }
+    return *threadBuffer;
+}
+
+void record(const char* category, const char* name, char phase) {
+    auto now = std::chrono::steady_clock::now() - epoch;
+    TraceBuffer& buffer = currentBuffer();
+    size_t index = buffer.recorded.load(std::memory_order_relaxed);
+    buffer.events[index & (TraceBuffer::capacity - 1)] =
+        TraceEvent{static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()), category, name, phase};
+    buffer.recorded.store(index + 1, std::memory_order_release);
+}
+
+} // namespace
+
+void startTracing() {
+    epoch = std::chrono::steady_clock::now();
+    tracing = true;
+}
+
+const char* traceName(const std::string& name) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return names.insert(name).first->c_str();
+}
+
+void traceBegin(const char* category, const char* name) {
+    record(category, name, 'B');
+}
+
+void traceEnd(const char* category, const char* name) {
+    record(category, name, 'E');
+}
+
+// Names are script identifiers and fixed labels, so they need no escaping
+void writeTrace(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    bool first = true;
+    auto separate = [&out, &first] {
+        out << (first ? "\n" : ",\n");
+        first = false;
+    };
+
+    for (const auto& buffer : buffers) {
+        separate();
+        out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->thread
+            << ", \"args\": {\"name\": \"" << (buffer->thread == 1 ? "main" : "thread " + std::to_string(buffer->thread)) << "\"}}";
+
+        size_t recorded = buffer->recorded.load(std::memory_order_acquire);
+        size_t begin = recorded > TraceBuffer::capacity ? recorded - TraceBuffer::capacity : 0;
+        for (size_t i = begin; i < recorded; i++) {
+            const TraceEvent& event = buffer->events[i & (TraceBuffer::capacity - 1)];
+            // Timestamps are in microseconds, with the nanoseconds after the point
+            separate();
+            out << "{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category << "\", \"ph\": \"" << event.phase
+                << "\", \"pid\": 1, \"tid\": " << buffer->thread << ", \"ts\": " << event.timestamp / 1000 << "."
+                << static_cast<char>('0' + event.timestamp / 100 % 10) << static_cast<char>('0' + event.timestamp / 10 % 10)
+                << static_cast<char>('0' + event.timestamp % 10) << "}";
+        }
+    }
+    out << "\n]}\n";
+}
+
+} // namespace SimpScript
@@ -2,34 +2,66 @@
 #include "Environment.h"
 #include "AST.h"
 #include "Interpreter.h"
+#include "HeapProfiler.h"
+#include "Jit.h"
+#include "Json.h"
+#include "Scheduler.h"
+#include "Trace.h"
 #include <sstream>
 #include <stdexcept>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
 
 namespace SimpScript {
 
 // NativeFunction implementation
-NativeFunction::NativeFunction(int arity, std::function<Value(std::vector<Value>&)> function)
-    : _arity(arity), function(function) {}
+NativeFunction::NativeFunction(int arity, std::function<Value(std::vector<Value>&)> function, bool pure)
+    : _arity(arity), function(function), pure(pure) {}
 
 int NativeFunction::arity() const {
     return _arity;
 }
 
-Value NativeFunction::call(std::vector<Value>& arguments) {
+bool NativeFunction::isPure() const {
+    return pure;
+}
+
+Value NativeFunction::call(Interpreter&, std::vector<Value>& arguments) {
+    SIMPSCRIPT_COUNT(nativeCalls);
     return function(arguments);
 }
 
 // UserFunction implementation
-UserFunction::UserFunction(const std::vector<std::string>& parameters, 
+UserFunction::UserFunction(const std::string& name,
+                           const std::vector<std::string>& parameters, 
                            std::unique_ptr<ASTNode> body,
-                           std::shared_ptr<Environment> closure)
-    : parameters(parameters), body(std::move(body)), closure(closure) {}
+                           std::shared_ptr<Environment> closure,
+                           std::shared_ptr<JitSite> jitSite)
+    : name(name), parameters(parameters), body(std::move(body)), closure(closure),
+      traceLabel(tracing ? traceName(name) : nullptr), jitSite(std::move(jitSite)) {}
 
 int UserFunction::arity() const {
     return parameters.size();
 }
 
-Value UserFunction::call(std::vector<Value>& arguments) {
+Value UserFunction::call(Interpreter& interpreter, std::vector<Value>& arguments) {
+    if (tracing) {
+        TraceScope scope("function", traceLabel);
+        return invoke(interpreter, arguments);
+    }
+    if (jit != nullptr) {
+        Value result;
+        if (jit->call(*this, arguments, result)) {
+            return result;
+        }
+    }
+    return invoke(interpreter, arguments);
+}
+
+Value UserFunction::invoke(Interpreter& interpreter, std::vector<Value>& arguments) {
+    SIMPSCRIPT_COUNT(userCalls);
+    Scheduler::checkStack();
     // Create a new environment using the closure as the enclosing environment
     auto environment = std::make_shared<Environment>(closure);
     
@@ -43,13 +75,71 @@ Value UserFunction::call(std::vector<Value>& arguments) {
         }
     }
     
+    // Execute the function body in the new environment, restoring the caller's afterwards
+    auto caller = interpreter.getEnvironment();
+    interpreter.setEnvironment(environment);
+    Value result;
     try {
-        // Execute the function body in the new environment
-        return body->evaluate(*reinterpret_cast<class Interpreter*>(environment.get()));
-    } catch (const ReturnValue& returnValue) {
-        // Catch return statements from within the function
-        return returnValue.getValue();
+        result = body->evaluate(interpreter);
+    } catch (...) {
+        interpreter.setEnvironment(caller);
+        interpreter.clearReturn();
+        throw;
+    }
+    interpreter.setEnvironment(caller);
+    
+    // A return statement stops the body early and supplies the result
+    if (interpreter.isReturning()) {
+        result = interpreter.clearReturn();
+    }
+    return result;
+}
+
+const std::string& UserFunction::getName() const {
+    return name;
+}
+
+const std::vector<std::string>& UserFunction::getParameters() const {
+    return parameters;
+}
+
+std::shared_ptr<Environment> UserFunction::getClosure() const {
+    return closure;
+}
+
+const ASTNode* UserFunction::getBody() const {
+    return body.get();
+}
+
+JitSite& UserFunction::getJitSite() {
+    return *jitSite;
+}
+
+void UserFunction::collectEffects(Effects& effects) const {
+    body->collectEffects(effects);
+}
+
+std::shared_ptr<UserFunction> UserFunction::withClosure(std::shared_ptr<Environment> environment) const {
+    return std::make_shared<UserFunction>(name, parameters, body->clone(), environment, jitSite);
+}
+
+// Range implementation
+int Range::size() const {
+    long long span = static_cast<long long>(stop) - start;
+    if (step > 0 && span > 0) {
+        return static_cast<int>((span + step - 1) / step);
     }
+    if (step < 0 && span < 0) {
+        return static_cast<int>((-span - step - 1) / -step);
+    }
+    return 0;
+}
+
+int Range::at(int index) const {
+    if (index < 0 || index >= size()) {
+        throw std::runtime_error("Range index out of bounds");
+    }
+    return start + index * step;
 }
 
 // Value implementation
@@ -57,8 +147,50 @@ Value::Value() : data(std::monostate()), type(Type::NIL) {}
 Value::Value(bool value) : data(value), type(Type::BOOLEAN) {}
 Value::Value(int value) : data(value), type(Type::INTEGER) {}
 Value::Value(double value) : data(value), type(Type::FLOAT) {}
-Value::Value(const std::string& value) : data(value), type(Type::STRING) {}
-Value::Value(const ArrayType& array) : data(array), type(Type::ARRAY) {}
+Value::Value(const char* value) : Value(std::string(value)) {}
+Value::Value(const std::string& value) : Value(std::string(value)) {}
+
+Value::Value(std::string&& value) : type(Type::STRING) {
+    size_t length = value.size();
+    SIMPSCRIPT_COUNT_BY(stringBytes, length);
+    std::shared_ptr<const std::string> owner;
+    if (heapProfiler != nullptr && HeapProfiler::currentSite != 0) {
+        size_t bytes = sizeof(std::string) + value.capacity();
+        owner = heapProfiler->track<const std::string>(new std::string(std::move(value)), HeapProfiler::currentSite, bytes);
+    } else {
+        owner = std::make_shared<const std::string>(std::move(value));
+    }
+    data = StringRef{std::shared_ptr<const char>(owner, owner->data()), length};
+}
+
+Value::Value(std::shared_ptr<const char> chars, size_t length)
+    : data(StringRef{std::move(chars), length}), type(Type::STRING) {}
+
+Value::Value(const ArrayType& array) : Value(ArrayType(array)) {}
+
+Value::Value(ArrayType&& array) : type(Type::ARRAY) {
+    size_t length = array.size();
+    if (heapProfiler != nullptr && HeapProfiler::currentSite != 0) {
+        size_t bytes = sizeof(ArrayType) + array.capacity() * sizeof(Value);
+        data = ArrayRef{heapProfiler->track(new ArrayType(std::move(array)), HeapProfiler::currentSite, bytes), 0, length};
+        return;
+    }
+    data = ArrayRef{std::make_shared<ArrayType>(std::move(array)), 0, length};
+}
+
+Value::Value(std::shared_ptr<NumberStorage> numbers) : type(Type::ARRAY) {
+    size_t length = numbers->numbers.size();
+    data = NumberArrayRef{std::move(numbers), 0, length};
+}
+
+Value::Value(std::shared_ptr<Map> map) : data(std::move(map)), type(Type::MAP) {}
+
+Value::Value(std::shared_ptr<DeferredJson> json) : type(json->object ? Type::MAP : Type::ARRAY) {
+    data = std::move(json);
+}
+Value::Value(const Range& range) : data(range), type(Type::RANGE) {}
+Value::Value(std::shared_ptr<Iterator> iterator) : data(std::move(iterator)), type(Type::ITERATOR) {}
+Value::Value(std::shared_ptr<Handle> handle) : data(std::move(handle)), type(Type::HANDLE) {}
 Value::Value(const FunctionType& function) : data(function), type(Type::FUNCTION) {}
 
 bool Value::isNil() const { return type == Type::NIL; }
@@ -68,6 +200,12 @@ bool Value::isFloat() const { return type == Type::FLOAT; }
 bool Value::isNumber() const { return isInteger() || isFloat(); }
 bool Value::isString() const { return type == Type::STRING; }
 bool Value::isArray() const { return type == Type::ARRAY; }
+bool Value::isPackedArray() const { return std::holds_alternative<NumberArrayRef>(data); }
+bool Value::isMap() const { return type == Type::MAP; }
+bool Value::isDeferredJson() const { return std::holds_alternative<std::shared_ptr<DeferredJson>>(data); }
+bool Value::isRange() const { return type == Type::RANGE; }
+bool Value::isIterator() const { return type == Type::ITERATOR; }
+bool Value::isHandle() const { return type == Type::HANDLE; }
 bool Value::isFunction() const { return type == Type::FUNCTION; }
 
 Value::Type Value::getType() const { return type; }
@@ -99,23 +237,130 @@ double Value::asFloat() const {
 
 std::string Value::asString() const {
     if (isString()) {
-        return std::get<std::string>(data);
+        return std::string(asStringView());
     }
     return toString();
 }
 
-Value::ArrayType& Value::asArray() {
+std::string_view Value::asStringView() const {
+    if (!isString()) {
+        throw std::runtime_error("Value is not a string");
+    }
+    const StringRef& ref = std::get<StringRef>(data);
+    return std::string_view(ref.chars.get(), ref.length);
+}
+
+const Value* Value::parsedJson() const {
+    if (const auto* json = std::get_if<std::shared_ptr<DeferredJson>>(&data)) {
+        return &(*json)->value();
+    }
+    return nullptr;
+}
+
+ArraySpan Value::asArray() const {
     if (!isArray()) {
         throw std::runtime_error("Value is not an array");
     }
-    return std::get<ArrayType>(data);
+    if (const Value* parsed = parsedJson()) {
+        return parsed->asArray();
+    }
+    if (const auto* packed = std::get_if<NumberArrayRef>(&data)) {
+        // Build the generic form of packed numbers once, on first use
+        NumberStorage& storage = *packed->owner;
+        std::call_once(storage.expandOnce, [&storage]() {
+            storage.expanded.reserve(storage.numbers.size());
+            for (double number : storage.numbers) {
+                storage.expanded.push_back(storage.integral ? Value(static_cast<int>(number)) : Value(number));
+            }
+        });
+        return ArraySpan(storage.expanded.data() + packed->offset, packed->length);
+    }
+    const ArrayRef& ref = std::get<ArrayRef>(data);
+    return ArraySpan(ref.owner->data() + ref.offset, ref.length);
 }
 
-const Value::ArrayType& Value::asArray() const {
+Value::ArrayType& Value::mutableArray() {
     if (!isArray()) {
         throw std::runtime_error("Value is not an array");
     }
-    return std::get<ArrayType>(data);
+    if (const Value* parsed = parsedJson()) {
+        // Copy before assigning: the parsed value belongs to the storage being replaced
+        Value copy = *parsed;
+        data = std::move(copy.data);
+    }
+    if (std::holds_alternative<NumberArrayRef>(data)) {
+        // Writing to packed numbers turns them into a generic array
+        ArraySpan elements = asArray();
+        SIMPSCRIPT_COUNT(arrayCopies);
+        SIMPSCRIPT_COUNT_BY(arrayCopyElements, elements.size());
+        data = ArrayRef{std::make_shared<ArrayType>(elements.begin(), elements.end()), 0, elements.size()};
+    }
+    ArrayRef& ref = std::get<ArrayRef>(data);
+    
+    // Copy on write: take a private copy if the storage is shared or this is a slice
+    if (ref.owner.use_count() > 1 || ref.offset != 0 || ref.length != ref.owner->size()) {
+        auto first = ref.owner->begin() + ref.offset;
+        SIMPSCRIPT_COUNT(arrayCopies);
+        SIMPSCRIPT_COUNT_BY(arrayCopyElements, ref.length);
+        ref.owner = std::make_shared<ArrayType>(first, first + ref.length);
+        ref.offset = 0;
+    }
+    return *ref.owner;
+}
+
+const Map& Value::asMap() const {
+    if (!isMap()) {
+        throw std::runtime_error("Value is not a map");
+    }
+    if (const Value* parsed = parsedJson()) {
+        return parsed->asMap();
+    }
+    return *std::get<std::shared_ptr<Map>>(data);
+}
+
+Map& Value::mutableMap() {
+    if (!isMap()) {
+        throw std::runtime_error("Value is not a map");
+    }
+    if (const Value* parsed = parsedJson()) {
+        // Copy before assigning: the parsed value belongs to the storage being replaced
+        Value copy = *parsed;
+        data = std::move(copy.data);
+    }
+    auto& map = std::get<std::shared_ptr<Map>>(data);
+    if (map.use_count() > 1) {
+        SIMPSCRIPT_COUNT(mapCopies);
+        map = std::make_shared<Map>(*map);
+    }
+    return *map;
+}
+
+const Range& Value::asRange() const {
+    if (!isRange()) {
+        throw std::runtime_error("Value is not a range");
+    }
+    return std::get<Range>(data);
+}
+
+std::shared_ptr<Iterator> Value::asIterator() const {
+    if (!isIterator()) {
+        throw std::runtime_error("Value is not an iterator");
+    }
+    return std::get<std::shared_ptr<Iterator>>(data);
+}
+
+std::shared_ptr<Handle> Value::asHandle() const {
+    if (!isHandle()) {
+        throw std::runtime_error("Value is not a handle");
+    }
+    return std::get<std::shared_ptr<Handle>>(data);
+}
+
+std::shared_ptr<DeferredJson> Value::asDeferredJson() const {
+    if (!isDeferredJson()) {
+        throw std::runtime_error("Value is not unparsed JSON");
+    }
+    return std::get<std::shared_ptr<DeferredJson>>(data);
 }
 
 Value::FunctionType Value::asFunction() const {
@@ -125,95 +370,191 @@ Value::FunctionType Value::asFunction() const {
     return std::get<FunctionType>(data);
 }
 
-Value& Value::at(int index) {
-    if (!isArray()) {
-        throw std::runtime_error("Value is not an array");
-    }
-    ArrayType& array = std::get<ArrayType>(data);
+const Value& Value::at(int index) const {
+    ArraySpan array = asArray();
     if (index < 0 || static_cast<size_t>(index) >= array.size()) {
         throw std::runtime_error("Array index out of bounds");
     }
     return array[index];
 }
 
-const Value& Value::at(int index) const {
-    if (!isArray()) {
-        throw std::runtime_error("Value is not an array");
-    }
-    const ArrayType& array = std::get<ArrayType>(data);
-    if (index < 0 || static_cast<size_t>(index) >= array.size()) {
-        throw std::runtime_error("Array index out of bounds");
+Value Value::element(int index) const {
+    if (const auto* packed = std::get_if<NumberArrayRef>(&data)) {
+        if (index < 0 || static_cast<size_t>(index) >= packed->length) {
+            throw std::runtime_error("Array index out of bounds");
+        }
+        double number = packed->owner->numbers[packed->offset + index];
+        return packed->owner->integral ? Value(static_cast<int>(number)) : Value(number);
     }
-    return array[index];
+    return at(index);
 }
 
 void Value::set(int index, const Value& value) {
     if (!isArray()) {
         throw std::runtime_error("Value is not an array");
     }
-    ArrayType& array = std::get<ArrayType>(data);
-    if (index < 0 || static_cast<size_t>(index) >= array.size()) {
+    if (index < 0 || index >= size()) {
         throw std::runtime_error("Array index out of bounds");
     }
-    array[index] = value;
+    mutableArray()[index] = value;
 }
 
 int Value::size() const {
+    if (const Value* parsed = parsedJson()) {
+        return parsed->size();
+    }
     if (isArray()) {
-        return static_cast<int>(std::get<ArrayType>(data).size());
+        if (const auto* packed = std::get_if<NumberArrayRef>(&data)) {
+            return static_cast<int>(packed->length);
+        }
+        return static_cast<int>(std::get<ArrayRef>(data).length);
+    } else if (isMap()) {
+        return static_cast<int>(asMap().size());
     } else if (isString()) {
-        return static_cast<int>(std::get<std::string>(data).size());
+        return static_cast<int>(std::get<StringRef>(data).length);
+    } else if (isRange()) {
+        return std::get<Range>(data).size();
     }
     throw std::runtime_error("Value does not have a size");
 }
 
-Value Value::call(std::vector<Value>& args) {
+Value Value::slice(int begin, int end) const {
+    if (!isArray() && !isString()) {
+        throw std::runtime_error("Only arrays and strings can be sliced");
+    }
+    
+    // Negative bounds count from the end; out of range bounds are clamped
+    int length = size();
+    if (begin < 0) begin += length;
+    if (end < 0) end += length;
+    begin = std::max(0, std::min(begin, length));
+    end = std::max(begin, std::min(end, length));
+    
+    if (isString()) {
+        const StringRef& ref = std::get<StringRef>(data);
+        return Value(std::shared_ptr<const char>(ref.chars, ref.chars.get() + begin), end - begin);
+    }
+    if (const Value* parsed = parsedJson()) {
+        return parsed->slice(begin, end);
+    }
+    
+    Value result;
+    if (const auto* packed = std::get_if<NumberArrayRef>(&data)) {
+        result.data = NumberArrayRef{packed->owner, packed->offset + begin, static_cast<size_t>(end - begin)};
+        result.type = Type::ARRAY;
+        return result;
+    }
+    const ArrayRef& ref = std::get<ArrayRef>(data);
+    result.data = ArrayRef{ref.owner, ref.offset + begin, static_cast<size_t>(end - begin)};
+    result.type = Type::ARRAY;
+    return result;
+}
+
+Value Value::call(Interpreter& interpreter, std::vector<Value>& args) {
     if (!isFunction()) {
         throw std::runtime_error("Value is not callable");
     }
     
-    FunctionType func = std::get<FunctionType>(data);
+    const FunctionType& func = std::get<FunctionType>(data);
     
-    // Check if number of arguments matches the function's arity
-    if (static_cast<int>(args.size()) != func->arity()) {
+    // Check if number of arguments matches the function's arity (negative means variadic)
+    if (func->arity() >= 0 && static_cast<int>(args.size()) != func->arity()) {
         std::stringstream ss;
         ss << "Expected " << func->arity() << " arguments but got " << args.size();
         throw std::runtime_error(ss.str());
     }
     
-    return func->call(args);
+    return func->call(interpreter, args);
 }
 
 std::string Value::toString() const {
-    std::stringstream ss;
+    if (isString()) {
+        return asString();
+    }
+    std::string out;
+    out.reserve(formattedLengthHint());
+    appendTo(out);
+    return out;
+}
+
+void Value::appendTo(std::string& out) const {
+    char buffer[32];
     
     switch (type) {
         case Type::NIL:
-            return "nil";
+            out += "nil";
+            break;
         case Type::BOOLEAN:
-            return std::get<bool>(data) ? "true" : "false";
-        case Type::INTEGER:
-            ss << std::get<int>(data);
-            return ss.str();
-        case Type::FLOAT:
-            ss << std::get<double>(data);
-            return ss.str();
+            out += std::get<bool>(data) ? "true" : "false";
+            break;
+        case Type::INTEGER: {
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), std::get<int>(data));
+            out.append(buffer, result.ptr);
+            break;
+        }
+        case Type::FLOAT: {
+            // Same formatting as the default iostream precision
+            int length = std::snprintf(buffer, sizeof(buffer), "%g", std::get<double>(data));
+            out.append(buffer, length);
+            break;
+        }
         case Type::STRING:
-            return std::get<std::string>(data);
+            out += asStringView();
+            break;
         case Type::ARRAY: {
-            const ArrayType& array = std::get<ArrayType>(data);
-            ss << "[";
-            for (size_t i = 0; i < array.size(); i++) {
-                if (i > 0) ss << ", ";
-                ss << array[i].toString();
+            out += '[';
+            for (int i = 0, count = size(); i < count; i++) {
+                if (i > 0) out += ", ";
+                element(i).appendTo(out);
+            }
+            out += ']';
+            break;
+        }
+        case Type::MAP: {
+            const Map& map = asMap();
+            out += '{';
+            for (size_t i = 0; i < map.size(); i++) {
+                if (i > 0) out += ", ";
+                out += map.keyAt(i);
+                out += ": ";
+                map.valueAt(i).appendTo(out);
             }
-            ss << "]";
-            return ss.str();
+            out += '}';
+            break;
         }
+        case Type::RANGE: {
+            const Range& range = std::get<Range>(data);
+            int length = std::snprintf(buffer, sizeof(buffer), "range(%d, %d, %d)",
+                                       range.start, range.stop, range.step);
+            out.append(buffer, length);
+            break;
+        }
+        case Type::ITERATOR:
+            out += "<iterator>";
+            break;
+        case Type::HANDLE:
+            out += std::get<std::shared_ptr<Handle>>(data)->describe();
+            break;
         case Type::FUNCTION:
-            return "<function>";
+            out += "<function>";
+            break;
         default:
-            return "<unknown>";
+            out += "<unknown>";
+            break;
+    }
+}
+
+size_t Value::formattedLengthHint() const {
+    switch (type) {
+        case Type::NIL: return 3;
+        case Type::BOOLEAN: return 5;
+        case Type::INTEGER: return 11;
+        case Type::FLOAT: return 12;
+        case Type::STRING: return std::get<StringRef>(data).length;
+        case Type::ARRAY: return 2 + size() * 4;
+        case Type::MAP: return 2 + size() * 16;
+        case Type::RANGE: return 48;
+        default: return 16;
     }
 }
 
@@ -222,22 +563,27 @@ bool Value::isTruthy() const {
     if (isBoolean()) return asBoolean();
     if (isInteger()) return asInteger() != 0;
     if (isFloat()) return asFloat() != 0.0;
-    if (isString()) return !asString().empty();
-    if (isArray()) return !asArray().empty();
+    if (isString()) return size() > 0;
+    if (isArray() || isMap()) return size() > 0;
+    if (isRange()) return asRange().size() > 0;
     return true;
 }
 
 // Arithmetic operators
 Value Value::operator+(const Value& rhs) const {
     if (isString() || rhs.isString()) {
-        // String concatenation
-        return Value(this->toString() + rhs.toString());
+        // String concatenation, formatted straight into one buffer
+        std::string result;
+        result.reserve(formattedLengthHint() + rhs.formattedLengthHint());
+        appendTo(result);
+        rhs.appendTo(result);
+        return Value(std::move(result));
     } else if (isNumber() && rhs.isNumber()) {
         // Numeric addition
         if (isFloat() || rhs.isFloat()) {
             return Value(asFloat() + rhs.asFloat());
         } else {
-            return Value(asInteger() + rhs.asInteger());
+            return Value(wrappingAdd(asInteger(), rhs.asInteger()));
         }
     }
     throw std::runtime_error("Cannot add these types");
@@ -248,7 +594,7 @@ Value Value::operator-(const Value& rhs) const {
         if (isFloat() || rhs.isFloat()) {
             return Value(asFloat() - rhs.asFloat());
         } else {
-            return Value(asInteger() - rhs.asInteger());
+            return Value(wrappingSub(asInteger(), rhs.asInteger()));
         }
     }
     throw std::runtime_error("Cannot subtract these types");
@@ -259,7 +605,7 @@ Value Value::operator*(const Value& rhs) const {
         if (isFloat() || rhs.isFloat()) {
             return Value(asFloat() * rhs.asFloat());
         } else {
-            return Value(asInteger() * rhs.asInteger());
+            return Value(wrappingMul(asInteger(), rhs.asInteger()));
         }
     }
     throw std::runtime_error("Cannot multiply these types");
@@ -276,6 +622,8 @@ Value Value::operator/(const Value& rhs) const {
         
         if (isFloat() || rhs.isFloat()) {
             return Value(asFloat() / rhs.asFloat());
+        } else if (rhs.asInteger() == -1) {
+            return Value(wrappingNegate(asInteger())); // The smallest integer divided by -1 wraps to itself
         } else {
             return Value(asInteger() / rhs.asInteger());
         }
@@ -288,6 +636,9 @@ Value Value::operator%(const Value& rhs) const {
         if (rhs.asInteger() == 0) {
             throw std::runtime_error("Modulo by zero");
         }
+        if (rhs.asInteger() == -1) {
+            return Value(0);
+        }
         return Value(asInteger() % rhs.asInteger());
     }
     throw std::runtime_error("Modulo requires integer operands");
@@ -314,16 +665,35 @@ bool Value::operator==(const Value& rhs) const {
         case Type::FLOAT:
             return asFloat() == rhs.asFloat();
         case Type::STRING:
-            return asString() == rhs.asString();
+            return asStringView() == rhs.asStringView();
         case Type::ARRAY: {
-            const ArrayType& a = asArray();
-            const ArrayType& b = rhs.asArray();
+            ArraySpan a = asArray();
+            ArraySpan b = rhs.asArray();
             if (a.size() != b.size()) return false;
             for (size_t i = 0; i < a.size(); i++) {
                 if (!(a[i] == b[i])) return false;
             }
             return true;
         }
+        case Type::MAP: {
+            const Map& a = asMap();
+            const Map& b = rhs.asMap();
+            if (a.size() != b.size()) return false;
+            for (size_t i = 0; i < a.size(); i++) {
+                const Value* other = b.find(a.keyAt(i));
+                if (other == nullptr || !(a.valueAt(i) == *other)) return false;
+            }
+            return true;
+        }
+        case Type::RANGE: {
+            const Range& a = asRange();
+            const Range& b = rhs.asRange();
+            return a.start == b.start && a.stop == b.stop && a.step == b.step;
+        }
+        case Type::ITERATOR:
+            return asIterator() == rhs.asIterator();
+        case Type::HANDLE:
+            return asHandle() == rhs.asHandle();
         case Type::FUNCTION:
             // Functions are only equal if they're the same object
             return asFunction() == rhs.asFunction();
@@ -340,7 +710,7 @@ bool Value::operator<(const Value& rhs) const {
     if (isNumber() && rhs.isNumber()) {
         return asFloat() < rhs.asFloat();
     } else if (isString() && rhs.isString()) {
-        return asString() < rhs.asString();
+        return asStringView() < rhs.asStringView();
     }
     throw std::runtime_error("Cannot compare these types with <");
 }
@@ -357,4 +727,39 @@ bool Value::operator>=(const Value& rhs) const {
     return !(*this < rhs);
 }
 
+// Map implementation
+size_t Map::position(const std::string& key) const {
+    SIMPSCRIPT_COUNT(mapLookups);
+    if (index.empty()) {
+        return static_cast<size_t>(std::find(keys.begin(), keys.end(), key) - keys.begin());
+    }
+    auto it = index.find(key);
+    return it == index.end() ? keys.size() : it->second;
+}
+
+const Value* Map::find(const std::string& key) const {
+    size_t found = position(key);
+    return found < keys.size() ? &values[found] : nullptr;
+}
+
+void Map::set(const std::string& key, const Value& value) {
+    size_t found = position(key);
+    if (found < keys.size()) {
+        values[found] = value;
+        return;
+    }
+    keys.push_back(key);
+    values.push_back(value);
+    
+    if (keys.size() > indexThreshold) {
+        if (index.empty()) {
+            for (size_t i = 0; i < keys.size(); i++) {
+                index.emplace(keys[i], i);
+            }
+        } else {
+            index.emplace(key, keys.size() - 1);
+        }
+    }
+}
+
 } // namespace SimpScript 
\ No newline at end of file
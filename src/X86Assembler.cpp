@@ -0,0 +1,350 @@
+#include "X86Assembler.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace SimpScript {
+
+static const size_t unbound = static_cast<size_t>(-1);
+
+static uint8_t number(Reg reg) {
+    return static_cast<uint8_t>(reg);
+}
+
+static uint8_t number(Xmm reg) {
+    return static_cast<uint8_t>(reg);
+}
+
+// X86Assembler implementation
+void X86Assembler::byte(uint8_t value) {
+    code.push_back(value);
+}
+
+void X86Assembler::int32(int32_t value) {
+    uint32_t bits = static_cast<uint32_t>(value);
+    for (int i = 0; i < 4; i++) {
+        byte(static_cast<uint8_t>(bits >> (8 * i)));
+    }
+}
+
+// The REX prefix, when the operands need one. Byte registers past bl need it even when empty,
+// or their encodings mean ah to bh
+void X86Assembler::rex(bool wide, uint8_t reg, uint8_t base, bool always) {
+    uint8_t prefix = 0x40 | (wide ? 0x08 : 0) | ((reg >> 3) << 2) | (base >> 3);
+    if (prefix != 0x40 || always) {
+        byte(prefix);
+    }
+}
+
+// ModRM for [base + disp32]; rsp and r12 as a base need a SIB byte
+void X86Assembler::memory(uint8_t reg, Reg base, int32_t displacement) {
+    byte(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (number(base) & 7)));
+    if ((number(base) & 7) == 4) {
+        byte(0x24);
+    }
+    int32(displacement);
+}
+
+void X86Assembler::direct(uint8_t reg, uint8_t rm) {
+    byte(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+void X86Assembler::relative(Label target) {
+    fixups.emplace_back(code.size(), target);
+    int32(0);
+}
+
+X86Assembler::Label X86Assembler::newLabel() {
+    labels.push_back(unbound);
+    return labels.size() - 1;
+}
+
+void X86Assembler::bind(Label label) {
+    labels[label] = code.size();
+}
+
+void X86Assembler::push(Reg reg) {
+    rex(false, 0, number(reg));
+    byte(static_cast<uint8_t>(0x50 + (number(reg) & 7)));
+}
+
+void X86Assembler::pop(Reg reg) {
+    rex(false, 0, number(reg));
+    byte(static_cast<uint8_t>(0x58 + (number(reg) & 7)));
+}
+
+void X86Assembler::mov(Reg destination, Reg source) {
+    rex(true, number(source), number(destination));
+    byte(0x89);
+    direct(number(source), number(destination));
+}
+
+void X86Assembler::movImm32(Reg destination, int32_t value) {
+    rex(false, 0, number(destination));
+    byte(static_cast<uint8_t>(0xB8 + (number(destination) & 7)));
+    int32(value);
+}
+
+void X86Assembler::movImm64(Reg destination, uint64_t value) {
+    rex(true, 0, number(destination));
+    byte(static_cast<uint8_t>(0xB8 + (number(destination) & 7)));
+    for (int i = 0; i < 8; i++) {
+        byte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+void X86Assembler::lea(Reg destination, Reg base, int32_t displacement) {
+    rex(true, number(destination), number(base));
+    byte(0x8D);
+    memory(number(destination), base, displacement);
+}
+
+void X86Assembler::load32(Reg destination, Reg base, int32_t displacement) {
+    rex(false, number(destination), number(base));
+    byte(0x8B);
+    memory(number(destination), base, displacement);
+}
+
+void X86Assembler::store32(Reg base, int32_t displacement, Reg source) {
+    rex(false, number(source), number(base));
+    byte(0x89);
+    memory(number(source), base, displacement);
+}
+
+void X86Assembler::load64(Reg destination, Reg base, int32_t displacement) {
+    rex(true, number(destination), number(base));
+    byte(0x8B);
+    memory(number(destination), base, displacement);
+}
+
+void X86Assembler::store64(Reg base, int32_t displacement, Reg source) {
+    rex(true, number(source), number(base));
+    byte(0x89);
+    memory(number(source), base, displacement);
+}
+
+void X86Assembler::loadDouble(Xmm destination, Reg base, int32_t displacement) {
+    byte(0xF2);
+    rex(false, number(destination), number(base));
+    byte(0x0F);
+    byte(0x10);
+    memory(number(destination), base, displacement);
+}
+
+void X86Assembler::storeDouble(Reg base, int32_t displacement, Xmm source) {
+    byte(0xF2);
+    rex(false, number(source), number(base));
+    byte(0x0F);
+    byte(0x11);
+    memory(number(source), base, displacement);
+}
+
+void X86Assembler::alu32(AluOp op, Reg destination, Reg source) {
+    rex(false, number(source), number(destination));
+    byte(static_cast<uint8_t>(op));
+    direct(number(source), number(destination));
+}
+
+// The /digit that selects op in the immediate forms
+static uint8_t immediateDigit(AluOp op) {
+    switch (op) {
+        case AluOp::ADD:
+            return 0;
+        case AluOp::OR:
+            return 1;
+        case AluOp::AND:
+            return 4;
+        case AluOp::SUB:
+            return 5;
+        case AluOp::XOR:
+            return 6;
+        case AluOp::CMP:
+            return 7;
+    }
+    return 0;
+}
+
+void X86Assembler::aluImm32(AluOp op, Reg destination, int32_t value) {
+    rex(false, 0, number(destination));
+    byte(0x81);
+    direct(immediateDigit(op), number(destination));
+    int32(value);
+}
+
+void X86Assembler::aluImm64(AluOp op, Reg destination, int32_t value) {
+    rex(true, 0, number(destination));
+    byte(0x81);
+    direct(immediateDigit(op), number(destination));
+    int32(value);
+}
+
+void X86Assembler::cmp64(Reg left, Reg base, int32_t displacement) {
+    rex(true, number(left), number(base));
+    byte(0x3B);
+    memory(number(left), base, displacement);
+}
+
+void X86Assembler::test32(Reg left, Reg right) {
+    rex(false, number(right), number(left));
+    byte(0x85);
+    direct(number(right), number(left));
+}
+
+void X86Assembler::imul32(Reg destination, Reg source) {
+    rex(false, number(destination), number(source));
+    byte(0x0F);
+    byte(0xAF);
+    direct(number(destination), number(source));
+}
+
+void X86Assembler::neg32(Reg reg) {
+    rex(false, 0, number(reg));
+    byte(0xF7);
+    direct(3, number(reg));
+}
+
+void X86Assembler::cdq() {
+    byte(0x99);
+}
+
+void X86Assembler::idiv32(Reg divisor) {
+    rex(false, 0, number(divisor));
+    byte(0xF7);
+    direct(7, number(divisor));
+}
+
+void X86Assembler::xchg32(Reg reg) {
+    rex(false, 0, number(reg));
+    byte(static_cast<uint8_t>(0x90 + (number(reg) & 7)));
+}
+
+void X86Assembler::setcc(Condition condition, Reg destination) {
+    rex(false, 0, number(destination), number(destination) >= 4);
+    byte(0x0F);
+    byte(static_cast<uint8_t>(0x90 + static_cast<uint8_t>(condition)));
+    direct(0, number(destination));
+}
+
+void X86Assembler::movzx8(Reg destination, Reg source) {
+    rex(false, number(destination), number(source), number(source) >= 4);
+    byte(0x0F);
+    byte(0xB6);
+    direct(number(destination), number(source));
+}
+
+void X86Assembler::sse(SseOp op, Xmm destination, Xmm source) {
+    byte(0xF2);
+    byte(0x0F);
+    byte(static_cast<uint8_t>(op));
+    direct(number(destination), number(source));
+}
+
+void X86Assembler::ucomisd(Xmm left, Xmm right) {
+    byte(0x66);
+    byte(0x0F);
+    byte(0x2E);
+    direct(number(left), number(right));
+}
+
+void X86Assembler::xorpd(Xmm destination, Xmm source) {
+    byte(0x66);
+    byte(0x0F);
+    byte(0x57);
+    direct(number(destination), number(source));
+}
+
+void X86Assembler::movapd(Xmm destination, Xmm source) {
+    byte(0x66);
+    byte(0x0F);
+    byte(0x28);
+    direct(number(destination), number(source));
+}
+
+void X86Assembler::movqToXmm(Xmm destination, Reg source) {
+    byte(0x66);
+    rex(true, number(destination), number(source));
+    byte(0x0F);
+    byte(0x6E);
+    direct(number(destination), number(source));
+}
+
+void X86Assembler::movqFromXmm(Reg destination, Xmm source) {
+    byte(0x66);
+    rex(true, number(source), number(destination));
+    byte(0x0F);
+    byte(0x7E);
+    direct(number(source), number(destination));
+}
+
+void X86Assembler::cvtsi2sd(Xmm destination, Reg source) {
+    byte(0xF2);
+    rex(false, number(destination), number(source));
+    byte(0x0F);
+    byte(0x2A);
+    direct(number(destination), number(source));
+}
+
+void X86Assembler::jmp(Label target) {
+    byte(0xE9);
+    relative(target);
+}
+
+void X86Assembler::jcc(Condition condition, Label target) {
+    byte(0x0F);
+    byte(static_cast<uint8_t>(0x80 + static_cast<uint8_t>(condition)));
+    relative(target);
+}
+
+void X86Assembler::call(Label target) {
+    byte(0xE8);
+    relative(target);
+}
+
+void X86Assembler::ret() {
+    byte(0xC3);
+}
+
+std::vector<uint8_t> X86Assembler::finish() {
+    for (const auto& [position, target] : fixups) {
+        if (labels[target] == unbound) {
+            throw std::logic_error("Jump to a label that was never bound");
+        }
+        // Relative to the end of the rel32 field, where the next instruction starts
+        int32_t offset = static_cast<int32_t>(labels[target]) - static_cast<int32_t>(position + 4);
+        uint32_t bits = static_cast<uint32_t>(offset);
+        for (int i = 0; i < 4; i++) {
+            code[position + i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+    }
+    fixups.clear();
+    return code;
+}
+
+// ExecutableCode implementation
+ExecutableCode::ExecutableCode(const std::vector<uint8_t>& code) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    length = (code.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error(std::string("Could not map memory for machine code: ") + std::strerror(errno));
+    }
+    std::memcpy(memory, code.data(), code.size());
+    // Never writable and executable at once
+    if (mprotect(memory, length, PROT_READ | PROT_EXEC) != 0) {
+        int error = errno;
+        munmap(memory, length);
+        throw std::runtime_error(std::string("Could not make machine code executable: ") + std::strerror(error));
+    }
+    pages = memory;
+}
+
+ExecutableCode::~ExecutableCode() {
+    if (pages != nullptr) {
+        munmap(pages, length);
+    }
+}
+
+} // namespace SimpScript
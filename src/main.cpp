@@ -1,16 +1,157 @@
 #include "Lexer.h"
 #include "Parser.h"
 #include "Interpreter.h"
+#include "HeapProfiler.h"
+#include "Coverage.h"
+#include "CppEmitter.h"
+#include "Jit.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
+#include "Server.h"
+#include "Shard.h"
+#include "Stats.h"
+#include "Stream.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace SimpScript;
 
+// What to do besides running the script, from the command line flags
+struct RunOptions {
+    bool debug = false;      // Print the tokens first
+    bool trace = false;
+    std::string traceOutput = "simpscript.trace.json"; // Chrome trace_event JSON
+    bool sharded = false;    // Run over shards of an input file instead
+    ShardOptions sharding;
+    bool stats = false;      // Print runtime statistics at exit
+    bool perfCounters = false; // Print hardware counters for each phase at exit
+    bool profile = false;
+    std::string profileOutput = "simpscript.folded"; // Collapsed stacks for flame graphs
+    bool heapProfile = false;
+    std::string heapOutput = "simpscript.heap"; // Heap snapshots
+    uint64_t heapInterval = uint64_t(64) << 20; // Bytes allocated between snapshots
+    bool coverage = false;
+    std::string coverageOutput = "simpscript.lcov"; // lcov tracefile
+    bool jit = false;        // Compile hot loops and functions to machine code
+};
+
+// Write the profile report to stderr and the collapsed stacks to their file
+static void finishProfile(Profiler& profiler, const std::string& path, const RunOptions& options) {
+    profiler.stop();
+    profiler.report(std::cerr, path);
+    std::ofstream stacks(options.profileOutput);
+    if (!stacks.is_open()) {
+        std::cerr << "Error: Could not open file '" << options.profileOutput << "'" << std::endl;
+        return;
+    }
+    profiler.writeCollapsed(stacks);
+    std::cerr << std::endl << "Collapsed stacks written to " << options.profileOutput << std::endl;
+}
+
+// Hardware counts for each phase of the run, for --perf-counters
+struct PhaseCounters {
+    PerfCounters counters;
+    std::vector<std::string> names;
+    std::vector<PerfSample> samples;
+    
+    void record(const char* name) {
+        names.push_back(name);
+        samples.push_back(counters.stop());
+    }
+};
+
+// Run one phase of the run, as a single event when tracing and counted when perf is set
+template <typename Body>
+static void phase(const char* name, PhaseCounters* perf, Body body) {
+    if (perf != nullptr) {
+        perf->counters.start();
+    }
+    try {
+        if (tracing) {
+            TraceScope scope("phase", name);
+            body();
+        } else {
+            body();
+        }
+    } catch (...) {
+        if (perf != nullptr) {
+            perf->record(name);
+        }
+        throw;
+    }
+    if (perf != nullptr) {
+        perf->record(name);
+    }
+}
+
+static void finishTrace(const RunOptions& options) {
+    std::ofstream trace(options.traceOutput);
+    if (!trace.is_open()) {
+        std::cerr << "Error: Could not open file '" << options.traceOutput << "'" << std::endl;
+        return;
+    }
+    writeTrace(trace);
+    std::cerr << "Trace written to " << options.traceOutput << std::endl;
+}
+
+// Write the lcov tracefile and a summary line to stderr
+static void finishCoverage(Coverage& lines, const RunOptions& options) {
+    coverage = nullptr;
+    std::ofstream tracefile(options.coverageOutput);
+    if (!tracefile.is_open()) {
+        std::cerr << "Error: Could not open file '" << options.coverageOutput << "'" << std::endl;
+        return;
+    }
+    lines.writeLcov(tracefile);
+    lines.summary(std::cerr);
+    std::cerr << "Coverage written to " << options.coverageOutput << std::endl;
+}
+
+// Lower a SimpScript file to C++ on stdout; returns the exit status
+int emitCpp(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file '" << path << "'" << std::endl;
+        return 1;
+    }
+    
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    try {
+        // The parser reports the error it stopped at instead of throwing it; a program with
+        // one is not lowered at all
+        std::ostringstream errors;
+        Lexer lexer(buffer.str());
+        Parser parser(lexer, errors);
+        std::unique_ptr<ASTNode> program = parser.parse();
+        if (!errors.str().empty()) {
+            std::cerr << errors.str();
+            return 1;
+        }
+        
+        // Buffered, so that an error part way through emits nothing either
+        std::ostringstream lowered;
+        CppEmitter(path).emit(*program, lowered);
+        std::cout << lowered.str();
+    } catch (const ParseError& e) {
+        std::cerr << "Parse error: " << e.what() << std::endl;
+        return 1;
+    } catch (const EmitError& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
 // Function to run a SimpScript file
-void runFile(const std::string& path, bool debug = false, bool traceDebug = false) {
+void runFile(const std::string& path, const RunOptions& options) {
     // Read the file contents
     std::ifstream file(path);
     if (!file.is_open()) {
@@ -23,7 +164,7 @@ void runFile(const std::string& path, bool debug = false, bool traceDebug = fals
     std::string source = buffer.str();
     
     // Debug mode: print tokens
-    if (debug) {
+    if (options.debug) {
         std::cout << "Tokens:" << std::endl;
         Lexer debugLexer(source);
         while (true) {
@@ -36,30 +177,123 @@ void runFile(const std::string& path, bool debug = false, bool traceDebug = fals
         std::cout << "End of tokens" << std::endl;
     }
     
-    // Parse and execute
+    // Parse and execute. The profilers outlive the interpreter, whose tasks may still unwind
+    // calls, and the values it frees as it goes
+    std::unique_ptr<Profiler> profiler;
+    std::ofstream heapSnapshots;
+    std::unique_ptr<HeapProfiler> heap;
+    std::unique_ptr<Coverage> lines;
+    std::unique_ptr<PhaseCounters> perf;
+    std::unique_ptr<Jit> compiler;
+    bool failed = false;
+    if (options.trace) {
+        startTracing();
+    }
+    if (options.heapProfile) {
+        heapSnapshots.open(options.heapOutput);
+        if (!heapSnapshots.is_open()) {
+            std::cerr << "Error: Could not open file '" << options.heapOutput << "'" << std::endl;
+        }
+        heap = std::make_unique<HeapProfiler>(path, heapSnapshots.is_open() ? &heapSnapshots : nullptr,
+                                              options.heapInterval);
+        heapProfiler = heap.get();
+    }
+    if (options.coverage) {
+        // Set before parsing, which is when statements get their counters
+        lines = std::make_unique<Coverage>(path);
+        coverage = lines.get();
+    }
+    if (options.perfCounters) {
+        perf = std::make_unique<PhaseCounters>();
+        if (!perf->counters.available()) {
+            std::cerr << "Hardware counters are unavailable: " << perf->counters.unavailableReason() << std::endl;
+            perf.reset();
+        }
+    }
+    if (options.jit) {
+        compiler = std::make_unique<Jit>();
+        if (compiler->available()) {
+            jit = compiler.get();
+        } else {
+            std::cerr << "JIT is unavailable: " << compiler->unavailableReason() << std::endl;
+        }
+    }
     try {
-        Lexer lexer(source);
-        Parser parser(lexer);
+        // The parser lexes as it goes, so lexing on its own is measured with a separate pass
+        if (perf) {
+            phase("lex", perf.get(), [&] {
+                Lexer lexer(source);
+                while (lexer.nextToken().getType() != TokenType::END_OF_FILE) {
+                }
+            });
+        }
         
-        // Enable trace debugging when requested
-        if (traceDebug) {
-            auto program = parser.parse();
-            std::cout << "Parsing succeeded, executing program..." << std::endl;
-            Interpreter interpreter;
-            interpreter.execute(program);
-        } else {
-            auto program = parser.parse();
-            Interpreter interpreter;
-            interpreter.execute(program);
+        std::unique_ptr<ASTNode> program;
+        phase("parse", perf.get(), [&] {
+            Lexer lexer(source);
+            Parser parser(lexer);
+            program = parser.parse();
+        });
+        
+        if (options.sharded) {
+            exit(runSharded(program, options.sharding));
         }
+        
+        Interpreter interpreter;
+        
+        // Snapshot the heap as the script ends, before the interpreter lets go of its values
+        struct ExitSnapshot {
+            ~ExitSnapshot() {
+                if (heapProfiler != nullptr) {
+                    heapProfiler->finish();
+                }
+            }
+        } exitSnapshot;
+        
+        if (options.profile) {
+            profiler = std::make_unique<Profiler>();
+            interpreter.setProfiler(profiler.get());
+            profiler->start();
+        }
+        phase("execute", perf.get(), [&] { interpreter.execute(program); });
     } catch (const ParseError& e) {
         std::cerr << "Parse error: " << e.what() << std::endl;
-        exit(1);
+        failed = true;
     } catch (const RuntimeError& e) {
         std::cerr << "Runtime error: " << e.what() << std::endl;
-        exit(1);
+        failed = true;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
+        failed = true;
+    }
+    
+    if (profiler) {
+        finishProfile(*profiler, path, options);
+    }
+    if (options.trace) {
+        finishTrace(options);
+    }
+    if (lines) {
+        finishCoverage(*lines, options);
+    }
+    if (options.stats) {
+        printStats(std::cerr, collectStats());
+    }
+    if (heap) {
+        heapProfiler = nullptr;
+        heap->report(std::cerr);
+        if (heapSnapshots.is_open()) {
+            std::cerr << std::endl << "Heap snapshots written to " << options.heapOutput << std::endl;
+        }
+    }
+    if (jit != nullptr) {
+        jit = nullptr;
+        compiler->summary(std::cerr);
+    }
+    if (perf) {
+        printPerfTable(std::cerr, perf->names.data(), perf->samples.data(), perf->names.size());
+    }
+    if (failed) {
         exit(1);
     }
 }
@@ -74,7 +308,12 @@ void runRepl() {
     
     while (true) {
         std::cout << ">> ";
-        if (!std::getline(std::cin, line) || line == "exit") {
+        Value input;
+        if (!interpreter.getInput()->readLine(input)) {
+            break;
+        }
+        line = input.asString();
+        if (line == "exit") {
             break;
         }
         
@@ -97,27 +336,106 @@ void runRepl() {
     }
 }
 
+// Function to serve script runs on a Unix domain socket until the process is stopped
+void runServer(const std::string& socketPath) {
+    try {
+        ScriptServer server(socketPath, std::thread::hardware_concurrency());
+        server.run();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        exit(1);
+    }
+}
+
 int main(int argc, char* argv[]) {
-    if (argc > 4) {
-        std::cout << "Usage: simpscript [script] [--debug] [--trace]" << std::endl;
-        return 1;
+    // All console I/O goes through iostreams or the interpreter's own input buffer
+    std::ios::sync_with_stdio(false);
+    
+    if (argc >= 2 && std::string(argv[1]) == "--serve") {
+        if (argc != 3) {
+            std::cout << "Usage: simpscript --serve <socket>" << std::endl;
+            return 1;
+        }
+        runServer(argv[2]);
+    } else if (argc >= 2 && std::string(argv[1]) == "--emit-cpp") {
+        if (argc != 3) {
+            std::cout << "Usage: simpscript --emit-cpp <script>" << std::endl;
+            return 1;
+        }
+        return emitCpp(argv[2]);
     } else if (argc >= 2) {
-        bool debug = false;
-        bool traceDebug = false;
+        RunOptions options;
+        bool usageError = false;
         std::string scriptPath = argv[1];
+        options.sharding.workers = 0;
         
-        // Check for debug flags
+        // Check for debug, tracing, statistics, counter, sharding and profiling flags
         for (int i = 2; i < argc; i++) {
             std::string arg = argv[i];
             if (arg == "--debug") {
-                debug = true;
+                options.debug = true;
             } else if (arg == "--trace") {
-                traceDebug = true;
+                options.trace = true;
+            } else if (arg == "--trace-output" && i + 1 < argc) {
+                options.trace = true;
+                options.traceOutput = argv[++i];
+            } else if (arg == "--shard-input" && i + 1 < argc) {
+                options.sharding.inputPath = argv[++i];
+            } else if (arg == "--workers" && i + 1 < argc) {
+                options.sharding.workers = std::strtoul(argv[++i], nullptr, 10);
+                usageError = usageError || options.sharding.workers == 0;
+            } else if (arg == "--merge-by-key") {
+                options.sharding.merge = ShardMerge::BY_KEY;
+            } else if (arg == "--stats") {
+                options.stats = true;
+            } else if (arg == "--perf-counters") {
+                options.perfCounters = true;
+            } else if (arg == "--coverage") {
+                options.coverage = true;
+            } else if (arg == "--coverage-output" && i + 1 < argc) {
+                options.coverage = true;
+                options.coverageOutput = argv[++i];
+            } else if (arg == "--heap-profile") {
+                options.heapProfile = true;
+            } else if (arg == "--heap-output" && i + 1 < argc) {
+                options.heapProfile = true;
+                options.heapOutput = argv[++i];
+            } else if (arg == "--heap-interval" && i + 1 < argc) {
+                options.heapProfile = true;
+                options.heapInterval = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--jit") {
+                options.jit = true;
+            } else if (arg == "--profile") {
+                options.profile = true;
+            } else if (arg == "--profile-output" && i + 1 < argc) {
+                options.profile = true;
+                options.profileOutput = argv[++i];
+            } else {
+                usageError = true;
             }
         }
+        options.sharded = !options.sharding.inputPath.empty();
+        bool shardFlags = options.sharding.workers > 0 || options.sharding.merge == ShardMerge::BY_KEY;
+        if (usageError || (!options.sharded && shardFlags) || (options.sharded && (options.profile || options.trace || options.stats || options.perfCounters || options.heapProfile || options.coverage || options.jit))) {
+            std::cout << "Usage: simpscript [script] [--debug] [--trace] [--trace-output <file>] [--stats] [--perf-counters]" << std::endl;
+            std::cout << "                  [--profile] [--profile-output <file>]" << std::endl;
+            std::cout << "                  [--heap-profile] [--heap-output <file>] [--heap-interval <bytes>]" << std::endl;
+            std::cout << "                  [--coverage] [--coverage-output <file>] [--jit]" << std::endl;
+            std::cout << "       simpscript <script> --shard-input <file> [--workers N] [--merge-by-key]" << std::endl;
+            std::cout << "       simpscript --emit-cpp <script>" << std::endl;
+            std::cout << "       simpscript --serve <socket>" << std::endl;
+            return 1;
+        }
+        if (options.stats && !statsEnabled()) {
+            std::cerr << "Error: --stats needs a build configured with SIMPSCRIPT_STATS" << std::endl;
+            return 1;
+        }
+        if (options.sharded && options.sharding.workers == 0) {
+            options.sharding.workers = std::max(1u, std::thread::hardware_concurrency());
+        }
         
         // Run the provided script file
-        runFile(scriptPath, debug, traceDebug);
+        runFile(scriptPath, options);
     } else {
         // Run the REPL
         runRepl();
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Run one test script and compare what it prints, stdout and stderr together, with the
+# .expected file beside it. A "# arguments:" line in the script gives the command line, with
+# SCRIPT standing for the script; by default it is the script alone. An "# environment:" line
+# sets variables for the run, such as SIMPSCRIPT_THREADS=4, and an "# input:" line names a file
+# to pipe to standard input. Scripts run from the tests directory, so data files are named
+# relative to it.
+#
+# Usage: run_test.sh <simpscript binary> <tests/name.simp>
+
+if [ $# -ne 2 ]; then
+    echo "usage: $0 <simpscript binary> <script>" >&2
+    exit 2
+fi
+
+binary=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+directory=$(dirname "$2")
+script=$(basename "$2")
+name=${script%.simp}
+arguments=$(sed -n 's/^# arguments: *//p' "$2")
+arguments=$(printf '%s\n' "${arguments:-SCRIPT}" | sed "s/SCRIPT/$script/g")
+
+environment=$(sed -n 's/^# environment: *//p' "$2")
+input=$(sed -n 's/^# input: *//p' "$2")
+
+actual=$(cd "$directory" && cat "${input:-/dev/null}" | env $environment "$binary" $arguments 2>&1)
+if [ "$actual" = "$(cat "$directory/$name.expected")" ]; then
+    echo "PASS $name"
+    exit 0
+fi
+
+echo "FAIL $name"
+printf '%s\n' "$actual" | diff -u "$directory/$name.expected" - | sed 's/^/    /'
+exit 1
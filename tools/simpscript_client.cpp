@@ -0,0 +1,70 @@
+// Runs a script on a server started with `simpscript --serve <socket>`, as if it were run
+// locally: arguments and stdin go to the script, its output comes back on stdout and stderr
+// and its exit status becomes ours.
+
+#include "Server.h"
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+using namespace SimpScript;
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: simpscript_client <socket> <script> [args...]" << std::endl;
+        return 1;
+    }
+
+    // The server has its own working directory, so it is sent an absolute path
+    char resolved[PATH_MAX];
+    if (::realpath(argv[2], resolved) == nullptr) {
+        std::cerr << "Error: Could not open file '" << argv[2] << "'" << std::endl;
+        return 1;
+    }
+
+    int server = connectToServer(argv[1]);
+    if (server < 0) {
+        std::cerr << "Error: Could not connect to '" << argv[1] << "'" << std::endl;
+        return 1;
+    }
+
+    bool sent = writeFrame(server, FrameType::PATH, resolved);
+    for (int i = 3; i < argc && sent; i++) {
+        sent = writeFrame(server, FrameType::ARG, argv[i]);
+    }
+
+    // Input typed at a terminal is not waited for; piped or redirected input is sent whole
+    if (!::isatty(STDIN_FILENO)) {
+        char buffer[1 << 16];
+        ssize_t count;
+        while (sent && (count = ::read(STDIN_FILENO, buffer, sizeof(buffer))) > 0) {
+            sent = writeFrame(server, FrameType::INPUT, std::string_view(buffer, static_cast<size_t>(count)));
+        }
+    }
+    sent = sent && writeFrame(server, FrameType::RUN, "");
+
+    FrameType type;
+    std::string payload;
+    while (sent && readFrame(server, type, payload)) {
+        switch (type) {
+            case FrameType::OUTPUT:
+                std::cout.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+                std::cout.flush();
+                break;
+            case FrameType::ERROR:
+                std::cerr.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+                break;
+            case FrameType::EXIT:
+                ::close(server);
+                return std::atoi(payload.c_str());
+            default:
+                break;
+        }
+    }
+
+    ::close(server);
+    std::cerr << "Error: Lost connection to the server" << std::endl;
+    return 1;
+}